@@ -5,8 +5,14 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
+#ifdef TCL_NETGEN
+#include <tcl.h>
+#endif
+
+#include "netgen.h"
 #include "hash.h"
 #include "objlist.h"
 #include "embed.h"
@@ -27,119 +33,324 @@ float RandomUniform(void)
 }
 #endif
 
-int GenerateAnnealPartition(int left, int right, int level)
-/* tries to find a balanced partition, as far as leaf cell usage */
-{
-  int i;
-  int IncludedElements, partition;
-  int ChangesMade, Iterations;
+/*----------------------------------------------------------------------*/
+/* Multi-start annealing.  AnnealChains independent chains anneal the	*/
+/* same range from different random starting points, each with its	*/
+/* own generator state, private copy of the permutation and private	*/
+/* node usage sums, so that they share nothing but the (read-only)	*/
+/* connectivity matrices and can run on separate threads.  The seeds	*/
+/* are drawn from the shared generator before any chain starts, so the	*/
+/* result depends only on the seed and not on thread scheduling.  With	*/
+/* a single chain, the shared generator itself is used and the		*/
+/* annealing is exactly that of the original serial code.		*/
+/*----------------------------------------------------------------------*/
+
+int AnnealChains = 1;	/* number of independent annealing chains */
+
+struct annealchain {
+  struct randomstate state;
+  struct randomstate *rs;	/* &state, or NULL for the shared generator */
+  int left, right, partition;
+  int *perm;		/* private copy of permutation[left..right] */
+  int *leftnodes;	/* node usage of perm[left..partition] */
+  int *rightnodes;	/* node usage of perm[partition + 1..right] */
+  unsigned char *counted;
   int leftfanout, rightfanout;
-  float T;
+  int verbose;		/* chain may Printf() its progress */
+#ifdef TCL_NETGEN
+  Tcl_ThreadId thread;
+  int started;
+#endif
+};
 
-  level++;  /* just to keep to compiler from whining about unused parameter */
+static struct annealchain *chains;
+static int chaincount;
+static int chainnodes, chainleaves;
 
-  IncludedElements = (right - left) / 2;
-  partition = left + IncludedElements - 1;
+static void FreeChains(void)
+{
+  int c;
 
-  /* don't actually use {left,right}fanout, but need to 
-     initialize leftnodes and rightnodes arrays */
+  for (c = 0; c < chaincount; c++) {
+    if (chains[c].perm != NULL) FREE(chains[c].perm);
+    if (chains[c].leftnodes != NULL) FREE(chains[c].leftnodes);
+    if (chains[c].rightnodes != NULL) FREE(chains[c].rightnodes);
+    if (chains[c].counted != NULL) FREE(chains[c].counted);
+  }
+  if (chains != NULL) FREE(chains);
+  chains = NULL;
+  chaincount = 0;
+}
 
-  leftfanout = PartitionFanout(left, partition, LEFT);
-  rightfanout = PartitionFanout(partition + 1, right, RIGHT);
+static int AllocChains(int count)
+/* (re)allocate scratch space for 'count' chains; node usage arrays are
+   kept zeroed between calls */
+{
+  int c;
+
+  if (chaincount >= count && chainnodes >= Nodes && chainleaves >= Leaves)
+    return(1);
+  FreeChains();
+  chains = (struct annealchain *)CALLOC(count, sizeof(struct annealchain));
+  if (chains == NULL) return(0);
+  chaincount = count;
+  chainnodes = Nodes;
+  chainleaves = Leaves;
+  for (c = 0; c < count; c++) {
+    chains[c].perm = (int *)CALLOC(Leaves + 1, sizeof(int));
+    chains[c].leftnodes = (int *)CALLOC(Nodes + 1, sizeof(int));
+    chains[c].rightnodes = (int *)CALLOC(Nodes + 1, sizeof(int));
+    chains[c].counted = (unsigned char *)CALLOC(Nodes + 1,
+		sizeof(unsigned char));
+    if (chains[c].perm == NULL || chains[c].leftnodes == NULL ||
+		chains[c].rightnodes == NULL || chains[c].counted == NULL) {
+      FreeChains();
+      return(0);
+    }
+  }
+  return(1);
+}
 
-#if 0
-  /* someday, need an escape clause here */
-  if (leftfanout <= TreeFanout[level] && rightfanout <= TreeFanout[level])
-	  return(partition);
-#endif
+static void ChainUsage(struct annealchain *c, int E, int *sum, int sign)
+/* add (sign) the node usage of element E to 'sum' */
+{
+  long k;
+
+  for (k = CRow[E]; k < CRow[E + 1]; k++) sum[CNode[k]] += sign * CStar[k];
+}
+
+static int ChainFanout(struct annealchain *c, int left, int right, int *sum)
+/* number of pins of perm[left..right], as PartitionFanout() */
+{
+  int E, node, ports;
+  long k;
+
+  ports = 0;
+  for (E = left; E <= right; E++)
+    for (k = CRow[c->perm[E]]; k < CRow[c->perm[E] + 1]; k++) {
+      node = CNode[k];
+      if (c->counted[node]) continue;
+      c->counted[node] = 1;
+      if (sum[node] && (sum[node] < NodeUsage[node] || PortNode[node]))
+	ports++;
+    }
+  for (E = left; E <= right; E++)
+    for (k = CRow[c->perm[E]]; k < CRow[c->perm[E] + 1]; k++)
+      c->counted[CNode[k]] = 0;
+  return(ports);
+}
+
+static void AnnealChain(struct annealchain *c)
+/* anneal perm[left..right] of one chain, leaving its fanouts behind */
+{
+  int i, E;
+  int left, right, partition;
+  int ChangesMade, Iterations;
+  int *perm, *leftnodes, *rightnodes;
+  float T;
+
+  left = c->left;
+  right = c->right;
+  partition = c->partition;
+  perm = c->perm;
+  leftnodes = c->leftnodes;
+  rightnodes = c->rightnodes;
+
+  for (E = left; E <= partition; E++) ChainUsage(c, perm[E], leftnodes, 1);
+  for (E = partition + 1; E <= right; E++)
+    ChainUsage(c, perm[E], rightnodes, 1);
 
-Printf("called generateannealpartition with left = %d, right = %d\n",left,right);
   /* actually do the annealing now */
   T = 3.0;
   do {
     int el1, el2;
+    int e1, e2;
+    long k1, k2;
     int delta;
 
     Iterations = 0;
     ChangesMade = 0;
     do {
-      el1 = Random(partition - left + 1) + left;
-      el2 = Random(right - partition) + partition + 1;
+      el1 = RandomStateInt(c->rs, partition - left + 1) + left;
+      el2 = RandomStateInt(c->rs, right - partition) + partition + 1;
       Iterations++;
 
       delta = 0;
-      for (i = 1; i <= Nodes; i++) {
-	/* could do the following test with XOR */
-	if (CSTAR[permutation[el1]][i] == 0 && CSTAR[permutation[el2]][i] == 0)
-	  continue;
-	if (CSTAR[permutation[el1]][i] != 0 && CSTAR[permutation[el2]][i] != 0)
+      e1 = perm[el1];
+      e2 = perm[el2];
+      k1 = CRow[e1];
+      k2 = CRow[e2];
+      /* only nodes used by exactly one of the two elements matter */
+      while (k1 < CRow[e1 + 1] || k2 < CRow[e2 + 1]) {
+	if (k1 < CRow[e1 + 1] && k2 < CRow[e2 + 1] && CNode[k1] == CNode[k2]) {
+	  k1++;
+	  k2++;
 	  continue;
+	}
 
-	/* only one of these is non-zero */
-	if (CSTAR[permutation[el1]][i] != 0) {
+	if (k2 >= CRow[e2 + 1] || (k1 < CRow[e1 + 1] && CNode[k1] < CNode[k2])) {
+	  i = CNode[k1];
 	  if (rightnodes[i] == 0) {
 	    /* things are not good unless all the fanout is captured in el1 */
-	    if (CSTAR[permutation[el1]][i] != leftnodes[i]) delta++;
+	    if (CStar[k1] != leftnodes[i]) delta++;
 	  }
 	  else {
 	    /* things are good if all fanout is captured in el1 */
-	    if (CSTAR[permutation[el1]][i] == leftnodes[i]) delta--;
+	    if (CStar[k1] == leftnodes[i]) delta--;
 	  }
+	  k1++;
 	}
 	else {
+	  i = CNode[k2];
 	  if (leftnodes[i] == 0) {
 	    /* things are not good unless all the fanout is captured in el2 */
-	    if (CSTAR[permutation[el2]][i] != rightnodes[i]) delta++;
+	    if (CStar[k2] != rightnodes[i]) delta++;
 	  }
 	  else {
 	    /* things are good if all fanout is captured in el2 */
-	    if (CSTAR[permutation[el2]][i] == rightnodes[i]) delta--;
+	    if (CStar[k2] == rightnodes[i]) delta--;
 	  }
+	  k2++;
 	}
       }
+      if (c->verbose) {
 DBUG_EXECUTE("place",
 Printf("\n");
-Printf("considering swapping %d and %d\n",permutation[el1],permutation[el2]);
+Printf("considering swapping %d and %d\n",e1,e2);
 Printf("E1: "); 
-for (i = 1; i <= Nodes; i++) Printf("%2d ",CSTAR[permutation[el1]][i]);
+for (k1 = CRow[e1]; k1 < CRow[e1 + 1]; k1++)
+  Printf("%d:%d ",CNode[k1],CStar[k1]);
 Printf("\nL:  ");
 for (i = 1; i <= Nodes; i++) Printf("%2d ",leftnodes[i]);
 Printf("\nE2: ");
-for (i = 1; i <= Nodes; i++) Printf("%2d ",CSTAR[permutation[el2]][i]);
+for (k2 = CRow[e2]; k2 < CRow[e2 + 1]; k2++)
+  Printf("%d:%d ",CNode[k2],CStar[k2]);
 Printf("\nR:  ");
 for (i = 1; i <= Nodes; i++) Printf("%2d ",rightnodes[i]);
 Printf("\nC0: ");
-for (i = 1; i <= Nodes; i++) Printf("%2d ",CSTAR[0][i]);
+for (i = 1; i <= Nodes; i++) Printf("%2d ",NodeUsage[i]);
 Printf("\ndelta = %d\n", delta);
 );
+      }
 
-      if (delta < 0 || exp(-delta / T) > RandomUniform()) {
+      if (delta < 0 || exp(-delta / T) > RandomStateUniform(c->rs)) {
 	int tmp;
 
 	if (delta < 0) ChangesMade++;
 	/* update the {left, right}nodes arrays */
-	for (i = 1; i <= Nodes; i++) {
-	   leftnodes[i] +=
-		 CSTAR[permutation[el2]][i] - CSTAR[permutation[el1]][i];
-	   rightnodes[i] -=
-		 CSTAR[permutation[el2]][i] - CSTAR[permutation[el1]][i];
-        }
+	ChainUsage(c, e1, leftnodes, -1);
+	ChainUsage(c, e1, rightnodes, 1);
+	ChainUsage(c, e2, leftnodes, 1);
+	ChainUsage(c, e2, rightnodes, -1);
 	/* now swap the elements */
+	if (c->verbose) {
 DBUG_EXECUTE("place",
-        Printf("swapping elements %d and %d\n",
-	       permutation[el1],permutation[el2]);
+        Printf("swapping elements %d and %d\n", e1, e2);
 	);
-	tmp = permutation[el1];
-	permutation[el1] = permutation[el2];
-	permutation[el2] = tmp;
+	}
+	tmp = perm[el1];
+	perm[el1] = perm[el2];
+	perm[el2] = tmp;
       }
       
     } while (ChangesMade <= MAX_CHANGES_PER_ITER && 
 	    Iterations < MAX_SIM_ANNEAL_ITER);
     T = 0.90 * T;
-Printf("decreasing T to %.2f after %d iterations.\n",T,Iterations);
+    if (c->verbose)
+      Printf("decreasing T to %.2f after %d iterations.\n",T,Iterations);
   } while (ChangesMade > 0);
 
+  c->leftfanout = ChainFanout(c, left, partition, leftnodes);
+  c->rightfanout = ChainFanout(c, partition + 1, right, rightnodes);
+
+  /* leave the usage arrays zeroed for the next call */
+  for (E = left; E <= partition; E++) ChainUsage(c, perm[E], leftnodes, -1);
+  for (E = partition + 1; E <= right; E++)
+    ChainUsage(c, perm[E], rightnodes, -1);
+}
+
+#ifdef TCL_NETGEN
+static Tcl_ThreadCreateType AnnealThread(ClientData clientData)
+{
+  AnnealChain((struct annealchain *)clientData);
+  TCL_THREAD_CREATE_RETURN;
+}
+#endif
+
+static int BetterChain(struct annealchain *a, struct annealchain *b, int level)
+/* is chain 'a' a better result than chain 'b'?  Partitions that meet
+   the fanout limit win;  then the smaller larger fanout, then the
+   smaller total */
+{
+  int fita, fitb, maxa, maxb;
+
+  fita = (a->leftfanout <= TreeFanout[level] &&
+	  a->rightfanout <= TreeFanout[level]);
+  fitb = (b->leftfanout <= TreeFanout[level] &&
+	  b->rightfanout <= TreeFanout[level]);
+  if (fita != fitb) return(fita);
+  maxa = MAX(a->leftfanout, a->rightfanout);
+  maxb = MAX(b->leftfanout, b->rightfanout);
+  if (maxa != maxb) return(maxa < maxb);
+  return(a->leftfanout + a->rightfanout < b->leftfanout + b->rightfanout);
+}
+
+int GenerateAnnealPartition(int left, int right, int level)
+/* tries to find a balanced partition, as far as leaf cell usage */
+{
+  int i, n, best;
+  int IncludedElements, partition;
+
+  IncludedElements = (right - left) / 2;
+  partition = left + IncludedElements - 1;
+
+  n = MAX(1, AnnealChains);
+  if (!AllocChains(n)) {
+    Fprintf(stderr, "Not enough memory for %d annealing chains\n", n);
+    return(0);
+  }
+
+Printf("called generateannealpartition with left = %d, right = %d\n",left,right);
+  for (i = 0; i < n; i++) {
+    struct annealchain *c = chains + i;
+
+    c->left = left;
+    c->right = right;
+    c->partition = partition;
+    memcpy(c->perm + left, permutation + left,
+	   (right - left + 1) * sizeof(int));
+    if (n == 1) c->rs = NULL;
+    else {
+      c->rs = &(c->state);
+      RandomStateSeed(c->rs, 1 + Random(1 << 30));
+    }
+    c->verbose = (n == 1);
+  }
+
+#ifdef TCL_NETGEN
+  for (i = 1; i < n; i++)
+    chains[i].started = (Tcl_CreateThread(&(chains[i].thread), AnnealThread,
+		(ClientData)(chains + i), TCL_THREAD_STACK_DEFAULT,
+		TCL_THREAD_JOINABLE) == TCL_OK);
+  AnnealChain(chains);
+  for (i = 1; i < n; i++) {
+    int result;
+
+    if (chains[i].started) Tcl_JoinThread(chains[i].thread, &result);
+    else AnnealChain(chains + i);	/* Tcl built without threads */
+  }
+#else
+  for (i = 0; i < n; i++) AnnealChain(chains + i);
+#endif
+
+  best = 0;
+  for (i = 1; i < n; i++)
+    if (BetterChain(chains + i, chains + best, level)) best = i;
+  if (n > 1)
+    Printf("%d annealing chains; best (%d) L fanout %d; R fanout %d\n",
+	   n, best, chains[best].leftfanout, chains[best].rightfanout);
+  memcpy(permutation + left, chains[best].perm + left,
+	 (right - left + 1) * sizeof(int));
   return (partition);
 }
 
@@ -189,7 +400,7 @@ int AnnealPartition(int left, int right, int level)
 	    found = 1;
 
     if (!found || level > TopDownStartLevel - 2) {
-      for (i = MAX_TREE_DEPTH; i > level; i--) Fprintf(stdout, "   ");
+      for (i = TopDownStartLevel; i > level; i--) Fprintf(stdout, "   ");
       Fprintf(stdout,
     "Level: %d; L (%d leaves) fanout %d; R (%d leaves) fanout %d (<= %d) %s\n",
 	      level, (partition - left + 1), leftfanout, 
@@ -210,7 +421,7 @@ int AnnealPartition(int left, int right, int level)
       if (leftfanout <= TreeFanout[level] && rightfanout <= TreeFanout[level])
 	      found = 1;
 
-      for (i = MAX_TREE_DEPTH; i > level; i--) Fprintf(stdout, "   ");
+      for (i = TopDownStartLevel; i > level; i--) Fprintf(stdout, "   ");
       Fprintf(stdout,
 	      "       Iteration %2d: L fanout %d; R fanout %d (<= %d) %s\n",
 	      iterations, leftfanout, rightfanout, TreeFanout[level],
@@ -23,6 +23,12 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include "config.h"
 #include <stdio.h>
 
+#ifdef TCL_NETGEN
+#include <tcl.h>
+#endif
+
+#include "netgen.h"
+
 #include "hash.h"
 #include "objlist.h"
 #include "timing.h"
@@ -39,17 +45,19 @@ int CountSwallowedElements;
 int Independent(int E1, int E2)
 /* return 1 if E1 and E2 share no leaves in common */
 {
-  int leafelement;
+  int leafelement, last;
   CountIndependent++;
-  for (leafelement = 0; leafelement <= PackedLeaves; leafelement++)
-    if (MSTAR[E1][leafelement] & MSTAR[E2][leafelement]) return (0);
+  last = MIN(MLAST(E1), MLAST(E2));
+  for (leafelement = MAX(MFIRST(E1), MFIRST(E2)); leafelement <= last;
+       leafelement++)
+    if (MSTAR(E1)[leafelement] & MSTAR(E2)[leafelement]) return (0);
   return(1);
 }
 
 int FanoutOK(int E1, int E2)
 {
-  int approxfanout;
-  int node;
+  unsigned long *c1, *c2;
+  int i, approxfanout, maxfanout;
 	
   CountFanoutOK++;
 
@@ -57,10 +65,14 @@ int FanoutOK(int E1, int E2)
   /* remember, the current PROTOCHIP requires allocation of 
      an output even for swallowed nodes */
 
-  approxfanout = 0;
-  for (node = 1; node <= Nodes; node++)
-    if (C[E1][node] || C[E2][node]) approxfanout++;
-  if (approxfanout > TreeFanout[MAX(LEVEL(E1),LEVEL(E2)) + 1]) return(0);
+  approxfanout = PINS(E1);
+  maxfanout = TreeFanout[MAX(LEVEL(E1),LEVEL(E2)) + 1];
+  c1 = CBITS(E1);
+  c2 = CBITS(E2);
+  for (i = CFIRST(E2); i <= CLAST(E2); i++) {
+    approxfanout += PopCount(c2[i] & ~c1[i]);
+    if (approxfanout > maxfanout) return(0);
+  }
   return(1);
 }
 
@@ -68,10 +80,13 @@ int FanoutOK(int E1, int E2)
 int Swallowed(int Parent, int Child)
 /* returns 1 if Child's fanout is contained in Parent's */
 {
-  int node;
+  unsigned long *parent, *child;
+  int i;
 
-  for (node = 1; node <= Nodes; node++) 
-    if (C[Child][node] && !(C[Parent][node])) return(0);
+  parent = CBITS(Parent);
+  child = CBITS(Child);
+  for (i = CFIRST(Child); i <= CLAST(Child); i++) 
+    if (child[i] & ~parent[i]) return(0);
 
 #ifdef PLACE_DEBUG
   Printf("Element %d swallowed by %d\n",Child,Parent);
@@ -85,15 +100,34 @@ int Swallowed(int Parent, int Child)
 int SmallEnough(int E1, int E2)
 /* returns 1 if fanout(E1+E2) is less than MAX(fanout(E1),fanout(E2)) */
 {
-  int node;
   int fanout;
+  long k1, k2;
 
   return(0); /* for now */
 
   fanout = 0;
-  for (node = 1; node <= Nodes; node++)
-    if (C[E1][node] || C[E2][node]) 
-      if (CSTAR[E1][node] + CSTAR[E2][node] < CSTAR[0][node]) fanout++;
+  k1 = CRow[E1];
+  k2 = CRow[E2];
+  while (k1 < CRow[E1 + 1] || k2 < CRow[E2 + 1]) {
+    int node, pin, usage;
+
+    if (k2 >= CRow[E2 + 1] || (k1 < CRow[E1 + 1] && CNode[k1] < CNode[k2])) {
+      node = CNode[k1];
+      pin = CPin[k1];
+      usage = CStar[k1++];
+    }
+    else if (k1 >= CRow[E1 + 1] || CNode[k2] < CNode[k1]) {
+      node = CNode[k2];
+      pin = CPin[k2];
+      usage = CStar[k2++];
+    }
+    else {
+      node = CNode[k1];
+      pin = CPin[k1] || CPin[k2];
+      usage = CStar[k1++] + CStar[k2++];
+    }
+    if (pin && usage < NodeUsage[node]) fanout++;
+  }
 
   return (fanout <= MAX(PINS(E1), PINS(E2)));
 
@@ -111,10 +145,10 @@ int SuccessfulEmbedding(int E)
 
 #if 1
   for (testleaf = 0; testleaf <= PackedLeaves; testleaf++)
-    if (MSTAR[E][testleaf] != MSTAR[0][testleaf]) return (0);
+    if (MSTAR(E)[testleaf] != MSTAR(0)[testleaf]) return (0);
 #else
   for (testleaf = 1; testleaf <= Leaves; testleaf++)
-    if (!TestPackedArrayBit(MSTAR[E],testleaf)) return(0);
+    if (!TestPackedArrayBit(MSTAR(E),testleaf)) return(0);
 #endif
   return(1);
 }
@@ -270,7 +304,7 @@ int DoAPass(int Level1, int Level2)
 	  found = NewN;
 	  goto done;
 	}
-	if (NewN >= MAX_ELEMENTS) return(MAX_ELEMENTS);
+	if (NewN >= ElementLimit) return(ElementLimit);
 	if (FatalError) goto done;
 	/* break; do not consider E1 or E2 any further */
       }
@@ -317,7 +351,7 @@ int DoAPass(int Level1, int Level2)
 	  found = NewN;
 	  goto done;
 	}
-	if (NewN >= MAX_ELEMENTS) return(MAX_ELEMENTS);
+	if (NewN >= ElementLimit) return(ElementLimit);
 	if (FatalError) goto done;
       }
     }
@@ -430,7 +464,7 @@ int DoAPass(int Level1, int Level2)
 	  found = NewN;
 	  goto done;
 	}
-	if (NewN >= MAX_ELEMENTS) return(MAX_ELEMENTS);
+	if (NewN >= ElementLimit) return(ElementLimit);
 	if (FatalError) goto done;
       }
     }
@@ -501,7 +535,7 @@ int ExhaustivePass(int Level)
 	  found = NewN;
 	  goto done;
 	}
-	if (NewN >= MAX_ELEMENTS) return(MAX_ELEMENTS);
+	if (NewN >= ElementLimit) return(ElementLimit);
 #if 0
 	if (Swallowed(E1,E2)) break;  /* works OK, but makes csrlntk 5 deep*/
 #endif
@@ -534,24 +568,296 @@ int ExhaustivePass(int Level)
 }
 
 
+/*----------------------------------------------------------------------*/
+/* Agglomerative embedding.  Instead of sweeping all pairs of elements	*/
+/* for each combination of levels, keep the candidate merges of the	*/
+/* current (disjoint) top-level elements in a binary heap, best first:	*/
+/* lowest resulting level, then fewest leaves (to keep the tree	*/
+/* balanced), then most shared nodes, then least fanout.		*/
+/* Merging two elements retires them, so after each merge only the	*/
+/* candidates of the new element need to be generated.  Candidates are	*/
+/* found through the nodes the elements still expose, ignoring cell	*/
+/* ports and nets of more than AGG_LARGE_NET leaves;  if the heap runs	*/
+/* dry, all remaining pairs are tried before giving up.			*/
+/*----------------------------------------------------------------------*/
+
+#define AGG_LARGE_NET 32
+
+struct candidate {
+  int E1, E2;
+  int level, leaves, common, pins;
+};
+
+static struct candidate *heap;
+static int heapsize, heapspace;
+static int *aggparent;	/* union-find over elements, to top-level ones */
+static int *aggstamp;	/* last element whose neighbours included this one */
+
+static int BetterCandidate(struct candidate *a, struct candidate *b)
+{
+  if (a->level != b->level) return(a->level < b->level);
+  if (a->leaves != b->leaves) return(a->leaves < b->leaves);
+  if (a->common != b->common) return(a->common > b->common);
+  if (a->pins != b->pins) return(a->pins < b->pins);
+  if (a->E1 != b->E1) return(a->E1 < b->E1);
+  return(a->E2 < b->E2);
+}
+
+static int HeapPush(struct candidate *c)
+{
+  struct candidate tmp;
+  int i, parent;
+
+  if (heapsize == heapspace) {
+    struct candidate *newheap;
+    int newspace;
+
+    newspace = (heapspace > 0) ? 2 * heapspace : 1024;
+    newheap = (struct candidate *)CALLOC(newspace, sizeof(struct candidate));
+    if (newheap == NULL) return(0);
+    if (heap != NULL) {
+      memcpy(newheap, heap, heapsize * sizeof(struct candidate));
+      FREE(heap);
+    }
+    heap = newheap;
+    heapspace = newspace;
+  }
+  i = heapsize++;
+  heap[i] = *c;
+  while (i > 0) {
+    parent = (i - 1) / 2;
+    if (!BetterCandidate(heap + i, heap + parent)) break;
+    tmp = heap[i];
+    heap[i] = heap[parent];
+    heap[parent] = tmp;
+    i = parent;
+  }
+  return(1);
+}
+
+static void HeapPop(struct candidate *c)
+{
+  struct candidate tmp;
+  int i, child;
+
+  *c = heap[0];
+  heap[0] = heap[--heapsize];
+  i = 0;
+  while ((child = 2 * i + 1) < heapsize) {
+    if (child + 1 < heapsize && BetterCandidate(heap + child + 1, heap + child))
+      child++;
+    if (!BetterCandidate(heap + child, heap + i)) break;
+    tmp = heap[i];
+    heap[i] = heap[child];
+    heap[child] = tmp;
+    i = child;
+  }
+}
+
+static int TopElement(int E)
+/* the top-level element that has absorbed E */
+{
+  int root, next;
+
+  for (root = E; aggparent[root] != root; root = aggparent[root]) ;
+  while (E != root) {
+    next = aggparent[E];
+    aggparent[E] = root;
+    E = next;
+  }
+  return(root);
+}
+
+static int MergedPins(int E1, int E2)
+/* PINS() of the element AddNewElement(E1, E2) would create */
+{
+  long k1, k2;
+  int node, usage, pin, pins;
+
+  pins = 0;
+  k1 = CRow[E1];
+  k2 = CRow[E2];
+  while (k1 < CRow[E1 + 1] || k2 < CRow[E2 + 1]) {
+    if (k2 >= CRow[E2 + 1] || (k1 < CRow[E1 + 1] && CNode[k1] < CNode[k2])) {
+      node = CNode[k1];
+      usage = CStar[k1];
+      pin = CPin[k1++];
+    }
+    else if (k1 >= CRow[E1 + 1] || CNode[k2] < CNode[k1]) {
+      node = CNode[k2];
+      usage = CStar[k2];
+      pin = CPin[k2++];
+    }
+    else {
+      node = CNode[k1];
+      usage = CStar[k1] + CStar[k2];
+      pin = CPin[k1++];
+      if (CPin[k2++]) pin = 1;
+    }
+    if (pin && usage < NodeUsage[node]) pins++;
+  }
+  return(pins);
+}
+
+static int AddCandidate(int E1, int E2)
+/* queue the merge of E1 and E2 if it is legal;  returns 0 if out of memory */
+{
+  struct candidate c;
+
+  c.level = MAX(LEVEL(E1), LEVEL(E2)) + 1;
+  if (c.level > TreeDepth || !FanoutOK(E1, E2)) return(1);
+  c.pins = MergedPins(E1, E2);
+  if (c.pins > TreeFanout[c.level]) return(1);
+  c.leaves = LEAVES(E1) + LEAVES(E2);
+  c.common = CommonNodes(E1, E2, 0);
+  c.E1 = MAX(E1, E2);
+  c.E2 = MIN(E1, E2);
+  return(HeapPush(&c));
+}
+
+static int AddNeighbours(int E)
+/* queue the merges of top-level element E with the top-level elements
+   it shares exposed nodes with */
+{
+  long k, m;
+  int node, X;
+
+  aggstamp[E] = E;
+  for (k = CRow[E]; k < CRow[E + 1]; k++) {
+    if (!CPin[k]) continue;	/* wholly inside E */
+    node = CNode[k];
+    if (PortNode[node] || NodeRow[node + 1] - NodeRow[node] > AGG_LARGE_NET)
+      continue;
+    for (m = NodeRow[node]; m < NodeRow[node + 1]; m++) {
+      X = TopElement(NodeLeaf[m]);
+      if (aggstamp[X] == E) continue;
+      aggstamp[X] = E;
+      if (!AddCandidate(E, X)) return(0);
+    }
+  }
+  return(1);
+}
+
+static int RescanCandidates(void)
+/* queue every legal merge of two top-level elements */
+{
+  int E1, E2;
+
+  for (E1 = 1; E1 <= NewN; E1++) {
+    if (aggparent[E1] != E1) continue;
+    for (E2 = 1; E2 < E1; E2++) {
+      if (aggparent[E2] != E2) continue;
+      if (AnyCommonNodes(E1, E2) && !AddCandidate(E1, E2)) return(0);
+    }
+  }
+  return(1);
+}
+
+static void FreeAgglomerative(void)
+{
+  if (heap != NULL) FREE(heap);
+  if (aggparent != NULL) FREE(aggparent);
+  if (aggstamp != NULL) FREE(aggstamp);
+  heap = NULL;
+  aggparent = aggstamp = NULL;
+  heapsize = heapspace = 0;
+}
+
+int AgglomerativePass(void)
+/* merge elements best candidate first until all leaves are covered */
+/* returns element number if successful embedding found */
+{
+  struct candidate c;
+  int E, found, rescanned, merges;
+
+  Pass++;
+  NewElements = 0;
+  NewSwallowed = 0;
+  SumPINS = 0;
+  SumCommonNodes = 0;
+  SumUsedLeaves = 0;
+
+  /* at most Leaves - 1 merges, each retiring two elements */
+  aggparent = (int *)CALLOC(Elements + Leaves + 1, sizeof(int));
+  aggstamp = (int *)CALLOC(Elements + Leaves + 1, sizeof(int));
+  if (aggparent == NULL || aggstamp == NULL) {
+    Fprintf(stderr, "Not enough memory for agglomerative embedding\n");
+    FreeAgglomerative();
+    return(0);
+  }
+  for (E = 1; E <= Elements; E++) aggparent[E] = E;
+
+  found = 0;
+  merges = 0;
+  rescanned = 0;
+  for (E = 1; E <= Elements; E++)
+    if (!AddNeighbours(E)) goto nomemory;
+
+  while (!found) {
+    if (heapsize == 0) {
+      if (rescanned) break;
+      rescanned = 1;
+      if (!RescanCandidates()) goto nomemory;
+      continue;
+    }
+    HeapPop(&c);
+    if (aggparent[c.E1] != c.E1 || aggparent[c.E2] != c.E2) continue;
+
+    AddNewElement(c.E1, c.E2);
+    if (NewN >= ElementLimit || FatalError) break;
+    merges++;
+    rescanned = 0;
+    aggparent[NewN] = NewN;
+    aggparent[c.E1] = aggparent[c.E2] = NewN;
+    if (SuccessfulEmbedding(NewN)) found = NewN;
+    else if (!AddNeighbours(NewN)) goto nomemory;
+  }
+  Elements = NewN;
+
+  Fprintf(stdout, "%2d: agglomerative, %d merges, %d queued\n",
+	  Pass, merges, heapsize);
+  Fprintf(outfile, "%2d: agglomerative, %d merges, %d queued\n",
+	  Pass, merges, heapsize);
+  if (logging) {
+    Fprintf(logfile, "%2d: agglomerative, %d merges, %d queued\n",
+	    Pass, merges, heapsize);
+    PrintOwnership(logfile); PrintC(logfile);
+    PrintCSTAR(logfile); Fflush(logfile);
+  }
+  FreeAgglomerative();
+  return(found);
+
+ nomemory:
+  Fprintf(stderr, "Not enough memory for agglomerative embedding\n");
+  Elements = NewN;
+  FreeAgglomerative();
+  return(0);
+}
+
+
 void PROLOG(FILE *f)
 {
-  long totalsize;
+  long totalsize, msize, mstarsize, csize, cstarsize, cbitsize;
   int junk,  MinDoneLevel;
 
   /* determine the minimum embedding level */
   junk = Leaves - 1;
   for (MinDoneLevel = 0; junk; MinDoneLevel++) junk = junk >> 1;
 
-  Fprintf(f,"MAX_ELEMENTS = %d, ",MAX_ELEMENTS);
-  Fprintf(f,"MAX_LEAVES = %d, ",MAX_LEAVES);
-  Fprintf(f,"MAX_NODES = %d, ",MAX_NODES);
-  Fprintf(f,"MAX_TREE_DEPTH = %d\n",MAX_TREE_DEPTH); 
+  Fprintf(f,"Element limit = %d, ",ElementLimit);
+  Fprintf(f,"leaves = %d, ",Leaves);
+  Fprintf(f,"nodes = %d, ",Nodes);
+  Fprintf(f,"tree depth = %d\n",TreeDepth); 
 
+  msize = (long)ElementSpace * sizeof(M[0]);
+  mstarsize = (long)ElementSpace * (PackedLeaves + 1) * sizeof(unsigned long);
+  csize = (long)ElementSpace * sizeof(long) + PinSpace * sizeof(unsigned char);
+  cstarsize = PinSpace * 2 * sizeof(int);
+  cbitsize = (long)ElementSpace * (PackedNodes + 1) * sizeof(unsigned long);
   Fprintf(f,"Matrix sizes: M = %ldK, MSTAR = %ldK, C = %ldK, CSTAR = %ldK\n",
-	  (long)sizeof(M)/1024,(long)sizeof(MSTAR)/1024,
-	  (long)sizeof(C)/1024, (long)sizeof(CSTAR)/1024);
-  totalsize = sizeof(M) + sizeof(MSTAR) + sizeof(C) + sizeof(CSTAR);
+	  msize/1024, mstarsize/1024, csize/1024, cstarsize/1024);
+  Fprintf(f,"              packed C = %ldK\n", cbitsize/1024);
+  totalsize = msize + mstarsize + csize + cstarsize + cbitsize;
 #ifdef EX_TREE_FOR_EXIST
   totalsize +=  sizeof(ex_array);
   Fprintf(f,"              ex_array = %ldK, total = %ldK\n",
@@ -574,9 +880,18 @@ void EmbedCell(char *cellname, char *filename)
 /*  int SomeNewElements; */
 	
   if (!OpenEmbeddingFile(cellname, filename)) return;
+  if (EmbedCacheLookup(LookupCell(cellname), bottomup)) {
+    Printf("Using cached embedding of cell %s\n", cellname);
+    PrintEmbeddingTree(stdout,cellname,1);
+    PrintEmbeddingTree(outfile,cellname,1);
+    if (logging) PrintEmbeddingTree(logfile,cellname,1);
+    CloseEmbeddingFile();
+    return;
+  }
 	
   StartTime = CPUTime();
   if (!InitializeMatrices(cellname)) return;
+  if (!InitializeOwnership()) return;
   if (!InitializeExistTest()) return;
   FatalError = 0;
   NewN = Elements;
@@ -602,16 +917,17 @@ void EmbedCell(char *cellname, char *filename)
   }
 
   if (Exhaustive) {
-    for (level1 = 0; level1 < MAX_TREE_DEPTH; level1++) {
+    for (level1 = 0; level1 < TreeDepth; level1++) {
       found = ExhaustivePass(level1);
       if (found || FatalError) goto done;
     }
   }
+  else if (Agglomerative) found = AgglomerativePass();
   else {
 #if 1
     /* do not try to be clever about minimizing passes */
     found = -1;  /* fake-out to first call below */
-    for (FillingLevel = 0; FillingLevel < MAX_TREE_DEPTH; FillingLevel++) {
+    for (FillingLevel = 0; FillingLevel < TreeDepth; FillingLevel++) {
       for (level1 = FillingLevel - 1; level1 >= 0 || found == -1; level1--){
 	if (found == -1) level1 = 0;
 	found = DoAPass(FillingLevel, level1);
@@ -619,7 +935,7 @@ void EmbedCell(char *cellname, char *filename)
 	/* now try to go up the ladder */
 	/* NewElements = 1; only do it if we added something in DoAPass */
 	for (level2 = FillingLevel + 1; 
-	     NewElements && level2 < MAX_TREE_DEPTH; level2++) {
+	     NewElements && level2 < TreeDepth; level2++) {
 	  found = DoAPass(level2, level2);
 	  if (found || FatalError) goto done;
 	}
@@ -631,7 +947,7 @@ void EmbedCell(char *cellname, char *filename)
     found = -1;  /* fake-out to first call below */
     SomeNewElements = 1;
     for (FillingLevel = 0; 
-	 FillingLevel < MAX_TREE_DEPTH && SomeNewElements; FillingLevel++) {
+	 FillingLevel < TreeDepth && SomeNewElements; FillingLevel++) {
       SomeNewElements = 0;
       for (level1 = FillingLevel - 1; level1 >= 0 || found == -1; level1--){
 	if (found == -1) level1 = 0;
@@ -641,7 +957,7 @@ void EmbedCell(char *cellname, char *filename)
 	/* now try to go up the ladder */
 	NewElements = 1;
 	for (level2 = FillingLevel + 1; 
-	     NewElements && level2 < MAX_TREE_DEPTH; level2++) {
+	     NewElements && level2 < TreeDepth; level2++) {
 	  found = DoAPass(level2, level2);
 	  if (found || FatalError) goto done;
 	}
@@ -656,7 +972,7 @@ void EmbedCell(char *cellname, char *filename)
     Fprintf(outfile,"Internal Fatal Error\n");
     found = 0;
   }
-  if (found >= MAX_ELEMENTS) found = 0;
+  if (found >= ElementLimit) found = 0;
 	
   if (found) {
     struct nlist *tp;
@@ -664,6 +980,7 @@ void EmbedCell(char *cellname, char *filename)
     tp = LookupCell(cellname);
     FreeEmbeddingTree((struct embed *)(tp->embedding));
     tp->embedding = EmbeddingTree(tp, found);
+    EmbedCacheStore(tp, bottomup);
 #if 0
     PrintEmbedding(stdout,cellname,found);
     PrintEmbedding(outfile,cellname,found);
@@ -157,7 +157,8 @@ extern int open(char *path, int oflag, ...); /* HPUX has it in <sys/fcntl.h> */
 /* Casting of allocation functions */
 #ifdef TCL_NETGEN
   #define CALLOC(a, s)	tcl_calloc(a, s)
-  #define MALLOC(s)	Tcl_Alloc(s)
+  #define MALLOC(s)	tcl_malloc(s)
+  extern char *tcl_malloc(unsigned int);
   #define FREE(a)	Tcl_Free((char *)a)
   extern char *Tcl_Strdup(const char *);
   #define STRDUP(a)	Tcl_Strdup((const char *)a)
@@ -0,0 +1,423 @@
+/* "NETGEN", a netlist-specification tool for VLSI
+   Copyright (C) 1989, 1990   Massimo A. Sivilotti
+   Author's address: mass@csvax.cs.caltech.edu;
+                     Caltech 256-80, Pasadena CA 91125.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation (any version).
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file copying.  If not, write to
+the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* embcache.c -- cache of embedding trees, shared by structurally
+                 identical cells and (through a cache file) by runs.
+
+   A cell is keyed by a hash of its structure that ignores all names:
+   the class of each instance (primitive classes by name, subcells by
+   their own structural key), and every pin and port numbered by the
+   order in which its node first appears.  Two cells with the same key
+   list the same leaves in the same order, so an embedding tree of one,
+   written in terms of instance numbers, is an embedding of the other.
+   The key is paired with a hash of the embedding parameters, since a
+   different strategy or fanout limit gives a different tree.
+
+   Trees are kept as strings in the format of PrintE(): a leaf is its
+   instance number, an internal node "(left right)", and a missing
+   child "-".  A cache file holds one line per tree:
+	<structure key> <parameter key> <cell name> <tree>
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef TCL_NETGEN
+#include <tcl.h>
+#endif
+
+#include "netgen.h"
+#include "hash.h"
+#include "objlist.h"
+#include "embed.h"
+#include "print.h"
+
+#define CACHE_HASHSIZE 1000
+
+static struct hashdict cachedict;
+static int cacheinitialized = 0;
+static char *cachefilename = NULL;
+
+/* structural keys of the cells seen while keying the current cell */
+static struct nlist **memocell;
+static unsigned long long *memokey;
+static int memocount, memospace;
+
+static unsigned long long CacheMix(unsigned long long x)
+{
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+  return(x);
+}
+
+static unsigned long long StringKey(char *s)
+{
+  unsigned long long key;
+
+  key = 0xCBF29CE484222325ULL;
+  while (*s) {
+    key ^= (unsigned char)*s++;
+    key *= 0x100000001B3ULL;
+  }
+  return(key);
+}
+
+static unsigned long long StructureKey(struct nlist *tp)
+/* hash of the structure of cell tp, independent of all names */
+{
+  struct objlist *ob;
+  struct nlist *tp2;
+  unsigned long long key, classkey;
+  int *canon;
+  int maxnode, nextnode, node, i;
+
+  for (i = 0; i < memocount; i++)
+    if (memocell[i] == tp) return(memokey[i]);
+
+  maxnode = 0;
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->node > maxnode) maxnode = ob->node;
+  canon = (int *)CALLOC(maxnode + 1, sizeof(int));
+  if (canon == NULL) return(0);
+
+  key = CacheMix(CLASS_SUBCKT);
+  nextnode = 0;
+  for (ob = tp->cell; ob != NULL; ob = ob->next) {
+    if (ob->type == FIRSTPIN) {
+      tp2 = LookupCell(ob->model.class);
+      /* a subcell leaf enters the embedding at the level of its own */
+      if (tp2 != NULL && tp2->class == CLASS_SUBCKT)
+	classkey = StructureKey(tp2) + ((tp2->embedding == NULL) ? 0 :
+		((struct embed *)(tp2->embedding))->level + 1);
+      else
+	classkey = StringKey(ob->model.class) + ((tp2 == NULL) ? 0 : tp2->class);
+      key = CacheMix(key ^ classkey);
+    }
+    if (ob->type < FIRSTPIN && ob->type != PORT) continue;
+
+    node = ob->node;
+    if (node > 0 && canon[node] == 0) canon[node] = ++nextnode;
+    key = CacheMix(key + ((unsigned long long)(ob->type - PORT) << 32) +
+		   (unsigned long long)((node > 0) ? canon[node] : 0));
+  }
+  FREE(canon);
+
+  if (memocount == memospace) {
+    struct nlist **newcell;
+    unsigned long long *newkey;
+
+    memospace = (memospace > 0) ? 2 * memospace : 16;
+    newcell = (struct nlist **)CALLOC(memospace, sizeof(struct nlist *));
+    newkey = (unsigned long long *)CALLOC(memospace,
+					  sizeof(unsigned long long));
+    if (newcell == NULL || newkey == NULL) {
+      if (newcell != NULL) FREE(newcell);
+      if (newkey != NULL) FREE(newkey);
+      memospace = memocount;
+      return(key);
+    }
+    if (memocount > 0) {
+      memcpy(newcell, memocell, memocount * sizeof(struct nlist *));
+      memcpy(newkey, memokey, memocount * sizeof(unsigned long long));
+      FREE(memocell);
+      FREE(memokey);
+    }
+    memocell = newcell;
+    memokey = newkey;
+  }
+  memocell[memocount] = tp;
+  memokey[memocount++] = key;
+  return(key);
+}
+
+static unsigned long long ParameterKey(enum EmbeddingStrategy strategy)
+/* hash of everything besides the cell that decides the embedding */
+{
+  unsigned long long key;
+  int i;
+
+  key = CacheMix((unsigned long long)strategy + 1);
+  if (strategy == bottomup)
+    key = CacheMix(key + 2 * Exhaustive + Agglomerative);
+  if (strategy == anneal)
+    key = CacheMix(key + AnnealChains);
+  for (i = 1; i <= MAX_TREE_DEPTH; i++) {
+    key = CacheMix(key + TreeFanout[i]);
+    key = CacheMix(key + MinCommonNodes[i]);
+    key = CacheMix(key + MinUsedLeaves[i]);
+  }
+  return(key);
+}
+
+static void CacheKey(struct nlist *tp, enum EmbeddingStrategy strategy,
+		     char *name)
+/* the hash table key of cell tp embedded with 'strategy' */
+{
+  unsigned long long structure;
+
+  memocount = 0;
+  structure = StructureKey(tp);
+  sprintf(name, "%016llx %016llx", structure, ParameterKey(strategy));
+}
+
+static void InitializeCache(void)
+{
+  if (cacheinitialized) return;
+  InitializeHashTable(&cachedict, CACHE_HASHSIZE);
+  cacheinitialized = 1;
+}
+
+
+/* tree strings are built in a buffer that grows as needed */
+static char *treebuf;
+static int treelen, treespace;
+
+static int AppendTree(char *s)
+{
+  int len;
+
+  len = strlen(s);
+  if (treelen + len + 1 > treespace) {
+    char *newbuf;
+    int newspace;
+
+    newspace = MAX(2 * treespace, treelen + len + 256);
+    newbuf = (char *)CALLOC(newspace, 1);
+    if (newbuf == NULL) return(0);
+    if (treebuf != NULL) {
+      memcpy(newbuf, treebuf, treelen + 1);
+      FREE(treebuf);
+    }
+    treebuf = newbuf;
+    treespace = newspace;
+  }
+  strcpy(treebuf + treelen, s);
+  treelen += len;
+  return(1);
+}
+
+static int WriteTree(struct embed *E)
+{
+  char number[20];
+
+  if (E == NULL) return(AppendTree("-"));
+  if (E->left == NULL && E->right == NULL) {
+    sprintf(number, "%d", E->instancenumber);
+    return(AppendTree(number));
+  }
+  return(AppendTree("(") && WriteTree(E->left) && AppendTree(" ")
+	 && WriteTree(E->right) && AppendTree(")"));
+}
+
+static struct embed *ReadTree(char **s, struct nlist *tp, int *level,
+			      int instances, int *error)
+/* parse a tree written by WriteTree() as an embedding of tp */
+{
+  struct embed *node;
+  int inst;
+
+  while (**s == ' ') (*s)++;
+  if (**s == '-') {
+    (*s)++;
+    return(NULL);
+  }
+  if ((node = (struct embed *)CALLOC(1, sizeof(struct embed))) == NULL) {
+    *error = 1;
+    return(NULL);
+  }
+  node->cell = tp;
+  if (**s == '(') {
+    (*s)++;
+    node->left = ReadTree(s, tp, level, instances, error);
+    if (!*error) node->right = ReadTree(s, tp, level, instances, error);
+    while (**s == ' ') (*s)++;
+    if (**s != ')' || (node->left == NULL && node->right == NULL))
+      *error = 1;
+    else {
+      (*s)++;
+      if (node->right == NULL) node->level = node->left->level + 1;
+      else if (node->left == NULL) node->level = node->right->level + 1;
+      else node->level = MAX(node->left->level, node->right->level) + 1;
+    }
+    return(node);
+  }
+  inst = (int)strtol(*s, s, 10);
+  if (inst < 1 || inst > instances || level[inst] < 0) *error = 1;
+  else {
+    node->level = level[inst];
+    level[inst] = -1;	/* each instance may appear only once */
+  }
+  node->instancenumber = inst;
+  return(node);
+}
+
+static struct embed *ParseTree(char *tree, struct nlist *tp)
+/* return the embedding of tp described by 'tree', or NULL if it is
+   not an embedding of every instance of tp */
+{
+  struct embed *E;
+  struct objlist *ob;
+  struct nlist *tp2;
+  int *level;
+  int instances, error;
+
+  instances = 0;
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->type == FIRSTPIN) instances++;
+  level = (int *)CALLOC(instances + 1, sizeof(int));
+  if (level == NULL) return(NULL);
+
+  /* leaves start at the level of their own embedding, as in
+     InitializeMatrices() */
+  instances = 0;
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->type == FIRSTPIN) {
+      tp2 = LookupCell(ob->model.class);
+      instances++;
+      if (tp2 != NULL && tp2->class == CLASS_SUBCKT && tp2->embedding != NULL)
+	level[instances] = ((struct embed *)(tp2->embedding))->level;
+    }
+
+  error = 0;
+  E = ReadTree(&tree, tp, level, instances, &error);
+  while (*tree == ' ' || *tree == '\n') tree++;
+  if (!error && *tree == '\0')
+    for (; instances > 0 && level[instances] < 0; instances--) ;
+  if (error || *tree != '\0' || instances > 0) {
+    FreeEmbeddingTree(E);
+    E = NULL;
+  }
+  FREE(level);
+  return(E);
+}
+
+
+int EmbedCacheLookup(struct nlist *tp, enum EmbeddingStrategy strategy)
+/* if an embedding of a cell like tp is cached, make it tp's embedding */
+/* returns 1 if found */
+{
+  char name[40];
+  char *tree;
+  struct embed *E;
+
+  InitializeCache();
+  CacheKey(tp, strategy, name);
+  if ((tree = (char *)HashLookup(name, &cachedict)) == NULL) return(0);
+  if ((E = ParseTree(tree, tp)) == NULL) return(0);
+  FreeEmbeddingTree((struct embed *)(tp->embedding));
+  tp->embedding = E;
+  return(1);
+}
+
+void EmbedCacheStore(struct nlist *tp, enum EmbeddingStrategy strategy)
+/* remember the embedding of tp, and append it to the cache file */
+{
+  char name[40];
+  char *tree;
+  FILE *f;
+
+  if (tp->embedding == NULL) return;
+  InitializeCache();
+  CacheKey(tp, strategy, name);
+  treelen = 0;
+  if (!AppendTree("") || !WriteTree((struct embed *)(tp->embedding)))
+    return;
+  if ((tree = (char *)HashLookup(name, &cachedict)) != NULL) {
+    if (!strcmp(tree, treebuf)) return;
+    FREE(tree);
+  }
+  if ((tree = strsave(treebuf)) == NULL) return;
+  HashPtrInstall(name, tree, &cachedict);
+
+  if (cachefilename == NULL) return;
+  if ((f = fopen(cachefilename, "a")) == NULL) {
+    Fprintf(stderr, "Unable to write embedding cache file %s\n",
+	    cachefilename);
+    return;
+  }
+  fprintf(f, "%s %s %s\n", name, tp->name, tree);
+  fclose(f);
+}
+
+static int ReadCacheLine(FILE *f)
+/* read a line of any length into treebuf;  returns 0 at end of file */
+{
+  char chunk[256];
+  int len;
+
+  treelen = 0;
+  if (!AppendTree("")) return(0);
+  while (fgets(chunk, sizeof(chunk), f) != NULL) {
+    if (!AppendTree(chunk)) return(0);
+    len = strlen(chunk);
+    if (len > 0 && chunk[len - 1] == '\n') return(1);
+  }
+  return(treelen > 0);
+}
+
+static int FreeCacheEntry(struct hashlist *p)
+{
+  if (p->ptr != NULL) FREE(p->ptr);
+  return(1);
+}
+
+void SetEmbedCacheFile(char *filename)
+/* read the trees in 'filename' and append new ones to it;  with no
+   file name, forget all cached trees instead */
+{
+  FILE *f;
+  char name[40];
+  unsigned long long structure, parameters;
+  int count, pos;
+
+  InitializeCache();
+  if (cachefilename != NULL) FREE(cachefilename);
+  cachefilename = NULL;
+  if (filename == NULL || *filename == '\0') {
+    RecurseHashTable(&cachedict, FreeCacheEntry);
+    HashKill(&cachedict);
+    InitializeHashTable(&cachedict, CACHE_HASHSIZE);
+    Printf("Embedding cache cleared.\n");
+    return;
+  }
+  cachefilename = strsave(filename);
+
+  count = 0;
+  if ((f = fopen(filename, "r")) != NULL) {
+    while (ReadCacheLine(f)) {
+      char *tree, *old;
+
+      pos = -1;
+      sscanf(treebuf, "%llx %llx %*s %n", &structure, &parameters, &pos);
+      if (pos < 0) continue;
+      tree = treebuf + pos;
+      tree[strcspn(tree, "\n")] = '\0';
+      if (*tree == '\0') continue;
+      sprintf(name, "%016llx %016llx", structure, parameters);
+      if ((old = (char *)HashLookup(name, &cachedict)) != NULL) FREE(old);
+      HashPtrInstall(name, strsave(tree), &cachedict);
+      count++;
+    }
+    fclose(f);
+  }
+  Printf("Read %d cached embeddings from %s\n", count, filename);
+}
@@ -46,7 +46,6 @@ int CountExists; /* count number of times test is performed */
 
 #ifdef EX_TREE_FOR_EXIST
 /* safe, but excessive */
-/* #define EX_SIZE (MAX_ELEMENTS * (MAX_LEAVES+1)) */
 #ifdef VMUNIX
 #define EX_SIZE 250000
 #else
@@ -84,6 +83,10 @@ unsigned short free_list; /* index into ex_array */
 
 struct ex ex_array[EX_SIZE];
 EX_LIST_PTR tree_root;
+
+/* is leaf i owned by element E1 or E2? */
+#define OwnedLeaf(E1,E2,i) \
+	(TestPackedArrayBit(MSTAR(E1),i) || TestPackedArrayBit(MSTAR(E2),i))
 #endif /* EX_TREE_FOR_EXIST */
 
 
@@ -115,27 +118,15 @@ EX_LIST_PTR GetExListElement(void)
 
 void AddToExistSet(int E1, int E2)
 {
-  char ownedleaves[MAX_LEAVES+1];
   int i;
   EX_LIST_PTR ptr;
 
-#if 1
-  for (i = 1; i <= Leaves; i++)
-    ownedleaves[i] = TestPackedArrayBit(MSTAR[E1],i) || 
-      TestPackedArrayBit(MSTAR[E2],i);
-#else
-  memzero(ownedleaves, sizeof(ownedleaves));
-  for (i = 1; i <= Leaves; i++)
-    if (TestPackedArrayBit(MSTAR[E1],i) || 
-	TestPackedArrayBit(MSTAR[E2],i)) ownedleaves[i] = 1;
-#endif
-
   if (tree_root == NULL) 
     if ((tree_root = GetExListElement()) == NULL) return;
 
   ptr = tree_root;
   for (i = 1; i <= Leaves; i++) {
-    if (ownedleaves[i] == 1) {
+    if (OwnedLeaf(E1,E2,i)) {
       if (ptr->one == NULL) 
 	if ((ptr->one = GetExListElement()) == NULL) return;
       ptr = ptr->one;
@@ -150,7 +141,6 @@ void AddToExistSet(int E1, int E2)
     
 int Exists(int E1, int E2)
 {
-  char ownedleaves[MAX_LEAVES+1];
   int i;
   EX_LIST_PTR ptr;
 
@@ -162,20 +152,15 @@ int Exists(int E1, int E2)
     return(0);
   }
 
-  memzero(ownedleaves, sizeof(ownedleaves));
-  for (i = 1; i <= Leaves; i++)
-    if (TestPackedArrayBit(MSTAR[E1],i) || 
-	TestPackedArrayBit(MSTAR[E2],i)) ownedleaves[i] = 1;
-
 #ifdef EXTREE_DEBUG
   Printf("checking existence of :");
-  for (i = 1; i <= Leaves; i++) Printf(" %d",ownedleaves[i]);
+  for (i = 1; i <= Leaves; i++) Printf(" %d",OwnedLeaf(E1,E2,i) ? 1 : 0);
   Printf("  ");
 #endif
 
   ptr = tree_root;
   for (i = 1; i <= Leaves; i++) {
-    if (ownedleaves[i] == 1) {
+    if (OwnedLeaf(E1,E2,i)) {
       if (ptr->one == NULL) {
 #ifdef EXTREE_DEBUG
 	Printf("(%d,%d) does not exist (i = %d)\n",E1,E2,i);
@@ -226,27 +211,15 @@ EX_LIST_PTR GetExListElement(void)
 
 void AddToExistSet(int E1, int E2)
 {
-  char ownedleaves[MAX_LEAVES+1];
   int i;
   EX_LIST_PTR ptr;
 
-#if 1
-  for (i = 1; i <= Leaves; i++)
-    ownedleaves[i] = TestPackedArrayBit(MSTAR[E1],i) || 
-      TestPackedArrayBit(MSTAR[E2],i);
-#else
-  memzero(ownedleaves, sizeof(ownedleaves));
-  for (i = 1; i <= Leaves; i++)
-    if (TestPackedArrayBit(MSTAR[E1],i) || 
-	TestPackedArrayBit(MSTAR[E2],i)) ownedleaves[i] = 1;
-#endif
-
   if (tree_root == 0) 
     if ((tree_root = GetExListElement()) == 0) return;
 
   ptr = tree_root;
   for (i = 1; i <= Leaves; i++) {
-    if (ownedleaves[i] == 1) {
+    if (OwnedLeaf(E1,E2,i)) {
       if (ex_array[ptr].one == 0) {
 	/* add it to list */
 	if (i == Leaves) ex_array[ptr].one = ptr;
@@ -267,7 +240,6 @@ void AddToExistSet(int E1, int E2)
     
 int Exists(int E1, int E2)
 {
-  char ownedleaves[MAX_LEAVES+1];
   int i;
   EX_LIST_PTR ptr;
 
@@ -279,20 +251,15 @@ int Exists(int E1, int E2)
     return(0);
   }
 
-  memzero(ownedleaves, sizeof(ownedleaves));
-  for (i = 1; i <= Leaves; i++)
-    if (TestPackedArrayBit(MSTAR[E1],i) || 
-	TestPackedArrayBit(MSTAR[E2],i)) ownedleaves[i] = 1;
-
 #ifdef EXTREE_DEBUG
   Printf("checking existence of :");
-  for (i = 1; i <= Leaves; i++) Printf(" %d",ownedleaves[i]);
+  for (i = 1; i <= Leaves; i++) Printf(" %d",OwnedLeaf(E1,E2,i) ? 1 : 0);
   Printf("  ");
 #endif
 
   ptr = tree_root;
   for (i = 1; i <= Leaves; i++) {
-    if (ownedleaves[i] == 1) {
+    if (OwnedLeaf(E1,E2,i)) {
       if (ex_array[ptr].one == 0) {
 #ifdef EXTREE_DEBUG
 	Printf("(%d,%d) does not exist (i = %d)\n",E1,E2,i);
@@ -326,20 +293,34 @@ void PrintExistSetStats(FILE *f)
 #endif /* EX_TREE_WITH_POINTERS */
 #else /* EX_TREE_FOR_EXIST */
 
+/* The exist set holds the leaf ownership (MSTAR(E1) | MSTAR(E2)) of	*/
+/* every element built so far, in an open-addressing hash table keyed	*/
+/* by a 64-bit fingerprint of the ownership words.  Each entry keeps	*/
+/* only the words between its first and last nonzero one, and entries	*/
+/* with equal fingerprints are compared word by word, so a collision	*/
+/* can cost time but never a wrong answer.  The table doubles whenever	*/
+/* it becomes half full.						*/
+
 struct ex_entry {
-  unsigned long mstar[(MAX_LEAVES / BITS_PER_LONG)  + 1];
-  struct ex_entry *next;
+  int first, last;		/* span of nonzero words */
+  unsigned long mstar[1];	/* really last - first + 1 words */
 };
 
-#if 1
-struct ex_entry *ex_tab[MAX_ELEMENTS];
-#else
-#ifdef IBMPC
-struct ex_entry *ex_tab[4100];
-#else
-struct ex_entry *ex_tab[66000];
-#endif
-#endif
+struct ex_slot {
+  unsigned long long key;
+  struct ex_entry *entry;	/* NULL if the slot is empty */
+};
+
+#define EX_INITIAL_SIZE 1024
+
+static struct ex_slot *ex_tab;
+static long ex_size;		/* always a power of 2 */
+static long ex_used;
+static long ex_lookups, ex_probes, ex_maxprobe;
+
+/* ownership of the element being tested or installed */
+static unsigned long *ex_mstar;
+static int ex_first, ex_last;
 
 
 void PRINTPACKED(unsigned long *mstar)
@@ -348,173 +329,185 @@ void PRINTPACKED(unsigned long *mstar)
   for (i = 0; i <= PackedLeaves; i++) Printf("%lX ",mstar[i]);
 }
 
-
-#ifdef IBMPC
-static unsigned int lochash(unsigned long *mstar)
-#else
-static unsigned long lochash(unsigned long *mstar)
-#endif
+static unsigned long long ExMix(unsigned long long x)
 {
-  int i;
-  unsigned long hashval;
-  
-  hashval = *mstar;
-  for (i = 1; i <= PackedLeaves; i++) hashval ^= mstar[i];
-  /* we now have a 32 bit field that we want to collapse to 16 / 12 bits */
-#ifdef EXTREE_DEBUG
-  Printf("hashval = %ld; ",(long)hashval);
-#endif
-
-#if 1
-  hashval = hashval % (MAX_ELEMENTS - 1);
-#else
-  hashval = (hashval >> 16) ^ (hashval & 0x0000FFFFL);
-#ifdef IBMPC
-  hasval = hashval >> 4;
-#endif
-#endif
-
-#ifdef EXTREE_DEBUG
-  Printf("element hashed to %ld\n",(long)hashval);
-#endif
-#ifdef IBMPC
-  return((int)hashval);
-#else
-  return(hashval);
-#endif
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+  return(x);
 }
 
-struct ex_entry *hashlookup(unsigned long *mstar)
+static unsigned long long ExUnion(int E1, int E2)
+/* leave MSTAR(E1) | MSTAR(E2) in ex_mstar[ex_first..ex_last], and
+   return its fingerprint */
 {
-  struct ex_entry *np;
   int i;
+  unsigned long word;
+  unsigned long long key;
+
+  ex_first = MIN(MFIRST(E1), MFIRST(E2));
+  ex_last = MAX(MLAST(E1), MLAST(E2));
+  key = 0;
+  for (i = ex_first; i <= ex_last; i++) {
+    word = MSTAR(E1)[i] | MSTAR(E2)[i];
+    ex_mstar[i] = word;
+    /* zero words add nothing, so the key does not depend on the span */
+    if (word != 0)
+      key += ExMix(word + (unsigned long long)i * 0x9E3779B97F4A7C15ULL);
+  }
+  while (ex_first < ex_last && ex_mstar[ex_first] == 0) ex_first++;
+  while (ex_last > ex_first && ex_mstar[ex_last] == 0) ex_last--;
 
-  for (np = ex_tab[lochash(mstar)]; np != NULL; np = np->next) 
-    for (i = 0; i <= PackedLeaves && mstar[i] == (np->mstar)[i]; i++) 
-      if (i == PackedLeaves) {
 #ifdef EXTREE_DEBUG
-	Printf("element found in hash table\n");
+  Printf("fingerprint = %llX; ", key);
 #endif
-	return(np);
-      }
-#ifdef EXTREE_DEBUG
-  Printf("element not in hash table\n");
-#endif
-  return(NULL);
+  return(key);
 }
 
-static struct ex_entry *hashinstall(unsigned long *mstar)
+static struct ex_slot *ExFind(unsigned long long key)
+/* the slot holding ex_mstar, or the empty slot where it belongs */
 {
+  struct ex_slot *slot;
   struct ex_entry *np;
-#ifdef IBMPC
-  unsigned int hashval;
-#else
-  unsigned long hashval;
-#endif
-  int i;
-
-  hashval = lochash(mstar);
-  for (np = ex_tab[hashval]; np != NULL; np = np->next) 
-    for (i = 0; i <= PackedLeaves && mstar[i] == (np->mstar)[i]; i++) 
-      if (i == PackedLeaves) {
-#ifdef EXTREE_DEBUG
-	Printf("element found in hash table\n");
-#endif
-	return(np);
-      }
+  long i, probes;
+
+  probes = 0;
+  for (i = (long)(key & (ex_size - 1)); ; i = (i + 1) & (ex_size - 1)) {
+    probes++;
+    slot = ex_tab + i;
+    if ((np = slot->entry) == NULL) break;
+    if (slot->key == key && np->first == ex_first && np->last == ex_last &&
+	memcmp(np->mstar, ex_mstar + ex_first,
+	       (ex_last - ex_first + 1) * sizeof(unsigned long)) == 0)
+      break;
+  }
+  ex_lookups++;
+  ex_probes += probes;
+  if (probes > ex_maxprobe) ex_maxprobe = probes;
+  return(slot);
+}
 
-  /* not found in hash table, so install it */
-  if ((np = (struct ex_entry *)CALLOC(1, sizeof(struct ex_entry))) == NULL)
-    return(NULL);
-  /*    memcpy(np->mstar, mstar, (PackedLeaves + 1)*sizeof(long)); */
-  memcpy(np->mstar, mstar, sizeof(np->mstar));
-  np->next = ex_tab[hashval];
-#ifdef EXTREE_DEBUG
-  Printf("Element installed in hash table\n");
-#endif
-  return(ex_tab[hashval] = np);
+static int ExGrow(void)
+/* double the size of the table */
+{
+  struct ex_slot *old, *slot;
+  long oldsize, i, j;
+
+  old = ex_tab;
+  oldsize = ex_size;
+  ex_tab = (struct ex_slot *)CALLOC(2 * oldsize, sizeof(struct ex_slot));
+  if (ex_tab == NULL) {
+    ex_tab = old;
+    return(0);
+  }
+  ex_size = 2 * oldsize;
+  for (i = 0; i < oldsize; i++) {
+    if (old[i].entry == NULL) continue;
+    for (j = (long)(old[i].key & (ex_size - 1)); ex_tab[j].entry != NULL;
+	 j = (j + 1) & (ex_size - 1)) ;
+    slot = ex_tab + j;
+    *slot = old[i];
+  }
+  FREE(old);
+  return(1);
 }
 
 int Exists(int E1, int E2)
 {
-  int i;
-  unsigned long mstar[(MAX_LEAVES / BITS_PER_LONG)  + 1];
+  unsigned long long key;
+  int found;
 
   CountExists++;
+  if (ex_tab == NULL) return(0);
 
-  for (i = 0; i <= PackedLeaves; i++)
-    mstar[i] = MSTAR[E1][i] | MSTAR[E2][i];
-
+  key = ExUnion(E1, E2);
+  found = (ExFind(key)->entry != NULL);
 #ifdef EXTREE_DEBUG
-  Printf("TESTING Existence of (%d,%d)",E1,E2);
-  PRINTPACKED(mstar);
-  Printf("\n");
+  Printf("TESTING Existence of (%d,%d): %s\n",E1,E2,
+	 found ? "found" : "not found");
 #endif
-  return (hashlookup(mstar) != NULL);
+  return(found);
 }
 
-int InitializeExistTest(void) 
+static void FreeExistSet(void)
 {
-#ifdef IBMPC
-  int i;
-#else
   long i;
-#endif
-  struct ex_entry *np;
-  struct ex_entry *npnext;
 
-  for (i = 0; i < sizeof(ex_tab) / sizeof(ex_tab[0]); i++) 
-    for (np = ex_tab[i]; np != NULL; np = npnext) {
-      npnext = np->next;
-      FREE(np);
-    }
-  memzero(ex_tab, sizeof(ex_tab));
+  if (ex_tab != NULL) {
+    for (i = 0; i < ex_size; i++)
+      if (ex_tab[i].entry != NULL) FREE(ex_tab[i].entry);
+    FREE(ex_tab);
+  }
+  ex_tab = NULL;
+  ex_size = ex_used = 0;
+  ex_lookups = ex_probes = ex_maxprobe = 0;
+  if (ex_mstar != NULL) FREE(ex_mstar);
+  ex_mstar = NULL;
+}
+
+int InitializeExistTest(void) 
+{
+  FreeExistSet();
+  ex_mstar = (unsigned long *)CALLOC(PackedLeaves + 1, sizeof(unsigned long));
+  ex_tab = (struct ex_slot *)CALLOC(EX_INITIAL_SIZE, sizeof(struct ex_slot));
+  if (ex_mstar == NULL || ex_tab == NULL) {
+    Fprintf(stderr, "Not enough memory for exist hash table\n");
+    FreeExistSet();
+    return(0);
+  }
+  ex_size = EX_INITIAL_SIZE;
   return(1);
 }
 
 void AddToExistSet(int E1, int E2) 
 {
-  int i;
-  unsigned long mstar[(MAX_LEAVES / BITS_PER_LONG)  + 1];
-
-  for (i = 0; i <= PackedLeaves; i++)
-    mstar[i] = MSTAR[E1][i] | MSTAR[E2][i];
+  unsigned long long key;
+  struct ex_slot *slot;
+  struct ex_entry *np;
+  int words;
 
+  if (ex_tab == NULL) return;
 #ifdef EXTREE_DEBUG
   Printf("Requesting installation of (%d,%d) in hash table\n",E1,E2);
 #endif
-  hashinstall(mstar);
+  key = ExUnion(E1, E2);
+  slot = ExFind(key);
+  if (slot->entry != NULL) return;
+
+  words = ex_last - ex_first + 1;
+  np = (struct ex_entry *)CALLOC(1, sizeof(struct ex_entry) +
+				 (words - 1) * sizeof(unsigned long));
+  if (np == NULL) return;
+  np->first = ex_first;
+  np->last = ex_last;
+  memcpy(np->mstar, ex_mstar + ex_first, words * sizeof(unsigned long));
+  slot->key = key;
+  slot->entry = np;
+  ex_used++;
+  if (2 * ex_used > ex_size) ExGrow();
 }
 
 void PrintExistSetStats(FILE *f)
 {
-  struct ex_entry *np;
-#ifdef IBMPC
-  int i;
-#else
-  long i;
-#endif
-  long bins;
-  long nodes;
-
-  bins = 0;
-  nodes = 0;
-  for (i = 0; i < sizeof(ex_tab) / sizeof(ex_tab[0]); i ++) 
-    if ((np = ex_tab[i]) != NULL) {
-      bins++;
-      while (np != NULL) {
-	nodes++;
-	np = np->next;
-      }
-    }
-
-  Fprintf(f,"Exist hash table stats: %ld of %ld bins used",
-	 (long)bins, (long)(sizeof(ex_tab) / sizeof(ex_tab[0])));
-  if (bins != 0) Fprintf(f,", %ld nodes (%.2f nodes/bin)",
-			 nodes, (float)nodes / (float)bins);
+  long i, words;
+
+  words = 0;
+  for (i = 0; i < ex_size; i++)
+    if (ex_tab[i].entry != NULL)
+      words += ex_tab[i].entry->last - ex_tab[i].entry->first + 1;
+
+  Fprintf(f,"Exist hash table stats: %ld entries in %ld slots",
+	  ex_used, ex_size);
+  if (ex_lookups != 0)
+    Fprintf(f,", %.2f probes/lookup (max %ld)",
+	    (float)ex_probes / (float)ex_lookups, ex_maxprobe);
   Fprintf(f,"\n");
   Fprintf(f,"Exist hash table memory usage: %ld bytes\n",
-	  (long)(sizeof(ex_tab) + nodes * sizeof(struct ex_entry)));
+	  (long)(ex_size * sizeof(struct ex_slot) +
+		 ex_used * sizeof(struct ex_entry) +
+		 (words - ex_used) * sizeof(unsigned long)));
 }
 
 
@@ -2,24 +2,20 @@
 #define LEAFPINS 15
 #define RENTEXP 0.3
 
-/* #ifdef VMUNIX */
-/* #define MAX_ELEMENTS 20000 */
-/* #define MAX_NODES 72 */
-/* #define MAX_LEAVES 64 */
+/* Element, node and leaf storage is sized to each cell as it is	*/
+/* embedded.  MAX_ELEMENTS is the least number of elements the	*/
+/* bottom-up search may create, and TREE_DEPTH the least depth of	*/
+/* an embedding tree;  both grow with the number of leaves.		*/
 #define MAX_ELEMENTS 5000
-#define MAX_NODES 150
-#define MAX_TREE_DEPTH 8
-/* #define MAX_LEAVES 256 */
-#define MAX_LEAVES (1<<MAX_TREE_DEPTH)
-#define BITS_PER_LONG 32
-/* #endif */ /* VMUNIX */
+#define TREE_DEPTH 8
+#define MAX_TREE_DEPTH 30
+#define BITS_PER_LONG (8 * (int)sizeof(unsigned long))
 
 #ifdef IBMPC
+#undef MAX_ELEMENTS
+#undef TREE_DEPTH
 #define MAX_ELEMENTS 100
-#define MAX_NODES 20
-#define MAX_LEAVES 16
-#define MAX_TREE_DEPTH 4
-#define BITS_PER_LONG 32
+#define TREE_DEPTH 4
 #endif /* IBMPC */
 
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -28,7 +24,7 @@
 
 /* abridged ownership and connectivity matrices */
 /* elements, nodes, leaves are indexed from 1 to N, nodes, leaves */
-extern unsigned short M[][7];
+extern int (*M)[7];
   /* height, L, R, SWALLOWED, PINS, LEAVES, USED */
 #define LEVEL(e)     (M[e][0])
 #define L(e)         (M[e][1])
@@ -38,14 +34,52 @@ extern unsigned short M[][7];
 #define LEAVES(e)    (M[e][5])
 #define USED(e)      (M[e][6])
 
-extern unsigned long MSTAR[MAX_ELEMENTS][(MAX_LEAVES / BITS_PER_LONG)  + 1];
+/* leaf ownership, PackedLeaves + 1 words per element; only	*/
+/* allocated by InitializeOwnership() for bottom-up embedding	*/
+extern unsigned long *MStar;
+#define MSTAR(e)     (MStar + (long)(e) * (PackedLeaves + 1))
 #define SetPackedArrayBit(A,B) \
-       (A [(B) / BITS_PER_LONG] |= (1L << ((B)%BITS_PER_LONG)))
+       (A [(B) / BITS_PER_LONG] |= (1UL << ((B)%BITS_PER_LONG)))
 #define TestPackedArrayBit(A,B) \
-       (A [(B) / BITS_PER_LONG] & (1L << ((B)%BITS_PER_LONG)))
-
-extern unsigned char C[MAX_ELEMENTS][MAX_NODES + 1];
-extern unsigned char CSTAR[MAX_ELEMENTS][MAX_NODES + 1];
+       (A [(B) / BITS_PER_LONG] & (1UL << ((B)%BITS_PER_LONG)))
+
+/* Sparse connectivity.  The nodes used by element e (e >= 1) are	*/
+/* CNode[CRow[e]] .. CNode[CRow[e + 1] - 1], in ascending order.	*/
+/* CStar holds the node usage CSTAR[e][node] of each entry and CPin	*/
+/* the port bit C[e][node].  Row 0, the port list of the whole	*/
+/* cell, is kept dense in NodeUsage and PortNode.			*/
+extern long *CRow;
+extern int *CNode;
+extern int *CStar;
+extern unsigned char *CPin;
+extern int *NodeUsage;			/* CSTAR[0][node] */
+extern unsigned char *PortNode;		/* C[0][node] */
+
+/* leaves on each node:  NodeLeaf[NodeRow[n]] .. NodeLeaf[NodeRow[n+1]-1] */
+extern long *NodeRow;
+extern int *NodeLeaf;
+
+/* port bits C[e][node] packed into PackedNodes + 1 words per	*/
+/* element, for the pair tests of bottom-up embedding;  only	*/
+/* allocated by InitializeOwnership(), like MSTAR.  Row 0 holds	*/
+/* the ports of the whole cell.					*/
+extern unsigned long *CBits;
+#define CBITS(e)     (CBits + (long)(e) * (PackedNodes + 1))
+
+/* only words CFIRST(e) .. CLAST(e) of CBITS(e), and MFIRST(e) ..	*/
+/* MLAST(e) of MSTAR(e), may be nonzero, so that the pair tests	*/
+/* need not scan the rest of the row				*/
+extern int (*Span)[4];
+#define CFIRST(e)    (Span[e][0])
+#define CLAST(e)     (Span[e][1])
+#define MFIRST(e)    (Span[e][2])
+#define MLAST(e)     (Span[e][3])
+
+#ifdef __GNUC__
+#define PopCount(w) __builtin_popcountl(w)
+#else
+extern int PopCount(unsigned long w);
+#endif
 
 extern int PackedLeaves;
 extern int CountExists;
@@ -69,22 +103,32 @@ extern struct embed *EmbeddingTree(struct nlist *tp, int E);
 extern void PrintEmbeddingTree(FILE *outfile, char *cellname, int flatten);
 
 
-/* different embedding strategies, found in random.c, anneal.c, greedy.c */
+/* different embedding strategies, found in random.c, anneal.c, greedy.c,
+   multilevel.c */
 extern int RandomPartition(int left, int right, int level);  /* random.c */
 extern int AnnealPartition(int left, int right, int level);  /* anneal.c */
+extern int AnnealChains;	/* independent annealing chains, anneal.c */
 extern int GreedyPartition(int left, int right, int level);  /* greedy.c */
+extern int MultilevelPartition(int left, int right, int level);
+							   /* multilevel.c */
 extern void EmbedCell(char *cellname, char *filename);       /* bottomup.c */
 
 extern int GradientDescent(int left, int right, int partition);  /* place.c */
 
 /* random data defined in greedy.c */
-extern int permutation[];
+extern int *permutation;
 extern int TopDownStartLevel;
 extern int TreeFanout[];
-extern int leftnodes[];
-extern int rightnodes[];
+extern int *leftnodes;
+extern int *rightnodes;
+
+enum EmbeddingStrategy {random_embedding, greedy, anneal, bottomup,
+	multilevel} ;
 
-enum EmbeddingStrategy {random_embedding, greedy, anneal, bottomup} ;
+/* embedding trees cached by cell structure, in embcache.c */
+extern int EmbedCacheLookup(struct nlist *tp, enum EmbeddingStrategy strategy);
+extern void EmbedCacheStore(struct nlist *tp, enum EmbeddingStrategy strategy);
+extern void SetEmbedCacheFile(char *filename);
 
 extern void TopDownEmbedCell(char *cellname, char *filename, 
 			     enum EmbeddingStrategy strategy);
@@ -98,16 +142,6 @@ extern void TopDownEmbedCell(char *cellname, char *filename,
 
 #define IsLeaf(E) (L(E) == 0 && R(E) == 0)
 
-/* abridged ownership and connectivity matrices */
-/* elements, nodes, leaves are indexed from 1 to N, nodes, leaves */
-extern unsigned short M[MAX_ELEMENTS][7];  
-/* height, L, R, SWALLOWED, PINS, LEAVES, USED */
-
-extern unsigned long MSTAR[MAX_ELEMENTS][(MAX_LEAVES / BITS_PER_LONG)  + 1];
-
-extern unsigned char C[MAX_ELEMENTS][MAX_NODES + 1];
-extern unsigned char CSTAR[MAX_ELEMENTS][MAX_NODES + 1];
-
 /* elements at level i must have TreeFanout[i] or fewer ports */
 extern int TreeFanout[MAX_TREE_DEPTH + 1];       /* tree fanout at each level */
 
@@ -121,7 +155,12 @@ extern int MinUsedLeaves[MAX_TREE_DEPTH + 1];
 extern int Nodes;   /* number of nodes in the cell */
 extern int Leaves;  /* number of leaves in the cell */
 extern int PackedLeaves; /* == Leaves / BITS_PER_LONG, just to save computation */
+extern int PackedNodes; /* == Nodes / BITS_PER_LONG */
 extern int Elements; /* number of elements */
+extern int ElementLimit; /* most elements bottom-up embedding may create */
+extern int ElementSpace; /* elements allocated */
+extern long PinSpace; /* sparse connectivity entries allocated */
+extern int TreeDepth; /* depth of the embedding tree for this cell */
 extern int NewN, NewElements;
 extern int SumPINS, SumCommonNodes, SumUsedLeaves;
 extern int NewSwallowed;
@@ -132,6 +171,7 @@ extern int LogLevel1; /* automatically log if Level1 == LogLevel1 */
 extern int LogLevel2;
 extern int FatalError; /* internal error */
 extern int Exhaustive; /* slow, methodical */
+extern int Agglomerative; /* priority-queue bottom-up merging */
 extern int PlaceDebug; /* interactive debug */
 
 extern FILE *outfile;  /* output file */
@@ -148,14 +188,18 @@ extern int CountSwallowedElements;
 extern int CountInLevel(int i, int upto);
 extern void AddNewElement (int E1, int E2); 
 extern int PartitionFanout(int left, int right, int side);
+extern void SwapPartitionUsage(int LeftElement, int RightElement);
 extern void Dbug_print_cells(int left, int right);
 extern int AnyCommonNodes(int E1, int E2);
+extern int CommonNodes(int E1, int E2, int IncludeGlobals);
 extern int InitializeMatrices(char *cellname);
+extern int InitializeOwnership(void);
 extern int OpenEmbeddingFile(char *cellname, char *filename);
 extern void CloseEmbeddingFile(void);
 extern void ToggleLogging(void);
 extern void ToggleDebug(void);
 extern void ToggleExhaustive(void);
+extern void ToggleAgglomerative(void);
 extern void DescribeCell(char *name, int detail);
 extern void ProtoEmbed(char *name, char ch);
 extern void ProtoPrintParameters(void);
@@ -425,6 +425,7 @@ char *ReadExt(char *fname, int doflat, int *fnum)
     }
   }
   CloseParseFile();
+  ResolveNodes();
   *fnum = filenum;
   return (CellDefInProgress) ? CurrentCell->name : NULL;
 }
@@ -25,6 +25,7 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
 
 #ifdef IBMPC
 #include <alloc.h>
@@ -106,11 +107,7 @@ void flattenCell(char *name, int file)
 	if (tmp->node > oldmax) oldmax = tmp->node;
       if (nextnode <= oldmax) nextnode = oldmax + 1;
 
-      for (tmp = ChildObjList; tmp != NULL; tmp = tmp->next) 
-	if (tmp->node <= oldmax && tmp->node != -1) {
-	  UpdateNodeNumbers(ChildObjList, tmp->node, nextnode);
-	  nextnode ++;
-	}
+      nextnode = RenumberObjList(ChildObjList, INT_MIN, nextnode);
 
       /* copy nodenumbers of ports from parent */
       ob2 = ParentParams;
@@ -270,8 +267,10 @@ int flattenInstancesOf(char *name, int fnum, char *instance)
       Printf("Error: no current cell.\n");
       return 0;
     }
-    else
+    else {
       ThisCell = CurrentCell;
+      ResolveNodes();	/* cell is being read;  settle its nets first */
+    }
   }
   else {
     if (Debug) 
@@ -334,12 +333,7 @@ int flattenInstancesOf(char *name, int fnum, char *instance)
 	if (tmp->node > oldmax) oldmax = tmp->node;
       if (nextnode <= oldmax) nextnode = oldmax + 1;
 
-      for (tmp = ChildObjList; tmp != NULL; tmp = tmp->next) 
-	if (tmp->node <= oldmax && tmp->node > 0) {
-	  if (Debug) Printf("Update node %d --> %d\n", tmp->node, nextnode);
-	  UpdateNodeNumbers(ChildObjList, tmp->node, nextnode);
-	  nextnode++;
-	}
+      nextnode = RenumberObjList(ChildObjList, 1, nextnode);
 
       /* copy nodenumbers of ports from parent */
       ob2 = ParentParams;
@@ -1142,6 +1136,7 @@ struct nlist *cleanuppins(struct hashlist *p, void *clientdata)
 
    ptr = (struct nlist *)(p->ptr);
    if (tc->file != ptr->file) return NULL;
+   FreeNodePins(ptr);
 
    /* Find each instance of cell tc used in cell ptr */
 
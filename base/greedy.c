@@ -21,10 +21,16 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #ifdef IBMPC
 #include <mem.h>  /* memset */
 #endif
 
+#ifdef TCL_NETGEN
+#include <tcl.h>
+#endif
+
+#include "netgen.h"
 #include "timing.h"
 #include "hash.h"
 #include "objlist.h"
@@ -42,12 +48,111 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 /**************************************************************************/
 
 static struct nlist *curcell;
-int permutation[MAX_LEAVES+1];
+int *permutation;
 int TopDownStartLevel;
 
-int leftnodes[MAX_NODES + 1];
-int rightnodes[MAX_NODES + 1];
+int *leftnodes;
+int *rightnodes;
+
+/* nodes whose entry in leftnodes or rightnodes may be non-zero, so */
+/* that those arrays can be cleared without sweeping every node */
+static int *leftlist, *rightlist;
+static int leftcount, rightcount;
+static unsigned char *onleft, *onright;
+
+/* scratch space of the partitioners, indexed by leaf or by position */
+static int *gain;
+static int *queue;
+static char *status;
+static int *position;
+
+static void FreePartition(void)
+{
+  if (permutation != NULL) FREE(permutation);
+  if (leftnodes != NULL) FREE(leftnodes);
+  if (rightnodes != NULL) FREE(rightnodes);
+  if (leftlist != NULL) FREE(leftlist);
+  if (rightlist != NULL) FREE(rightlist);
+  if (onleft != NULL) FREE(onleft);
+  if (onright != NULL) FREE(onright);
+  if (gain != NULL) FREE(gain);
+  if (queue != NULL) FREE(queue);
+  if (status != NULL) FREE(status);
+  if (position != NULL) FREE(position);
+  permutation = NULL;
+  leftnodes = rightnodes = NULL;
+  leftlist = rightlist = NULL;
+  onleft = onright = NULL;
+  gain = queue = position = NULL;
+  status = NULL;
+  leftcount = rightcount = 0;
+}
 
+static int InitializePartition(void)
+/* size the partitioning arrays for the cell set up by InitializeMatrices */
+/* return 1 if OK */
+{
+  FreePartition();
+  permutation = (int *)CALLOC(Leaves + 1, sizeof(int));
+  leftnodes = (int *)CALLOC(Nodes + 1, sizeof(int));
+  rightnodes = (int *)CALLOC(Nodes + 1, sizeof(int));
+  leftlist = (int *)CALLOC(Nodes + 1, sizeof(int));
+  rightlist = (int *)CALLOC(Nodes + 1, sizeof(int));
+  onleft = (unsigned char *)CALLOC(Nodes + 1, sizeof(unsigned char));
+  onright = (unsigned char *)CALLOC(Nodes + 1, sizeof(unsigned char));
+  gain = (int *)CALLOC(Leaves + 1, sizeof(int));
+  queue = (int *)CALLOC(Leaves + 1, sizeof(int));
+  status = (char *)CALLOC(Leaves + 1, sizeof(char));
+  position = (int *)CALLOC(Leaves + 1, sizeof(int));
+  if (permutation == NULL || leftnodes == NULL || rightnodes == NULL ||
+	leftlist == NULL || rightlist == NULL || onleft == NULL ||
+	onright == NULL || gain == NULL || queue == NULL ||
+	status == NULL || position == NULL) {
+    Fprintf(stderr,"Not enough memory to partition %d leaves\n",Leaves);
+    FreePartition();
+    return(0);
+  }
+  return(1);
+}
+
+static void UsePartitionNode(int side, int node, int usage)
+/* add 'usage' to the node usage of 'node' on 'side' of the partition */
+{
+  if (side == LEFT) {
+    if (!onleft[node]) {
+      onleft[node] = 1;
+      leftlist[leftcount++] = node;
+    }
+    leftnodes[node] += usage;
+  }
+  else {
+    if (!onright[node]) {
+      onright[node] = 1;
+      rightlist[rightcount++] = node;
+    }
+    rightnodes[node] += usage;
+  }
+}
+
+static void ClearPartitionNodes(int side)
+{
+  int i;
+
+  if (side == LEFT) {
+    for (i = 0; i < leftcount; i++) {
+      leftnodes[leftlist[i]] = 0;
+      onleft[leftlist[i]] = 0;
+    }
+    leftcount = 0;
+  }
+  else {
+    for (i = 0; i < rightcount; i++) {
+      rightnodes[rightlist[i]] = 0;
+      onright[rightlist[i]] = 0;
+    }
+    rightcount = 0;
+  }
+}
 
 int PartitionFanout(int left, int right, int side)
 /* returns number of pins for partition (left,right) */
@@ -55,23 +160,52 @@ int PartitionFanout(int left, int right, int side)
    these represent the integrated node usages for the left and right 
    partitions */
 {
-  int i, E;
+  int i, E, node;
   int ports;
-  int sum;
-
+  int count;
+  int *sum, *list;
+  long k;
+
+  /* save total node usage in 'leftnodes' and 'rightnodes' */
+  ClearPartitionNodes(side);
+  for (E = left; E <= right; E++)
+    for (k = CRow[permutation[E]]; k < CRow[permutation[E] + 1]; k++)
+      UsePartitionNode(side, CNode[k], CStar[k]);
+
+  if (side == LEFT) {
+    sum = leftnodes;
+    list = leftlist;
+    count = leftcount;
+  }
+  else {
+    sum = rightnodes;
+    list = rightlist;
+    count = rightcount;
+  }
   ports = 0;
-  for (i = 1; i <= Nodes; i++) {
-    sum = 0;
-    for (E = left; E <= right; E++) sum += CSTAR[permutation[E]][i];
-    /* save total node usage in 'leftnodes' and 'rightnodes' */
-    if (side == LEFT) leftnodes[i] = sum;
-    else rightnodes[i] = sum;
-
-    if (sum && (sum < CSTAR[0][i] || C[0][i])) ports ++;
+  for (i = 0; i < count; i++) {
+    node = list[i];
+    if (sum[node] && (sum[node] < NodeUsage[node] || PortNode[node])) ports ++;
   }
   return(ports);
 }
 
+void SwapPartitionUsage(int LeftElement, int RightElement)
+/* update leftnodes and rightnodes for moving LeftElement from the left
+   partition to the right one, and RightElement the other way */
+{
+  long k;
+
+  for (k = CRow[LeftElement]; k < CRow[LeftElement + 1]; k++) {
+    UsePartitionNode(LEFT, CNode[k], -CStar[k]);
+    UsePartitionNode(RIGHT, CNode[k], CStar[k]);
+  }
+  for (k = CRow[RightElement]; k < CRow[RightElement + 1]; k++) {
+    UsePartitionNode(LEFT, CNode[k], CStar[k]);
+    UsePartitionNode(RIGHT, CNode[k], -CStar[k]);
+  }
+}
+
 
 #ifndef DBUG_OFF
 void Dbug_print_cells(int left, int right)
@@ -88,25 +222,30 @@ void Dbug_print_cells(int left, int right)
 #endif
 
 
-int FindOptimum(int left, int right, int *mynodes, int *othernodes)
+static void FindGains(int left, int right, int *mynodes, int *othernodes)
+/* set gain[E] for moving each element E in (left..right) across */
 {
-  int E, max, choice, i;
-  int gain[MAX_LEAVES + 1];
+  int E, i;
+  long k;
 
-  /* find the left optimum */
   for (E = left; E <= right; E++) {
     gain[E] = 0;
-    for (i = 1; i <= Nodes; i++) {
-#ifdef BAD
-      if (C[permutation[E]][i] && mynodes[i] == 1) gain[E]++;
-#else
+    for (k = CRow[permutation[E]]; k < CRow[permutation[E] + 1]; k++) {
+      if (!CPin[k]) continue;
+      i = CNode[k];
       /* remember: left,rightnodes built up from CSTAR */
-      if (C[permutation[E]][i] && mynodes[i] == CSTAR[permutation[E]][i])
-	      gain[E]++;
-#endif
-      else if (C[permutation[E]][i] && othernodes[i] == 0) gain[E]--;
+      if (mynodes[i] == CStar[k]) gain[E]++;
+      else if (othernodes[i] == 0) gain[E]--;
     }
   }
+}
+
+int FindOptimum(int left, int right, int *mynodes, int *othernodes)
+{
+  int E, max, choice;
+
+  /* find the left optimum */
+  FindGains(left, right, mynodes, othernodes);
   
   max = 0;
   choice = 0;
@@ -131,22 +270,10 @@ int GradientDescent(int left, int right, int partition)
   int leftchoice, rightchoice;
   int tmp;
 #if 1
-  int E, leftmax, rightmax, i;
-  int gain[MAX_LEAVES + 1];
+  int E, leftmax, rightmax;
 
   /* find the left optimum */
-  for (E = left; E <= partition; E++) {
-    gain[E] = 0;
-    for (i = 1; i <= Nodes; i++) {
-#ifdef BAD
-      if (C[permutation[E]][i] && leftnodes[i] == 1) gain[E]++;
-#else
-      if (C[permutation[E]][i] && leftnodes[i] == CSTAR[permutation[E]][i])
-	      gain[E]++;
-#endif
-      else if (C[permutation[E]][i] && rightnodes[i] == 0) gain[E]--;
-    }
-  }
+  FindGains(left, partition, leftnodes, rightnodes);
   
   leftmax = 0;
   leftchoice = 0;
@@ -160,18 +287,7 @@ int GradientDescent(int left, int right, int partition)
   DBUG_EXECUTE("place", Fprintf(DBUG_FILE, "\n");   );
 
   /* find the right optimum */
-  for (E = partition+1; E <= right; E++) {
-    gain[E] = 0;
-    for (i = 1; i <= Nodes; i++) {
-#ifdef BAD
-      if (C[permutation[E]][i] && rightnodes[i] == 1) gain[E]++;
-#else
-      if (C[permutation[E]][i] && rightnodes[i] == CSTAR[permutation[E]][i])
-	      gain[E]++;
-#endif
-      else if (C[permutation[E]][i] && leftnodes[i] == 0) gain[E]--;
-    }
-  }
+  FindGains(partition+1, right, rightnodes, leftnodes);
   
   rightmax = 0;
   rightchoice = 0;
@@ -197,38 +313,34 @@ int GradientDescent(int left, int right, int partition)
   DBUG_PRINT("place",("Swapping %s and %s", 
 	     (InstanceNumber(curcell,permutation[leftchoice]))->instance,
 	     (InstanceNumber(curcell,permutation[rightchoice]))->instance));
-#ifdef BAD
-  tmp = permutation[leftchoice];
-  permutation[leftchoice] = permutation[rightchoice];
-  permutation[rightchoice] = tmp;
-  /* update node usage lists */
-  for (tmp = 1; tmp <= Nodes; tmp++) {
-    if (C[permutation[leftchoice]][tmp]) {
-      leftnodes[tmp] -= C[permutation[leftchoice]][tmp];
-      rightnodes[tmp] += C[permutation[leftchoice]][tmp];
-    }
-    if (C[permutation[rightchoice]][tmp]) {
-      leftnodes[tmp] += C[permutation[rightchoice]][tmp];
-      rightnodes[tmp] -= C[permutation[rightchoice]][tmp];
-    }
-  }
-#else
   /* update node usage lists, remembering that CSTAR goes into leftnodes */
-  for (tmp = 1; tmp <= Nodes; tmp++) {
-    if (CSTAR[permutation[leftchoice]][tmp]) {
-      leftnodes[tmp] -= CSTAR[permutation[leftchoice]][tmp];
-      rightnodes[tmp] += CSTAR[permutation[leftchoice]][tmp];
-    }
-    if (CSTAR[permutation[rightchoice]][tmp]) {
-      leftnodes[tmp] += CSTAR[permutation[rightchoice]][tmp];
-      rightnodes[tmp] -= CSTAR[permutation[rightchoice]][tmp];
-    }
-  }
+  SwapPartitionUsage(permutation[leftchoice], permutation[rightchoice]);
   /* THEN swap the elements */
   tmp = permutation[leftchoice];
   permutation[leftchoice] = permutation[rightchoice];
   permutation[rightchoice] = tmp;
-#endif
+  return(1);
+}
+
+static int CompareLeaves(const void *a, const void *b)
+/* order leaves by number */
+{
+  return(*(const int *)a - *(const int *)b);
+}
+
+static int ComparePositions(const void *a, const void *b)
+/* order leaves by their position in the permutation */
+{
+  return(position[*(const int *)a] - position[*(const int *)b]);
+}
+
+static int OnlyPorts(int E)
+/* returns 1 if all the nodes of E are ports of the cell */
+{
+  long k;
+
+  for (k = CRow[E]; k < CRow[E + 1]; k++)
+    if (CPin[k] && !PortNode[CNode[k]]) return(0);
   return(1);
 }
 
@@ -236,9 +348,7 @@ int GenerateGreedyPartition(int left, int right, int level)
 /* tries to find a balanced partition, as far as leaf cell usage */
 {
   int i;
-  int head, tail;
-  int queue[MAX_LEAVES + 1];
-  char status[MAX_LEAVES + 1];
+  int head, tail, next;
   int IncludedElements;
 
 #define QUEUED  1
@@ -251,22 +361,28 @@ for (i = left; i <= right; i++) Printf(" %d",permutation[i]);
 Printf("\n");
 #endif
 
-  memzero(status, sizeof(status));
-  for (i = left; i <= right; i++) status[permutation[i]] = OUTSIDE;
+  /* status is zero for every element outside (left..right) */
+  for (i = left; i <= right; i++) {
+    status[permutation[i]] = OUTSIDE;
+    position[permutation[i]] = i;
+  }
   head = 0;
   tail = 0;
+  next = left;
   IncludedElements = 0;
 
   while (IncludedElements <= (right - left) / 2) {
     int element;
+    int first, allports;
+    long k, m;
 
     element = level;  /* keep the compiler from bitching */
     if (head != tail) element = queue[head++];
     else {
       /* start from some random element */
-      for (i = left; i <= right; i++) {
-	if (status[permutation[i]] == OUTSIDE) {
-	  element = permutation[i];
+      for (; next <= right; next++) {
+	if (status[permutation[next]] == OUTSIDE) {
+	  element = permutation[next];
 	  break;
 	}
       }
@@ -274,26 +390,41 @@ Printf("\n");
     status[element] = INSIDE;
     IncludedElements++;
 
-    for (i = left; i <= right; i++) {
-      /* check to see if an element should be added to the queue */
-      if (status[permutation[i]] == QUEUED) continue;
-      if (status[permutation[i]] == INSIDE) continue;
-      /* otherwise, add it to the queue, if it has common nodes with element */
-      if (AnyCommonNodes(element, permutation[i])) {
-	status[permutation[i]] = QUEUED;
-	queue[tail++] = permutation[i];
+    /* add the elements that have common nodes with element to the queue,
+       in order of the permutation.  As in AnyCommonNodes(), ports of the
+       cell only count if they are all that either element connects to */
+    first = tail;
+    allports = OnlyPorts(element);
+    for (k = CRow[element]; k < CRow[element + 1]; k++) {
+      int node;
+
+      if (!CPin[k]) continue;
+      node = CNode[k];
+      if (PortNode[node] && !allports) continue;
+      for (m = NodeRow[node]; m < NodeRow[node + 1]; m++) {
+	int E;
+
+	E = NodeLeaf[m];
+	if (status[E] != OUTSIDE) continue;
+	if (allports && !OnlyPorts(E)) continue;
+	status[E] = QUEUED;
+	queue[tail++] = E;
       }
     }
+    qsort(queue + first, tail - first, sizeof(int), ComparePositions);
   }
   /* at this point, status contains the list of elements, classified
      as either INSIDE, OUTSIDE, or QUEUED.  It is now easy to generate
-     a permutation.
+     a permutation, taking the elements in order.
      */
+  for (i = left; i <= right; i++) queue[i - left] = permutation[i];
+  qsort(queue, right - left + 1, sizeof(int), CompareLeaves);
   head = left;
   tail = right;
-  for (i = 1; i <= Leaves; i++) {
-    if (status[i] == INSIDE) permutation[head++] = i;
-    else if (status[i] != 0) permutation[tail--] = i;
+  for (i = 0; i <= right - left; i++) {
+    if (status[queue[i]] == INSIDE) permutation[head++] = queue[i];
+    else permutation[tail--] = queue[i];
+    status[queue[i]] = 0;
   }
 
   return (left + IncludedElements - 1);
@@ -362,7 +493,7 @@ int GreedyPartition(int left, int right, int level)
 	    found = 1;
 
     if (!found || level > TopDownStartLevel - 2) {
-      for (i = MAX_TREE_DEPTH; i > level; i--) Fprintf(stdout, "   ");
+      for (i = TopDownStartLevel; i > level; i--) Fprintf(stdout, "   ");
       Fprintf(stdout,
     "Level: %d; L (%d leaves) fanout %d; R (%d leaves) fanout %d (<= %d) %s\n",
 	      level, (partition - left + 1), leftfanout, 
@@ -382,7 +513,7 @@ int GreedyPartition(int left, int right, int level)
       if (leftfanout <= TreeFanout[level] && rightfanout <= TreeFanout[level])
 	      found = 1;
 
-      for (i = MAX_TREE_DEPTH; i > level; i--) Fprintf(stdout, "   ");
+      for (i = TopDownStartLevel; i > level; i--) Fprintf(stdout, "   ");
       Fprintf(stdout,
 	      "       Iteration %2d: L fanout %d; R fanout %d (<= %d) %s\n",
 	      iterations, leftfanout, rightfanout, TreeFanout[level],
@@ -441,15 +572,24 @@ void TopDownEmbedCell(char *cellname, char *filename,
   tp = LookupCell(cellname);
   curcell = tp;
   if (!OpenEmbeddingFile(cellname, filename)) return;
+  if (EmbedCacheLookup(tp, strategy)) {
+    Printf("Using cached embedding of cell %s\n", cellname);
+    PrintEmbeddingTree(stdout,cellname,1);
+    PrintEmbeddingTree(outfile,cellname,1);
+    if (logging) PrintEmbeddingTree(logfile,cellname,1);
+    CloseEmbeddingFile();
+    return;
+  }
 	
   StartTime = CPUTime();
   if (!InitializeMatrices(cellname)) return;
+  if (!InitializePartition()) return;
   NewN = Elements;
   for (i = 1; i <= Leaves; i++) permutation[i] = i;
 
   RandomSeed(1);
   Found = 0;
-  TopDownStartLevel = MAX_TREE_DEPTH;
+  TopDownStartLevel = TreeDepth;
   switch (strategy) {
   case random_embedding:
     Found = RandomPartition(1, Leaves, TopDownStartLevel);
@@ -460,6 +600,9 @@ void TopDownEmbedCell(char *cellname, char *filename,
   case anneal:
     Found = AnnealPartition(1, Leaves, TopDownStartLevel);
     break;
+  case multilevel:
+    Found = MultilevelPartition(1, Leaves, TopDownStartLevel);
+    break;
   case bottomup:
     Fprintf(stderr,"ERROR: called TopDownEmbedCell with bottomup strategy\n");
     break;
@@ -478,6 +621,7 @@ void TopDownEmbedCell(char *cellname, char *filename,
 
     FreeEmbeddingTree((struct embed *)(tp->embedding));
     tp->embedding = EmbeddingTree(tp, Found);
+    EmbedCacheStore(tp, strategy);
     PrintEmbeddingTree(stdout,cellname,1);
     PrintEmbeddingTree(outfile,cellname,1);
     if (logging) PrintEmbeddingTree(logfile,cellname,1);
@@ -0,0 +1,768 @@
+/* "NETGEN", a netlist-specification tool for VLSI
+   Copyright (C) 1989, 1990   Massimo A. Sivilotti
+   Author's address: mass@csvax.cs.caltech.edu;
+                     Caltech 256-80, Pasadena CA 91125.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation (any version).
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file copying.  If not, write to
+the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* multilevel.c -- multilevel Fiduccia-Mattheyses graph partitioning for
+                   embedding netlists on hierarchical prototyping chip.
+
+   Each bisection coarsens the leaves of the partition by heavy edge
+   matching, splits the coarsest graph by growing regions, then projects
+   the split back one level at a time, refining it at every level with
+   Fiduccia-Mattheyses passes over gain buckets.  The cost minimized is
+   the number of nodes used by both halves, which is what drives the
+   fanout of each half.
+*/
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef TCL_NETGEN
+#include <tcl.h>
+#endif
+
+#include "netgen.h"
+#include "hash.h"
+#include "objlist.h"
+#include "embed.h"
+#include "print.h"
+#include "dbug.h"
+
+#define ML_COARSEST 40		/* stop coarsening at this many cells */
+#define ML_IMBALANCE 10		/* percent by which a half may exceed 1/2 */
+#define ML_LARGE_NET 32		/* larger nets are ignored when clustering */
+#define ML_TRIES 4		/* initial partitions of the coarsest graph */
+#define ML_PASSES 8		/* most refinement passes at each level */
+
+#define MAX_PARTITION_ITERATIONS 10
+
+/* a hypergraph of cells joined by nets, both numbered from 0 */
+struct mlgraph {
+  int cells;
+  int nets;
+  int maxweight;	/* heaviest cell */
+  int *weight;		/* leaves in each cell */
+  int *cellrow;		/* nets of cell c: cellnet[cellrow[c]..cellrow[c+1]-1] */
+  int *cellnet;
+  int *netrow;		/* cells of net n: netcell[netrow[n]..netrow[n+1]-1] */
+  int *netcell;
+  int *map;		/* cell of the coarser graph containing each cell */
+  struct mlgraph *coarser;
+};
+
+/* state of Fiduccia-Mattheyses refinement of one graph */
+struct fm {
+  struct mlgraph *g;
+  int *side;		/* 0 or 1 for each cell */
+  int weight[2];	/* leaves on each side */
+  int cut;		/* nets with cells on both sides */
+  int *count;		/* cells of net n on side s: count[2 * n + s] */
+  int *gain;		/* decrease in cut from moving each cell */
+  int *next, *prev;	/* gain bucket lists */
+  int *head;		/* first cell in bucket b of side s: head[s*buckets+b] */
+  int top[2];		/* highest bucket of each side that may be in use */
+  int buckets;
+  int maxdegree;
+  char *locked;
+  int *moves;
+};
+
+/* node number to net number + 1 in the graph being built */
+static int *netindex;
+static int netindexsize;
+
+static void FreeGraphs(struct mlgraph *g)
+{
+  struct mlgraph *coarser;
+
+  while (g != NULL) {
+    coarser = g->coarser;
+    if (g->weight != NULL) FREE(g->weight);
+    if (g->cellrow != NULL) FREE(g->cellrow);
+    if (g->cellnet != NULL) FREE(g->cellnet);
+    if (g->netrow != NULL) FREE(g->netrow);
+    if (g->netcell != NULL) FREE(g->netcell);
+    if (g->map != NULL) FREE(g->map);
+    FREE(g);
+    g = coarser;
+  }
+}
+
+static struct mlgraph *AllocGraph(int cells, int nets, int pins)
+{
+  struct mlgraph *g;
+
+  g = (struct mlgraph *)CALLOC(1, sizeof(struct mlgraph));
+  if (g == NULL) return(NULL);
+  g->cells = cells;
+  g->nets = nets;
+  g->weight = (int *)CALLOC(cells + 1, sizeof(int));
+  g->cellrow = (int *)CALLOC(cells + 1, sizeof(int));
+  g->cellnet = (int *)CALLOC(pins + 1, sizeof(int));
+  g->netrow = (int *)CALLOC(nets + 1, sizeof(int));
+  g->netcell = (int *)CALLOC(pins + 1, sizeof(int));
+  g->map = (int *)CALLOC(cells + 1, sizeof(int));
+  if (g->weight == NULL || g->cellrow == NULL || g->cellnet == NULL ||
+	g->netrow == NULL || g->netcell == NULL || g->map == NULL) {
+    FreeGraphs(g);
+    return(NULL);
+  }
+  return(g);
+}
+
+static void Transpose(int rows, int *row, int *col, int cols,
+		      int *trow, int *tcol)
+/* set (trow, tcol) to the transpose of the sparse matrix (row, col) */
+{
+  int i, j;
+
+  for (j = 0; j <= cols; j++) trow[j] = 0;
+  for (i = 0; i < rows; i++)
+    for (j = row[i]; j < row[i + 1]; j++) trow[col[j] + 1]++;
+  for (j = 0; j < cols; j++) trow[j + 1] += trow[j];
+  /* trow[j] is advanced past column j as it is filled ... */
+  for (i = 0; i < rows; i++)
+    for (j = row[i]; j < row[i + 1]; j++) tcol[trow[col[j]]++] = i;
+  /* ... so shift it back */
+  for (j = cols; j > 0; j--) trow[j] = trow[j - 1];
+  trow[0] = 0;
+}
+
+static struct mlgraph *LeafGraph(int left, int right)
+/* return the graph of leaves permutation[left..right] */
+{
+  struct mlgraph *g;
+  int *touched;
+  int c, i, E, node, nets, pins, used;
+  long k;
+
+  if (netindexsize < Nodes + 1) {
+    if (netindex != NULL) FREE(netindex);
+    netindexsize = 0;
+    netindex = (int *)CALLOC(Nodes + 1, sizeof(int));
+    if (netindex == NULL) return(NULL);
+    netindexsize = Nodes + 1;
+  }
+
+  pins = 0;
+  for (c = left; c <= right; c++)
+    pins += CRow[permutation[c] + 1] - CRow[permutation[c]];
+  touched = (int *)CALLOC(pins + 1, sizeof(int));
+  if (touched == NULL) return(NULL);
+
+  /* count the leaves on each node */
+  used = 0;
+  for (c = left; c <= right; c++) {
+    E = permutation[c];
+    for (k = CRow[E]; k < CRow[E + 1]; k++)
+      if (netindex[CNode[k]]++ == 0) touched[used++] = CNode[k];
+  }
+
+  /* a node on fewer than two of the leaves can never be cut */
+  nets = 0;
+  pins = 0;
+  for (i = 0; i < used; i++) {
+    node = touched[i];
+    if (netindex[node] >= 2) {
+      pins += netindex[node];
+      netindex[node] = ++nets;
+    }
+    else netindex[node] = 0;
+  }
+
+  g = AllocGraph(right - left + 1, nets, pins);
+  if (g != NULL) {
+    pins = 0;
+    for (c = 0; c < g->cells; c++) {
+      E = permutation[left + c];
+      g->weight[c] = 1;
+      g->cellrow[c] = pins;
+      for (k = CRow[E]; k < CRow[E + 1]; k++)
+	if (netindex[CNode[k]]) g->cellnet[pins++] = netindex[CNode[k]] - 1;
+    }
+    g->cellrow[g->cells] = pins;
+    g->maxweight = 1;
+    Transpose(g->cells, g->cellrow, g->cellnet, nets, g->netrow, g->netcell);
+  }
+
+  for (i = 0; i < used; i++) netindex[touched[i]] = 0;
+  FREE(touched);
+  return(g);
+}
+
+static struct mlgraph *Coarsen(struct mlgraph *g, int maxweight)
+/* return a graph with about half the cells of g, joining pairs of cells
+   with heavy edge matching, or NULL if g does not shrink enough */
+{
+  struct mlgraph *cg;
+  int *order, *touched, *mark;
+  float *score;
+  int i, j, m, n, u, v, best, count, cells, nets, pins, first;
+
+  order = (int *)CALLOC(g->cells, sizeof(int));
+  touched = (int *)CALLOC(g->cells, sizeof(int));
+  score = (float *)CALLOC(g->cells, sizeof(float));
+  if (order == NULL || touched == NULL || score == NULL) {
+    if (order != NULL) FREE(order);
+    if (touched != NULL) FREE(touched);
+    if (score != NULL) FREE(score);
+    return(NULL);
+  }
+
+  /* visit the cells in random order */
+  for (i = 0; i < g->cells; i++) {
+    order[i] = i;
+    g->map[i] = -1;
+  }
+  for (i = g->cells - 1; i > 0; i--) {
+    j = Random(i + 1);
+    u = order[i];
+    order[i] = order[j];
+    order[j] = u;
+  }
+
+  cells = 0;
+  for (i = 0; i < g->cells; i++) {
+    u = order[i];
+    if (g->map[u] >= 0) continue;
+
+    /* score the free neighbours of u by the nets they share */
+    count = 0;
+    for (j = g->cellrow[u]; j < g->cellrow[u + 1]; j++) {
+      n = g->cellnet[j];
+      if (g->netrow[n + 1] - g->netrow[n] > ML_LARGE_NET) continue;
+      for (m = g->netrow[n]; m < g->netrow[n + 1]; m++) {
+	v = g->netcell[m];
+	if (v == u || g->map[v] >= 0 ||
+	    g->weight[u] + g->weight[v] > maxweight) continue;
+	if (score[v] == 0) touched[count++] = v;
+	score[v] += 1.0 / (g->netrow[n + 1] - g->netrow[n] - 1);
+      }
+    }
+
+    best = -1;
+    for (j = 0; j < count; j++) {
+      v = touched[j];
+      if (best < 0 || score[v] > score[best] || (score[v] == score[best] &&
+	  g->weight[v] < g->weight[best])) best = v;
+    }
+    for (j = 0; j < count; j++) score[touched[j]] = 0;
+
+    g->map[u] = cells;
+    if (best >= 0) g->map[best] = cells;
+    cells++;
+  }
+  FREE(order);
+  FREE(touched);
+  FREE(score);
+  if (cells * 10 > g->cells * 9) return(NULL);
+
+  mark = (int *)CALLOC(cells, sizeof(int));
+  if (mark == NULL) return(NULL);
+
+  /* count the nets that still join two or more cells */
+  for (i = 0; i < cells; i++) mark[i] = -1;
+  nets = 0;
+  pins = 0;
+  for (n = 0; n < g->nets; n++) {
+    count = 0;
+    for (m = g->netrow[n]; m < g->netrow[n + 1]; m++) {
+      v = g->map[g->netcell[m]];
+      if (mark[v] != n) {
+	mark[v] = n;
+	count++;
+      }
+    }
+    if (count >= 2) {
+      nets++;
+      pins += count;
+    }
+  }
+
+  cg = AllocGraph(cells, nets, pins);
+  if (cg == NULL) {
+    FREE(mark);
+    return(NULL);
+  }
+  for (i = 0; i < cells; i++) mark[i] = -1;
+  nets = 0;
+  pins = 0;
+  for (n = 0; n < g->nets; n++) {
+    first = pins;
+    for (m = g->netrow[n]; m < g->netrow[n + 1]; m++) {
+      v = g->map[g->netcell[m]];
+      if (mark[v] != n) {
+	mark[v] = n;
+	cg->netcell[pins++] = v;
+      }
+    }
+    if (pins - first >= 2) cg->netrow[++nets] = pins;
+    else pins = first;
+  }
+  FREE(mark);
+
+  for (i = 0; i < g->cells; i++) cg->weight[g->map[i]] += g->weight[i];
+  for (i = 0; i < cells; i++)
+    if (cg->weight[i] > cg->maxweight) cg->maxweight = cg->weight[i];
+  Transpose(nets, cg->netrow, cg->netcell, cells, cg->cellrow, cg->cellnet);
+  return(cg);
+}
+
+
+static void FMFree(struct fm *f)
+{
+  if (f->count != NULL) FREE(f->count);
+  if (f->gain != NULL) FREE(f->gain);
+  if (f->next != NULL) FREE(f->next);
+  if (f->prev != NULL) FREE(f->prev);
+  if (f->head != NULL) FREE(f->head);
+  if (f->locked != NULL) FREE(f->locked);
+  if (f->moves != NULL) FREE(f->moves);
+}
+
+static int FMAlloc(struct fm *f, struct mlgraph *g, int *side)
+/* return 1 if OK */
+{
+  int c;
+
+  f->g = g;
+  f->side = side;
+  f->maxdegree = 0;
+  for (c = 0; c < g->cells; c++)
+    if (g->cellrow[c + 1] - g->cellrow[c] > f->maxdegree)
+      f->maxdegree = g->cellrow[c + 1] - g->cellrow[c];
+  f->buckets = 2 * f->maxdegree + 1;
+  f->count = (int *)CALLOC(2 * g->nets + 1, sizeof(int));
+  f->gain = (int *)CALLOC(g->cells + 1, sizeof(int));
+  f->next = (int *)CALLOC(g->cells + 1, sizeof(int));
+  f->prev = (int *)CALLOC(g->cells + 1, sizeof(int));
+  f->head = (int *)CALLOC(2 * f->buckets, sizeof(int));
+  f->locked = (char *)CALLOC(g->cells + 1, sizeof(char));
+  f->moves = (int *)CALLOC(g->cells + 1, sizeof(int));
+  if (f->count == NULL || f->gain == NULL || f->next == NULL ||
+	f->prev == NULL || f->head == NULL || f->locked == NULL ||
+	f->moves == NULL) {
+    FMFree(f);
+    return(0);
+  }
+  return(1);
+}
+
+static void BucketInsert(struct fm *f, int c)
+{
+  int s, b, *head;
+
+  s = f->side[c];
+  b = f->gain[c] + f->maxdegree;
+  head = f->head + s * f->buckets + b;
+  f->prev[c] = -1;
+  f->next[c] = *head;
+  if (*head >= 0) f->prev[*head] = c;
+  *head = c;
+  if (b > f->top[s]) f->top[s] = b;
+}
+
+static void BucketRemove(struct fm *f, int c)
+{
+  int s, b;
+
+  s = f->side[c];
+  b = f->gain[c] + f->maxdegree;
+  if (f->prev[c] >= 0) f->next[f->prev[c]] = f->next[c];
+  else f->head[s * f->buckets + b] = f->next[c];
+  if (f->next[c] >= 0) f->prev[f->next[c]] = f->prev[c];
+}
+
+static void AdjustGain(struct fm *f, int c, int delta)
+{
+  if (f->locked[c]) return;
+  BucketRemove(f, c);
+  f->gain[c] += delta;
+  BucketInsert(f, c);
+}
+
+static void FMSetup(struct fm *f)
+/* compute the side weights, net counts, cut and gains of f->side,
+   and put every cell in its gain bucket */
+{
+  struct mlgraph *g;
+  int c, j, n, s;
+
+  g = f->g;
+  f->weight[0] = f->weight[1] = 0;
+  for (n = 0; n < 2 * g->nets; n++) f->count[n] = 0;
+  for (c = 0; c < g->cells; c++) {
+    f->weight[f->side[c]] += g->weight[c];
+    for (j = g->cellrow[c]; j < g->cellrow[c + 1]; j++)
+      f->count[2 * g->cellnet[j] + f->side[c]]++;
+  }
+  f->cut = 0;
+  for (n = 0; n < g->nets; n++)
+    if (f->count[2 * n] && f->count[2 * n + 1]) f->cut++;
+
+  for (j = 0; j < 2 * f->buckets; j++) f->head[j] = -1;
+  f->top[0] = f->top[1] = -1;
+  for (c = 0; c < g->cells; c++) {
+    s = f->side[c];
+    f->locked[c] = 0;
+    f->gain[c] = 0;
+    for (j = g->cellrow[c]; j < g->cellrow[c + 1]; j++) {
+      n = g->cellnet[j];
+      if (f->count[2 * n + s] == 1) f->gain[c]++;
+      if (f->count[2 * n + 1 - s] == 0) f->gain[c]--;
+    }
+    BucketInsert(f, c);
+  }
+}
+
+static int FMBest(struct fm *f, int s)
+/* return a free cell of highest gain on side s, or -1 */
+{
+  while (f->top[s] >= 0 && f->head[s * f->buckets + f->top[s]] < 0)
+    f->top[s]--;
+  if (f->top[s] < 0) return(-1);
+  return(f->head[s * f->buckets + f->top[s]]);
+}
+
+static void FMMove(struct fm *f, int c)
+/* move cell c to the other side and lock it, updating the gains of
+   the free cells on its nets */
+{
+  struct mlgraph *g;
+  int from, to, j, m, n, v;
+
+  g = f->g;
+  from = f->side[c];
+  to = 1 - from;
+  BucketRemove(f, c);
+  f->locked[c] = 1;
+  f->side[c] = to;
+  f->weight[from] -= g->weight[c];
+  f->weight[to] += g->weight[c];
+
+  for (j = g->cellrow[c]; j < g->cellrow[c + 1]; j++) {
+    n = g->cellnet[j];
+    /* net becomes cut:  moving any other cell over no longer uncuts it */
+    if (f->count[2 * n + to] == 0) {
+      for (m = g->netrow[n]; m < g->netrow[n + 1]; m++)
+	AdjustGain(f, g->netcell[m], 1);
+    }
+    else if (f->count[2 * n + to] == 1) {
+      for (m = g->netrow[n]; m < g->netrow[n + 1]; m++) {
+	v = g->netcell[m];
+	if (v != c && f->side[v] == to) {
+	  AdjustGain(f, v, -1);
+	  break;
+	}
+      }
+    }
+    f->count[2 * n + from]--;
+    f->count[2 * n + to]++;
+    /* net becomes uncut, or only one cell holds it on the old side */
+    if (f->count[2 * n + from] == 0) {
+      for (m = g->netrow[n]; m < g->netrow[n + 1]; m++)
+	AdjustGain(f, g->netcell[m], -1);
+    }
+    else if (f->count[2 * n + from] == 1) {
+      for (m = g->netrow[n]; m < g->netrow[n + 1]; m++) {
+	v = g->netcell[m];
+	if (f->side[v] == from) {
+	  AdjustGain(f, v, 1);
+	  break;
+	}
+      }
+    }
+  }
+}
+
+static void FMRebalance(struct fm *f, int maxside)
+/* move the best cells off a side heavier than maxside */
+{
+  int s, c;
+
+  FMSetup(f);
+  for (s = 0; s < 2; s++)
+    while (f->weight[s] > maxside && (c = FMBest(f, s)) >= 0) FMMove(f, c);
+}
+
+static void FMRefine(struct fm *f, int maxside)
+/* improve the partition with passes of single cell moves, each pass
+   keeping its best prefix in which both sides weigh at most maxside */
+{
+  struct mlgraph *g;
+  int pass, moved, bestmoves, total, bestgain, limit;
+  int c, c0, c1;
+
+  g = f->g;
+  /* a pass may overshoot by one cell, to let cells trade sides */
+  limit = maxside + g->maxweight;
+  for (pass = 0; pass < ML_PASSES; pass++) {
+    FMSetup(f);
+    moved = bestmoves = 0;
+    total = bestgain = 0;
+    for (;;) {
+      c0 = FMBest(f, 0);
+      if (c0 >= 0 && f->weight[1] + g->weight[c0] > limit) c0 = -1;
+      c1 = FMBest(f, 1);
+      if (c1 >= 0 && f->weight[0] + g->weight[c1] > limit) c1 = -1;
+      if (c0 < 0 && c1 < 0) break;
+
+      if (c0 < 0) c = c1;
+      else if (c1 < 0) c = c0;
+      else if (f->gain[c0] != f->gain[c1])
+	c = (f->gain[c0] > f->gain[c1]) ? c0 : c1;
+      else c = (f->weight[0] >= f->weight[1]) ? c0 : c1;
+
+      total += f->gain[c];
+      FMMove(f, c);
+      f->moves[moved++] = c;
+      if (total > bestgain && f->weight[0] <= maxside &&
+	  f->weight[1] <= maxside) {
+	bestgain = total;
+	bestmoves = moved;
+      }
+    }
+    /* undo the moves made after the best point of the pass */
+    while (moved > bestmoves) {
+      c = f->moves[--moved];
+      f->side[c] = 1 - f->side[c];
+    }
+    if (bestgain <= 0) break;
+  }
+  FMSetup(f);
+}
+
+static void GrowPartition(struct fm *f, int maxside)
+/* put about half of the cells on side 0, growing regions of connected
+   cells from random starting points */
+{
+  struct mlgraph *g;
+  int *queue;
+  char *queued;
+  int c, i, j, m, n, start, scan, head, tail, total, weight;
+
+  g = f->g;
+  /* the refinement scratch space is free at this point */
+  queue = f->moves;
+  queued = f->locked;
+  total = 0;
+  for (c = 0; c < g->cells; c++) {
+    f->side[c] = 1;
+    queued[c] = 0;
+    total += g->weight[c];
+  }
+
+  start = Random(g->cells);
+  scan = 0;
+  head = tail = 0;
+  weight = 0;
+  while (weight < total / 2) {
+    if (head == tail) {
+      /* start a new region */
+      for (; scan < g->cells && queued[(start + scan) % g->cells]; scan++) ;
+      if (scan == g->cells) break;
+      c = (start + scan) % g->cells;
+      queued[c] = 1;
+      queue[tail++] = c;
+    }
+    c = queue[head++];
+    if (weight + g->weight[c] > maxside) continue;
+    f->side[c] = 0;
+    weight += g->weight[c];
+    for (j = g->cellrow[c]; j < g->cellrow[c + 1]; j++) {
+      n = g->cellnet[j];
+      if (g->netrow[n + 1] - g->netrow[n] > ML_LARGE_NET) continue;
+      for (m = g->netrow[n]; m < g->netrow[n + 1]; m++) {
+	i = g->netcell[m];
+	if (!queued[i]) {
+	  queued[i] = 1;
+	  queue[tail++] = i;
+	}
+      }
+    }
+  }
+}
+
+static int Bisect(struct mlgraph *g, int *side, int maxside, int hardside)
+/* split g into side[], refining the split of the next coarser graph;
+   no side of g may weigh more than hardside, nor of any coarser graph
+   more than maxside.  Return 1 if OK */
+{
+  struct fm f;
+  int *coarseside, *bestside;
+  int c, try, bestcut;
+
+  if (g->coarser != NULL) {
+    coarseside = (int *)CALLOC(g->coarser->cells, sizeof(int));
+    if (coarseside == NULL) return(0);
+    if (!Bisect(g->coarser, coarseside, maxside, maxside)) {
+      FREE(coarseside);
+      return(0);
+    }
+    for (c = 0; c < g->cells; c++) side[c] = coarseside[g->map[c]];
+    FREE(coarseside);
+    if (!FMAlloc(&f, g, side)) return(0);
+  }
+  else {
+    /* keep the best of several initial partitions */
+    bestside = (int *)CALLOC(g->cells, sizeof(int));
+    if (bestside == NULL) return(0);
+    if (!FMAlloc(&f, g, side)) {
+      FREE(bestside);
+      return(0);
+    }
+    bestcut = -1;
+    for (try = 0; try < ML_TRIES; try++) {
+      GrowPartition(&f, maxside);
+      FMRebalance(&f, maxside);
+      FMRefine(&f, maxside);
+      if (bestcut < 0 || f.cut < bestcut) {
+	bestcut = f.cut;
+	for (c = 0; c < g->cells; c++) bestside[c] = side[c];
+      }
+    }
+    for (c = 0; c < g->cells; c++) side[c] = bestside[c];
+    FREE(bestside);
+  }
+  FMRebalance(&f, hardside);
+  FMRefine(&f, hardside);
+  FMFree(&f);
+  return(1);
+}
+
+int GenerateMultilevelPartition(int left, int right, int level)
+/* split permutation[left..right] into (left..partition) and
+   (partition+1..right), returning partition, or 0 if none is possible */
+{
+  struct mlgraph *graph, *g, *cg;
+  int *side, *leaves;
+  int n, c, i, partition, maxside, hardside, maxweight;
+
+  n = right - left + 1;
+  /* each half may hold a little more than half of the leaves,
+     but no more than a tree of depth level - 1 */
+  maxside = MIN(n / 2 + MAX(1, n * ML_IMBALANCE / 100), n - 1);
+  hardside = MIN(maxside, POW2(level - 1));
+  if (n - hardside > hardside) return(0);
+  /* keep clusters light enough to balance the halves */
+  maxweight = MAX(1, MIN(maxside - n / 2, 3 * n / (2 * ML_COARSEST)));
+
+  graph = LeafGraph(left, right);
+  side = (int *)CALLOC(n, sizeof(int));
+  leaves = (int *)CALLOC(n, sizeof(int));
+  if (graph == NULL || side == NULL || leaves == NULL) goto nomemory;
+  for (g = graph; g->cells > ML_COARSEST &&
+	 (cg = Coarsen(g, maxweight)) != NULL; g = cg)
+    g->coarser = cg;
+  if (!Bisect(graph, side, maxside, hardside)) goto nomemory;
+
+  /* leaves on side 0 go to the left, keeping their order */
+  for (c = 0; c < n; c++) leaves[c] = permutation[left + c];
+  i = left;
+  for (c = 0; c < n; c++)
+    if (side[c] == 0) permutation[i++] = leaves[c];
+  partition = i - 1;
+  for (c = 0; c < n; c++)
+    if (side[c] == 1) permutation[i++] = leaves[c];
+
+  FreeGraphs(graph);
+  FREE(side);
+  FREE(leaves);
+  return(partition);
+
+ nomemory:
+  Fprintf(stderr,"Not enough memory to partition %d leaves\n",n);
+  if (graph != NULL) FreeGraphs(graph);
+  if (side != NULL) FREE(side);
+  if (leaves != NULL) FREE(leaves);
+  return(0);
+}
+
+int MultilevelPartition(int left, int right, int level)
+/* return index of new element, if successful partition has been found */
+{
+  int partition;
+  int iterations;
+  int found;
+  int OriginalNewN;
+  int leftelement, rightelement;
+
+  DBUG_ENTER("MultilevelPartition");
+  OriginalNewN = NewN;
+  if (level < LEVEL(permutation[left])) {
+    Fprintf(stdout,"Failed at level %d; subtree too deep\n",level);
+    DBUG_RETURN(0);
+  }
+
+  if (left == right) DBUG_RETURN(permutation[left]);
+
+  if (level < 1) {
+    Fprintf(stdout,"Failed at level %d; too many leaves\n",level);
+    DBUG_RETURN(0);
+  }
+
+  /* each try coarsens and splits from different random choices */
+  iterations = 0;
+  do {
+    int i;
+    int leftfanout, rightfanout;
+
+    iterations++;
+    partition = GenerateMultilevelPartition(left, right, level);
+    if (partition == 0) DBUG_RETURN(0); /* no valid partition */
+
+    found = 0;
+    leftfanout = PartitionFanout(left,partition,LEFT);
+    rightfanout = PartitionFanout(partition+1, right, RIGHT);
+    if (leftfanout <= TreeFanout[level] && rightfanout <= TreeFanout[level])
+	    found = 1;
+
+    if (!found || level > TopDownStartLevel - 2) {
+      for (i = TopDownStartLevel; i > level; i--) Fprintf(stdout, "   ");
+      Fprintf(stdout,
+    "Level: %d; L (%d leaves) fanout %d; R (%d leaves) fanout %d (<= %d) %s\n",
+	      level, (partition - left + 1), leftfanout,
+	      (right - partition), rightfanout, TreeFanout[level],
+	      found ? "SUCCESSFUL" : "UNSUCCESSFUL");
+    }
+
+    DBUG_EXECUTE("place",
+		 Fprintf(DBUG_FILE,"Level %d: ",level);
+		 Dbug_print_cells(left,partition);
+		 Dbug_print_cells(partition+1,right);
+		 Fprintf(DBUG_FILE,"\n");
+		 Fprintf(DBUG_FILE, "%s\n", found?"SUCCESSFUL":"UNSUCCESSFUL");
+		 );
+  } while (iterations < MAX_PARTITION_ITERATIONS && !found);
+  if (!found) {
+    Fprintf(stdout,"Failed embedding at level %d; no partition\n",level);
+    goto fail;
+  }
+
+  leftelement = MultilevelPartition(left, partition, level-1);
+  if (leftelement == 0) goto fail;
+  rightelement = MultilevelPartition(partition+1, right, level-1);
+  if (rightelement == 0) goto fail;
+
+  /* add it to the list */
+  AddNewElement(leftelement, rightelement);
+  DBUG_RETURN(NewN);
+
+ fail:
+  NewN = OriginalNewN;
+  DBUG_RETURN(0);
+}
@@ -21,6 +21,7 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include "config.h"
 
 #include <stdio.h>
+#include <ctype.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <time.h>    /* for time() as a seed for random number generator */
@@ -45,6 +46,7 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include "netfile.h"
 #include "print.h"
 #include "dbug.h"
+#include "timing.h"
 
 #ifdef TCL_NETGEN
 int InterruptPending = 0;
@@ -129,9 +131,22 @@ struct Correspond {
 	struct Correspond *next;
 };
 
+/* Class correspondences are also binned by (case-folded) class name,	*/
+/* so that LookupPrematchedClass() need only check records naming the	*/
+/* cell in question.  Each bin lists the most recent record first, the	*/
+/* same order as ClassCorrespondence.					*/
+
+struct CorrespondLink {
+	struct Correspond *crec;
+	struct CorrespondLink *next;
+};
+
+#define CORRESPONDHASHSIZE 997
+
 struct ElementClass *ElementClasses = NULL;
 struct NodeClass *NodeClasses = NULL;
 struct Correspond *ClassCorrespondence = NULL;
+static struct CorrespondLink *CorrespondTable[CORRESPONDHASHSIZE];
 struct Correspond *CompareQueue = NULL;
 struct IgnoreList *ClassIgnore = NULL;
 
@@ -1492,6 +1507,407 @@ Tcl_Obj *ListNodeClasses(int legal)
 
 #endif
 
+#ifdef TCL_NETGEN
+
+/*----------------------------------------------------------------------*/
+/* JSON report.  While a report file is open, the "-list" output of	*/
+/* compare, verify, equate pins, and the property check is written	*/
+/* straight to the file instead of being appended to the Tcl variable	*/
+/* "lvs_out", in the same format that netgen::convert_to_json writes.	*/
+/* The file holds an array with one object per cell pair compared.	*/
+/* Each object is started by the first key written for the pair and	*/
+/* ended by ReportNextCell().  Separators are written ahead of each	*/
+/* item, so nothing needs to be known about what follows.		*/
+/*----------------------------------------------------------------------*/
+
+static FILE *ReportFile = NULL;
+static int ReportCells = 0;	/* Number of objects started */
+static int ReportKeys = -1;	/* Keys in the current object, -1 if none */
+
+/* Pairs of names and counts collected for the two circuits side by	*/
+/* side, and written one circuit after the other.			*/
+
+struct ReportPair {
+   char *name1;
+   char *name2;
+   int count1;
+   int count2;
+};
+
+static struct ReportPair *ReportPairs = NULL;
+static int ReportNumPairs = 0;
+static int ReportMaxPairs = 0;
+
+int ReportOpen(char *filename)
+{
+  ReportClose();
+  ReportFile = fopen(filename, "w");
+  if (ReportFile == NULL) return 0;
+
+  ReportCells = 0;
+  ReportKeys = -1;
+  fprintf(ReportFile, "[\n");
+  return 1;
+}
+
+void ReportNextCell(void)
+{
+  if ((ReportFile == NULL) || (ReportKeys < 0)) return;
+  fprintf(ReportFile, "%s  }", (ReportKeys > 0) ? "\n" : "");
+  ReportKeys = -1;
+}
+
+void ReportClose(void)
+{
+  if (ReportFile == NULL) return;
+  ReportNextCell();
+  fprintf(ReportFile, "%s]\n", (ReportCells > 0) ? "\n" : "");
+  fclose(ReportFile);
+  ReportFile = NULL;
+}
+
+int ReportActive(void)
+{
+  return (ReportFile != NULL);
+}
+
+/* Start the value of "key", starting a new object if needed */
+
+static void ReportKey(char *key)
+{
+  if (ReportKeys < 0) {
+     fprintf(ReportFile, "%s  {\n", (ReportCells > 0) ? ",\n" : "");
+     ReportCells++;
+     ReportKeys = 0;
+  }
+  else if (ReportKeys > 0)
+     fprintf(ReportFile, ",\n");
+  ReportKeys++;
+
+  fprintf(ReportFile, "   ");
+  WriteJSONString(ReportFile, key);
+  fprintf(ReportFile, ": [\n");
+}
+
+static void ReportAddPair(char *name1, int count1, char *name2, int count2)
+{
+  struct ReportPair *newpairs;
+
+  if (ReportNumPairs == ReportMaxPairs) {
+     ReportMaxPairs = (ReportMaxPairs == 0) ? 32 : (ReportMaxPairs << 1);
+     newpairs = (struct ReportPair *)MALLOC(ReportMaxPairs *
+		sizeof(struct ReportPair));
+     if (ReportNumPairs > 0)
+        memcpy(newpairs, ReportPairs, ReportNumPairs *
+		sizeof(struct ReportPair));
+     if (ReportPairs != NULL) FREE(ReportPairs);
+     ReportPairs = newpairs;
+  }
+  ReportPairs[ReportNumPairs].name1 = strsave(name1);
+  ReportPairs[ReportNumPairs].name2 = strsave(name2);
+  ReportPairs[ReportNumPairs].count1 = count1;
+  ReportPairs[ReportNumPairs].count2 = count2;
+  ReportNumPairs++;
+}
+
+static void ReportFreePairs(void)
+{
+  int i;
+
+  for (i = 0; i < ReportNumPairs; i++) {
+     FREE(ReportPairs[i].name1);
+     FREE(ReportPairs[i].name2);
+  }
+  ReportNumPairs = 0;
+}
+
+/* Write the collected pairs as "devices", a list of {name, count} for	*/
+/* each circuit.  An empty circuit gets a placeholder entry, as it	*/
+/* does from netgen::convert_to_json.					*/
+
+static void ReportDevices(void)
+{
+  int i, last;
+
+  ReportKey("devices");
+  fprintf(ReportFile, "       [\n");
+  if (ReportNumPairs == 0) fprintf(ReportFile, "         [\"\", 0 ]\n");
+  for (i = 0; i < ReportNumPairs; i++) {
+     last = (i == ReportNumPairs - 1);
+     fprintf(ReportFile, "         [");
+     WriteJSONString(ReportFile, ReportPairs[i].name1);
+     fprintf(ReportFile, ", %d%s]%s\n", ReportPairs[i].count1,
+		(last) ? " " : "", (last) ? "" : ",");
+  }
+  fprintf(ReportFile, "       ], [\n");
+  if (ReportNumPairs == 0) fprintf(ReportFile, "         [\"\", 0 ]\n");
+  for (i = 0; i < ReportNumPairs; i++) {
+     last = (i == ReportNumPairs - 1);
+     fprintf(ReportFile, "         [");
+     WriteJSONString(ReportFile, ReportPairs[i].name2);
+     fprintf(ReportFile, ", %d ]%s\n", ReportPairs[i].count2,
+		(last) ? "" : ",");
+  }
+  fprintf(ReportFile, "       ]\n   ]");
+  ReportFreePairs();
+}
+
+/* Write the collected pairs as "pins", a list of names per circuit */
+
+static void ReportPins(void)
+{
+  int i;
+
+  ReportKey("pins");
+  fprintf(ReportFile, "      [\n");
+  if (ReportNumPairs == 0) fprintf(ReportFile, "        \"\"");
+  for (i = 0; i < ReportNumPairs; i++) {
+     fprintf(ReportFile, "%s        ", (i > 0) ? ",\n" : "");
+     WriteJSONString(ReportFile, ReportPairs[i].name1);
+  }
+  fprintf(ReportFile, "\n      ], [\n");
+  if (ReportNumPairs == 0) fprintf(ReportFile, "        \"\"");
+  for (i = 0; i < ReportNumPairs; i++) {
+     fprintf(ReportFile, "%s        ", (i > 0) ? ",\n" : "");
+     WriteJSONString(ReportFile, ReportPairs[i].name2);
+  }
+  fprintf(ReportFile, "\n      ]\n   ]");
+  ReportFreePairs();
+}
+
+static void ReportNames(char *name1, char *name2)
+{
+  ReportKey("name");
+  fprintf(ReportFile, "      ");
+  WriteJSONString(ReportFile, name1);
+  fprintf(ReportFile, ",\n      ");
+  WriteJSONString(ReportFile, name2);
+  fprintf(ReportFile, "\n   ]");
+}
+
+static void ReportNets(int count1, int count2)
+{
+  ReportKey("nets");
+  fprintf(ReportFile, "    %d,\n    %d\n   ]", count1, count2);
+}
+
+/* Write the nets of one circuit in a node class group, padded to	*/
+/* "nmax" entries with unmatched nets.  Each net is its name and a	*/
+/* list of {device, pin, count} fanout entries.				*/
+
+static void ReportNetFragments(struct FormattedList **nlists, int nl, int nmax)
+{
+  int n, f, fanout;
+  struct FanoutList *fl;
+
+  for (n = 0; n < nmax; n++) {
+     fprintf(ReportFile, "%s          [\n            ", (n > 0) ? ",\n" : "");
+     WriteJSONString(ReportFile, (n < nl) ? nlists[n]->name :
+		"(no matching net)");
+     fprintf(ReportFile, ",\n            [\n");
+     fanout = (n < nl) ? nlists[n]->fanout : 0;
+     if (fanout == 0) fprintf(ReportFile, "              [ \"\", \"\", 0 ]");
+     for (f = 0; f < fanout; f++) {
+	fl = &nlists[n]->flist[f];
+	fprintf(ReportFile, "%s              [ ", (f > 0) ? ",\n" : "");
+	WriteJSONString(ReportFile, fl->model);
+	fprintf(ReportFile, ", ");
+	WriteJSONString(ReportFile, fl->name);
+	fprintf(ReportFile, ", %d ]", fl->count);
+	if (fl->permute > 1) FREE(fl->name);
+     }
+     fprintf(ReportFile, "\n            ]\n          ]");
+  }
+}
+
+/* Write the devices of one circuit in an element class group, padded	*/
+/* to "nmax" entries with unmatched instances.  Each device is its	*/
+/* name and a list of {pin, count} entries, with one entry for each	*/
+/* group of permutable pins.						*/
+
+static void ReportElementFragments(struct FormattedList **elists, int nl,
+	int nmax)
+{
+  int n, f, k, fanout;
+  char *estr;
+  struct FanoutList *fl;
+
+  for (n = 0; n < nmax; n++) {
+     if (n < nl) {
+	estr = elists[n]->name;
+	if (*estr == '/') estr++;	// Remove leading slash, if any
+	fanout = elists[n]->fanout;
+     }
+     else {
+	estr = "(no matching instance)";
+	fanout = 0;
+     }
+     fprintf(ReportFile, "%s          [\n            ", (n > 0) ? ",\n" : "");
+     WriteJSONString(ReportFile, estr);
+     fprintf(ReportFile, ",\n            [\n");
+     if (fanout == 0) fprintf(ReportFile, "              [ \"\", 0 ]");
+     for (f = 0, k = 0; f < fanout; f++, k++) {
+	fl = &elists[n]->flist[f];
+	fprintf(ReportFile, "%s              [ ", (k > 0) ? ",\n" : "");
+	WriteJSONString(ReportFile, fl->name);
+	fprintf(ReportFile, ", %d ]", fl->count);
+	if (fl->permute != (char)1)
+	   while (elists[n]->flist[f].permute == (char)0) f++;
+     }
+     fprintf(ReportFile, "\n            ]\n          ]");
+  }
+}
+
+/*----------------------------------------------------------------------*/
+/* Write the node classes with legalpartition equal to "legal" as	*/
+/* "goodnets" or "badnets", in the same nesting as ListNodeClasses().	*/
+/* A "legal" value of -1 matches no class and writes an empty list.	*/
+/*----------------------------------------------------------------------*/
+
+void ReportNodeClasses(int legal)
+{
+  struct FormattedList **nlists1, **nlists2;
+  struct NodeClass *nscan;
+  struct Node *N;
+  int numlists1, numlists2, n1, n2, nmax, groups;
+
+  if (ReportFile == NULL) return;
+  ReportKey((legal == TRUE) ? "goodnets" : "badnets");
+
+  groups = 0;
+  for (nscan = NodeClasses; nscan != NULL; nscan = nscan->next) {
+    if (legal != nscan->legalpartition) continue;
+
+    numlists1 = numlists2 = 0;
+    for (N = nscan->nodes; N != NULL; N = N->next) {
+       if (N->graph == Circuit1->file)
+	  numlists1++;
+       else
+	  numlists2++;
+    }
+    nlists1 = (struct FormattedList **)CALLOC(numlists1,
+		sizeof(struct FormattedList *));
+    nlists2 = (struct FormattedList **)CALLOC(numlists2,
+		sizeof(struct FormattedList *));
+
+    n1 = n2 = 0;
+    for (N = nscan->nodes; N != NULL; N = N->next) {
+       if (N->graph == Circuit1->file)
+	  nlists1[n1++] = FormatBadNodeFragment(N);
+       else
+	  nlists2[n2++] = FormatBadNodeFragment(N);
+    }
+    nmax = (n1 > n2) ? n1 : n2;
+
+    fprintf(ReportFile, "%s      [\n        [\n", (groups > 0) ? ",\n" : "");
+    ReportNetFragments(nlists1, n1, nmax);
+    fprintf(ReportFile, "%s        ], [\n", (nmax > 0) ? "\n" : "");
+    ReportNetFragments(nlists2, n2, nmax);
+    fprintf(ReportFile, "%s        ]\n      ]", (nmax > 0) ? "\n" : "");
+    groups++;
+
+    FreeFormattedLists(nlists1, numlists1);
+    FreeFormattedLists(nlists2, numlists2);
+  }
+  fprintf(ReportFile, "%s   ]", (groups > 0) ? "\n" : "");
+}
+
+/*----------------------------------------------------------------------*/
+/* Write the element classes with legalpartition equal to "legal" as	*/
+/* "goodelements" or "badelements", in the same nesting as		*/
+/* ListElementClasses().  A "legal" value of -1 writes an empty list.	*/
+/*----------------------------------------------------------------------*/
+
+void ReportElementClasses(int legal)
+{
+  struct FormattedList **elist1, **elist2;
+  struct ElementClass *escan;
+  struct Element *E;
+  int numlists1, numlists2, n1, n2, nmax, groups;
+
+  if (ReportFile == NULL) return;
+  ReportKey((legal == TRUE) ? "goodelements" : "badelements");
+
+  groups = 0;
+  for (escan = ElementClasses; escan != NULL; escan = escan->next) {
+    if (legal != escan->legalpartition) continue;
+
+    numlists1 = numlists2 = 0;
+    for (E = escan->elements; E != NULL; E = E->next) {
+       if (E->graph == Circuit1->file)
+	  numlists1++;
+       else
+	  numlists2++;
+    }
+    elist1 = (struct FormattedList **)CALLOC(numlists1,
+		sizeof(struct FormattedList *));
+    elist2 = (struct FormattedList **)CALLOC(numlists2,
+		sizeof(struct FormattedList *));
+
+    n1 = n2 = 0;
+    for (E = escan->elements; E != NULL; E = E->next) {
+       if (E->graph == Circuit1->file)
+	  elist1[n1++] = FormatBadElementFragment(E);
+       else
+	  elist2[n2++] = FormatBadElementFragment(E);
+    }
+    nmax = (n1 > n2) ? n1 : n2;
+
+    fprintf(ReportFile, "%s      [\n        [\n", (groups > 0) ? ",\n" : "");
+    ReportElementFragments(elist1, n1, nmax);
+    fprintf(ReportFile, "%s        ], [\n", (nmax > 0) ? "\n" : "");
+    ReportElementFragments(elist2, n2, nmax);
+    fprintf(ReportFile, "%s        ]\n      ]", (nmax > 0) ? "\n" : "");
+    groups++;
+
+    FreeFormattedLists(elist1, numlists1);
+    FreeFormattedLists(elist2, numlists2);
+  }
+  fprintf(ReportFile, "%s   ]", (groups > 0) ? "\n" : "");
+}
+
+/* Write the properties of one circuit from a property list made by	*/
+/* NewPropertyList() and PropertyList():  the instance name and a	*/
+/* list of {name, value} pairs.						*/
+
+static void ReportPropertySide(Tcl_Obj *eprop, int side)
+{
+  Tcl_Obj **pobjv, *iobj, *mobj, *vobj;
+  int pobjc, i;
+
+  Tcl_ListObjGetElements(netgeninterp, eprop, &pobjc, &pobjv);
+  Tcl_ListObjIndex(netgeninterp, pobjv[0], side, &iobj);
+  fprintf(ReportFile, "         [\n           ");
+  WriteJSONString(ReportFile, (iobj) ? Tcl_GetString(iobj) : "");
+  fprintf(ReportFile, ",\n           [\n");
+  for (i = 1; i < pobjc; i++) {
+     Tcl_ListObjIndex(netgeninterp, pobjv[i], side, &mobj);
+     fprintf(ReportFile, "%s             [", (i > 1) ? ",\n" : "");
+     Tcl_ListObjIndex(netgeninterp, mobj, 0, &vobj);
+     WriteJSONString(ReportFile, (vobj) ? Tcl_GetString(vobj) : "");
+     fprintf(ReportFile, ", ");
+     Tcl_ListObjIndex(netgeninterp, mobj, 1, &vobj);
+     WriteJSONString(ReportFile, (vobj) ? Tcl_GetString(vobj) : "");
+     fprintf(ReportFile, "]");
+  }
+  fprintf(ReportFile, "%s           ]\n         ]", (pobjc > 1) ? "\n" : "");
+}
+
+/* Write one entry of "properties" and release its list */
+
+static void ReportProperties(Tcl_Obj *eprop, int index)
+{
+  Tcl_IncrRefCount(eprop);
+  fprintf(ReportFile, "%s      [\n", (index > 0) ? ",\n" : "");
+  ReportPropertySide(eprop, 0);
+  fprintf(ReportFile, ",\n");
+  ReportPropertySide(eprop, 1);
+  fprintf(ReportFile, "\n      ]");
+  Tcl_DecrRefCount(eprop);
+}
+
+#endif
+
 /* 
  *---------------------------------------------------------------------
  *---------------------------------------------------------------------
@@ -1865,6 +2281,10 @@ static int NewNumberOfNclasses;
 
 static int Iterations;
 
+/* Convergence trace counters, reset by Iterate() before each pass */
+static int FractureSplits;	/* classes that fractured into several */
+static int FractureIllegal;	/* illegal partitions after fracturing */
+
 void FreeEntireElementClass(struct ElementClass *ElementClasses)
 {
   struct ElementClass *next;
@@ -1918,6 +2338,7 @@ void FreeEntireNodeClass(struct NodeClass *NodeClasses)
 
 int BadMatchDetected;
 int PropertyErrorDetected;
+int SignatureMismatch;
 int NewFracturesMade;
 
 
@@ -1938,6 +2359,7 @@ void ResetState(void)
   Iterations = 0;
   BadMatchDetected = 0;
   PropertyErrorDetected = 0;
+  SignatureMismatch = 0;
   NewFracturesMade = 0;
   ExhaustiveSubdivision = 0;	/* why not ?? */
   /* maybe should free up free lists ??? */
@@ -2567,6 +2989,7 @@ int FractureElementClass(struct ElementClass **Elist)
     if (Eclass->count != 2 || ExhaustiveSubdivision) {
        Enew = MakeElist(Eclass->elements);
        FreeElementClass(Eclass);
+       if (Enew != NULL && Enew->next != NULL) FractureSplits++;
        if (Ehead == NULL) {
 	  Ehead = Etail = Enew;
 	  Magic(Etail->magic);
@@ -2589,8 +3012,11 @@ int FractureElementClass(struct ElementClass **Elist)
   }
   *Elist = Ehead;
   NewNumberOfEclasses = 0;
-  for (Eclass = *Elist; Eclass != NULL; Eclass = Eclass->next) 
+  FractureIllegal = 0;
+  for (Eclass = *Elist; Eclass != NULL; Eclass = Eclass->next) {
 	  NewNumberOfEclasses++;
+	  if (!Eclass->legalpartition) FractureIllegal++;
+  }
 
   if (Debug == TRUE) {
      if (Iterations == 0) Fprintf(stdout, "\n");
@@ -2616,6 +3042,7 @@ int FractureNodeClass(struct NodeClass **Nlist)
     if (Nclass->count != 2 || ExhaustiveSubdivision) {
        Nnew = MakeNlist(Nclass->nodes);
        FreeNodeClass(Nclass);
+       if (Nnew != NULL && Nnew->next != NULL) FractureSplits++;
        if (Nhead == NULL) {
 	  Nhead = Ntail = Nnew;
 	  Magic(Ntail->magic);
@@ -2638,8 +3065,11 @@ int FractureNodeClass(struct NodeClass **Nlist)
   }
   *Nlist = Nhead;
   NewNumberOfNclasses = 0;
-  for (Nclass = *Nlist; Nclass != NULL; Nclass = Nclass->next)
+  FractureIllegal = 0;
+  for (Nclass = *Nlist; Nclass != NULL; Nclass = Nclass->next) {
 	  NewNumberOfNclasses++;
+	  if (!Nclass->legalpartition) FractureIllegal++;
+  }
 
   if (Debug == TRUE) {
     Fprintf(stdout, "Net groups = %4d (+%d)\n",
@@ -2652,52 +3082,20 @@ int FractureNodeClass(struct NodeClass **Nlist)
   return(NewNumberOfNclasses);
 }
 
-/* Structure used by lookupclass */
-
-typedef struct _chd {
-   int file;
-   unsigned long classhash;
-} chdata;
-
-/*----------------------------------------------------------------------*/
-/* Callback function used by LookupClassEquivalent			*/
-/*----------------------------------------------------------------------*/
-
-struct nlist *lookupclass(struct hashlist *p, void *clientdata)
-{
-    struct nlist *ptr;
-    chdata *chd = (chdata *)clientdata;
-
-    ptr = (struct nlist *)(p->ptr);
-
-    if (ptr->file == chd->file)
-	if (ptr->classhash == chd->classhash)
-	    return ptr;
-
-    return NULL;
-}
-
 /*----------------------------------------------------------------------*/
 /* Given the class (cellname) "model" in file "file1", find the		*/
-/* equivalent class in "file2".  This is done by exhaustively searching	*/
-/* the cell database for a matching classhash number.  It is therefore	*/
-/* not intended to be run often;  it should be only run when choosing	*/
-/* two cells to compare.						*/
+/* equivalent class in "file2".  This is done by looking up the		*/
+/* matching classhash number in the cell database's classhash index.	*/
 /*----------------------------------------------------------------------*/
 
 struct nlist *LookupClassEquivalent(char *model, int file1, int file2)
 {
-   struct nlist *tp, *tp2;
-   chdata chd;
+   struct nlist *tp;
 
    tp = LookupCellFile(model, file1);
    if (tp == NULL) return NULL;
 
-   chd.file = file2;
-   chd.classhash = tp->classhash;
-
-   tp2 = RecurseCellHashTable2(lookupclass, (void *)(&chd));
-   return tp2;
+   return LookupCellClass(tp->classhash, file2);
 }
 
 /*----------------------------------------------------------------------*/
@@ -2710,9 +3108,16 @@ struct nlist *LookupClassEquivalent(char *model, int file1, int file2)
 struct nlist *LookupPrematchedClass(struct nlist *tc1, int file2)
 {
    struct Correspond *crec;
+   struct CorrespondLink *clink;
    struct nlist *tc2 = NULL;
 
-   for (crec = ClassCorrespondence; crec != NULL; crec = crec->next) {
+   /* Records that do not name tc1 cannot match, so only the bin for	*/
+   /* tc1's name needs to be checked.  Later (older) records override	*/
+   /* earlier ones, as in a scan of the full ClassCorrespondence list.	*/
+
+   clink = CorrespondTable[hashnocase(tc1->name, CORRESPONDHASHSIZE)];
+   for (; clink != NULL; clink = clink->next) {
+      crec = clink->crec;
       if (crec->file1 == tc1->file) {
 	 if ((*matchfunc)(tc1->name, crec->class1))
 	    if (crec->file2 == file2 || crec->file2 == -1)
@@ -2740,7 +3145,7 @@ struct nlist *LookupPrematchedClass(struct nlist *tc1, int file2)
 	    tc2 = LookupCell(crec->class1);
       }
    }
-   if (tc2 != NULL) tc2->classhash = tc1->classhash;
+   if (tc2 != NULL) SetCellClasshash(tc2, tc1->classhash);
    return tc2;
 }
 
@@ -2790,7 +3195,7 @@ int FirstElementPass(struct Element *E, int noflat, int dolist)
   }
 
 #ifdef TCL_NETGEN
-  if (dolist) {
+  if (dolist && (ReportFile == NULL)) {
      clist1 = Tcl_NewListObj(0, NULL);
      clist2 = Tcl_NewListObj(0, NULL);
   }
@@ -2850,7 +3255,10 @@ int FirstElementPass(struct Element *E, int noflat, int dolist)
            Fprintf(stdout, ostr);
 	}
 #ifdef TCL_NETGEN
-	if (dolist) {
+	if (dolist && (ReportFile != NULL))
+	   ReportAddPair(Esrch->object->model.class, C1,
+			(C2 > 0) ? tp2->name : "(no matching element)", C2);
+	else if (dolist) {
 	   Tcl_Obj *elist;
 	   elist = Tcl_NewListObj(0, NULL);
 	   Tcl_ListObjAppendElement(netgeninterp, elist,
@@ -2912,7 +3320,10 @@ int FirstElementPass(struct Element *E, int noflat, int dolist)
            Fprintf(stdout, ostr);
 	}
 #ifdef TCL_NETGEN
-	if (dolist) {
+	if (dolist && (ReportFile != NULL))
+	   ReportAddPair("(no matching element)", 0,
+			Esrch->object->model.class, C2);
+	else if (dolist) {
 	   Tcl_Obj *elist;
 	   elist = Tcl_NewListObj(0, NULL);
 	   Tcl_ListObjAppendElement(netgeninterp, elist,
@@ -2964,7 +3375,9 @@ int FirstElementPass(struct Element *E, int noflat, int dolist)
   }
 
 #ifdef TCL_NETGEN
-  if (dolist) {
+  if (dolist && (ReportFile != NULL))
+     ReportDevices();
+  else if (dolist) {
      Tcl_Obj *mlist;
 
      mlist = Tcl_NewListObj(0, NULL);
@@ -3023,7 +3436,9 @@ void FirstNodePass(struct Node *N, int dolist)
   }
 
 #ifdef TCL_NETGEN
-  if (dolist) {
+  if (dolist && (ReportFile != NULL))
+     ReportNets(C1, C2);
+  else if (dolist) {
      Tcl_Obj *nlist;
 
      nlist = Tcl_NewListObj(0, NULL);
@@ -3038,6 +3453,66 @@ void FirstNodePass(struct Node *N, int dolist)
 #endif
 }
 
+/*--------------------------------------------------------------*/
+/* Signature prefilter.  After the first fracture, element	*/
+/* classes are split by device class and node classes by	*/
+/* fanout.  A class with a different number of members from	*/
+/* each circuit means the device counts per class or the net	*/
+/* degree histograms differ.  Since refining the partition	*/
+/* cannot balance an unbalanced class, the circuits cannot	*/
+/* match, and iterating to convergence only serves to produce	*/
+/* diagnostics.  Port counts are reported with the signature	*/
+/* but do not by themselves prevent a match, since pins are	*/
+/* resolved separately.						*/
+/*								*/
+/* Sets SignatureMismatch and returns the number of unbalanced	*/
+/* classes.							*/
+/*--------------------------------------------------------------*/
+
+int CheckSignatures(struct nlist *tc1, struct nlist *tc2)
+{
+  struct ElementClass *EC;
+  struct NodeClass *NC;
+  struct Element *E;
+  struct Node *N;
+  struct objlist *ob;
+  int C1, C2, ebad, nbad, ports1, ports2;
+
+  ebad = 0;
+  for (EC = ElementClasses; EC != NULL; EC = EC->next) {
+    C1 = C2 = 0;
+    for (E = EC->elements; E != NULL; E = E->next)
+      (E->graph == Circuit1->file) ? C1++ : C2++;
+    if (C1 != C2) ebad++;
+  }
+
+  nbad = 0;
+  for (NC = NodeClasses; NC != NULL; NC = NC->next) {
+    C1 = C2 = 0;
+    for (N = NC->nodes; N != NULL; N = N->next)
+      (N->graph == Circuit1->file) ? C1++ : C2++;
+    if (C1 != C2) nbad++;
+  }
+
+  SignatureMismatch = ebad + nbad;
+  if (SignatureMismatch == 0) return 0;
+
+  /* Proven mismatch;  VerifyMatching() need not wait for iteration */
+  BadMatchDetected = 1;
+
+  ports1 = ports2 = 0;
+  for (ob = tc1->cell; ob != NULL && ob->type == PORT; ob = ob->next) ports1++;
+  for (ob = tc2->cell; ob != NULL && ob->type == PORT; ob = ob->next) ports2++;
+
+  Printf("Cell signatures differ:  %d device class%s and %d net fanout "
+		"class%s do not match.\n", ebad, (ebad == 1) ? "" : "es",
+		nbad, (nbad == 1) ? "" : "es");
+  if (ports1 != ports2)
+     Printf("Circuit 1 has %d pins, Circuit 2 has %d pins.\n", ports1, ports2);
+
+  return SignatureMismatch;
+}
+
 /*--------------------------------------------------------------*/
 /* Declare cells to be non-matching by clearing the		*/
 /* CELL_MATCHED	flag in both cells.  This will force cell	*/
@@ -3363,6 +3838,25 @@ void RemoveCompareQueue()
    CompareQueue = NULL;
 }
 
+/*----------------------------------------------------------------------*/
+/* Determine if matching will be case sensitive or case insensitive	*/
+/* for the two cells tc1 and tc2, and set the global match functions.	*/
+/*----------------------------------------------------------------------*/
+
+void SetMatchFunctions(struct nlist *tc1, struct nlist *tc2)
+{
+    matchfunc = match;
+    matchintfunc = matchfile;
+    hashfunc = hash;
+    if (tc1 != NULL && tc2 != NULL) {
+        if ((tc1->flags & CELL_NOCASE) && (tc2->flags & CELL_NOCASE)) {
+	   matchfunc = matchnocase;
+	   matchintfunc = matchfilenocase;
+	   hashfunc = hashnocase;
+        }
+    }
+}
+
 /*----------------------------------*/
 /* create an initial data structure */
 /*----------------------------------*/
@@ -3393,17 +3887,7 @@ void CreateTwoLists(char *name1, int file1, char *name2, int file2, int dolist)
     else
         tc2 = LookupCellFile(name2, file2);
 
-    /* determine if matching will be case sensitive or case insensitive */
-    matchfunc = match;
-    matchintfunc = matchfile;
-    hashfunc = hash;
-    if (tc1 != NULL && tc2 != NULL) {
-        if ((tc1->flags & CELL_NOCASE) && (tc2->flags & CELL_NOCASE)) {
-	   matchfunc = matchnocase;
-	   matchintfunc = matchfilenocase;
-	   hashfunc = hashnocase;
-        }
-    }
+    SetMatchFunctions(tc1, tc2);
 
     modified = CreateLists(name1, file1);
     if (Elements == NULL) {
@@ -3489,7 +3973,9 @@ void CreateTwoLists(char *name1, int file1, char *name2, int file2, int dolist)
     SummarizeDataStructures();
   
 #ifdef TCL_NETGEN
-    if (dolist) {
+    if (dolist && (ReportFile != NULL))
+       ReportNames(name1, name2);
+    else if (dolist) {
        Tcl_Obj *nlist;
 
        nlist = Tcl_NewListObj(0, NULL);
@@ -3510,6 +3996,9 @@ void CreateTwoLists(char *name1, int file1, char *name2, int file2, int dolist)
     FirstNodePass(NodeClasses->nodes, dolist);
     FractureElementClass(&ElementClasses);
     FractureNodeClass(&NodeClasses);
+
+    /* check for invariants that already prove a mismatch */
+    CheckSignatures(tc1, tc2);
 }
 
 void RegroupDataStructures(void)
@@ -3626,10 +4115,101 @@ unsigned long NodeHash(struct Node *N)
   return(hashval);
 }
 
+/*----------------------------------------------------------------------*/
+/* Convergence trace.  While a trace file is open, Iterate() writes one	*/
+/* CSV row for each element and node refinement pass:  the cell, the	*/
+/* iteration, the pass ("element" or "node"), the number of classes	*/
+/* and the change, the number of classes split, the number of entries	*/
+/* rehashed, the number of illegal partitions, the time spent in	*/
+/* microseconds, and a histogram of class sizes in power-of-two		*/
+/* buckets (1, 2, 3-4, 5-8, ... with the last bucket open-ended).	*/
+/*----------------------------------------------------------------------*/
+
+#define TRACEBUCKETS 16
+
+static FILE *TraceFile = NULL;
+
+int TraceOpen(char *filename)
+{
+  int i;
+
+  TraceClose();
+  TraceFile = fopen(filename, "w");
+  if (TraceFile == NULL) return 0;
+
+  fprintf(TraceFile, "cell,iteration,pass,classes,delta,split,rehashed,"
+		"illegal,usec");
+  for (i = 0; i < TRACEBUCKETS - 1; i++)
+     fprintf(TraceFile, ",size_%d", 1 << i);
+  fprintf(TraceFile, ",size_max\n");
+  return 1;
+}
+
+void TraceClose(void)
+{
+  if (TraceFile != NULL) fclose(TraceFile);
+  TraceFile = NULL;
+}
+
+int TraceActive(void)
+{
+  return (TraceFile != NULL);
+}
+
+static int TraceBucket(int count)
+/* returns the histogram bucket for a class of "count" entries */
+{
+  int b;
+
+  for (b = 0; b < TRACEBUCKETS - 1; b++)
+     if (count <= (1 << b)) break;
+  return b;
+}
+
+static void TraceWrite(char *pass, int *histogram, int classes, int delta,
+		int rehashed, double start)
+{
+  int i;
+
+  fprintf(TraceFile, "\"%s\",%d,%s,%d,%d,%d,%d,%d,%.0f",
+	(Circuit1 == NULL) ? "" : Circuit1->name, Iterations, pass,
+	classes, delta, FractureSplits, rehashed, FractureIllegal,
+	(WallTime() - start) * 1.0e6);
+  for (i = 0; i < TRACEBUCKETS; i++)
+     fprintf(TraceFile, ",%d", histogram[i]);
+  fprintf(TraceFile, "\n");
+}
+
+static void TraceElementPass(int rehashed, double start)
+{
+  struct ElementClass *EC;
+  int histogram[TRACEBUCKETS];
+
+  memset(histogram, 0, sizeof(histogram));
+  for (EC = ElementClasses; EC != NULL; EC = EC->next)
+     histogram[TraceBucket(EC->count)]++;
+  TraceWrite("element", histogram, OldNumberOfEclasses, NewNumberOfEclasses,
+		rehashed, start);
+}
+
+static void TraceNodePass(int rehashed, double start)
+{
+  struct NodeClass *NC;
+  int histogram[TRACEBUCKETS];
+
+  memset(histogram, 0, sizeof(histogram));
+  for (NC = NodeClasses; NC != NULL; NC = NC->next)
+     histogram[TraceBucket(NC->count)]++;
+  TraceWrite("node", histogram, OldNumberOfNclasses, NewNumberOfNclasses,
+		rehashed, start);
+}
+
 int Iterate(void)
 /* does one iteration, and returns TRUE if we are done */
 {
   int notdone;
+  int rehashed;
+  double start;
   struct ElementClass *EC;
   struct NodeClass *NC;
 
@@ -3643,13 +4223,18 @@ int Iterate(void)
   for (NC = NodeClasses; NC != NULL; NC = NC->next) 
     Magic(NC->magic);
 
+  StatsBegin("iterate");
   Iterations++;
   NewFracturesMade = 0;
+  FractureSplits = rehashed = 0;
+  if (TraceFile != NULL) start = WallTime();
   
   for (EC = ElementClasses; EC != NULL; EC = EC->next) {
     struct Element *E;
-    for (E = EC->elements; E != NULL; E = E->next)
+    for (E = EC->elements; E != NULL; E = E->next) {
       E->hashval = ElementHash(E);
+      rehashed++;
+    }
 
     // Check for partitions of two elements, not balanced
     if (EC->count == 2 && EC->elements->graph ==
@@ -3659,10 +4244,18 @@ int Iterate(void)
 
   notdone = FractureElementClass(&ElementClasses);
 
+  if (TraceFile != NULL) {
+    TraceElementPass(rehashed, start);
+    start = WallTime();
+  }
+  FractureSplits = rehashed = 0;
+
   for (NC = NodeClasses; NC != NULL; NC = NC->next) {
     struct Node *N;
-    for (N = NC->nodes; N != NULL; N = N->next)
+    for (N = NC->nodes; N != NULL; N = N->next) {
       N->hashval = NodeHash(N);
+      rehashed++;
+    }
 
     // Check for partitions of two nodes, not balanced
     if (NC->count == 2 && NC->nodes->graph ==
@@ -3670,7 +4263,24 @@ int Iterate(void)
        NC->legalpartition = 0;
   }
   notdone = notdone | FractureNodeClass(&NodeClasses);
+  if (TraceFile != NULL) TraceNodePass(rehashed, start);
+
+  StatsIteration((Circuit1 == NULL) ? NULL : Circuit1->name, Iterations,
+		OldNumberOfEclasses, OldNumberOfNclasses);
+  StatsEnd();
 
+#ifdef TCL_NETGEN
+  /* Report progress from a background job */
+  if (JobActive && Circuit1 != NULL && Circuit2 != NULL) {
+    int unresolved = 0;
+    for (EC = ElementClasses; EC != NULL; EC = EC->next)
+      if (EC->count != 2) unresolved++;
+    for (NC = NodeClasses; NC != NULL; NC = NC->next)
+      if (NC->count != 2) unresolved++;
+    JobProgress(Circuit1->name, Circuit2->name, Iterations,
+		OldNumberOfEclasses, OldNumberOfNclasses, unresolved);
+  }
+#endif
 
 #if 0
   if (NewFracturesMade) Printf("New fractures made;   ");
@@ -3731,8 +4341,25 @@ typedef struct _propsort {
     struct objlist *ob;
 } propsort;
 
+/* Scratch list used by serial_sort() and parallel_sort(), grown	*/
+/* as needed and kept between calls.				*/
+
+static propsort *sortlist = NULL;
+static int sortlistsize = 0;
+
+static propsort *GetSortList(int run)
+{
+    if (run > sortlistsize) {
+	if (sortlist != NULL) FREE(sortlist);
+	sortlistsize = (run > 2 * sortlistsize) ? run : 2 * sortlistsize;
+	sortlist = (propsort *)MALLOC(sortlistsize * sizeof(propsort));
+    }
+    return sortlist;
+}
+
 /*--------------------------------------------------------------*/
-/* Property sorting routine used by qsort()			*/
+/* Property sorting routine used by qsort().  Ties are broken	*/
+/* by original position so that the sort is stable.		*/
 /*--------------------------------------------------------------*/
 
 static int compsort(const void *p1, const void *p2)
@@ -3742,33 +4369,38 @@ static int compsort(const void *p1, const void *p2)
     s1 = (propsort *)p1;
     s2 = (propsort *)p2;
 
-    return (s1->value > s2->value) ? 1 : 0;
+    if (s1->value > s2->value) return 1;
+    if (s1->value < s2->value) return -1;
+    return (s1->idx > s2->idx) ? 1 : ((s1->idx < s2->idx) ? -1 : 0);
 }
 
 /*--------------------------------------------------------------*/
 /* Sort properties of ob1 starting at property idx1 up to	*/
-/* property (idx1 + run).  Use serial critical property for	*/
-/* sorting.  Multiply critical property by S before sort.	*/
+/* property (idx1 + run), by the critical property of type	*/
+/* "crittype" multiplied by the value of property "S".		*/
 /* ob1 is the record before the first property.			*/
 /*--------------------------------------------------------------*/
 
-void serial_sort(struct objlist *ob1, struct nlist *tp1, int idx1, int run)
+static void sort_run(struct objlist *ob1, struct nlist *tp1, int idx1, int run,
+	int crittype)
 {
-   struct objlist *obn, *obp;
+   struct objlist *obn, *obp, *obpre;
    propsort *proplist;
    struct property *kl;
    struct valuelist *vl;
    int i, p, sval;
    double cval;
 
-   obn = ob1->next;
-   for (i = 0; i < idx1; i++) obn = obn->next;
+   FreeNodePins(tp1);
+   obpre = ob1;
+   for (i = 0; i < idx1; i++) obpre = obpre->next;
+   obn = obpre->next;
 
-   // Create a structure of length (run) to hold critical property
-   // value and index.  Then sort that list, then use the sorted
-   // indexes to sort the actual property linked list.
+   // Fill a list of length (run) with critical property value and
+   // index.  Then sort that list, then use the sorted indexes to
+   // sort the actual property linked list.
 
-   proplist = (propsort *)MALLOC(run * sizeof(propsort));
+   proplist = GetSortList(run);
 
    obp = obn;
    sval = 1;
@@ -3778,15 +4410,16 @@ void serial_sort(struct objlist *ob1, struct nlist *tp1, int idx1, int run)
 	 vl = &(obp->instance.props[p]);
 	 if (vl->type == PROP_ENDLIST) break;
 	 if (vl->key == NULL) continue;
-         if (!strcmp(vl->key, "S"))
+         if (!strcmp(vl->key, "S")) {
 	    sval = vl->value.ival;
-	 else {
-	    kl = (struct property *)HashLookup(vl->key, &(tp1->propdict));
-	    if (kl && (kl->merge == MERGE_SER_CRIT))
-		if (vl->type == PROP_INTEGER)
-		   cval = (double)vl->value.ival;
-		else
-		   cval = vl->value.dval;
+	    continue;
+	 }
+	 kl = (struct property *)HashLookup(vl->key, &(tp1->propdict));
+	 if (kl && (kl->merge == crittype)) {
+	    if (vl->type == PROP_INTEGER)
+	       cval = (double)vl->value.ival;
+	    else
+	       cval = vl->value.dval;
 	 }
       }
       proplist[i].value = (double)sval * cval;
@@ -3798,15 +4431,25 @@ void serial_sort(struct objlist *ob1, struct nlist *tp1, int idx1, int run)
 
    qsort(&proplist[0], run, sizeof(propsort), compsort);
 
-   // Re-sort list
-   obp = ob1;
+   // Re-sort list, keeping the records in front of the run
+   obp = obpre;
    for (i = 0; i < run; i++) {
       obp->next = proplist[i].ob;
       obp = obp->next;
    }
    obp->next = obn;	/* Restore last link */
+}
+
+/*--------------------------------------------------------------*/
+/* Sort properties of ob1 starting at property idx1 up to	*/
+/* property (idx1 + run).  Use serial critical property for	*/
+/* sorting.  Multiply critical property by S before sort.	*/
+/* ob1 is the record before the first property.			*/
+/*--------------------------------------------------------------*/
 
-   FREE(proplist);
+void serial_sort(struct objlist *ob1, struct nlist *tp1, int idx1, int run)
+{
+   sort_run(ob1, tp1, idx1, run, MERGE_SER_CRIT);
 }
 
 /*--------------------------------------------------------------*/
@@ -3861,58 +4504,7 @@ int parallel_combine(struct objlist *ob1, struct nlist *tp1, int idx1, int run1,
 
 void parallel_sort(struct objlist *ob1, struct nlist *tp1, int idx1, int run)
 {
-   struct objlist *obn, *obp;
-   propsort *proplist;
-   struct property *kl;
-   struct valuelist *vl;
-   int i, p, sval;
-   double cval;
-
-   obn = ob1->next;
-   for (i = 0; i < idx1; i++) obn = obn->next;
-
-   // Create a structure of length (run) to hold critical property
-   // value and index.  Then sort that list, then use the sorted
-   // indexes to sort the actual property linked list.
-
-   proplist = (propsort *)MALLOC(run * sizeof(propsort));
-
-   obp = obn;
-   sval = 1;
-   cval = 0.0;
-   for (i = 0; i < run; i++) {
-      for (p = 0;; p++) {
-	 vl = &(obp->instance.props[p]);
-	 if (vl->type == PROP_ENDLIST) break;
-	 if (vl->key == NULL) continue;
-         if (!strcmp(vl->key, "S"))
-	    sval = vl->value.ival;
-         kl = (struct property *)HashLookup(vl->key, &(tp1->propdict));
-	 if (kl == NULL) continue;		/* Ignored property */
-         if (kl->merge == MERGE_ADD_CRIT)
-	    if (vl->type == PROP_INTEGER)
-	        cval = (double)vl->value.ival;
-	    else
-	        cval = vl->value.dval;
-      }
-      proplist[i].value = (double)sval * cval;
-      proplist[i].idx = i;
-      proplist[i].ob = obp;
-      obp = obp->next;
-   }
-   obn = obp;	/* Link from last property */
-
-   qsort(&proplist[0], run, sizeof(propsort), compsort);
-
-   // Re-sort list
-   obp = ob1;
-   for (i = 0; i < run; i++) {
-      obp->next = proplist[i].ob;
-      obp = obp->next;
-   }
-   obp->next = obn;	/* Restore last link */
-
-   FREE(proplist);
+   sort_run(ob1, tp1, idx1, run, MERGE_ADD_CRIT);
 }
 
 /*--------------------------------------------------------------*/
@@ -4201,6 +4793,250 @@ void PropertySortAndCombine(struct objlist *pre1, struct nlist *tp1,
       Printf("No more changes can be made to serial/parallel networks.\n");
 }
 
+/*--------------------------------------------------------------*/
+/* Scratch space used by PropertyOptimize().  This is kept	*/
+/* between calls and only grows, since the routine is called	*/
+/* for every instance with more than one property record.	*/
+/*--------------------------------------------------------------*/
+
+static struct property **optprops = NULL;	/* Properties of interest	*/
+static struct valuelist *optdflt = NULL;	/* Default value of each	*/
+static struct valuelist **optvals = NULL;	/* Values, (run x pcount)	*/
+static struct objlist **optobs = NULL;		/* Property record of each run	*/
+static int *optpos = NULL;			/* Sorted position of records	*/
+static int *optheads = NULL;			/* Ordered heads, by position	*/
+static int *optothers = NULL;			/* Other heads, by record	*/
+static int optpsize = 0, optdsize = 0, optvsize = 0, optosize = 0;
+static int optssize = 0, opthsize = 0, optrsize = 0;
+
+#define OPT_SORT_MIN 16		/* Shortest run that is sorted		*/
+
+static int optpcount;		/* Number of properties of interest	*/
+static int optcrit;		/* Index of the critical property	*/
+static int optprime;		/* Index of the primary property	*/
+
+#define OPTVAL(i, p) optvals[(i) * optpcount + (p)]
+
+/* Grow a scratch array, keeping the first "keep" entries */
+
+static void *OptGrow(void *buf, int *size, int need, int elsize, int keep)
+{
+   void *newbuf;
+   int newsize;
+
+   if (need <= *size) return buf;
+   newsize = (need > 2 * (*size)) ? need : 2 * (*size);
+   newbuf = MALLOC(newsize * elsize);
+   if (buf != NULL) {
+      if (keep > 0) memcpy(newbuf, buf, keep * elsize);
+      FREE(buf);
+   }
+   *size = newsize;
+   return newbuf;
+}
+
+/*--------------------------------------------------------------*/
+/* Return the value of property p for record i, or its default	*/
+/*--------------------------------------------------------------*/
+
+static struct valuelist *OptValue(int i, int p)
+{
+   struct valuelist *vl = OPTVAL(i, p);
+   return (vl == NULL) ? &optdflt[p] : vl;
+}
+
+/*--------------------------------------------------------------*/
+/* Check if property p of records i and j match to within the	*/
+/* property's slop.  A value that is missing from a record	*/
+/* takes the property default.  Values of different types do	*/
+/* not match.							*/
+/*--------------------------------------------------------------*/
+
+static int OptMatchValues(int p, int i, int j)
+{
+   struct property *kl = optprops[p];
+   struct valuelist *vl, *vl2;
+   double dval;
+
+   if (OPTVAL(i, p) == NULL && OPTVAL(j, p) == NULL) return 1;
+   vl = OptValue(i, p);
+   vl2 = OptValue(j, p);
+
+   switch (vl->type) {
+      case PROP_DOUBLE:
+      case PROP_VALUE:
+	 if (vl2->type != PROP_DOUBLE && vl2->type != PROP_VALUE) return 0;
+	 dval = 2 * fabs(vl->value.dval - vl2->value.dval)
+			/ (vl->value.dval + vl2->value.dval);
+	 return (dval <= kl->slop.dval) ? 1 : 0;
+      case PROP_INTEGER:
+	 if (vl2->type != PROP_INTEGER) return 0;
+	 return (abs(vl->value.ival - vl2->value.ival) <= kl->slop.ival) ? 1 : 0;
+      case PROP_STRING:
+	 if (vl2->type != PROP_STRING) return 0;
+	 return (*matchfunc)(vl->value.string, vl2->value.string);
+
+      /* will not attempt to match expressions, but it could
+       * be done with some minor effort by matching each
+       * stack token and comparing those that are strings.
+       */
+   }
+   return 0;
+}
+
+/* Check if all non-critical properties of records i and j match */
+
+static int OptMatchRecords(int i, int j)
+{
+   int p;
+
+   for (p = 1; p < optpcount; p++) {
+      if (p == optcrit) continue;
+      if (!OptMatchValues(p, i, j)) return 0;
+   }
+   return 1;
+}
+
+/*--------------------------------------------------------------*/
+/* A record is "ordered" if its primary property is present and	*/
+/* of a type for which the records matching it within slop form	*/
+/* a contiguous range when sorted:  integers, strings, and	*/
+/* positive real values.					*/
+/*--------------------------------------------------------------*/
+
+static int OptOrdered(int i)
+{
+   struct valuelist *vl;
+
+   if (optprime < 0) return 0;
+   vl = OPTVAL(i, optprime);
+   if (vl == NULL) return 0;
+   switch (vl->type) {
+      case PROP_INTEGER:
+      case PROP_STRING:
+	 return 1;
+      case PROP_DOUBLE:
+      case PROP_VALUE:
+	 return (vl->value.dval > 0.0) ? 1 : 0;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------*/
+/* Order two ordered records by type and value of the primary	*/
+/* property.  Strings are ordered consistently with matchfunc().	*/
+/*--------------------------------------------------------------*/
+
+static int OptComparePrimary(int i1, int i2)
+{
+   struct valuelist *vl1 = OPTVAL(i1, optprime);
+   struct valuelist *vl2 = OPTVAL(i2, optprime);
+   int t1, t2;
+
+   t1 = (vl1->type == PROP_VALUE) ? PROP_DOUBLE : vl1->type;
+   t2 = (vl2->type == PROP_VALUE) ? PROP_DOUBLE : vl2->type;
+   if (t1 != t2) return (t1 > t2) ? 1 : -1;
+
+   switch (t1) {
+      case PROP_DOUBLE:
+	 if (vl1->value.dval == vl2->value.dval) return 0;
+	 return (vl1->value.dval > vl2->value.dval) ? 1 : -1;
+      case PROP_INTEGER:
+	 if (vl1->value.ival == vl2->value.ival) return 0;
+	 return (vl1->value.ival > vl2->value.ival) ? 1 : -1;
+      case PROP_STRING:
+	 if (matchfunc == matchnocase)
+	    return comparenocase(vl1->value.string, vl2->value.string);
+	 return strcmp(vl1->value.string, vl2->value.string);
+   }
+   return 0;
+}
+
+/* Sorting routine for qsort():  Order by primary property, then by position */
+
+static int OptCompareRecords(const void *p1, const void *p2)
+{
+   int i1 = *(const int *)p1;
+   int i2 = *(const int *)p2;
+   int r;
+
+   r = OptComparePrimary(i1, i2);
+   if (r != 0) return r;
+   return (i1 > i2) ? 1 : ((i1 < i2) ? -1 : 0);
+}
+
+/*--------------------------------------------------------------*/
+/* Sort the ordered records of a run on property p into		*/
+/* optheads[], and return the number of distinct values.	*/
+/* The number of ordered records is returned in "count".	*/
+/*--------------------------------------------------------------*/
+
+static int OptSortOn(int p, int run, int *count)
+{
+   int i, k, distinct;
+
+   optprime = p;
+   k = 0;
+   for (i = 0; i < run; i++)
+      if (OptOrdered(i)) optheads[k++] = i;
+   qsort(optheads, k, sizeof(int), OptCompareRecords);
+
+   distinct = (k > 0) ? 1 : 0;
+   for (i = 1; i < k; i++)
+      if (OptComparePrimary(optheads[i - 1], optheads[i]) != 0)
+	 distinct++;
+   *count = k;
+   return distinct;
+}
+
+/*--------------------------------------------------------------*/
+/* Add a record "M" ("S") = 1 to the end of the property list	*/
+/* of record i, and regenerate the value pointers for record i.	*/
+/*--------------------------------------------------------------*/
+
+static void OptAddMultiple(struct nlist *tp, int i, char *multiple)
+{
+   struct objlist *ob2 = optobs[i];
+   struct property *kl;
+   struct valuelist *vl, *newvlist;
+   int p;
+
+   // Count entries, add one, reallocate
+   for (p = 0;; p++) {
+      vl = &ob2->instance.props[p];
+      if (vl->type == PROP_ENDLIST) break;
+   }
+   p++;
+   newvlist = (struct valuelist *)CALLOC(p + 1, sizeof(struct valuelist));
+   // Move end record forward
+   vl = &newvlist[p];
+   vl->key = NULL;
+   vl->type = PROP_ENDLIST;
+   vl->value.ival = 0;
+
+   // Add "M" ("S") record behind it
+   vl = &newvlist[--p];
+   vl->key = PropKey(multiple);
+   vl->type = PROP_INTEGER;
+   vl->value.ival = 1;
+   OPTVAL(i, 0) = vl;
+
+   // Copy the rest of the records and regenerate value pointers
+   for (--p; p >= 0; p--) {
+      vl = &newvlist[p];
+      vl->key = ob2->instance.props[p].key;
+      vl->type = ob2->instance.props[p].type;
+      vl->value = ob2->instance.props[p].value;
+      if (vl->key == NULL) continue;
+      kl = (struct property *)HashLookup(vl->key, &(tp->propdict));
+      if (kl != NULL) OPTVAL(i, kl->idx) = vl;
+   }
+
+   // Replace instance properties with the new list
+   FREE(ob2->instance.props);
+   ob2->instance.props = newvlist;
+}
+
 /*--------------------------------------------------------------*/
 /* "ob" points to the first property record of an object	*/
 /* instance.  Check if there are multiple property records.  If	*/
@@ -4208,27 +5044,24 @@ void PropertySortAndCombine(struct objlist *pre1, struct nlist *tp1,
 /* critical property (if defined), and merge devices with the	*/
 /* same properties (by summing property "M" for devices)	*/
 /*								*/
+/* Records are sorted on their primary property so that each	*/
+/* record is only compared against records whose primary	*/
+/* property is within slop of its own.				*/
+/*								*/
 /* For final optimization, if run == 1 and M > 1, then merge	*/
 /* the critical property over M and set M to 1.			*/
 /*								*/
 /* Return the number of devices modified.			*/
 /*--------------------------------------------------------------*/
 
-typedef struct _proplink *proplinkptr;
-typedef struct _proplink {
-   struct property *prop;
-   proplinkptr next;
-} proplink;
-
 int PropertyOptimize(struct objlist *ob, struct nlist *tp, int run, int serial)
 {
    struct objlist *ob2, *obt;
-   struct property *kl, *m_rec, **plist;
-   struct valuelist ***vlist, *vl, *vl2, *newvlist;
-   proplinkptr plink, ptop;
-   int pcount, p, i, j, k, pmatch, ival, crit, ctype;
-   double dval;
-   static struct valuelist nullvl, dfltvl;
+   struct property *kl, *m_rec;
+   struct valuelist *vl;
+   int pcount, p, i, j, k, h, lo, hi, nheads, nothers, best, crit;
+   int nsorted, distinct, most;
+   static struct valuelist nullvl;
    char multiple[2];
    int changed = 0;
 
@@ -4244,60 +5077,81 @@ int PropertyOptimize(struct objlist *ob, struct nlist *tp, int run, int serial)
    // an array of properties of interest to fill in order.
 
    m_rec = NULL;
-   ptop = NULL;
    pcount = 1;
    crit = -1;
-   ctype = -1;
+   optprops = (struct property **)OptGrow(optprops, &optpsize, 8,
+		sizeof(struct property *), 0);
+   optprops[0] = NULL;
    kl = (struct property *)HashFirst(&(tp->propdict));
    while (kl != NULL) {
-      // Make a linked list so we don't have to iterate through the hash again 
-      plink = (proplinkptr)MALLOC(sizeof(proplink));
-      plink->prop = kl;
-      plink->next = ptop;
-      ptop = plink;
       if ((*matchfunc)(kl->key, multiple)) {
 	 kl->idx = 0;
 	 m_rec = kl;
       }
-      else
+      else {
+	 optprops = (struct property **)OptGrow(optprops, &optpsize,
+		pcount + 1, sizeof(struct property *), pcount);
 	 kl->idx = pcount++;
+      }
+      optprops[kl->idx] = kl;
 
       // Set critical property index, if there is one.
       // To do: deal with possibility of multiple critical properties
       // per instance?
 
       if ((serial == FALSE) && (kl->merge == MERGE_ADD_CRIT ||
-		kl->merge == MERGE_PAR_CRIT)) {
+		kl->merge == MERGE_PAR_CRIT))
 	 crit = kl->idx;
-	 ctype = kl->merge;
-      }
-      else if ((serial == TRUE) && (kl->merge == MERGE_SER_CRIT)) {
+      else if ((serial == TRUE) && (kl->merge == MERGE_SER_CRIT))
 	 crit = kl->idx;
-	 ctype = MERGE_ADD_CRIT;
-      }
       kl = (struct property *)HashNext(&(tp->propdict));
    }
-   // Recast the linked list as an array
-   plist = (struct property **)CALLOC(pcount, sizeof(struct property *));
-   vlist = (struct valuelist ***)CALLOC(pcount, sizeof(struct valuelist **));
-   if (m_rec == NULL)
-      vlist[0] = (struct valuelist **)CALLOC(run, sizeof(struct valuelist *));
-
-   while (ptop != NULL) {
-      plist[ptop->prop->idx] = ptop->prop;
-      vlist[ptop->prop->idx] = (struct valuelist **)CALLOC(run,
-		sizeof(struct valuelist *));
-      plink = ptop;
-      FREE(ptop);
-      ptop = plink->next;
+
+   // Default values for properties missing from a record
+
+   optdflt = (struct valuelist *)OptGrow(optdflt, &optdsize, pcount,
+		sizeof(struct valuelist), 0);
+   for (p = 1; p < pcount; p++) {
+      kl = optprops[p];
+      optdflt[p].key = kl->key;
+      optdflt[p].type = kl->type;
+      switch (kl->type) {
+	 case PROP_STRING:
+	    optdflt[p].value.string = kl->pdefault.string;
+	    break;
+	 case PROP_INTEGER:
+	    optdflt[p].value.ival = kl->pdefault.ival;
+	    break;
+	 case PROP_DOUBLE:
+	 case PROP_VALUE:
+	    optdflt[p].value.dval = kl->pdefault.dval;
+	    break;
+	 case PROP_EXPRESSION:
+	    optdflt[p].value.stack = kl->pdefault.stack;
+	    break;
+      }
    }
-   
+
+   // Count the records actually present
+   i = 0;
+   for (ob2 = ob; ob2 && ob2->type == PROPERTY; ob2 = ob2->next)
+      if (++i == run) break;
+   run = i;
+
+   optvals = (struct valuelist **)OptGrow(optvals, &optvsize, run * pcount,
+		sizeof(struct valuelist *), 0);
+   memset(optvals, 0, run * pcount * sizeof(struct valuelist *));
+   optobs = (struct objlist **)OptGrow(optobs, &optosize, run,
+		sizeof(struct objlist *), 0);
+
    // Now, for each property record, sort the properties of interest
    // so that they are all in order.  Property "M" ("S") goes in position
    // zero.
 
+   optpcount = pcount;
    i = 0;
    for (ob2 = ob; ob2 && ob2->type == PROPERTY; ob2 = ob2->next) {
+      optobs[i] = ob2;
       for (p = 0;; p++) {
 	 vl = &(ob2->instance.props[p]);
 	 if (vl->type == PROP_ENDLIST) break;
@@ -4305,11 +5159,11 @@ int PropertyOptimize(struct objlist *ob, struct nlist *tp, int run, int serial)
 	 kl = (struct property *)HashLookup(vl->key, &(tp->propdict));
 	 if (kl == NULL && m_rec == NULL) {
 	    if ((*matchfunc)(vl->key, multiple)) {
-	       vlist[0][i] = vl;
+	       OPTVAL(i, 0) = vl;
 	    }
 	 }
  	 else if (kl != NULL) {
-	    vlist[kl->idx][i] = vl;
+	    OPTVAL(i, kl->idx) = vl;
 	 }
       }
       if (++i == run) break;
@@ -4317,7 +5171,7 @@ int PropertyOptimize(struct objlist *ob, struct nlist *tp, int run, int serial)
 
    // Check for "M" ("S") records with type double and promote them to integer
    for (i = 0; i < run; i++) {
-      vl = vlist[0][i];
+      vl = OPTVAL(i, 0);
       if (vl != NULL) {
          if (vl->type == PROP_DOUBLE) {
             vl->type = PROP_INTEGER;
@@ -4326,182 +5180,148 @@ int PropertyOptimize(struct objlist *ob, struct nlist *tp, int run, int serial)
       }
    }
 
-   // Now combine records with same properties by summing M (S).
-   for (i = 0; i < run - 1; i++) {
-      for (j = 1; j < run; j++) {
-	 pmatch = 0;
-	 for (p = 1; p < pcount; p++) {
-	    kl = plist[p];
-	    vl = vlist[p][i];
-	    vl2 = vlist[p][j];
-	    if (vl == NULL && vl2 == NULL) {
-	       pmatch++;
-	       continue;
-	    }
-
-	    // If either value is missing, it takes kl->pdefault
-	    // and must apply promotions if necessary.
-
-	    else if (vl == NULL || vl2 == NULL) {
-		if (vl == NULL) {
-		    if (kl->type != vlist[p][j]->type)
-			PromoteProperty(kl, vl2);
-		}
-		else {
-		    if (kl->type != vlist[p][i]->type)
-			PromoteProperty(kl, vl);
-		}
-		vl = &dfltvl;
-		dfltvl.type = kl->type;
-		switch (kl->type) {
-		    case PROP_STRING:
-			dfltvl.value.string = kl->pdefault.string;
-			break;
-		    case PROP_INTEGER:
-			dfltvl.value.ival = kl->pdefault.ival;
-			break;
-		    case PROP_DOUBLE:
-		    case PROP_VALUE:
-			dfltvl.value.ival = kl->pdefault.ival;
-			break;
-		    case PROP_EXPRESSION:
-			dfltvl.value.stack = kl->pdefault.stack;
-			break;
-		}
-	    }
-
-	    // Critical properties can be multiplied up by M (S) and do not
-	    // need to match.  May want a more nuanced comparison, though.
-	    if (p == crit) {
-	       pmatch++;
-	       continue;
-	    }
+   // Values missing from a record take the property default, and the
+   // values they are compared against are promoted to the type of the
+   // property.
+
+   for (p = 1; p < pcount; p++) {
+      kl = optprops[p];
+      for (i = 0; i < run; i++)
+	 if (OPTVAL(i, p) == NULL) break;
+      if (i == run) continue;
+      for (i = 0; i < run; i++) {
+	 vl = OPTVAL(i, p);
+	 if ((vl != NULL) && (kl->type != vl->type))
+	    PromoteProperty(kl, vl);
+      }
+   }
 
-	    switch(vl->type) {
-	       case PROP_DOUBLE:
-	       case PROP_VALUE:
-	          dval = 2 * fabs(vl->value.dval - vl2->value.dval)
-				/ (vl->value.dval + vl2->value.dval);
-		  if (dval <= kl->slop.dval) pmatch++;
-		  break;
-	       case PROP_INTEGER:
-		  ival = abs(vl->value.ival - vl2->value.ival);
-		  if (ival <= kl->slop.ival) pmatch++; 
-		  break;
-	       case PROP_STRING:
-		  if ((*matchfunc)(vl->value.string, vl2->value.string)) pmatch++;
-		  break;
+   // Now combine records with same properties by summing M (S).
+   // Each record is merged into the earliest record that it matches
+   // and that has not itself been merged away (a "head").  Records
+   // are taken in order.  Heads whose primary property can be sorted
+   // are kept in sorted order, so only the heads on either side of a
+   // record that match its primary property need to be checked.
+
+   optpos = (int *)OptGrow(optpos, &optssize, run, sizeof(int), 0);
+   optheads = (int *)OptGrow(optheads, &opthsize, run, sizeof(int), 0);
+   optothers = (int *)OptGrow(optothers, &optrsize, run, sizeof(int), 0);
+
+   // Short runs are not worth sorting.  Otherwise the primary property
+   // is the one with the most distinct values.
+
+   optcrit = crit;
+   optprime = -1;
+   nsorted = 0;
+   if (run >= OPT_SORT_MIN) {
+      most = 0;
+      h = -1;
+      for (p = 1; p < pcount; p++) {
+	 if (p == crit) continue;
+	 distinct = OptSortOn(p, run, &nsorted);
+	 if (distinct > most) {
+	    most = distinct;
+	    h = p;
+	 }
+      }
+      if (h < 0)
+	 optprime = -1;
+      else if (h != optprime)
+	 OptSortOn(h, run, &nsorted);
+   }
+   for (i = 0; i < nsorted; i++) optpos[optheads[i]] = i;
+
+   nheads = 0;
+   nothers = 0;
+   for (j = 0; j < run; j++) {
+      if (OPTVAL(j, 0) != NULL && OPTVAL(j, 0)->value.ival <= 0) continue;
+
+      best = -1;
+      if (OptOrdered(j)) {
+	 // Binary search for the position of j among the ordered heads
+	 lo = 0;
+	 hi = nheads;
+	 while (lo < hi) {
+	    k = (lo + hi) / 2;
+	    if (optpos[optheads[k]] < optpos[j]) lo = k + 1;
+	    else hi = k;
+	 }
+	 for (k = lo - 1; k >= 0; k--) {
+	    h = optheads[k];
+	    if (!OptMatchValues(optprime, h, j)) break;
+	    if ((best < 0 || h < best) && OptMatchRecords(h, j)) best = h;
+	 }
+	 for (k = lo; k < nheads; k++) {
+	    h = optheads[k];
+	    if (!OptMatchValues(optprime, h, j)) break;
+	    if ((best < 0 || h < best) && OptMatchRecords(h, j)) best = h;
+	 }
+      }
+      else {
+	 lo = -1;
+	 for (k = 0; k < nheads; k++) {
+	    h = optheads[k];
+	    if ((best < 0 || h < best) && OptMatchRecords(h, j)) best = h;
+	 }
+      }
+      for (k = 0; k < nothers; k++) {
+	 h = optothers[k];
+	 if (best >= 0 && h > best) break;
+	 if (OptMatchRecords(h, j)) {
+	    best = h;
+	    break;
+	 }
+      }
 
-	       /* will not attempt to match expressions, but it could
-		* be done with some minor effort by matching each
-		* stack token and comparing those that are strings.
-		*/
-	    }
+      if (best < 0) {
+	 // j starts a new group
+	 if (lo < 0)
+	    optothers[nothers++] = j;
+	 else {
+	    memmove(optheads + lo + 1, optheads + lo,
+			(nheads - lo) * sizeof(int));
+	    optheads[lo] = j;
+	    nheads++;
 	 }
-	 if (pmatch == (pcount - 1)) {
-	    // Sum M (S) (p == 0) records and remove one record
-	    if (vlist[0][i] == NULL) {
-	       // Add this to the end of the property record
-	       // find ith record in ob
-	       p = 0;
-	       for (ob2 = ob; p != i; ob2 = ob2->next, p++);
-	       // Count entries, add one, reallocate
-	       for (p = 0;; p++) {
-		  vl = &ob2->instance.props[p];
-		  if (vl->type == PROP_ENDLIST) break;
-	       }
-	       p++;
-	       newvlist = (struct valuelist *)CALLOC(p + 1,
-				sizeof(struct valuelist));
-	       // Move end record forward
-	       vl = &newvlist[p];
-	       vl->key = NULL;
-	       vl->type = PROP_ENDLIST;
-	       vl->value.ival = 0;
-
-	       // Add "M" ("S") record behind it
-	       vl = &newvlist[--p];
-	       vl->key = strsave(multiple);
-	       vl->type = PROP_INTEGER;
-	       vl->value.ival = 1;
-	       vlist[0][i] = vl;
-	       // Copy the rest of the records and regenerate vlist
-	       for (--p; p >= 0; p--) {
-	          vl = &newvlist[p];
-	          vl->key = ob2->instance.props[p].key;
-	          vl->type = ob2->instance.props[p].type;
-	          vl->value = ob2->instance.props[p].value;
-
-		  kl = (struct property *)HashLookup(vl->key, &(tp->propdict));
-		  if (kl != NULL) vlist[kl->idx][i] = vl;
-	       }
+	 continue;
+      }
 
-	       // Replace instance properties with the new list
-	       FREE(ob2->instance.props);
-	       ob2->instance.props = newvlist;
-	    }
+      // Sum M (S) (p == 0) records and remove one record
+      if (OPTVAL(best, 0) == NULL) OptAddMultiple(tp, best, multiple);
 
-	    if (vlist[0][j] == NULL) {
-	       vlist[0][j] = &nullvl;	// Mark this position
-	       vlist[0][i]->value.ival++;
-	    }
-	    else if (vlist[0][i]->value.ival > 0) {
-	       vlist[0][i]->value.ival += vlist[0][j]->value.ival;
-	       vlist[0][j]->value.ival = 0;
-	    }
-	 }
-         else j++;
+      if (OPTVAL(j, 0) == NULL) {
+	 OPTVAL(j, 0) = &nullvl;	// Mark this position
+	 OPTVAL(best, 0)->value.ival++;
+      }
+      else {
+	 OPTVAL(best, 0)->value.ival += OPTVAL(j, 0)->value.ival;
+	 OPTVAL(j, 0)->value.ival = 0;
       }
    }
 
    // For the special case of run == 1, reduce M (or S) to 1 by
    // merging the critical property (if any)
 
-   if ((run == 1) && (crit != -1) && (vlist[0][0] != NULL)) {
-      int mult = vlist[0][0]->value.ival;
-      if (mult > 1) {
-         vl = vlist[crit][0];
-
-         if ((serial == TRUE) && (ctype = MERGE_SER_CRIT)) {
-	    if (vl->type == PROP_INTEGER)
-	       vl->value.ival *= mult;
-	    else if (vl->type == PROP_DOUBLE)
-	       vl->value.dval *= (double)mult;
-	    vlist[0][0]->value.ival = 1;
-	    changed += mult;
-         }
-         else if (serial == FALSE && (ctype = MERGE_ADD_CRIT)) {
-	    if (vl->type == PROP_INTEGER)
-	       vl->value.ival *= mult;
-	    else if (vl->type == PROP_DOUBLE)
-	       vl->value.dval *= (double)mult;
-	    vlist[0][0]->value.ival = 1;
-	    changed += mult;
-         }
-         else if (serial == FALSE && (ctype = MERGE_PAR_CRIT)) {
-	    /* Technically one should check if divide-by-mult */	
-	    /* reduces the value to < 1 and promote to double */
-            /* if so, but that's a very unlikely case.	      */
-	    if (vl->type == PROP_INTEGER)
-	       vl->value.ival /= mult;
-	    else if (vl->type == PROP_DOUBLE)
-	       vl->value.dval /= (double)mult;
-	    vlist[0][0]->value.ival = 1;
-	    changed += mult;
-         }
-	 if (changed > 0) {
-	    if (serial)
-	       Printf("Combined %d serial devices.\n", changed);
-	    else
-	       Printf("Combined %d parallel devices.\n", changed);
-	 }
+   if ((run == 1) && (crit != -1) && (OPTVAL(0, 0) != NULL)) {
+      int mult = OPTVAL(0, 0)->value.ival;
+      if ((mult > 1) && ((vl = OPTVAL(0, crit)) != NULL)) {
+	 if (vl->type == PROP_INTEGER)
+	    vl->value.ival *= mult;
+	 else if (vl->type == PROP_DOUBLE)
+	    vl->value.dval *= (double)mult;
+	 OPTVAL(0, 0)->value.ival = 1;
+	 changed += mult;
+	 if (serial)
+	    Printf("Combined %d serial devices.\n", changed);
+	 else
+	    Printf("Combined %d parallel devices.\n", changed);
       }
    }
 
    // Remove entries with M (S) = 0
    ob2 = ob;
    for (i = 1; i < run; i++) {
-      vl = vlist[0][i];
+      vl = OPTVAL(i, 0);
       if (vl != NULL && vl->value.ival == 0) {
 	 obt = ob2->next;
 	 ob2->next = ob2->next->next;
@@ -4512,14 +5332,11 @@ int PropertyOptimize(struct objlist *ob, struct nlist *tp, int run, int serial)
 	 ob2 = ob2->next;
    }
 
-   // Cleanup memory allocation
+   // Reset property indexes
    for (p = 0; p < pcount; p++) {
-      kl = (struct property *)plist[p];
+      kl = optprops[p];
       if (kl) kl->idx = 0;
-      FREE(vlist[p]);
    }
-   FREE(plist);
-   FREE(vlist);
 
    return changed;
 }
@@ -4736,7 +5553,8 @@ PropertyCheckMismatch(struct objlist *tp1, struct nlist *tc1,
          vl2 = &(tp2->instance.props[j]);
 	 if (vl2->type == PROP_ENDLIST) break;
 	 if (check2[j] == 0)
-	    if ((*matchfunc)(vl1->key, vl2->key)) break;
+	    if ((vl1->key == vl2->key) || (*matchfunc)(vl1->key, vl2->key))
+	       break;
       }
       if (vl2->type == PROP_ENDLIST) {
 	 /* Check against M and S records;  a missing M or S	*/
@@ -5360,7 +6178,20 @@ void PrintPropertyResults(int do_list)
     struct ElementClass *EC;
 #ifdef TCL_NETGEN
 
-    if (do_list) {
+    if (do_list && (ReportFile != NULL)) {
+       Tcl_Obj *eprop;
+       int n = 0;
+
+       /* Write each instance as it is checked, without keeping	*/
+       /* the list for all instances.					*/
+       ReportKey("properties");
+       for (EC = ElementClasses; EC != NULL; EC = EC->next) {
+ 	   eprop = PropertyCheck(EC, 1, 1, &rval);
+	   if (eprop != NULL) ReportProperties(eprop, n++);
+       }
+       fprintf(ReportFile, "%s   ]", (n > 0) ? "\n" : "");
+    }
+    else if (do_list) {
        Tcl_Obj *proplist, *eprop;
 
        proplist = Tcl_NewListObj(0, NULL);
@@ -6090,9 +6921,10 @@ int EquivalenceClasses(char *name1, int file1, char *name2, int file2)
 {
    char *class1, *class2;
    struct Correspond *newc;
+   struct CorrespondLink *clink;
    struct nlist *tp, *tp2, *tpx;
    unsigned char need_new_seed = 0;
-   int reverse = 0;
+   int reverse = 0, bin1, bin2;
 
    if (file1 != -1 && file2 != -1) {
 
@@ -6130,7 +6962,7 @@ int EquivalenceClasses(char *name1, int file1, char *name2, int file2)
 	 while (need_new_seed == 1) {
 	    altname = (char *)MALLOC(strlen(name1) + 2);
 	    sprintf(altname, "%s%c", name1, (char)(65 + Random(26)));
-	    tp->classhash = (*hashfunc)(altname, 0);
+	    SetCellClasshash(tp, (*hashfunc)(altname, 0));
 
 	    /* Make sure randomly-altered name is not in any netlist */
 	    if ((LookupCellFile(altname, file1) == NULL) &&
@@ -6142,9 +6974,9 @@ int EquivalenceClasses(char *name1, int file1, char *name2, int file2)
       }
 
       if (reverse)
-         tp->classhash = tp2->classhash;
+         SetCellClasshash(tp, tp2->classhash);
       else
-         tp2->classhash = tp->classhash;
+         SetCellClasshash(tp2, tp->classhash);
       return 1;
    }
 
@@ -6161,6 +6993,21 @@ int EquivalenceClasses(char *name1, int file1, char *name2, int file2)
    newc->next = ClassCorrespondence;
    ClassCorrespondence = newc;
 
+   bin1 = hashnocase(name1, CORRESPONDHASHSIZE);
+   bin2 = hashnocase(name2, CORRESPONDHASHSIZE);
+
+   clink = (struct CorrespondLink *)CALLOC(1, sizeof(struct CorrespondLink));
+   clink->crec = newc;
+   clink->next = CorrespondTable[bin1];
+   CorrespondTable[bin1] = clink;
+
+   if (bin2 != bin1) {
+      clink = (struct CorrespondLink *)CALLOC(1, sizeof(struct CorrespondLink));
+      clink->crec = newc;
+      clink->next = CorrespondTable[bin2];
+      CorrespondTable[bin2] = clink;
+   }
+
    return 1;
 }
 
@@ -6181,6 +7028,7 @@ int reorderpins(struct hashlist *p, int file)
     ptr = (struct nlist *)(p->ptr);
 
     if (ptr->file != file) return 1;	/* Keeps the search going */
+    FreeNodePins(ptr);
 
     /* Pull the port order from the cell and put it in a list	*/
     /* NOTE:  This method requires the use of "CleanupPins()"	*/
@@ -6289,6 +7137,7 @@ struct nlist *addproxies(struct hashlist *p, void *clientdata)
 
     ptr = (struct nlist *)(p->ptr);
     if (ptr->file != tc->file) return NULL;	/* Keep going */
+    FreeNodePins(ptr);
 
     // Count the largest node number used in the cell
     maxnode = -1;
@@ -6375,6 +7224,78 @@ struct nlist *addproxies(struct hashlist *p, void *clientdata)
     return NULL;	/* Keep the search going */
 }
 
+/*----------------------------------------------------------------------*/
+/* Reorder the pins of cell tc2 (which must be Circuit2) and of all its	*/
+/* instances according to the pin indexes in model.port, then reset	*/
+/* the indexes.  Used by MatchPins() and CompareCacheApply().		*/
+/*----------------------------------------------------------------------*/
+
+static void SortCellPins(struct nlist *tc2)
+{
+   struct objlist *ob2, *obn;
+   int swapped;
+
+   /* Reorder pins in Circuit2 instances to match Circuit1 */
+
+   RecurseCellFileHashTable(reorderpins, tc2->file);
+   FreeNodePins(tc2);
+
+   /* Reorder pins in Circuit2 cell to match Circuit1		*/
+   /* Unlike the instance records, the structures are swapped,	*/
+   /* so the object hash pointers don't become invalid.		*/
+
+   do {
+      swapped = 0;
+      obn = NULL;
+      for (ob2 = tc2->cell; ob2 != NULL; ob2 = ob2->next) {
+	 if (ob2->next != NULL && IsPort(ob2) && IsPort(ob2->next)) {
+	    if (ob2->model.port > ob2->next->model.port) {
+	       swapped++;
+	       if (obn != NULL) {
+		  obn->next = ob2->next;
+	          ob2->next = ob2->next->next;
+	          obn->next->next = ob2;
+	       }
+	       else {
+		  tc2->cell = ob2->next;
+	          ob2->next = ob2->next->next;
+	          tc2->cell->next = ob2;
+	       }
+	       break;
+	    }
+	 }
+	 obn = ob2;
+      }
+   } while (swapped > 0);
+
+   /* Whether or not pins matched, reset ob2's pin indexes to 0 */
+
+   for (ob2 = tc2->cell; ob2 != NULL; ob2 = ob2->next) {
+      if (ob2->type != PORT) break;
+      ob2->model.port = -1;
+   }
+}
+
+#ifdef TCL_NETGEN
+/*------------------------------------------------------*/
+/* Add a pair of pin names to the "-list" output of	*/
+/* MatchPins(), or to the JSON report if one is open.	*/
+/*------------------------------------------------------*/
+
+static void ListPinPair(Tcl_Obj *plist1, Tcl_Obj *plist2, char *name1,
+	char *name2)
+{
+   if (ReportFile != NULL)
+      ReportAddPair(name1, 0, name2, 0);
+   else {
+      Tcl_ListObjAppendElement(netgeninterp, plist1,
+		Tcl_NewStringObj(name1, -1));
+      Tcl_ListObjAppendElement(netgeninterp, plist2,
+		Tcl_NewStringObj(name2, -1));
+   }
+}
+#endif
+
 /*------------------------------------------------------*/
 /* Declare that the device class "name1" is equivalent	*/
 /* to class "name2".  This is the same as the above	*/
@@ -6394,7 +7315,8 @@ struct nlist *addproxies(struct hashlist *p, void *clientdata)
 /* then some pins may be matched arbitrarily.		*/
 /*							*/
 /* If "dolist" is 1, append the list representing the	*/
-/* output (if any) to variable tcl_out, if it exists.	*/
+/* output (if any) to variable tcl_out, if it exists,	*/
+/* or write it to the JSON report if one is open.	*/
 /*							*/
 /* Return codes:					*/
 /* 2: Neither cell had pins, so matching is unnecessary	*/
@@ -6409,7 +7331,7 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
    struct objlist *ob1, *ob2, *obn, *obp, *ob1s, *ob2s, *obt;
    struct NodeClass *NC;
    struct Node *N1, *N2;
-   int i, j, k, m, a, b, swapped, numnodes, numorig;
+   int i, j, k, m, a, b, numnodes, numorig;
    int result = 1, haspins = 0;
    int hasproxy1 = 0, hasproxy2 = 0;
    int needclean1 = 0, needclean2 = 0;
@@ -6420,6 +7342,8 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
 
    if (tc1 == NULL) tc1 = Circuit1;
    if (tc2 == NULL) tc2 = Circuit2;
+   FreeNodePins(tc1);
+   FreeNodePins(tc2);
 
    for (ob2 = tc2->cell; ob2 != NULL; ob2 = ob2->next) {
       if (ob2->type != PORT) break;
@@ -6443,7 +7367,7 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
    numorig = numnodes;
 
 #ifdef TCL_NETGEN
-   if (dolist) {
+   if (dolist && (ReportFile == NULL)) {
       mlist = Tcl_NewListObj(0, NULL);
       plist1 = Tcl_NewListObj(0, NULL);
       plist2 = Tcl_NewListObj(0, NULL);
@@ -6488,7 +7412,9 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
 	             }
 	             if (N2 == NULL) {
 #ifdef TCL_NETGEN
-			if (dolist) {
+			if (dolist && (ReportFile != NULL))
+			   ReportPins();
+			else if (dolist) {
 			   Tcl_SetVar2Ex(netgeninterp, "lvs_out", NULL,
 					Tcl_NewStringObj("pins", -1),
 					TCL_APPEND_VALUE | TCL_LIST_ELEMENT);
@@ -6524,10 +7450,7 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
 			   }
 #ifdef TCL_NETGEN
 			   if (dolist) {
-		              Tcl_ListObjAppendElement(netgeninterp, plist1,
-					Tcl_NewStringObj(obn->name, -1));
-		              Tcl_ListObjAppendElement(netgeninterp, plist2,
-					Tcl_NewStringObj(obp->name, -1));
+		              ListPinPair(plist1, plist2, obn->name, obp->name);
 			   }
 #endif
 			   ob2->model.port = i;		/* save order */
@@ -6559,10 +7482,8 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
 			}
 #ifdef TCL_NETGEN
 			if (dolist && strcmp(obn->name, "(no pins)")) {
-		           Tcl_ListObjAppendElement(netgeninterp, plist1,
-				Tcl_NewStringObj(obn->name, -1));
-		           Tcl_ListObjAppendElement(netgeninterp, plist2,
-				Tcl_NewStringObj("(no matching pin)", -1));
+		           ListPinPair(plist1, plist2, obn->name,
+					"(no matching pin)");
 			}
 #endif
 			result = 0;
@@ -6602,10 +7523,8 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
 		  }
 #ifdef TCL_NETGEN
 		  if (dolist) {
-		     Tcl_ListObjAppendElement(netgeninterp, plist1,
-				Tcl_NewStringObj(obn->name, -1));
-		     Tcl_ListObjAppendElement(netgeninterp, plist2,
-				Tcl_NewStringObj("(no matching pin)", -1));
+		     ListPinPair(plist1, plist2, obn->name,
+				"(no matching pin)");
 		  }
 #endif
 		  result = 0;
@@ -6658,10 +7577,7 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
 	       }
 #ifdef TCL_NETGEN
 	       if (dolist) {
-		  Tcl_ListObjAppendElement(netgeninterp, plist1,
-				Tcl_NewStringObj(ob1->name, -1));
-		  Tcl_ListObjAppendElement(netgeninterp, plist2,
-				Tcl_NewStringObj(ob2->name, -1));
+		  ListPinPair(plist1, plist2, ob1->name, ob2->name);
 	       }
 #endif
 	    }
@@ -6707,10 +7623,7 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
 	 }
 #ifdef TCL_NETGEN
          if (dolist) {
-	    Tcl_ListObjAppendElement(netgeninterp, plist1,
-			Tcl_NewStringObj("(no matching pin)", -1));
-	    Tcl_ListObjAppendElement(netgeninterp, plist2,
-			Tcl_NewStringObj(ob2->name, -1));
+	    ListPinPair(plist1, plist2, "(no matching pin)", ob2->name);
          }
 #endif
 	 result = 0;
@@ -6895,49 +7808,16 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
       }
    }
 
-   /* Reorder pins in Circuit2 instances to match Circuit1 */
-
-   RecurseCellFileHashTable(reorderpins, Circuit2->file);
-
-   /* Reorder pins in Circuit2 cell to match Circuit1		*/
-   /* Unlike the instance records, the structures are swapped,	*/
-   /* so the object hash pointers don't become invalid.		*/
-
-   do {
-      swapped = 0;
-      obn = NULL;
-      for (ob2 = tc2->cell; ob2 != NULL; ob2 = ob2->next) {
-	 if (ob2->next != NULL && IsPort(ob2) && IsPort(ob2->next)) {
-	    if (ob2->model.port > ob2->next->model.port) {
-	       swapped++;
-	       if (obn != NULL) {
-		  obn->next = ob2->next;
-	          ob2->next = ob2->next->next;
-	          obn->next->next = ob2;
-	       }
-	       else {
-		  tc2->cell = ob2->next;
-	          ob2->next = ob2->next->next;
-	          tc2->cell->next = ob2;
-	       }
-	       break;
-	    }
-	 }
-	 obn = ob2;
-      }
-   } while (swapped > 0);
-
-   /* Whether or not pins matched, reset ob2's pin indexes to 0 */
+   /* Reorder pins in Circuit2 and its instances to match Circuit1 */
 
-   for (ob2 = tc2->cell; ob2 != NULL; ob2 = ob2->next) {
-      if (ob2->type != PORT) break;
-      ob2->model.port = -1;
-   }
+   SortCellPins(tc2);
 
 #ifdef TCL_NETGEN
    /* Handle list output */
 
-   if (dolist) {
+   if (dolist && (ReportFile != NULL))
+      ReportPins();
+   else if (dolist) {
       Tcl_SetVar2Ex(netgeninterp, "lvs_out", NULL,
 			Tcl_NewStringObj("pins", -1),
 			TCL_APPEND_VALUE | TCL_LIST_ELEMENT);
@@ -6949,6 +7829,545 @@ int MatchPins(struct nlist *tc1, struct nlist *tc2, int dolist)
    return result;
 }
 
+/*----------------------------------------------------------------------*/
+/* Compare result cache.  During hierarchical LVS, a subcircuit pair	*/
+/* that was proven equivalent with an exact pin match is recorded	*/
+/* under a key made from a structural hash of both cells.  The hash	*/
+/* covers the cell contents, the contents of all cells instanced	*/
+/* below them, pin permutations, property definitions, class		*/
+/* equivalences, and ignored classes.  When the same pair is queued	*/
+/* again with the same key, the recorded pin order is reapplied and	*/
+/* the full comparison is skipped.  The cache can be saved to and	*/
+/* loaded from a file so that it persists between runs.		*/
+/*----------------------------------------------------------------------*/
+
+struct CacheEntry {
+   char *key;
+   int numpins;
+   char **pins1;	/* Pin order of cell 1 */
+   char **pins2;	/* Corresponding pins of cell 2 */
+};
+
+int CompareCacheActive = FALSE;
+
+static struct hashdict compcache;
+static int compcache_init = FALSE;
+
+/* Key for the pair currently being compared, waiting to be recorded */
+static char *PendingKey = NULL;
+static struct nlist *PendingTc1 = NULL, *PendingTc2 = NULL;
+
+#define CACHE_KEY_LENGTH 33
+
+/* Mix a string into the hash pair h[0], h[1] */
+
+static void CacheMixString(unsigned long *h, char *s, int nocase)
+{
+   unsigned char c;
+
+   if (s != NULL) {
+      while ((c = (unsigned char)*s++) != '\0') {
+	 if (nocase) c = toupper(c);
+	 h[0] = (h[0] ^ c) * 16777619UL;
+	 h[1] = (h[1] * 31) + c + 0x9e3779b9UL;
+      }
+   }
+   h[0] = (h[0] ^ 0xff) * 16777619UL;
+   h[1] = (h[1] * 31) + 0xff;
+}
+
+/* Mix an integer value into the hash pair */
+
+static void CacheMixInt(unsigned long *h, unsigned long v)
+{
+   int i;
+
+   for (i = 0; i < (int)sizeof(unsigned long); i++) {
+      h[0] = (h[0] ^ (v & 0xff)) * 16777619UL;
+      h[1] = (h[1] * 31) + (v & 0xff) + 0x9e3779b9UL;
+      v >>= 8;
+   }
+}
+
+static void CacheMixDouble(unsigned long *h, double d)
+{
+   char dstr[32];
+
+   sprintf(dstr, "%.12g", d);
+   CacheMixString(h, dstr, 0);
+}
+
+static void CacheMixValue(unsigned long *h, struct valuelist *vl, int nocase)
+{
+   struct tokstack *stack;
+
+   CacheMixString(h, vl->key, nocase);
+   CacheMixInt(h, (unsigned long)vl->type);
+   switch (vl->type) {
+      case PROP_STRING:
+	 CacheMixString(h, vl->value.string, nocase);
+	 break;
+      case PROP_INTEGER:
+	 CacheMixInt(h, (unsigned long)vl->value.ival);
+	 break;
+      case PROP_DOUBLE:
+      case PROP_VALUE:
+	 CacheMixDouble(h, vl->value.dval);
+	 break;
+      case PROP_EXPRESSION:
+	 for (stack = vl->value.stack; stack; stack = stack->next) {
+	    CacheMixInt(h, (unsigned long)stack->toktype);
+	    if (stack->toktype == TOK_DOUBLE)
+	       CacheMixDouble(h, stack->data.dvalue);
+	    else if (stack->toktype == TOK_STRING ||
+			stack->toktype == TOK_OPT_STRING)
+	       CacheMixString(h, stack->data.string, nocase);
+	 }
+	 break;
+   }
+}
+
+/*----------------------------------------------------------------------*/
+/* Compute the structural hash of cell "tc" into hval[0], hval[1].	*/
+/* Instances are summed so that the result does not depend on the	*/
+/* order of instances in the netlist;  nets are identified by name.	*/
+/* "otherfile" is the file of the compared netlist, used to find	*/
+/* equivalent classes.  "memo" holds the hashes of cells already	*/
+/* visited.								*/
+/*----------------------------------------------------------------------*/
+
+static void CellStructureHash(struct nlist *tc, int otherfile,
+	struct hashdict *memo, unsigned long *hval)
+{
+   struct objlist *ob;
+   struct nlist *tsub, *teq;
+   struct property *kl;
+   struct Permutation *perm;
+   struct valuelist *vl;
+   unsigned long h[2], sum[2], ih[2], *mh;
+   char **netnames;
+   int maxnode, nocase, i;
+
+   mh = (unsigned long *)HashLookup(tc->name, memo);
+   if (mh != NULL) {
+      hval[0] = mh[0];
+      hval[1] = mh[1];
+      return;
+   }
+   nocase = (tc->flags & CELL_NOCASE) ? 1 : 0;
+
+   h[0] = 2166136261UL;
+   h[1] = 5381;
+   CacheMixString(h, tc->name, nocase);
+   CacheMixInt(h, (unsigned long)tc->class);
+   CacheMixInt(h, (unsigned long)(tc->flags & (COMB_SERIAL | COMB_NO_PARALLEL)));
+
+   /* Pin permutations and property definitions (in any order) */
+
+   sum[0] = sum[1] = 0;
+   for (perm = tc->permutes; perm != NULL; perm = perm->next) {
+      ih[0] = ih[1] = 0;
+      CacheMixString(ih, perm->pin1, nocase);
+      CacheMixString(ih, perm->pin2, nocase);
+      sum[0] += ih[0];
+      sum[1] += ih[1];
+   }
+   kl = (struct property *)HashFirst(&(tc->propdict));
+   while (kl != NULL) {
+      ih[0] = ih[1] = 1;
+      CacheMixString(ih, kl->key, nocase);
+      CacheMixInt(ih, (unsigned long)kl->type);
+      CacheMixInt(ih, (unsigned long)kl->merge);
+      if (kl->type == PROP_INTEGER)
+	 CacheMixInt(ih, (unsigned long)kl->slop.ival);
+      else
+	 CacheMixDouble(ih, kl->slop.dval);
+      sum[0] += ih[0];
+      sum[1] += ih[1];
+      kl = (struct property *)HashNext(&(tc->propdict));
+   }
+   CacheMixInt(h, sum[0]);
+   CacheMixInt(h, sum[1]);
+
+   /* Name each net by the first port or node record found for it */
+
+   maxnode = -1;
+   for (ob = tc->cell; ob != NULL; ob = ob->next)
+      if (ob->type != PROPERTY && ob->node > maxnode) maxnode = ob->node;
+   netnames = (char **)CALLOC(maxnode + 2, sizeof(char *));
+   for (ob = tc->cell; ob != NULL; ob = ob->next)
+      if (ob->type < FIRSTPIN && ob->type != PROPERTY && ob->node >= 0)
+	 if (netnames[ob->node] == NULL) netnames[ob->node] = ob->name;
+   for (ob = tc->cell; ob != NULL; ob = ob->next)
+      if (ob->type >= FIRSTPIN && ob->node >= 0)
+	 if (netnames[ob->node] == NULL) netnames[ob->node] = ob->name;
+
+   /* Ports, in order */
+
+   for (ob = tc->cell; ob != NULL && ob->type == PORT; ob = ob->next) {
+      CacheMixString(h, ob->name, nocase);
+      CacheMixString(h, (ob->node >= 0) ? netnames[ob->node] : NULL, nocase);
+   }
+
+   /* Globals and instances, in any order */
+
+   sum[0] = sum[1] = 0;
+   ih[0] = ih[1] = 0;
+   for (; ob != NULL; ob = ob->next) {
+      if (IsGlobal(ob)) {
+	 ih[0] = ih[1] = 2;
+	 CacheMixString(ih, ob->name, nocase);
+	 sum[0] += ih[0];
+	 sum[1] += ih[1];
+	 ih[0] = ih[1] = 0;
+      }
+      else if (ob->type == FIRSTPIN) {
+	 sum[0] += ih[0];
+	 sum[1] += ih[1];
+	 ih[0] = ih[1] = 3;
+
+	 /* The instanced cell, and its equivalent in the other netlist */
+	 tsub = LookupCellFile(ob->model.class, tc->file);
+	 if (tsub != NULL) {
+	    mh = (unsigned long *)HashLookup(tsub->name, memo);
+	    if (mh == NULL) {
+	       unsigned long sh[2];
+
+	       CellStructureHash(tsub, otherfile, memo, sh);
+	       mh = (unsigned long *)HashLookup(tsub->name, memo);
+	    }
+	    CacheMixInt(ih, mh[0]);
+	    CacheMixInt(ih, mh[1]);
+	    CacheMixInt(ih, mh[2]);
+	    CacheMixInt(ih, mh[3]);
+	 }
+	 else
+	    CacheMixString(ih, ob->model.class, nocase);
+      }
+      if (ob->type >= FIRSTPIN) {
+	 CacheMixInt(ih, (unsigned long)ob->type);
+	 CacheMixString(ih, (ob->node >= 0) ? netnames[ob->node] : NULL, nocase);
+      }
+      else if (ob->type == PROPERTY) {
+	 for (i = 0;; i++) {
+	    vl = &(ob->instance.props[i]);
+	    if (vl->type == PROP_ENDLIST) break;
+	    if (vl->key == NULL) continue;
+	    CacheMixValue(ih, vl, nocase);
+	 }
+      }
+   }
+   sum[0] += ih[0];
+   sum[1] += ih[1];
+   CacheMixInt(h, sum[0]);
+   CacheMixInt(h, sum[1]);
+   FREE(netnames);
+
+   /* Memo entries carry the hash of the equivalent class name so	*/
+   /* that instances in the parent see "equate classes" settings.	*/
+
+   mh = (unsigned long *)MALLOC(4 * sizeof(unsigned long));
+   mh[0] = h[0];
+   mh[1] = h[1];
+   mh[2] = mh[3] = 0;
+   teq = LookupClassEquivalent(tc->name, tc->file, otherfile);
+   CacheMixString(mh + 2, (teq != NULL) ? teq->name : NULL, nocase);
+   HashPtrInstall(tc->name, mh, memo);
+
+   hval[0] = h[0];
+   hval[1] = h[1];
+}
+
+/* Free a memo table used by CellStructureHash() */
+
+static void FreeHashMemo(struct hashdict *memo)
+{
+   unsigned long *mh;
+
+   mh = (unsigned long *)HashFirst(memo);
+   while (mh != NULL) {
+      FREE(mh);
+      mh = (unsigned long *)HashNext(memo);
+   }
+   HashKill(memo);
+}
+
+/*----------------------------------------------------------------------*/
+/* Compute the cache key for the pair tc1, tc2.  The key is also kept	*/
+/* as the pending key, to be recorded by CompareCacheRecord() if the	*/
+/* comparison succeeds.  Returns a pointer to the key string.		*/
+/*----------------------------------------------------------------------*/
+
+char *CompareCacheKey(struct nlist *tc1, struct nlist *tc2)
+{
+   struct hashdict memo;
+   struct IgnoreList *ilist;
+   unsigned long h1[2], h2[2], h[2];
+
+   InitializeHashTable(&memo, OBJHASHSIZE);
+   CellStructureHash(tc1, tc2->file, &memo, h1);
+   FreeHashMemo(&memo);
+
+   InitializeHashTable(&memo, OBJHASHSIZE);
+   CellStructureHash(tc2, tc1->file, &memo, h2);
+   FreeHashMemo(&memo);
+
+   h[0] = h1[0];
+   h[1] = h1[1];
+   CacheMixInt(h, h2[0]);
+   CacheMixInt(h, h2[1]);
+   CacheMixInt(h, (unsigned long)(tc1->flags & CELL_NOCASE));
+   CacheMixInt(h, (unsigned long)(tc2->flags & CELL_NOCASE));
+   for (ilist = ClassIgnore; ilist != NULL; ilist = ilist->next) {
+      if (ilist->file == -1 || ilist->file == tc1->file ||
+		ilist->file == tc2->file) {
+	 CacheMixString(h, ilist->class, 0);
+	 CacheMixInt(h, (unsigned long)ilist->type);
+      }
+   }
+
+   /* Upper-case hex digits hash and match the same way whether or	*/
+   /* not the current match functions are case-insensitive.		*/
+
+   if (PendingKey == NULL) PendingKey = (char *)MALLOC(CACHE_KEY_LENGTH);
+   snprintf(PendingKey, CACHE_KEY_LENGTH, "%016lX%016lX", h[0], h[1]);
+   PendingTc1 = tc1;
+   PendingTc2 = tc2;
+   return PendingKey;
+}
+
+static void InitCompareCache(void)
+{
+   if (compcache_init == FALSE) {
+      InitializeHashTable(&compcache, OBJHASHSIZE);
+      compcache_init = TRUE;
+   }
+}
+
+static void FreeCacheEntry(struct CacheEntry *entry)
+{
+   int i;
+
+   for (i = 0; i < entry->numpins; i++) {
+      FREE(entry->pins1[i]);
+      FREE(entry->pins2[i]);
+   }
+   if (entry->pins1) FREE(entry->pins1);
+   if (entry->pins2) FREE(entry->pins2);
+   FREE(entry->key);
+   FREE(entry);
+}
+
+static void AddCacheEntry(struct CacheEntry *entry)
+{
+   struct CacheEntry *old;
+
+   InitCompareCache();
+   old = (struct CacheEntry *)HashLookup(entry->key, &compcache);
+   if (old != NULL) {
+      HashDelete(entry->key, &compcache);
+      FreeCacheEntry(old);
+   }
+   HashPtrInstall(entry->key, entry, &compcache);
+}
+
+/*----------------------------------------------------------------------*/
+/* Record the result of the pending comparison of tc1 and tc2.  Only	*/
+/* pairs that matched uniquely, without property errors, and with an	*/
+/* exact pin match are recorded.  "pinresult" is the return value of	*/
+/* MatchPins().								*/
+/*----------------------------------------------------------------------*/
+
+void CompareCacheRecord(struct nlist *tc1, struct nlist *tc2, int pinresult)
+{
+   struct CacheEntry *entry;
+   struct objlist *ob1, *ob2;
+   int i, n;
+
+   if ((CompareCacheActive == FALSE) || (PendingKey == NULL)) return;
+   if ((tc1 != PendingTc1) || (tc2 != PendingTc2)) return;
+   PendingTc1 = PendingTc2 = NULL;
+
+   if (pinresult != 1) return;
+   if (PropertyErrorDetected != 0) return;
+   if ((ElementClasses == NULL) || (VerifyMatching() != 0)) return;
+
+   n = 0;
+   for (ob1 = tc1->cell, ob2 = tc2->cell; ob1 && ob2 && IsPort(ob1)
+		&& IsPort(ob2); ob1 = ob1->next, ob2 = ob2->next) n++;
+   if ((ob1 && IsPort(ob1)) || (ob2 && IsPort(ob2))) return;
+
+   entry = (struct CacheEntry *)CALLOC(1, sizeof(struct CacheEntry));
+   entry->key = strsave(PendingKey);
+   entry->numpins = n;
+   if (n > 0) {
+      entry->pins1 = (char **)CALLOC(n, sizeof(char *));
+      entry->pins2 = (char **)CALLOC(n, sizeof(char *));
+   }
+   for (i = 0, ob1 = tc1->cell, ob2 = tc2->cell; i < n;
+		i++, ob1 = ob1->next, ob2 = ob2->next) {
+      entry->pins1[i] = strsave(ob1->name);
+      entry->pins2[i] = strsave(ob2->name);
+   }
+   AddCacheEntry(entry);
+}
+
+/*----------------------------------------------------------------------*/
+/* If the key for tc1 and tc2 is in the cache, reapply the recorded	*/
+/* pin order to tc2 and its instances, as MatchPins() would have done.	*/
+/* Return 1 if the cached result was applied, 0 otherwise.		*/
+/*----------------------------------------------------------------------*/
+
+int CompareCacheApply(char *key, struct nlist *tc1, struct nlist *tc2)
+{
+   struct CacheEntry *entry;
+   struct objlist *ob;
+   int i, n;
+
+   if ((CompareCacheActive == FALSE) || (compcache_init == FALSE)) return 0;
+   entry = (struct CacheEntry *)HashLookup(key, &compcache);
+   if (entry == NULL) return 0;
+
+   /* Pin names must be the same as when the result was recorded */
+
+   n = 0;
+   for (ob = tc1->cell; ob != NULL && IsPort(ob); ob = ob->next) {
+      if ((n >= entry->numpins) || strcmp(ob->name, entry->pins1[n])) return 0;
+      n++;
+   }
+   if (n != entry->numpins) return 0;
+
+   n = 0;
+   for (ob = tc2->cell; ob != NULL && IsPort(ob); ob = ob->next) {
+      ob->model.port = -1;
+      for (i = 0; i < entry->numpins; i++)
+	 if (!strcmp(ob->name, entry->pins2[i])) {
+	    ob->model.port = i;
+	    break;
+	 }
+      if (ob->model.port == -1) break;
+      n++;
+   }
+   if ((ob != NULL && IsPort(ob)) || (n != entry->numpins)) {
+      for (ob = tc2->cell; ob != NULL && IsPort(ob); ob = ob->next)
+	 ob->model.port = -1;
+      return 0;
+   }
+
+   Circuit1 = tc1;
+   Circuit2 = tc2;
+   SetMatchFunctions(tc1, tc2);
+   SortCellPins(tc2);
+   PendingTc1 = PendingTc2 = NULL;
+   return 1;
+}
+
+/* Remove all entries from the cache */
+
+void CompareCacheClear(void)
+{
+   struct CacheEntry *entry;
+
+   if (compcache_init == FALSE) return;
+   entry = (struct CacheEntry *)HashFirst(&compcache);
+   while (entry != NULL) {
+      FreeCacheEntry(entry);
+      entry = (struct CacheEntry *)HashNext(&compcache);
+   }
+   HashKill(&compcache);
+   compcache_init = FALSE;
+}
+
+/* Return the number of entries in the cache */
+
+int CompareCacheCount(void)
+{
+   void *entry;
+   int n = 0;
+
+   if (compcache_init == FALSE) return 0;
+   for (entry = HashFirst(&compcache); entry; entry = HashNext(&compcache)) n++;
+   return n;
+}
+
+/*----------------------------------------------------------------------*/
+/* Write the cache to a file.  Entries with pin names containing	*/
+/* whitespace are not saved.  Return the number of entries written,	*/
+/* or -1 if the file could not be opened.				*/
+/*----------------------------------------------------------------------*/
+
+int CompareCacheSave(char *filename)
+{
+   FILE *f;
+   struct CacheEntry *entry;
+   int i, n = 0;
+
+   f = fopen(filename, "w");
+   if (f == NULL) return -1;
+   fprintf(f, "netgen_compare_cache 1\n");
+   if (compcache_init == TRUE) {
+      entry = (struct CacheEntry *)HashFirst(&compcache);
+      while (entry != NULL) {
+	 for (i = 0; i < entry->numpins; i++)
+	    if (strpbrk(entry->pins1[i], " \t\n") ||
+			strpbrk(entry->pins2[i], " \t\n")) break;
+	 if (i == entry->numpins) {
+	    fprintf(f, "%s %d\n", entry->key, entry->numpins);
+	    for (i = 0; i < entry->numpins; i++)
+	       fprintf(f, "%s %s\n", entry->pins1[i], entry->pins2[i]);
+	    n++;
+	 }
+	 entry = (struct CacheEntry *)HashNext(&compcache);
+      }
+   }
+   fclose(f);
+   return n;
+}
+
+/*----------------------------------------------------------------------*/
+/* Read cache entries from a file written by CompareCacheSave().	*/
+/* Return the number of entries read, or -1 on error.			*/
+/*----------------------------------------------------------------------*/
+
+int CompareCacheLoad(char *filename)
+{
+   FILE *f;
+   struct CacheEntry *entry;
+   char key[CACHE_KEY_LENGTH + 1], pin1[1024], pin2[1024];
+   int i, n = 0, numpins, version;
+
+   f = fopen(filename, "r");
+   if (f == NULL) return -1;
+   if ((fscanf(f, "netgen_compare_cache %d", &version) != 1) || (version != 1)) {
+      fclose(f);
+      return -1;
+   }
+   while (fscanf(f, "%33s %d", key, &numpins) == 2) {
+      if (numpins < 0) break;
+      entry = (struct CacheEntry *)CALLOC(1, sizeof(struct CacheEntry));
+      entry->key = strsave(key);
+      if (numpins > 0) {
+	 entry->pins1 = (char **)CALLOC(numpins, sizeof(char *));
+	 entry->pins2 = (char **)CALLOC(numpins, sizeof(char *));
+      }
+      for (i = 0; i < numpins; i++) {
+	 if (fscanf(f, "%1023s %1023s", pin1, pin2) != 2) break;
+	 entry->pins1[i] = strsave(pin1);
+	 entry->pins2[i] = strsave(pin2);
+	 entry->numpins++;
+      }
+      if (i < numpins) {
+	 FreeCacheEntry(entry);
+	 fclose(f);
+	 return -1;
+      }
+      AddCacheEntry(entry);
+      n++;
+   }
+   fclose(f);
+   return n;
+}
+
 /*------------------------------------------------------*/
 /* Find the equivalent node to object "ob" in the other	*/
 /* circuit.  Return a pointer to the object structure	*/
@@ -7085,7 +8504,8 @@ void handler(int sig)
 
 void enable_interrupt()
 {
-   InterruptPending = 0;
+   /* A cancelled background job stays interrupted */
+   InterruptPending = JobCancelled;
    oldinthandler = signal(SIGINT, handler);
 }
 
@@ -7,6 +7,8 @@ extern struct nlist *Circuit1;
 extern struct nlist *Circuit2;
 
 extern int ExhaustiveSubdivision;
+extern int BadMatchDetected;
+extern int SignatureMismatch;
 
 #ifdef TCL_NETGEN
 #include <tcl.h>
@@ -21,9 +23,12 @@ extern void SummarizeNodeClasses(struct NodeClass *NC);
 extern void PrintPropertyResults(int do_list);
 extern void PrintCoreStats(void);
 extern void ResetState(void);
+extern void SetMatchFunctions(struct nlist *tc1, struct nlist *tc2);
 extern void CreateTwoLists(char *name1, int file1, char *name2, int file2,
 		int dolist);
 extern int Iterate(void);
+extern int CheckSignatures(struct nlist *tc1, struct nlist *tc2);
+extern void MatchFail(char *name1, char *name2);
 extern int VerifyMatching(void);
 extern void PrintAutomorphisms(void);
 extern int ResolveAutomorphisms(void);
@@ -47,14 +52,39 @@ extern void PrintIllegalClasses();
 extern void PrintIllegalNodeClasses();
 extern void PrintIllegalElementClasses();
 
+extern int  TraceOpen(char *filename);
+extern void TraceClose(void);
+extern int  TraceActive(void);
+
 #ifdef TCL_NETGEN
 extern int EquivalentNode();
 extern int EquivalentElement();
 
+extern int CompareCacheActive;
+extern char *CompareCacheKey(struct nlist *tc1, struct nlist *tc2);
+extern int  CompareCacheApply(char *key, struct nlist *tc1, struct nlist *tc2);
+extern void CompareCacheRecord(struct nlist *tc1, struct nlist *tc2, int pinresult);
+extern void CompareCacheClear(void);
+extern int  CompareCacheCount(void);
+extern int  CompareCacheSave(char *filename);
+extern int  CompareCacheLoad(char *filename);
+
+extern int  JobActive;
+extern volatile int JobCancelled;
+extern void JobProgress(char *cell1, char *cell2, int iteration,
+		int eclasses, int nclasses, int unresolved);
+
 extern void enable_interrupt();
 extern void disable_interrupt();
 
 extern Tcl_Obj *ListNodeClasses(int legal);
 extern Tcl_Obj *ListElementClasses(int legal);
+
+extern int  ReportOpen(char *filename);
+extern void ReportNextCell(void);
+extern void ReportClose(void);
+extern int  ReportActive(void);
+extern void ReportNodeClasses(int legal);
+extern void ReportElementClasses(int legal);
 #endif
 
@@ -40,6 +40,7 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include "netfile.h"
 #include "print.h"
 #include "netcmp.h"
+#include "timing.h"
 
 int Debug = 0;
 int VerboseOutput = 1;  /* by default, we get verbose output */
@@ -92,6 +93,7 @@ void PushTok(int toktype, void *tval, struct tokstack **top)
 	    newstack->data.dvalue = *((double *)tval);
 	    break;
 	case TOK_STRING:
+	case TOK_OPT_STRING:
 	    newstack->data.string = strsave((char *)tval);
 	    break;
 	case TOK_SGL_QUOTE:
@@ -153,6 +155,7 @@ struct tokstack *CopyTokStack(struct tokstack *stack)
 	newstack->toktype = stackptr->toktype;
 	switch (stackptr->toktype) {
 	    case TOK_STRING:
+	    case TOK_OPT_STRING:
 		newstack->data.string = strsave(stackptr->data.string);
 		break;
 	    default:
@@ -255,6 +258,475 @@ int TokGetValue(char *estr, struct nlist *parent, struct objlist *parprops,
     return ((result == 0) ? -1 : 1);
 }
 
+/*--------------------------------------------------------------*/
+/* Push an operand of an expression on to the expression stack.	*/
+/* Literal values are converted immediately.  Anything else is	*/
+/* left as a string to be resolved against the parameters in	*/
+/* effect each time the expression is used.  If "optional" is	*/
+/* TRUE, the operand is dropped if it cannot be resolved.	*/
+/*--------------------------------------------------------------*/
+
+void PushOperand(char *estr, int optional, struct tokstack **top)
+{
+    double dval;
+
+    if (*estr == '\0') return;
+
+    if (StringIsValue(estr) && (ConvertStringToFloat(estr, &dval) == 1))
+	PushTok(TOK_DOUBLE, &dval, top);
+    else
+	PushTok((optional) ? TOK_OPT_STRING : TOK_STRING, estr, top);
+}
+
+/*--------------------------------------------------------------*/
+/* Parse an expression string into tokenized form.  Operands	*/
+/* are not substituted here, so the result depends only on the	*/
+/* string and can be shared between all instances using it.	*/
+/* Note that "estr" is modified in the process.			*/
+/*--------------------------------------------------------------*/
+
+struct tokstack *TokenizeExpression(char *estr)
+{
+    struct tokstack *expstack, *lptr;
+    char *tstr, *sstr;
+    int numlast, savetok;
+    double dval;
+
+    expstack = NULL;
+    tstr = estr;
+
+    numlast = 0;
+    while (*tstr != '\0') {
+	switch(*tstr) {
+
+	    case '+':
+		if (numlast == 0) {
+		    /* This is part of a number */
+		    dval = strtod(estr, &sstr);
+		    if (sstr > estr && sstr > tstr) {
+			tstr = sstr - 1;
+			numlast = 1;
+		    }
+		    break;
+		}
+		/* Not a number, so must be arithmetic */
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+		PushTok(TOK_PLUS, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case '-':
+		if (numlast == 0) {
+		    /* This is part of a number */
+		    dval = strtod(estr, &sstr);
+		    if (sstr > estr && sstr > tstr) {
+			tstr = sstr - 1;
+			numlast = 1;
+		    }
+		    break;
+		}
+		/* Not a number, so must be arithmetic */
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+		PushTok(TOK_MINUS, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case '1': case '2': case '3': case '4': case '5':
+	    case '6': case '7': case '8': case '9': case '0':
+		/* Numerical value.  Use strtod() to capture */
+		if (numlast == 1) break;
+		dval = strtod(estr, &sstr);
+		if (sstr > estr && sstr > tstr) {
+		    tstr = sstr - 1;
+		    numlast = 1;
+		}
+		break;
+
+	    case '/':
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+		PushTok(TOK_DIVIDE, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case '*':
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+		PushTok(TOK_MULTIPLY, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case '(':
+		*tstr = '\0';
+
+		/* Check for predefined function keywords */
+
+		if (!strcmp(estr, "IF")) {
+		    PushTok(TOK_FUNC_IF, NULL, &expstack);
+		}
+		else {
+		    /* Treat as a parenthetical grouping */
+
+		    PushOperand(estr, FALSE, &expstack);
+		    PushTok(TOK_FUNC_OPEN, NULL, &expstack);
+		}
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case ')':
+		*tstr = '\0';
+
+		if (expstack == NULL) break;
+		savetok = expstack->toktype;
+
+		PushOperand(estr, FALSE, &expstack);
+
+		switch (savetok) {
+		    case TOK_FUNC_THEN:
+			PushTok(TOK_FUNC_ELSE, NULL, &expstack);
+			break;
+		    default:
+			PushTok(TOK_FUNC_CLOSE, NULL, &expstack);
+			break;
+		}
+		numlast = 1;
+		estr = tstr + 1;
+		break;
+
+	    case '\'':
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+		PushTok(TOK_SGL_QUOTE, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case '"':
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+		PushTok(TOK_DBL_QUOTE, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case '{':
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+		PushTok(TOK_GROUP_OPEN, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case '}':
+		*tstr = '\0';
+		PushOperand(estr, TRUE, &expstack);
+		PushTok(TOK_GROUP_CLOSE, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 1;
+		break;
+
+	    case '!':
+		if (*(tstr + 1) == '=') {
+		    *tstr = '\0';
+		    PushOperand(estr, FALSE, &expstack);
+		    PushTok(TOK_NE, NULL, &expstack);
+		}
+		numlast = 0;
+		break;
+
+	    case '=':
+		if (*(tstr + 1) == '=') {
+		    *tstr = '\0';
+		    PushOperand(estr, FALSE, &expstack);
+		    PushTok(TOK_EQ, NULL, &expstack);
+		    numlast = 0;
+		}
+		break;
+
+	    case '>':
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+
+		if (*(tstr + 1) == '=') {
+		    PushTok(TOK_GE, NULL, &expstack);
+		    tstr++;
+		}
+		else
+		    PushTok(TOK_GT, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case '<':
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+
+		if (*(tstr + 1) == '=') {
+		    PushTok(TOK_LE, NULL, &expstack);
+		    tstr++;
+		}
+		else
+		    PushTok(TOK_LT, NULL, &expstack);
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    case ',':
+		*tstr = '\0';
+		PushOperand(estr, FALSE, &expstack);
+		if (expstack == NULL) break;
+		lptr = expstack;
+		while (lptr->next) {
+		    lptr = lptr->next;
+		    if (lptr->toktype == TOK_FUNC_THEN) {
+			PushTok(TOK_FUNC_ELSE, NULL, &expstack);
+			break;
+		    }
+		    else if (lptr->toktype == TOK_FUNC_IF) {
+			PushTok(TOK_FUNC_THEN, NULL, &expstack);
+			break;
+		    }
+		}
+		estr = tstr + 1;
+		numlast = 0;
+		break;
+
+	    default:
+		break;
+	}
+	tstr++;
+    }
+    PushOperand(estr, FALSE, &expstack);
+    return expstack;
+}
+
+/*--------------------------------------------------------------*/
+/* Expression cache.  Each distinct expression string is	*/
+/* tokenized once and kept in "exprcache" as a template with	*/
+/* unresolved parameter operands.  Each template keeps a small	*/
+/* direct-mapped table of reduced results keyed by the values	*/
+/* its parameters had when the result was computed, so that	*/
+/* instances sharing both the expression and the parameter	*/
+/* values need no tokenizing or reduction at all.		*/
+/*--------------------------------------------------------------*/
+
+#define EXPR_CACHE_SIZE	 1009	/* Hash size for expression strings */
+#define EXPR_CACHE_MAX	 65536	/* Maximum number of cached expressions */
+#define EXPR_MEMO_SIZE	 16	/* Results remembered per expression */
+
+struct exprmemo {
+    double *vals;		/* Parameter values (NULL if unused) */
+    unsigned char *resolved;	/* Whether each parameter was found */
+    unsigned char type;		/* PROP_DOUBLE or PROP_STRING */
+    union {
+	double dval;
+	char *string;
+    } value;
+};
+
+struct exprentry {
+    struct tokstack *stack;	/* Tokenized expression template */
+    int nvars;			/* Number of parameter operands */
+    double *vals;		/* Scratch space for parameter values */
+    unsigned char *resolved;	/* Scratch space for resolved flags */
+    struct exprmemo *memo;	/* Table of EXPR_MEMO_SIZE results */
+};
+
+static struct hashdict exprcache;
+static int exprcache_count = 0;
+
+/*--------------------------------------------------------------*/
+/* Find the bottom (first token) of an expression stack		*/
+/*--------------------------------------------------------------*/
+
+static struct tokstack *TokBottom(struct tokstack *stack)
+{
+    if (stack == NULL) return NULL;
+    while (stack->next != NULL) stack = stack->next;
+    return stack;
+}
+
+/*--------------------------------------------------------------*/
+/* Return the cache entry for expression string "estr", 	*/
+/* tokenizing the expression if it has not been seen before.	*/
+/* Returns NULL if the cache is full.				*/
+/*--------------------------------------------------------------*/
+
+static struct exprentry *GetExprEntry(char *estr)
+{
+    struct exprentry *entry;
+    struct tokstack *stackptr;
+    char *ecopy;
+    int i;
+
+    if (exprcache.hashtab == NULL)
+	InitializeHashTable(&exprcache, EXPR_CACHE_SIZE);
+
+    entry = (struct exprentry *)HashInt2Lookup(estr, 0, &exprcache);
+    if (entry != NULL) return entry;
+    if (exprcache_count >= EXPR_CACHE_MAX) return NULL;
+
+    entry = (struct exprentry *)CALLOC(1, sizeof(struct exprentry));
+    ecopy = strsave(estr);
+    entry->stack = TokenizeExpression(ecopy);
+    FREE(ecopy);
+
+    for (stackptr = entry->stack; stackptr; stackptr = stackptr->next)
+	if (stackptr->toktype == TOK_STRING || stackptr->toktype == TOK_OPT_STRING)
+	    entry->nvars++;
+
+    if (entry->nvars > 0) {
+	entry->vals = (double *)CALLOC(entry->nvars, sizeof(double));
+	entry->resolved = (unsigned char *)CALLOC(entry->nvars,
+		sizeof(unsigned char));
+    }
+    entry->memo = (struct exprmemo *)CALLOC(EXPR_MEMO_SIZE,
+		sizeof(struct exprmemo));
+    for (i = 0; i < EXPR_MEMO_SIZE; i++)
+	entry->memo[i].type = PROP_ENDLIST;
+
+    HashInt2PtrInstall(estr, 0, entry, &exprcache);
+    exprcache_count++;
+    return entry;
+}
+
+/*--------------------------------------------------------------*/
+/* Resolve the parameter operands of a cached expression into	*/
+/* the entry's scratch space, and return the memo table slot	*/
+/* for this set of values.					*/
+/*--------------------------------------------------------------*/
+
+static struct exprmemo *ExprMemoSlot(struct exprentry *entry,
+	struct nlist *parent, struct objlist *parprops, int glob)
+{
+    struct tokstack *stackptr;
+    unsigned long hashval;
+    unsigned char *bytes;
+    int i, j;
+
+    hashval = 0;
+    i = 0;
+    for (stackptr = TokBottom(entry->stack); stackptr; stackptr = stackptr->last) {
+	if (stackptr->toktype != TOK_STRING && stackptr->toktype != TOK_OPT_STRING)
+	    continue;
+	if (TokGetValue(stackptr->data.string, parent, parprops, glob,
+			&entry->vals[i]) == 1) {
+	    entry->resolved[i] = 1;
+	    bytes = (unsigned char *)&entry->vals[i];
+	    for (j = 0; j < sizeof(double); j++)
+		hashval = bytes[j] + (hashval << 6) + (hashval << 16) - hashval;
+	}
+	else {
+	    entry->resolved[i] = 0;
+	    entry->vals[i] = 0.0;
+	    hashval = (hashval << 6) + (hashval << 16) - hashval + 1;
+	}
+	i++;
+    }
+    return &entry->memo[hashval % EXPR_MEMO_SIZE];
+}
+
+/*--------------------------------------------------------------*/
+/* Return TRUE if the memo slot holds a result for the values	*/
+/* currently in the entry's scratch space.			*/
+/*--------------------------------------------------------------*/
+
+static int ExprMemoMatch(struct exprentry *entry, struct exprmemo *memo)
+{
+    int i;
+
+    if (memo->type != PROP_DOUBLE && memo->type != PROP_STRING) return FALSE;
+    for (i = 0; i < entry->nvars; i++) {
+	if (memo->resolved[i] != entry->resolved[i]) return FALSE;
+	if (entry->resolved[i] && (memo->vals[i] != entry->vals[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+/*--------------------------------------------------------------*/
+/* Record the reduced value of an expression in a memo slot.	*/
+/*--------------------------------------------------------------*/
+
+static void ExprMemoStore(struct exprentry *entry, struct exprmemo *memo,
+	struct valuelist *kv)
+{
+    if (memo->type == PROP_STRING) FREE(memo->value.string);
+    memo->type = PROP_ENDLIST;
+
+    if ((memo->vals == NULL) && (entry->nvars > 0)) {
+	memo->vals = (double *)CALLOC(entry->nvars, sizeof(double));
+	memo->resolved = (unsigned char *)CALLOC(entry->nvars,
+		sizeof(unsigned char));
+    }
+    if (entry->nvars > 0) {
+	memcpy(memo->vals, entry->vals, entry->nvars * sizeof(double));
+	memcpy(memo->resolved, entry->resolved, entry->nvars);
+    }
+
+    if (kv->type == PROP_DOUBLE) {
+	memo->type = PROP_DOUBLE;
+	memo->value.dval = kv->value.dval;
+    }
+    else if (kv->type == PROP_STRING) {
+	memo->type = PROP_STRING;
+	memo->value.string = strsave(kv->value.string);
+    }
+}
+
+/*--------------------------------------------------------------*/
+/* Substitute parameter operands of a tokenized expression with	*/
+/* the values resolved for them.  Optional operands that could	*/
+/* not be resolved are removed.  "values" is the cache entry	*/
+/* whose scratch space holds the values, or NULL to look the	*/
+/* values up directly.  Returns the new top of the stack.	*/
+/*--------------------------------------------------------------*/
+
+static struct tokstack *ResolveTokStack(struct tokstack *top,
+	struct exprentry *values, struct nlist *parent,
+	struct objlist *parprops, int glob)
+{
+    struct tokstack *stackptr, *nextptr;
+    double dval;
+    int i, result;
+
+    i = 0;
+    for (stackptr = TokBottom(top); stackptr; stackptr = nextptr) {
+	nextptr = stackptr->last;
+	if (stackptr->toktype != TOK_STRING && stackptr->toktype != TOK_OPT_STRING)
+	    continue;
+
+	if (values != NULL) {
+	    result = (values->resolved[i]) ? 1 : -1;
+	    dval = values->vals[i];
+	    i++;
+	}
+	else
+	    result = TokGetValue(stackptr->data.string, parent, parprops,
+			glob, &dval);
+
+	if (result == 1) {
+	    FREE(stackptr->data.string);
+	    stackptr->toktype = TOK_DOUBLE;
+	    stackptr->data.dvalue = dval;
+	}
+	else if (stackptr->toktype == TOK_OPT_STRING) {
+	    if (stackptr->last) stackptr->last->next = stackptr->next;
+	    else top = stackptr->next;
+	    if (stackptr->next) stackptr->next->last = stackptr->last;
+	    FREE(stackptr->data.string);
+	    FREE(stackptr);
+	}
+    }
+    return top;
+}
+
 /*--------------------------------------------------------------*/
 /* Work through the property list of an instance, looking for	*/
 /* properties that are marked as expressions.  For each 	*/
@@ -272,9 +744,10 @@ int ReduceExpressions(struct objlist *instprop, struct objlist *parprops,
 
     struct tokstack *expstack, *stackptr, *lptr, *nptr;
     struct valuelist *kv;
-    struct property *kl = NULL;
-    char *estr, *tstr, *sstr;
-    int toktype, functype, i, result, modified, numlast, savetok;
+    struct exprentry *entry;
+    struct exprmemo *memo;
+    char *estr;
+    int i, result, modified;
     double dval;
 
     if (instprop == NULL) return 0;	// Nothing to do
@@ -283,6 +756,7 @@ int ReduceExpressions(struct objlist *instprop, struct objlist *parprops,
     for (i = 0;; i++) {
 
 	kv = &(instprop->instance.props[i]);
+	memo = NULL;
 	switch (kv->type) {
 	    case PROP_ENDLIST:
 		break;
@@ -298,259 +772,36 @@ int ReduceExpressions(struct objlist *instprop, struct objlist *parprops,
 
 	    case PROP_STRING:
 
-		expstack = NULL;
 		estr = kv->value.string;
-		tstr = estr;
 
-		numlast = 0;
-		while (*tstr != '\0') {
-		    switch(*tstr) {
-		    
-			case '+':
-			    if (numlast == 0) {
-				/* This is part of a number */
-				dval = strtod(estr, &sstr);
-				if (sstr > estr && sstr > tstr) {
-			            tstr = sstr - 1;
-			            numlast = 1;
-				}
-				break;
-			    }
-			    /* Not a number, so must be arithmetic */
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-			    PushTok(TOK_PLUS, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case '-':
-			    if (numlast == 0) {
-				/* This is part of a number */
-				dval = strtod(estr, &sstr);
-				if (sstr > estr && sstr > tstr) {
-				    tstr = sstr - 1;
-				    numlast = 1;
-				}
-				break;
-			    }
-			    /* Not a number, so must be arithmetic */
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-			    PushTok(TOK_MINUS, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case '1': case '2': case '3': case '4': case '5':
-			case '6': case '7': case '8': case '9': case '0':
-			    /* Numerical value.  Use strtod() to capture */
-			    if (numlast == 1) break;
-			    dval = strtod(estr, &sstr);
-			    if (sstr > estr && sstr > tstr) {
-				tstr = sstr - 1;
-				numlast = 1;
-			    }
-			    break;
-
-			case '/':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-			    PushTok(TOK_DIVIDE, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case '*':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-			    PushTok(TOK_MULTIPLY, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case '(':
-			    *tstr = '\0';
-
-			    /* Check for predefined function keywords */
-
-			    if (!strcmp(estr, "IF")) {
-				PushTok(TOK_FUNC_IF, NULL, &expstack);
-			    }
-			    else {
-			        /* Treat as a parenthetical grouping */
-
-			        result = TokGetValue(estr, parent, parprops,
-					glob, &dval);
-			        if (result == 1)
-				    PushTok(TOK_DOUBLE, &dval, &expstack);
-			        else if (result == -1)
-				    PushTok(TOK_STRING, estr, &expstack);
-			        PushTok(TOK_FUNC_OPEN, NULL, &expstack);
-			    }
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case ')':
-			    *tstr = '\0';
-
-			    if (expstack == NULL) break;
-			    savetok = expstack->toktype;
-
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-
-			    switch (savetok) {
-				case TOK_FUNC_THEN:
-				    PushTok(TOK_FUNC_ELSE, NULL, &expstack);
-				    break;
-				default:
-				    PushTok(TOK_FUNC_CLOSE, NULL, &expstack);
-				    break;
-			    }
-			    numlast = 1;
-			    estr = tstr + 1;
-			    break;
-
-			case '\'':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-			    PushTok(TOK_SGL_QUOTE, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case '"':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-			    PushTok(TOK_DBL_QUOTE, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case '{':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-			    PushTok(TOK_GROUP_OPEN, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case '}':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    PushTok(TOK_GROUP_CLOSE, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 1;
-			    break;
-
-			case '!':
-			    if (*(tstr + 1) == '=') {
-				*tstr = '\0';
-				result = TokGetValue(estr, parent, parprops,
-					glob, &dval);
-				if (result == 1)
-				    PushTok(TOK_DOUBLE, &dval, &expstack);
-				else if (result == -1)
-				    PushTok(TOK_STRING, estr, &expstack);
-				PushTok(TOK_NE, NULL, &expstack);
-			    }
-			    numlast = 0;
-			    break;
-
-			case '=':
-			    if (*(tstr + 1) == '=') {
-	 			*tstr = '\0';
-	 			result = TokGetValue(estr, parent, parprops,
-						glob, &dval);
-	 			if (result == 1)
-				    PushTok(TOK_DOUBLE, &dval, &expstack);
-	 			else if (result == -1)
-				    PushTok(TOK_STRING, estr, &expstack);
-				PushTok(TOK_EQ, NULL, &expstack);
-				numlast = 0;
-			    }
-			    break;
-
-			case '>':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-
-			    if (*(tstr + 1) == '=') {
-				PushTok(TOK_GE, NULL, &expstack);
-				tstr++;
-			    }
-			    else
-				PushTok(TOK_GT, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case '<':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-
-			    if (*(tstr + 1) == '=') {
-				PushTok(TOK_LE, NULL, &expstack);
-				tstr++;
-			    }
-			    else
-				PushTok(TOK_LT, NULL, &expstack);
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
-
-			case ',':
-			    *tstr = '\0';
-			    result = TokGetValue(estr, parent, parprops, glob, &dval);
-			    if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-			    else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
-			    if (expstack == NULL) break;
-			    lptr = expstack;
-			    while (lptr->next) {
-				lptr = lptr->next;
-				if (lptr->toktype == TOK_FUNC_THEN) {
-				    PushTok(TOK_FUNC_ELSE, NULL, &expstack);
-				    break;
-				}
-				else if (lptr->toktype == TOK_FUNC_IF) {
-				    PushTok(TOK_FUNC_THEN, NULL, &expstack);
-				    break;
-				}
-			    }
-			    estr = tstr + 1;
-			    numlast = 0;
-			    break;
+		/* Plain values don't need to be tokenized */
+		if (StringIsValue(estr) && (ConvertStringToFloat(estr, &dval) == 1)) {
+		    FREE(estr);
+		    kv->type = PROP_DOUBLE;
+		    kv->value.dval = dval;
+		    continue;
+		}
 
-			default:
-			    break;
+		entry = GetExprEntry(estr);
+		if (entry == NULL) {
+		    /* Cache is full;  tokenize this instance directly */
+		    expstack = ResolveTokStack(TokenizeExpression(estr), NULL,
+				parent, parprops, glob);
+		}
+		else {
+		    memo = ExprMemoSlot(entry, parent, parprops, glob);
+		    if (ExprMemoMatch(entry, memo)) {
+			FREE(estr);
+			kv->type = memo->type;
+			if (memo->type == PROP_DOUBLE)
+			    kv->value.dval = memo->value.dval;
+			else
+			    kv->value.string = strsave(memo->value.string);
+			continue;
 		    }
-		    tstr++;
+		    expstack = ResolveTokStack(CopyTokStack(entry->stack), entry,
+				parent, parprops, glob);
 		}
-		result = TokGetValue(estr, parent, parprops, glob, &dval);
-		if (result == 1) PushTok(TOK_DOUBLE, &dval, &expstack);
-		else if (result == -1) PushTok(TOK_STRING, estr, &expstack);
 
 		FREE(kv->value.string);
 		kv->value.stack = expstack;
@@ -851,6 +1102,12 @@ int ReduceExpressions(struct objlist *instprop, struct objlist *parprops,
 	    // Still an expression;  do nothing
 	}
 
+	// Remember the result for other instances using the same
+	// expression with the same parameter values
+
+	if ((memo != NULL) && (kv->type == PROP_DOUBLE || kv->type == PROP_STRING))
+	    ExprMemoStore(entry, memo, kv);
+
 	// Free up the stack if it's not being used
 
 	if (kv->type != PROP_EXPRESSION)
@@ -1184,6 +1441,7 @@ void ReopenCellDef(char *name, int fnum)
 
   if (Debug) Printf("Reopening cell definition: %s\n",name);
   GarbageCollect();
+  ResolveNodes();
   if ((CurrentCell = LookupCellFile(name, fnum)) == NULL) {
     Printf("Undefined cell: %s\n", name);
     return;
@@ -1205,6 +1463,7 @@ void CellDef(char *name, int fnum)
 
     if (Debug) Printf("Defining cell: %s\n",name);
     GarbageCollect();
+    ResolveNodes();
     if ((CurrentCell = LookupCellFile(name, fnum)) != NULL) {
 	if (AddToExistingDefinition) {
 	    ReopenCellDef(name, fnum);
@@ -1223,7 +1482,7 @@ void CellDef(char *name, int fnum)
 
     LastPlaced = NULL;
     CurrentTail = NULL;
-    FreeNodeNames(CurrentCell);
+    OpenNodeNames(CurrentCell);	/* empty;  kept up to date as nodes are added */
     NextNode = 1;
 
     // Mark cell as case insensitive if case insensitivity is in effect
@@ -2046,7 +2305,7 @@ struct objlist *LinkProperties(char *model, struct keyvalue *topptr)
     for (entries = 0, kv = topptr; kv != NULL; kv = kv->next, entries++)
     {
 	newkv = &(tp->instance.props[entries]);
-	newkv->key = strsave(kv->key);
+	newkv->key = PropKey(kv->key);
 	/* No promotion to types other than string at this point */
 	newkv->type = PROP_STRING;
 	newkv->value.string = strsave(kv->value);
@@ -2422,7 +2681,7 @@ void CopyProperties(struct objlist *obj_to, struct objlist *obj_from)
 	 kvcur = &(kvcopy[i]);
          kvcur->type = kv->type;
 	 if (kv->type == PROP_ENDLIST) break;
-         kvcur->key = strsave(kv->key);
+         kvcur->key = kv->key;
          switch (kvcur->type) {
 	    case PROP_STRING:
       	        kvcur->value.string = strsave(kv->value.string);
@@ -2657,14 +2916,94 @@ char *ScaleStringFloatValue(char *vstr, double scale)
       return vstr;
 }
 
+/*----------------------------------------------------------------------*/
+/* Nets of the cell being read are merged in a union-find forest over	*/
+/* node numbers, so that join() takes nearly constant time instead of	*/
+/* a pass over the whole cell.  Until the merges are resolved, an	*/
+/* object may carry any node number of its net.  ResolveNodes() gives	*/
+/* every object the lowest node number of its net, which is what the	*/
+/* in-place renumbering in join() used to produce.  It is called when	*/
+/* the cell is closed, and before any other cell is opened.		*/
+/*----------------------------------------------------------------------*/
+
+static int *NodeParent = NULL;		/* parent of each node number */
+static int NodeParentSize = 0;		/* entries allocated */
+static int NodeParentUsed = 0;		/* entries initialized */
+static struct nlist *NodeParentCell = NULL;	/* cell with pending merges */
+
+static int FindNode(int node)
+{
+   if (node < 0 || node >= NodeParentUsed) return node;
+   while (NodeParent[node] != node) {
+      NodeParent[node] = NodeParent[NodeParent[node]];	/* path halving */
+      node = NodeParent[node];
+   }
+   return node;
+}
+
+/* Merge the net rooted at 'oldnode' into the net rooted at 'nodenum' */
+
+static void MergeNodes(int nodenum, int oldnode)
+{
+   int *newparent;
+   int newsize, i;
+
+   if (oldnode >= NodeParentSize) {
+      newsize = (NodeParentSize > 0) ? NodeParentSize : 1024;
+      while (newsize <= oldnode) newsize <<= 1;
+      newparent = (int *)MALLOC(newsize * sizeof(int));
+      if (NodeParent != NULL) {
+	 memcpy(newparent, NodeParent, NodeParentUsed * sizeof(int));
+	 FREE(NodeParent);
+      }
+      NodeParent = newparent;
+      NodeParentSize = newsize;
+   }
+   for (i = NodeParentUsed; i <= oldnode; i++) NodeParent[i] = i;
+   if (NodeParentUsed <= oldnode) NodeParentUsed = oldnode + 1;
+
+   NodeParent[oldnode] = nodenum;
+   NodeParentCell = CurrentCell;
+}
+
+void ResolveNodes(void)
+{
+   struct objlist *ob;
+   struct nlist *tp;
+   int node;
+
+   if ((tp = NodeParentCell) == NULL) {
+      /* no merges, but names may still be unsettled */
+      SettleNodeNames(CurrentCell);
+      return;
+   }
+
+   for (ob = tp->cell; ob != NULL; ob = ob->next) {
+      if (ob->node < 0) continue;
+      node = FindNode(ob->node);
+      if (node != ob->node) {
+	 /* a name cached under the old number (cache built while	*/
+	 /* merges were pending) belongs to the root now		*/
+	 MergeNodeNames(tp, ob->node, node);
+	 ob->node = node;
+      }
+   }
+
+   NodeParentUsed = 0;
+   NodeParentCell = NULL;
+
+   /* Only nodes whose names tied while reading are chosen again */
+   SettleNodeNames(tp);
+}
+
 /*----------------------------------------------------------------------*/
 /* Workhorse subroutine for the Connect() function			*/
 /*----------------------------------------------------------------------*/
 
 void join(char *node1, char *node2)
 {
-	struct objlist *tp1, *tp2, *tp3;
-	int nodenum, oldnode;
+	struct objlist *tp1, *tp2;
+	int nodenum, oldnode, node1num, node2num;
 
 	if (CurrentCell == NULL) {
 		Printf( "No current cell for join(%s,%s)\n",
@@ -2685,28 +3024,43 @@ void join(char *node1, char *node2)
 	}
 	if (Debug) Printf("         joining: %s == %s (",
 		           tp1->name,tp2->name);
+
+	/* merges pending in another cell must not leak into this one */
+	if (NodeParentCell != NULL && NodeParentCell != CurrentCell)
+		ResolveNodes();
 	
 	/* see if either node has an assigned node number */
 	if ((tp1->node == -1) && (tp2->node == -1)) {
 		tp1->node = NextNode;
 		tp2->node = NextNode++;
+		CacheNodeName(CurrentCell, tp1);
+		CacheNodeName(CurrentCell, tp2);
 		if (Debug) Printf("New ");
 	}
-	else if (tp1->node == -1) tp1->node = tp2->node;
-	else if (tp2->node == -1) tp2->node = tp1->node;
+	else if (tp1->node == -1) {
+		tp1->node = FindNode(tp2->node);
+		CacheNodeName(CurrentCell, tp1);
+	}
+	else if (tp2->node == -1) {
+		tp2->node = FindNode(tp1->node);
+		CacheNodeName(CurrentCell, tp2);
+	}
 	else {
-		if (tp1->node < tp2->node) {
-			nodenum = tp1->node;
-			oldnode = tp2->node;
-		} else {
-			nodenum = tp2->node;
-			oldnode = tp1->node;
+		node1num = FindNode(tp1->node);
+		node2num = FindNode(tp2->node);
+		if (node1num != node2num) {
+			if (node1num < node2num) {
+				nodenum = node1num;
+				oldnode = node2num;
+			} else {
+				nodenum = node2num;
+				oldnode = node1num;
+			}
+			MergeNodes(nodenum, oldnode);
+			MergeNodeNames(CurrentCell, oldnode, nodenum);
 		}
-		/* now search through entire list, updating nodes as needed */
-		for (tp3 = CurrentCell->cell; tp3 != NULL; tp3 = tp3->next) 
-			if (tp3->node == oldnode)  tp3->node = nodenum;
 	}
-	if (Debug) Printf("Node = %d)\n",tp1->node);
+	if (Debug) Printf("Node = %d)\n", FindNode(tp1->node));
 }
 
 /*----------------------------------------------------------------------*/
@@ -2864,7 +3218,10 @@ void ConnectAllNodes(char *model, int file)
     if (ob->node >= nodenum) nodenum = ob->node + 1;
 
   for (ob = tp->cell; ob != NULL; ob = ob->next)
-    if (ob->node == -1) ob->node = nodenum++;
+    if (ob->node == -1) {
+      ob->node = nodenum++;
+      CacheNodeName(tp, ob);
+    }
 }
 
 /*----------------------------------------------------------------------*/
@@ -2958,7 +3315,7 @@ int add_prop_tag(struct objlist *obr, char tagc)
 	       break;
          }
 	 kv2 = (struct valuelist *)MALLOC((k + 2) * sizeof(struct valuelist));
-	 kv2->key = strsave("_tag");
+	 kv2->key = PropKey("_tag");
 	 kv2->type = PROP_STRING;
 	 /* Value is set to tagc */
 	 kv2->value.string = (char *)MALLOC(2);
@@ -3055,6 +3412,8 @@ int CombineParallel(char *model, int file)
       Printf("Cell: %s does not exist.\n", model);
       return -1;
    }
+   StatsBegin("parallel");
+   FreeNodePins(tp);
 
    InitializeHashTable(&devdict, OBJHASHSIZE);
 
@@ -3184,7 +3543,7 @@ int CombineParallel(char *model, int file)
 
 	       /* Create property record for property "M" and set to 1 */
 	       kv = &(nob->instance.props[0]);
-	       kv->key = strsave("M");
+	       kv->key = PropKey("M");
 	       kv->type = PROP_INTEGER;
 	       kv->value.ival = 1;
 
@@ -3211,7 +3570,7 @@ int CombineParallel(char *model, int file)
 
 	       /* Create property record for property "M" and set to 1 */
 	       kv = &(nob->instance.props[0]);
-	       kv->key = strsave("M");
+	       kv->key = PropKey("M");
 	       kv->type = PROP_INTEGER;
 	       kv->value.ival = 1;
 
@@ -3268,6 +3627,7 @@ int CombineParallel(char *model, int file)
    if (dcnt > 0) {
       Fprintf(stdout, "Class %s:  Merged %d devices.\n", model, dcnt);
    }
+   StatsEnd();
    return dcnt;
 }
 
@@ -3330,6 +3690,9 @@ int CombineSerial(char *model, int file)
       Printf("Cell: %s does not exist.\n", model);
       return -1;
    }
+   StatsBegin("serial");
+   FreeNodePins(tp);
+
    /* Diagnostic */
    /* Printf("CombineSerial start model = %s file = %d\n", model, file); */
 
@@ -3418,7 +3781,7 @@ int CombineSerial(char *model, int file)
 
 	       /* Create property record for property "_tag" */
 	       kv = &(nob->instance.props[0]);
-	       kv->key = strsave("_tag");
+	       kv->key = PropKey("_tag");
 	       kv->type = PROP_STRING;
 	       /* Value is set to "+" */
 	       kv->value.string = (char *)MALLOC(2);
@@ -3441,7 +3804,7 @@ int CombineSerial(char *model, int file)
 		  if (kv->type == PROP_ENDLIST) {
 		     kv2 = (struct valuelist *)MALLOC((k + 2) *
 				sizeof(struct valuelist));
-		     kv2->key = strsave("_tag");
+		     kv2->key = PropKey("_tag");
 		     kv2->type = PROP_STRING;
 		     /* Value is set to "+" */
 		     kv2->value.string = (char *)MALLOC(2);
@@ -3543,6 +3906,7 @@ int CombineSerial(char *model, int file)
       }
    }
    FREE(instlist);
+   StatsEnd();
    return scnt;
 }
 
@@ -3573,7 +3937,8 @@ void EndCell(void)
     }
   }
   LastPlaced = NULL;
-  CacheNodeNames(CurrentCell);
+  ResolveNodes();
+  CloseNodeNames(CurrentCell);
   if (NoDisconnectedNodes)  ConnectAllNodes(CurrentCell->name, CurrentCell->file);
   CurrentCell = NULL;
   CurrentTail = NULL;
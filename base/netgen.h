@@ -41,6 +41,7 @@ extern int  PropertyTolerance(char *name, int fnum, char *key, int ival,
 extern int  PropertyMerge(char *name, int fnum, char *key, int merge_type);
 extern void ResolveProperties(char *name1, int file1, char *name2, int file2);
 extern void CopyProperties(struct objlist *obj_to, struct objlist *obj_from);
+extern struct tokstack *CopyTokStack(struct tokstack *stack);
 extern int PromoteProperty(struct property *, struct valuelist *);
 extern int SetPropertyDefault(struct property *, struct valuelist *);
 extern struct objlist *LinkProperties(char *model, struct keyvalue *topptr);
@@ -108,6 +109,7 @@ extern char *ConvertParam(char *);
 extern int  ConvertStringToFloat(char *, double *);
 extern char *ScaleStringFloatValue(char *, double);
 extern void join(char *node1, char *node2);
+extern void ResolveNodes(void);
 extern void Connect(char *tplt1, char *tplt2);
 extern void Place(char *name);
 extern void Array(char *Cell, int num);
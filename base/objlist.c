@@ -21,6 +21,7 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>	/* for qsort() and bsearch() */
 #include <ctype.h>
 #ifdef IBMPC
 #include <alloc.h>
@@ -111,6 +112,34 @@ void AddToGarbageList(struct objlist *head)
 	nextfree = (nextfree + 1) % GARBAGESIZE;
 }
 
+/*----------------------------------------------------------------------*/
+/* Property keys are interned:  every instance property record holding	*/
+/* key "w" points to the same string, so keys are not allocated and	*/
+/* freed once per device, and can be compared by pointer.  Interned	*/
+/* keys are never freed.						*/
+/*----------------------------------------------------------------------*/
+
+#define PROPKEYHASHSIZE 257
+
+static struct hashdict propkeys;
+
+char *PropKey(char *key)
+{
+	struct hashlist *np;
+	char *ikey;
+
+	if (key == NULL) return NULL;
+	if (propkeys.hashtab == NULL)
+		InitializeHashTable(&propkeys, PROPKEYHASHSIZE);
+
+	ikey = (char *)HashInt2Lookup(key, 0, &propkeys);
+	if (ikey != NULL) return ikey;
+
+	np = HashInt2PtrInstall(key, 0, NULL, &propkeys);
+	np->ptr = np->name;
+	return np->name;
+}
+
 #ifdef DEBUG_GARBAGE
 /* otherwise, inline these functions with macros */
 
@@ -231,6 +260,22 @@ int matchnocase(char *st1, char *st2)
    return 1;
 }
 
+/* Case-insensitive ordering, consistent with matchnocase():	*/
+/* returns zero exactly when matchnocase() would return 1.	*/
+
+int comparenocase(char *st1, char *st2)
+{
+   char *sp1 = st1;
+   char *sp2 = st2;
+
+   while (*sp1 != '\0' && *sp2 != '\0') {
+      if (to_lower[*sp1] != to_lower[*sp2]) break;
+      sp1++;
+      sp2++;
+   }
+   return (int)to_lower[*sp1] - (int)to_lower[*sp2];
+}
+
 /* Case-sensitive matching with file matching */
 
 int matchfile(char *st1, char *st2, int f1, int f2)
@@ -311,6 +356,143 @@ struct nlist *LookupCellFile(char *s, int f)
    return HashIntLookup(s, f, &cell_dict);
 }
 
+/*----------------------------------------------------------------------*/
+/* Secondary index of cells by (file, classhash).  Cells are chained in	*/
+/* bins so that the equivalent class of a cell in another file can be	*/
+/* found without walking the whole cell hash table.  Every change to a	*/
+/* cell's classhash must go through SetCellClasshash() to keep the	*/
+/* index current.							*/
+/*----------------------------------------------------------------------*/
+
+struct classlink {
+  struct nlist *cell;
+  struct classlink *next;
+};
+
+static struct classlink **class_tab = NULL;
+static int class_tabsize = 0;
+static int class_count = 0;
+
+static int ClassBin(unsigned long classhash, int file, int size)
+{
+  unsigned long h;
+
+  h = classhash + (unsigned long)(file + 1) * 0x9e3779b97f4a7c15UL;
+  h ^= h >> 29;
+  return (int)(h % (unsigned long)size);
+}
+
+static void ClassIndexGrow(void)
+{
+  struct classlink **newtab, *cl, *clnext;
+  int newsize, i, bin;
+
+  newsize = (class_tabsize == 0) ? CELLHASHSIZE : 2 * class_tabsize;
+  newtab = (struct classlink **)CALLOC(newsize, sizeof(struct classlink *));
+
+  /* Rehash, keeping the relative order of entries within each bin */
+  for (i = class_tabsize - 1; i >= 0; i--) {
+    for (cl = class_tab[i]; cl != NULL; cl = clnext) {
+      clnext = cl->next;
+      bin = ClassBin(cl->cell->classhash, cl->cell->file, newsize);
+      cl->next = newtab[bin];
+      newtab[bin] = cl;
+    }
+  }
+  if (class_tab != NULL) FREE(class_tab);
+  class_tab = newtab;
+  class_tabsize = newsize;
+}
+
+static void ClassIndexInsert(struct nlist *tp)
+{
+  struct classlink *cl;
+  int bin;
+
+  if (class_count >= 2 * class_tabsize) ClassIndexGrow();
+
+  cl = (struct classlink *)MALLOC(sizeof(struct classlink));
+  cl->cell = tp;
+  bin = ClassBin(tp->classhash, tp->file, class_tabsize);
+  cl->next = class_tab[bin];
+  class_tab[bin] = cl;
+  class_count++;
+}
+
+static void ClassIndexRemove(struct nlist *tp)
+{
+  struct classlink *cl, *lcl;
+  int bin;
+
+  if (class_tabsize == 0) return;
+  bin = ClassBin(tp->classhash, tp->file, class_tabsize);
+  lcl = NULL;
+  for (cl = class_tab[bin]; cl != NULL; cl = cl->next) {
+    if (cl->cell == tp) {
+      if (lcl == NULL)
+	class_tab[bin] = cl->next;
+      else
+	lcl->next = cl->next;
+      FREE(cl);
+      class_count--;
+      return;
+    }
+    lcl = cl;
+  }
+}
+
+/* Change the classhash of a cell in the cell hash table */
+
+void SetCellClasshash(struct nlist *tp, unsigned long classhash)
+{
+  if (tp->classhash == classhash) return;
+  ClassIndexRemove(tp);
+  tp->classhash = classhash;
+  ClassIndexInsert(tp);
+}
+
+/* Callback used by LookupCellClass() when the index is ambiguous */
+
+static struct nlist *lookupclass(struct hashlist *p, void *clientdata)
+{
+  struct nlist *ptr, *key;
+
+  ptr = (struct nlist *)(p->ptr);
+  key = (struct nlist *)clientdata;
+
+  if ((ptr->file == key->file) && (ptr->classhash == key->classhash))
+    return ptr;
+  return NULL;
+}
+
+/* Find a cell in file "file" with the given classhash.  If more than	*/
+/* one cell shares the classhash, return the first one found in the	*/
+/* cell hash table, as an exhaustive search of the table would.		*/
+
+struct nlist *LookupCellClass(unsigned long classhash, int file)
+{
+  struct classlink *cl;
+  struct nlist *found, key;
+  int nfound;
+
+  if (class_tabsize == 0) return NULL;
+
+  found = NULL;
+  nfound = 0;
+  cl = class_tab[ClassBin(classhash, file, class_tabsize)];
+  for (; cl != NULL; cl = cl->next) {
+    if ((cl->cell->file == file) && (cl->cell->classhash == classhash)) {
+      found = cl->cell;
+      nfound++;
+    }
+  }
+  if (nfound <= 1) return found;
+
+  key.file = file;
+  key.classhash = classhash;
+  return RecurseHashTablePointer(&cell_dict, lookupclass, (void *)&key);
+}
+
 struct nlist *InstallInCellHashTable(char *name, int fnum)
 {
   struct hashlist *ptr;
@@ -335,6 +517,7 @@ struct nlist *InstallInCellHashTable(char *name, int fnum)
 
   ptr = HashIntPtrInstall(name, fnum, p, &cell_dict);
   if (ptr == NULL) return(NULL);
+  ClassIndexInsert(p);
   return(p);
  fail:
   if (p->name != NULL) FREE(p->name);
@@ -369,7 +552,7 @@ void CellRehash(char *name, char *newname, int file)
      HashIntDelete(name, file, &cell_dict);
 
   // Change the classhash to reflect the new name
-  tp->classhash = (*hashfunc)(newname, 0);
+  SetCellClasshash(tp, (*hashfunc)(newname, 0));
 }
 
 struct nlist *OldCell;
@@ -571,6 +754,7 @@ void CellDelete(char *name, int fnum)
   }
 
   HashIntDelete(name, fnum, &cell_dict);
+  ClassIndexRemove(tp);
   /* now make sure that we free all the fields of the nlist struct */
   if (tp->name != NULL) FREE(tp->name);
   HashKill(&(tp->objdict));
@@ -754,8 +938,105 @@ char *FixTemplate(char *t)
 	return(rstr);
 }
 			
+/*----------------------------------------------------------------------*/
+/* Lists returned by List() are short-lived, like the garbage lists:	*/
+/* a result is only good until many more lists have been made.  A	*/
+/* result holding one object, which is what nearly every call returns,	*/
+/* is a record from a ring of views rather than an object allocated	*/
+/* and later thrown out with the garbage.				*/
+/*----------------------------------------------------------------------*/
+
+static struct objlist ListViews[GARBAGESIZE];
+static int nextview = 0;
+
+static struct objlist *ListView(struct objlist *ob)
+{
+  struct objlist *view;
+
+  view = &ListViews[nextview];
+  nextview = (nextview + 1) % GARBAGESIZE;
+  memcpy(view, ob, sizeof(struct objlist));
+  view->next = NULL;
+  return(view);
+}
+
 #ifndef TCL_NETGEN
 
+/*----------------------------------------------------------------------*/
+/* Compiled templates are kept in a small cache, least recently used	*/
+/* out first, since scripts tend to apply the same few templates over	*/
+/* and over.  This is only possible where the compiled expression is	*/
+/* a value of its own (see REGEXP_FREE_TEMPLATE in regexp.h).		*/
+/*----------------------------------------------------------------------*/
+
+#define REGEXP_CACHE_SIZE 16
+
+#ifdef REGEXP_FREE_TEMPLATE
+static struct regexpcache {
+  char *template;		/* template as passed to List() */
+  int wildcards;		/* value of UnixWildcards when compiled */
+  Regexp expression;
+  unsigned long lastuse;
+} RegexpCache[REGEXP_CACHE_SIZE];
+static unsigned long RegexpClock = 0;
+#endif
+
+static Regexp CompileTemplate(char *list_template)
+{
+  Regexp RegularExpression;
+  char *template2;
+#ifdef REGEXP_FREE_TEMPLATE
+  struct regexpcache *rc, *oldest;
+
+  oldest = RegexpCache;
+  for (rc = RegexpCache; rc < RegexpCache + REGEXP_CACHE_SIZE; rc++) {
+    if (rc->template != NULL && rc->wildcards == UnixWildcards &&
+		!strcmp(rc->template, list_template)) {
+      rc->lastuse = ++RegexpClock;
+      return(rc->expression);
+    }
+    if (rc->lastuse < oldest->lastuse) oldest = rc;
+  }
+#endif
+
+  template2 = FixTemplate(list_template);
+  DBUG_PRINT("regex",("Compiling regular expression: %s => %s",
+		      list_template, template2));
+  RegularExpression = RegexpCompile(template2);
+  DBUG_PRINT("regex",("   Result = %ld",(long)RegularExpression));
+  FreeString(template2);
+
+#ifdef REGEXP_FREE_TEMPLATE
+  if (RegularExpression != NULL) {
+    if (oldest->template != NULL) {
+      FreeString(oldest->template);
+      FREE(oldest->expression);
+    }
+    oldest->template = strsave(list_template);
+    oldest->wildcards = UnixWildcards;
+    oldest->expression = RegularExpression;
+    oldest->lastuse = ++RegexpClock;
+  }
+#endif
+  return(RegularExpression);
+}
+
+/*----------------------------------------------------------------------*/
+/* Return the length of the literal prefix of 'list_template' if it	*/
+/* is a plain prefix match ("name*"), which needs no regular		*/
+/* expression at all;  otherwise return -1.				*/
+/*----------------------------------------------------------------------*/
+
+static int PrefixTemplate(char *list_template)
+{
+  char *wild;
+
+  if (!UnixWildcards) return(-1);
+  wild = strpbrk(list_template, "*?[]{},\\");
+  if (wild == NULL || *wild != '*' || *(wild + 1) != '\0') return(-1);
+  return((int)(wild - list_template));
+}
+
 /*
  *-------------------------------------------------------------------
  * returns a list of objects in CurrentCell whose names match the
@@ -768,8 +1049,7 @@ struct objlist *List(char *list_template)
   Regexp RegularExpression;
   struct objlist *head, *tail;
   struct objlist *test, *tmp;
-  char *template2;
-  int itmp;
+  int itmp, prefix;
 	
   if (CurrentCell == NULL) {
     Fprintf(stderr,"No current cell in List()\n");
@@ -789,26 +1069,24 @@ struct objlist *List(char *list_template)
     /* just find element, forget about regular expressions */
     test = LookupObject(list_template, CurrentCell);
     if (test != NULL) {
-      /* insert it directly into list (list has only this element) */
-      head = GetObject();
-      memcpy(head, test, sizeof(struct objlist));
-      head->next = NULL;
-      AddToGarbageList(head);
-      return(head);
+      /* list has only this element */
+      return(ListView(test));
     }
   }
   /* otherwise, need to deal with wildcards */
 
+  prefix = PrefixTemplate(list_template);
+  RegularExpression = (prefix < 0) ? CompileTemplate(list_template) : NULL;
+#else
+  prefix = -1;
+  RegularExpression = CompileTemplate(list_template);
 #endif /* OPTIMIZE_WILDCARDS */
 
-  template2 = FixTemplate(list_template);
-  DBUG_PRINT("regex",("Compiling regular expression: %s => %s",
-		      list_template, template2));
-  RegularExpression = RegexpCompile(template2);
-  DBUG_PRINT("regex",("   Result = %ld",(long)RegularExpression));
-  FreeString(template2);
   for ( ; test != NULL; test = test->next) {
-    itmp = RegexpMatch(RegularExpression,test->name);
+    if (prefix >= 0)
+      itmp = !strncmp(test->name, list_template, prefix);
+    else
+      itmp = RegexpMatch(RegularExpression,test->name);
     DBUG_PRINT("regex",("Testing string %s, result = %d", test->name, itmp));
     if (itmp) {
       tmp = GetObject();
@@ -828,10 +1106,6 @@ struct objlist *List(char *list_template)
     }
   }
 
-#ifdef REGEXP_FREE_TEMPLATE
-  FREE(RegularExpression);
-#endif
-
   AddToGarbageList(head);
   return(head);
 }
@@ -851,28 +1125,16 @@ struct objlist *List(char *list_template)
 	
 struct objlist *List(char *obj_name)
 {
-  struct objlist *head, *test;
+  struct objlist *test;
 	
   if (CurrentCell == NULL) {
     Fprintf(stderr,"No current cell in List()\n");
     return (NULL);
   }
-  if (QuickSearch)
-    test = LastPlaced;
-  else
-    test = CurrentCell->cell;
-
-  head = NULL;
 
   test = LookupObject(obj_name, CurrentCell);
-  if (test != NULL) {
-    /* insert it directly into list (list has only this element) */
-    head = GetObject();
-    memcpy(head, test, sizeof(struct objlist));
-    head->next = NULL;
-  }
-  AddToGarbageList(head);
-  return(head);
+  if (test == NULL) return(NULL);
+  return(ListView(test));
 }
 
 #endif	/* TCL_NETGEN */
@@ -1022,6 +1284,43 @@ void UpdateNodeNumbers(struct objlist *lst, int from, int to)
 	}
 }
 
+/* Give the nodes of list 'lst' consecutive new numbers starting at	*/
+/* 'nextnode', in order of first appearance.  Only node numbers of at	*/
+/* least 'lowest' are changed, and -1 (unconnected) never is.  This	*/
+/* does in two passes over the list what one UpdateNodeNumbers() call	*/
+/* per node used to do.  Returns the next unused node number.		*/
+
+int RenumberObjList(struct objlist *lst, int lowest, int nextnode)
+{
+	struct objlist *ob;
+	int minnode, maxnode, count, *order;
+
+	count = 0;
+	minnode = maxnode = 0;
+	for (ob = lst; ob != NULL; ob = ob->next) {
+		if (ob->node < lowest || ob->node == -1) continue;
+		if (count == 0 || ob->node < minnode) minnode = ob->node;
+		if (count == 0 || ob->node > maxnode) maxnode = ob->node;
+		count = 1;
+	}
+	if (count == 0) return nextnode;
+
+	/* order[] holds the order of first appearance of each node, from 1 */
+	order = (int *)CALLOC(maxnode - minnode + 1, sizeof(int));
+	if (order == NULL) return nextnode;
+	count = 0;
+	for (ob = lst; ob != NULL; ob = ob->next) {
+		if (ob->node < lowest || ob->node == -1) continue;
+		if (order[ob->node - minnode] == 0)
+			order[ob->node - minnode] = ++count;
+		ob->node = nextnode + order[ob->node - minnode] - 1;
+	}
+	FREE(order);
+	return nextnode + count;
+}
+
+static void AddNodeName(struct nlist *tp, struct objlist *ob, int ordered);
+
 void AddToCurrentCell(struct objlist *ob)
 {
    AddToCurrentCellNoHash(ob);
@@ -1050,6 +1349,8 @@ void AddToCurrentCellNoHash(struct objlist *ob)
   else CurrentTail->next = ob;
   CurrentTail = ob;
   ob->next = NULL;
+  FreeNodePins(CurrentCell);
+  AddNodeName(CurrentCell, ob, 1);	/* 'ob' is last in the list */
 }
 
 void AddInstanceToCurrentCell(struct objlist *ob)
@@ -1073,7 +1374,6 @@ void FreeObject(struct objlist *ob)
 	for (i = 0; ; i++) {
 	   kv = &(ob->instance.props[i]);
 	   if (kv->type == PROP_ENDLIST) break;
-	   FreeString(kv->key);
 	   if (kv->type == PROP_STRING && kv->value.string != NULL)
 	      FreeString(kv->value.string);
 	   else if (kv->type == PROP_EXPRESSION) {
@@ -1103,6 +1403,7 @@ void FreeObject(struct objlist *ob)
 void FreeObjectAndHash(struct objlist *ob, struct nlist *ptr)
 {
    HashDelete(ob->name, &(ptr->objdict));
+   FreeNodePins(ptr);
    FreeObject(ob);
 }
 
@@ -1179,131 +1480,264 @@ struct objlist *InstanceNumber(struct nlist *tp, int inst)
 /*               NodeName cacheing stuff                              */
 /**********************************************************************/
 
-
-
-static char *OldNodeName(struct nlist *tp, int node)
+/* The node name cache of a cell holds, for every node number, the	*/
+/* object whose name best describes the node.  Order of preference:	*/
+/*   1) Named ports of cells						*/
+/*   2) Named internal nodes of cells					*/
+/*   3) Unique global ports (these names are descriptive, but long)	*/
+/*   4) Global ports							*/
+/*   5) Pins on instances						*/
+/* Among objects of equal preference, the first one in the object list	*/
+/* is kept.  The cache is kept up to date while a cell is being read	*/
+/* (see CacheNodeName() and MergeNodeNames()), and rebuilt in one pass	*/
+/* by CacheNodeNames() after operations that rewrite the object list	*/
+/* wholesale.  While reading, an object offered for a node that	*/
+/* already has a name of equal preference may come before or after	*/
+/* that name in the list.  Such nodes are marked unsettled, and	*/
+/* SettleNodeNames() picks their names again in list order.		*/
+/*									*/
+/* A cell that is open, that is, started by CellDef() and not yet	*/
+/* ended by EndCell(), names its nodes differently:  among objects of	*/
+/* equal preference the last one is taken, except for ports, where	*/
+/* the first one is.  Cells read from .ext files are never ended, so	*/
+/* their written netlists depend on this rule.  The same rule applies	*/
+/* to a cell whose cache was freed and is built again on a lookup.	*/
+/* These names are kept in nodename_last beside the cache, and		*/
+/* CloseNodeNames() drops them when the cell is ended.			*/
+
+#define NODENAME_CACHE_MIN 64
+
+static int NodeNameRank(int type)
 {
-  /* return a legitimate node name for node number 'node' in cell *tp */
-  /* Order of preference:
-     1) Named ports of cells
-     2) Named internal nodes of cells
-     3) Unique global ports (these names are descriptive, but long)
-     4) Global ports
-     5) Pins on instances
-     */
+  switch (type) {
+    case PORT: return 0;
+    case NODE: return 1;
+    case UNIQUEGLOBAL: return 2;
+    case GLOBAL: return 3;
+  }
+  return 4;	/* pin or property, which never replaces a name */
+}
 
-  struct objlist *ob;
-  struct objlist *firstport;
-  struct objlist *firstnode;
-  struct objlist *firstuniqueglobal;
-  struct objlist *firstglobal;
-  struct objlist *firstpin;
-  static char StrBuffer[100];
+/* Make room in the cache of 'tp' for node number 'node'.  The cache	*/
+/* grows geometrically so that adding nodes one at a time is cheap.	*/
 
-#if 0
-  /* make second pass, looking for ports */
-  ob = tp->cell;
-  while (ob != NULL) {
-    if ((node == ob->node) && IsPort(ob)) {
-      strcpy(StrBuffer, ob->name);
-      return(StrBuffer);
+static int GrowNodeNames(struct nlist *tp, int node)
+{
+  struct objlist **newcache, **newlast;
+  unsigned char *newflags;
+  long newsize;
+
+  if (node < tp->nodename_cache_size) return 1;
+
+  newsize = (tp->nodename_cache_size > 0) ? tp->nodename_cache_size :
+		NODENAME_CACHE_MIN;
+  while (newsize <= node) newsize <<= 1;
+
+  newcache = (struct objlist **)CALLOC(newsize, sizeof(struct objlist *));
+  if (newcache == NULL) return 0;
+  if (tp->nodename_last != NULL) {
+    newlast = (struct objlist **)CALLOC(newsize, sizeof(struct objlist *));
+    if (newlast == NULL) {
+      FREE(newcache);
+      return 0;
     }
-    ob = ob->next;
+    memcpy(newlast, tp->nodename_last,
+		tp->nodename_cache_size * sizeof(struct objlist *));
+    FREE(tp->nodename_last);
+    tp->nodename_last = newlast;
   }
-
-  /* make third pass, looking for named internal nodes */
-  ob = tp->cell;
-  while (ob != NULL) {
-    if ((node == ob->node) && (ob->type == NODE)) {
-      strcpy(StrBuffer, ob->name);
-      return(StrBuffer);
+  if (tp->nodename_unsettled != NULL) {
+    newflags = (unsigned char *)CALLOC(newsize, sizeof(unsigned char));
+    if (newflags == NULL) {
+      FREE(newcache);
+      return 0;
     }
-    ob = ob->next;
+    memcpy(newflags, tp->nodename_unsettled, tp->nodename_cache_size);
+    FREE(tp->nodename_unsettled);
+    tp->nodename_unsettled = newflags;
   }
-
-  /* make zeroth pass, looking for unique global ports */
-  ob = tp->cell;
-  while (ob != NULL) {
-    if ((node == ob->node) && (ob->type == UNIQUEGLOBAL)) {
-      strcpy(StrBuffer, ob->name);
-      return(StrBuffer);
-    }
-    ob = ob->next;
+  if (tp->nodename_cache != NULL) {
+    memcpy(newcache, tp->nodename_cache,
+		tp->nodename_cache_size * sizeof(struct objlist *));
+    FREE(tp->nodename_cache);
   }
+  tp->nodename_cache = newcache;
+  tp->nodename_cache_size = newsize;
+  return 1;
+}
 
-  /* make first pass, looking for global ports */
-  ob = tp->cell;
-  while (ob != NULL) {
-    if ((node == ob->node) && (ob->type == GLOBAL)) {
-      strcpy(StrBuffer, ob->name);
-      return(StrBuffer);
-    }
-    ob = ob->next;
+/* Mark the cached name of 'node' as one to be chosen again */
+
+static void UnsettleNodeName(struct nlist *tp, int node)
+{
+  if (tp->nodename_unsettled == NULL) {
+    tp->nodename_unsettled = (unsigned char *)CALLOC(tp->nodename_cache_size,
+		sizeof(unsigned char));
+    if (tp->nodename_unsettled == NULL) return;
   }
+  if (tp->nodename_unsettled[node] == 0) {
+    tp->nodename_unsettled[node] = 1;
+    tp->nodename_nunsettled++;
+  }
+}
 
-  /* make fourth pass, looking for first pin */
-  ob = tp->cell;
-  while (ob != NULL) {
-    if (node == ob->node) {
-      strcpy(StrBuffer, ob->name);
-      return(StrBuffer);
-    }
-    ob = ob->next;
+/* Offer object 'ob' as the name of its node in cell 'tp'.  The	*/
+/* cached name is replaced only by a more preferable one.  'ordered'	*/
+/* is nonzero when 'ob' is known to come after every object already	*/
+/* on its node, so that a tie is settled in favor of the cached name,	*/
+/* or in favor of 'ob' for the names of an open cell.  A cell without	*/
+/* a cache is left alone;  its cache is built in full on the first	*/
+/* lookup.								*/
+
+static void AddNodeName(struct nlist *tp, struct objlist *ob, int ordered)
+{
+  struct objlist *present;
+  int rank;
+
+  if (tp->nodename_cache == NULL || ob->node < 0) return;
+  if (!GrowNodeNames(tp, ob->node)) return;
+  if (ob->node > tp->nodename_cache_maxnodenum)
+    tp->nodename_cache_maxnodenum = ob->node;
+
+  rank = NodeNameRank(ob->type);
+  present = tp->nodename_cache[ob->node];
+  if (present == NULL || rank < NodeNameRank(present->type))
+    tp->nodename_cache[ob->node] = ob;
+  else if (!ordered && present != ob && rank == NodeNameRank(present->type))
+    UnsettleNodeName(tp, ob->node);
+
+  /* Properties never name a node of an open cell */
+  if (tp->nodename_last == NULL || (rank == 4 && ob->type < FIRSTPIN)) return;
+  present = tp->nodename_last[ob->node];
+  if (present == NULL || rank < NodeNameRank(present->type))
+    tp->nodename_last[ob->node] = ob;
+  else if (present != ob && rank == NodeNameRank(present->type)) {
+    if (!ordered)
+      UnsettleNodeName(tp, ob->node);
+    else if (!IsPort(ob))
+      tp->nodename_last[ob->node] = ob;
   }
-#endif
+}
+
+void CacheNodeName(struct nlist *tp, struct objlist *ob)
+{
+  if (tp == NULL) return;
+  FreeNodePins(tp);
+  AddNodeName(tp, ob, 0);
+}
+
+/* Move the name of node 'from' in 'names' to node 'to', keeping the	*/
+/* more preferable of the two.						*/
+
+static void FoldNodeName(struct nlist *tp, struct objlist **names,
+	int from, int to)
+{
+  struct objlist *ob, *present;
+
+  if ((ob = names[from]) == NULL) return;
+  names[from] = NULL;
+  present = names[to];
+  if (present == NULL || NodeNameRank(ob->type) < NodeNameRank(present->type))
+    names[to] = ob;
+  else if (NodeNameRank(ob->type) == NodeNameRank(present->type))
+    UnsettleNodeName(tp, to);
+}
+
+/* Fold the cached name of node 'from' into node 'to' when the two	*/
+/* nets are merged, keeping the more preferable of the two names.	*/
 
-  firstport = NULL;
-  firstnode = NULL;
-  firstuniqueglobal = NULL;
-  firstglobal = NULL;
-  firstpin = NULL;
-  if (node < 1) {
-    sprintf(StrBuffer, "Disconnected(%d)",node);
-    return(StrBuffer);
+void MergeNodeNames(struct nlist *tp, int from, int to)
+{
+  if (tp == NULL) return;
+  FreeNodePins(tp);
+  if (tp->nodename_cache == NULL) return;
+  if (from < 0 || from >= tp->nodename_cache_size || to < 0) return;
+  if (tp->nodename_cache[from] == NULL) return;
+  if (!GrowNodeNames(tp, to)) return;
+  if (to > tp->nodename_cache_maxnodenum)
+    tp->nodename_cache_maxnodenum = to;
+
+  if (tp->nodename_unsettled != NULL && tp->nodename_unsettled[from]) {
+    tp->nodename_unsettled[from] = 0;
+    tp->nodename_nunsettled--;
+    UnsettleNodeName(tp, to);
   }
-  for (ob = tp->cell; ob != NULL; ob = ob->next) {
-    if (node == ob->node) {
-      if (ob->type >= FIRSTPIN) firstpin = ob;
-      else if (IsPort(ob)) {
-	firstport = ob;
-	strcpy(StrBuffer,ob->name);
-	return(StrBuffer);
-      }
-      else if (ob->type == NODE) firstnode = ob;
-      else if (ob->type == UNIQUEGLOBAL) firstuniqueglobal = ob;
-      else if (ob->type == GLOBAL) firstglobal = ob;
-      else 
-	Fprintf(stderr,"??? ob->type = %d on %s\n",ob->type,ob->name);
+
+  FoldNodeName(tp, tp->nodename_cache, from, to);
+  if (tp->nodename_last != NULL)
+    FoldNodeName(tp, tp->nodename_last, from, to);
+}
+
+/* Choose again, in list order, the names of the unsettled nodes of	*/
+/* 'tp'.  Every object must carry the final node number of its net.	*/
+/* Nodes whose names were never in doubt are not touched.		*/
+
+void SettleNodeNames(struct nlist *tp)
+{
+  struct objlist *ob;
+  unsigned char *flags;
+  long node;
+
+  if (tp == NULL || tp->nodename_nunsettled == 0) return;
+  flags = tp->nodename_unsettled;
+  for (node = 0; node <= tp->nodename_cache_maxnodenum; node++)
+    if (flags[node]) {
+      tp->nodename_cache[node] = NULL;
+      if (tp->nodename_last != NULL) tp->nodename_last[node] = NULL;
     }
-  }
 
-  if (firstport != NULL) ob = firstport;
-  else if (firstnode != NULL) ob = firstnode;
-  else if (firstuniqueglobal != NULL) ob = firstuniqueglobal;
-  else if (firstglobal != NULL) ob = firstglobal;
-  else if (firstpin != NULL) ob = firstpin;
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->node >= 0 && ob->node < tp->nodename_cache_size && flags[ob->node])
+      AddNodeName(tp, ob, 1);
+
+  memset(flags, 0, tp->nodename_cache_size);
+  tp->nodename_nunsettled = 0;
+}
+
+static void BuildNodeNames(struct nlist *tp, int open);
+
+/* Fill in the missing cache entry of 'node' by scanning the cell, as	*/
+/* the name lookup did before the cache was kept up to date.		*/
+
+static void FillNodeName(struct nlist *tp, int node)
+{
+  struct objlist *ob;
+
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->node == node) AddNodeName(tp, ob, 1);
+}
+
+/* The names by which lookups in 'tp' go */
+
+#define NODENAMES(tp) \
+	(((tp)->nodename_last != NULL) ? (tp)->nodename_last : (tp)->nodename_cache)
+
+/* The name of a node of an open cell that no object names */
+
+static char *MissingNodeName(int node)
+{
+  static char StrBuffer[100];
+
+  if (node < 1)
+    sprintf(StrBuffer, "Disconnected(%d)", node);
   else {
-    /* if we got to here, we have a serious problem */
-    Fprintf (stderr, "NodeName(%d) called with bogus parameter\n", node);
-    sprintf(StrBuffer, "bogus(%d)",node);
-    return(StrBuffer);
+    Fprintf(stderr, "NodeName(%d) called with bogus parameter\n", node);
+    sprintf(StrBuffer, "bogus(%d)", node);
   }
-  strcpy(StrBuffer,ob->name);
   return(StrBuffer);
 }
 
-
 char *NodeName(struct nlist *tp, int node)
 {
   if (node == -1) return("Disconnected");
-  if (tp->nodename_cache != NULL) {
-    if (node > tp->nodename_cache_maxnodenum || 
-	tp->nodename_cache[node] == NULL)
-      return ("IllegalNode");
-    else
-      return (tp->nodename_cache[node]->name);
+  if (tp->nodename_cache == NULL) BuildNodeNames(tp, 1);
+  if (tp->nodename_last != NULL && node < 1) return(MissingNodeName(node));
+  if (node < 0 || node > tp->nodename_cache_maxnodenum ||
+	tp->nodename_cache == NULL || NODENAMES(tp)[node] == NULL) {
+    if (tp->nodename_last != NULL) return(MissingNodeName(node));
+    return ("IllegalNode");
   }
-  return (OldNodeName(tp, node));
+  return (NODENAMES(tp)[node]->name);
 }
 
 char *NodeAlias(struct nlist *tp, struct objlist *ob)
@@ -1311,76 +1745,603 @@ char *NodeAlias(struct nlist *tp, struct objlist *ob)
    as it correctly handles disconnected nodes */
 {
   if (ob == NULL) return("NULL");
-  if (ob->node == -1) {
+  if (ob->node < 0) {
 /*    Fprintf(stderr,"Disconnected node in NodeAlias: %s\n",ob->name); */
     return(ob->name);
   }
-  if ((ob->node >= 0) && (tp->nodename_cache != NULL) &&
-		(ob->node <= tp->nodename_cache_maxnodenum))
-    return (tp->nodename_cache[ob->node]->name);
-  return (OldNodeName(tp, ob->node));
+  if (tp->nodename_cache == NULL) BuildNodeNames(tp, 1);
+  if (tp->nodename_cache == NULL) return(ob->name);
+  if (tp->nodename_last != NULL && ob->node == 0) return(MissingNodeName(0));
+  if ((ob->node > tp->nodename_cache_maxnodenum) ||
+		(NODENAMES(tp)[ob->node] == NULL))
+    FillNodeName(tp, ob->node);
+  if ((ob->node <= tp->nodename_cache_maxnodenum) &&
+		(NODENAMES(tp)[ob->node] != NULL))
+    return (NODENAMES(tp)[ob->node]->name);
+  if (tp->nodename_last != NULL) return(MissingNodeName(ob->node));
+  return(ob->name);
 }
 
 void FreeNodeNames(struct nlist *tp)
 {
   if (tp == NULL) return;
+  FreeNodePins(tp);
   if (tp->nodename_cache != NULL)
     FREE(tp->nodename_cache);
+  if (tp->nodename_unsettled != NULL)
+    FREE(tp->nodename_unsettled);
+  if (tp->nodename_last != NULL)
+    FREE(tp->nodename_last);
   tp->nodename_cache = NULL;
   tp->nodename_cache_maxnodenum = 0;
+  tp->nodename_cache_size = 0;
+  tp->nodename_unsettled = NULL;
+  tp->nodename_nunsettled = 0;
+  tp->nodename_last = NULL;
 }
 
-void CacheNodeNames(struct nlist *tp)
+/* Build the node name cache of 'tp' from its object list, with the	*/
+/* names of an open cell as well if 'open' is nonzero.			*/
+
+static void BuildNodeNames(struct nlist *tp, int open)
 {
   int nodes;
   struct objlist *ob;
 
-  if (tp == NULL) return;
-  if (tp->nodename_cache != NULL) FreeNodeNames(tp);
   nodes = 0;
 
   for (ob = tp->cell; ob != NULL; ob = ob->next)
     if (ob->node > nodes) nodes = ob->node;
 
-  if (nodes == 0) return;
+  /* Allocate even for a cell without nodes, so that lookups	*/
+  /* in it do not come back here.				*/
+  if (!GrowNodeNames(tp, nodes)) return;
+  if (open) {
+    tp->nodename_last = (struct objlist **)CALLOC(tp->nodename_cache_size,
+		sizeof(struct objlist *));
+    if (tp->nodename_last == NULL) {
+      FreeNodeNames(tp);
+      return;
+    }
+  }
 
-  tp->nodename_cache = 
-    (struct objlist **)CALLOC(nodes+1, sizeof(*(tp->nodename_cache)));
-  if (tp->nodename_cache == NULL) return;
-  tp->nodename_cache_maxnodenum = nodes;
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    AddNodeName(tp, ob, 1);
+}
 
-  for (ob = tp->cell; ob != NULL; ob = ob->next) {
-    int present, new_type;
-
-    if (ob->node < 0) continue;  /* do not cache it */
-    if ((tp->nodename_cache)[ob->node] == NULL) 
-      (tp->nodename_cache)[ob->node] = ob;
-
-    present = ((tp->nodename_cache)[ob->node])->type;
-    new_type = ob->type;
-
-    if (new_type == present) continue;
-    if (new_type >= FIRSTPIN && present >= FIRSTPIN) continue;
-
-    switch (new_type) {
-    case PORT: 
-      (tp->nodename_cache)[ob->node] = ob;
-      break;
-    case NODE:
-      if (present != PORT)
-	(tp->nodename_cache)[ob->node] = ob;
-      break;
-    case UNIQUEGLOBAL:
-      if (present != PORT && present != NODE)
-	(tp->nodename_cache)[ob->node] = ob;
-      break;
-    case GLOBAL:
-      if (present != PORT && present != NODE && present != UNIQUEGLOBAL)
-	(tp->nodename_cache)[ob->node] = ob;
-      break;
-    default:   /* we have a pin or property, which we can ignore */
-      break;
+void CacheNodeNames(struct nlist *tp)
+{
+  if (tp == NULL) return;
+  FreeNodeNames(tp);
+  BuildNodeNames(tp, 0);
+}
+
+/* Start the node names of a cell opened by CellDef() */
+
+void OpenNodeNames(struct nlist *tp)
+{
+  if (tp == NULL) return;
+  FreeNodeNames(tp);
+  BuildNodeNames(tp, 1);
+}
+
+/* End the names of an open cell.  The cache, kept all along, already	*/
+/* holds the names a full CacheNodeNames() pass would choose.		*/
+
+void CloseNodeNames(struct nlist *tp)
+{
+  if (tp == NULL || tp->nodename_last == NULL) return;
+  FREE(tp->nodename_last);
+  tp->nodename_last = NULL;
+}
+
+/*----------------------------------------------------------------------*/
+/* Query index of a cell.  The query commands ("nodes", "elements",	*/
+/* "describe" and friends) need all objects on a given net, and all	*/
+/* pins of a given instance, which otherwise means scanning the whole	*/
+/* object list once per net or per pin.  The index has two parts, each	*/
+/* built on first use:							*/
+/*   bynode:  objects with node >= 0, grouped by node number, each	*/
+/*	      group in object list order.				*/
+/*   byname:  all named objects sorted by name, so that the pins of an	*/
+/*	      instance "inst" ("inst/pin") are found by prefix search.	*/
+/* Anything that adds, removes, reorders, renames or reconnects objects	*/
+/* of a cell must call FreeNodePins().  This is done by FreeNodeNames()	*/
+/* and the other node name cache updates, which cover most changes.	*/
+/*----------------------------------------------------------------------*/
+
+struct pinname {
+  struct objlist *ob;
+  long order;		/* position in the object list */
+};
+
+struct pinindex {
+  int maxnode;			/* largest node number indexed */
+  long *nodestart;		/* start of each node's group in bynode */
+  struct objlist **bynode;
+  long nnames;			/* number of entries in byname */
+  struct pinname *byname;
+};
+
+void FreeNodePins(struct nlist *tp)
+{
+  struct pinindex *pi;
+
+  if (tp == NULL || (pi = tp->pinindex) == NULL) return;
+  if (pi->nodestart != NULL) FREE(pi->nodestart);
+  if (pi->bynode != NULL) FREE(pi->bynode);
+  if (pi->byname != NULL) FREE(pi->byname);
+  FREE(pi);
+  tp->pinindex = NULL;
+}
+
+static struct pinindex *GetPinIndex(struct nlist *tp)
+{
+  if (tp->pinindex == NULL)
+    tp->pinindex = (struct pinindex *)CALLOC(1, sizeof(struct pinindex));
+  return tp->pinindex;
+}
+
+static void CacheNodePins(struct nlist *tp, struct pinindex *pi)
+{
+  struct objlist *ob;
+  long *fill;
+  int maxnode, i;
+
+  maxnode = 0;
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->node > maxnode) maxnode = ob->node;
+
+  pi->maxnode = maxnode;
+  pi->nodestart = (long *)CALLOC(maxnode + 2, sizeof(long));
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->node >= 0) pi->nodestart[ob->node + 1]++;
+  for (i = 0; i <= maxnode; i++)
+    pi->nodestart[i + 1] += pi->nodestart[i];
+
+  pi->bynode = (struct objlist **)CALLOC(pi->nodestart[maxnode + 1] + 1,
+		sizeof(struct objlist *));
+  fill = (long *)CALLOC(maxnode + 1, sizeof(long));
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->node >= 0)
+      pi->bynode[pi->nodestart[ob->node] + fill[ob->node]++] = ob;
+  FREE(fill);
+}
+
+/* Return the objects of cell "tp" on net "node", in object list	*/
+/* order, and set "count" to their number.				*/
+
+struct objlist **NodePins(struct nlist *tp, int node, int *count)
+{
+  struct pinindex *pi;
+
+  *count = 0;
+  pi = GetPinIndex(tp);
+  if (pi->bynode == NULL) CacheNodePins(tp, pi);
+  if (node < 0 || node > pi->maxnode) return NULL;
+
+  *count = (int)(pi->nodestart[node + 1] - pi->nodestart[node]);
+  return pi->bynode + pi->nodestart[node];
+}
+
+static int pinnamecompare(const void *a, const void *b)
+{
+  const struct pinname *p1 = (const struct pinname *)a;
+  const struct pinname *p2 = (const struct pinname *)b;
+  int r;
+
+  r = strcmp(p1->ob->name, p2->ob->name);
+  if (r != 0) return r;
+  return (p1->order > p2->order) ? 1 : ((p1->order < p2->order) ? -1 : 0);
+}
+
+static int pinordercompare(const void *a, const void *b)
+{
+  const struct pinname *p1 = (const struct pinname *)a;
+  const struct pinname *p2 = (const struct pinname *)b;
+
+  return (p1->order > p2->order) ? 1 : ((p1->order < p2->order) ? -1 : 0);
+}
+
+static void CacheNamePins(struct nlist *tp, struct pinindex *pi)
+{
+  struct objlist *ob;
+  long n, order;
+
+  n = 0;
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->name != NULL) n++;
+
+  pi->byname = (struct pinname *)CALLOC(n + 1, sizeof(struct pinname));
+  n = order = 0;
+  for (ob = tp->cell; ob != NULL; ob = ob->next, order++) {
+    if (ob->name == NULL) continue;
+    pi->byname[n].ob = ob;
+    pi->byname[n].order = order;
+    n++;
+  }
+  qsort(pi->byname, n, sizeof(struct pinname), pinnamecompare);
+  pi->nnames = n;
+}
+
+/* Append to "found" all objects named "prefix" or "prefix/...".  If	*/
+/* "slashed" is 0, names with a leading '/' are skipped (they are	*/
+/* found by searching again with the '/' prepended to "prefix").	*/
+
+static long PrefixRange(struct pinindex *pi, char *prefix, int slashed,
+		struct pinname *found, long nfound)
+{
+  long lo, hi, mid;
+  int len;
+  char *name;
+
+  len = strlen(prefix);
+
+  lo = 0;
+  hi = pi->nnames;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (strcmp(pi->byname[mid].ob->name, prefix) < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  for (; lo < pi->nnames; lo++) {
+    name = pi->byname[lo].ob->name;
+    if (strncmp(name, prefix, len)) break;
+    if (name[len] != '/' && name[len] != '\0') continue;
+    if (slashed == 0 && *name == '/') continue;
+    found[nfound++] = pi->byname[lo];
+  }
+  return nfound;
+}
+
+/* Find all objects of cell "tp" named "prefix" or "prefix/...", which	*/
+/* are the pins of instance "prefix" (and, in a flattened cell, all	*/
+/* objects below it).  If "noslash" is set, a leading '/' on an object	*/
+/* name is ignored.  Sets "obs" to an allocated list of the objects in	*/
+/* object list order, which the caller must free, and returns the	*/
+/* number of objects found.						*/
+
+int PrefixObjects(struct nlist *tp, char *prefix, int noslash,
+		struct objlist ***obs)
+{
+  struct pinindex *pi;
+  struct pinname *found;
+  char *slashprefix;
+  long nfound, i;
+
+  *obs = NULL;
+  pi = GetPinIndex(tp);
+  if (pi->byname == NULL) CacheNamePins(tp, pi);
+
+  found = (struct pinname *)CALLOC(pi->nnames + 1, sizeof(struct pinname));
+  if (noslash) {
+    nfound = PrefixRange(pi, prefix, 0, found, 0);
+    slashprefix = (char *)MALLOC(strlen(prefix) + 2);
+    sprintf(slashprefix, "/%s", prefix);
+    nfound = PrefixRange(pi, slashprefix, 1, found, nfound);
+    FREE(slashprefix);
+    qsort(found, nfound, sizeof(struct pinname), pinordercompare);
+  }
+  else
+    nfound = PrefixRange(pi, prefix, -1, found, 0);
+
+  if (nfound > 0) {
+    *obs = (struct objlist **)CALLOC(nfound, sizeof(struct objlist *));
+    for (i = 0; i < nfound; i++) (*obs)[i] = found[i].ob;
+  }
+  FREE(found);
+  return (int)nfound;
+}
+
+
+/*----------------------------------------------------------------------*/
+/* Cell database snapshots.  SnapshotSave() keeps a private copy of	*/
+/* every cell belonging to one file (or to all files), and		*/
+/* SnapshotRestore() puts the contents of those cells back, so that	*/
+/* netlists read once can be compared many times with different	*/
+/* setups.  Cells are restored in place, so pointers to their nlist	*/
+/* records remain valid.  Cells created in the saved files since the	*/
+/* snapshot are deleted, and cells deleted since are reinstalled.	*/
+/*----------------------------------------------------------------------*/
+
+struct objmap {
+  struct objlist *from;
+  struct objlist *to;
+};
+
+static struct nlist **SnapCells = NULL;	/* sorted by file and name */
+static int SnapCount = 0;
+static int SnapFile = -2;		/* file saved, -1 for all, -2 none */
+
+static int objmapcompare(const void *a, const void *b)
+{
+  struct objlist *oa = ((struct objmap *)a)->from;
+  struct objlist *ob = ((struct objmap *)b)->from;
+
+  return (oa < ob) ? -1 : (oa > ob) ? 1 : 0;
+}
+
+static int snapcompare(const void *a, const void *b)
+{
+  struct nlist *ta = *((struct nlist **)a);
+  struct nlist *tb = *((struct nlist **)b);
+
+  if (ta->file != tb->file) return (ta->file < tb->file) ? -1 : 1;
+  return strcmp(ta->name, tb->name);
+}
+
+/* Copy a hash table of objects, pointing each entry at the copy of	*/
+/* its object.  The table is copied bin by bin, so it does not depend	*/
+/* on which hash function is in effect.  Entries pointing to objects	*/
+/* that are no longer in the cell are dropped.				*/
+
+static void CopyObjectHash(struct hashdict *to, struct hashdict *from,
+		struct objmap *map, int nobjs)
+{
+  struct hashlist *np, *newp, *tail;
+  struct objmap key, *found;
+  int i;
+
+  InitializeHashTable(to, from->hashsize);
+  if (from->hashtab == NULL) return;
+  for (i = 0; i < from->hashsize; i++) {
+    tail = NULL;
+    for (np = from->hashtab[i]; np != NULL; np = np->next) {
+      key.from = (struct objlist *)np->ptr;
+      found = (struct objmap *)bsearch(&key, map, nobjs, sizeof(struct objmap),
+		objmapcompare);
+      if (found == NULL) continue;
+      newp = (struct hashlist *)CALLOC(1, sizeof(struct hashlist));
+      newp->name = strsave(np->name);
+      newp->ptr = (void *)found->to;
+      if (tail == NULL) to->hashtab[i] = newp;
+      else tail->next = newp;
+      tail = newp;
     }
   }
 }
 
+/* Copy a hash table of property keys */
+
+static void CopyPropertyHash(struct hashdict *to, struct hashdict *from)
+{
+  struct hashlist *np, *newp, *tail;
+  struct property *prop, *newprop;
+  int i;
+
+  InitializeHashTable(to, from->hashsize);
+  if (from->hashtab == NULL) return;
+  for (i = 0; i < from->hashsize; i++) {
+    tail = NULL;
+    for (np = from->hashtab[i]; np != NULL; np = np->next) {
+      prop = (struct property *)np->ptr;
+      newprop = (struct property *)CALLOC(1, sizeof(struct property));
+      *newprop = *prop;
+      newprop->key = strsave(prop->key);
+      if (prop->type == PROP_STRING && prop->pdefault.string != NULL)
+	newprop->pdefault.string = strsave(prop->pdefault.string);
+      else if (prop->type == PROP_EXPRESSION)
+	newprop->pdefault.stack = CopyTokStack(prop->pdefault.stack);
+      newp = (struct hashlist *)CALLOC(1, sizeof(struct hashlist));
+      newp->name = strsave(np->name);
+      newp->ptr = (void *)newprop;
+      if (tail == NULL) to->hashtab[i] = newp;
+      else tail->next = newp;
+      tail = newp;
+    }
+  }
+}
+
+/* Copy the contents of cell "from" into the (empty) cell "to".  The	*/
+/* name, hash table linkage, and embedding of "to" are not changed.	*/
+
+static void CopyCellContents(struct nlist *to, struct nlist *from)
+{
+  struct objlist *ob, *newob, *tail;
+  struct objmap *map;
+  struct Permutation *perm, *newperm, *permtail;
+  int nobjs, i;
+
+  to->file = from->file;
+  to->number = from->number;
+  to->dumped = from->dumped;
+  to->flags = from->flags;
+  to->class = from->class;
+  to->classhash = from->classhash;
+  to->nodename_cache = NULL;
+  to->nodename_cache_maxnodenum = 0;
+  to->nodename_cache_size = 0;
+  to->nodename_unsettled = NULL;
+  to->nodename_nunsettled = 0;
+  to->nodename_last = NULL;
+  to->pinindex = NULL;
+
+  nobjs = 0;
+  for (ob = from->cell; ob != NULL; ob = ob->next) nobjs++;
+  map = (struct objmap *)CALLOC(nobjs + 1, sizeof(struct objmap));
+
+  /* Copy objects.  Unlike CopyObjList(), keep the port numbers */
+  to->cell = tail = NULL;
+  for (ob = from->cell, i = 0; ob != NULL; ob = ob->next, i++) {
+    newob = GetObject();
+    newob->name = (ob->name) ? strsave(ob->name) : NULL;
+    newob->type = ob->type;
+    newob->node = ob->node;
+    if (ob->type == PROPERTY) {
+      newob->model.class = NULL;
+      newob->instance.props = NULL;
+      CopyProperties(newob, ob);
+    }
+    else {
+      if (IsPort(ob))
+	newob->model.port = ob->model.port;
+      else
+	newob->model.class = (ob->model.class) ? strsave(ob->model.class) : NULL;
+      newob->instance.name = (ob->instance.name) ?
+		strsave(ob->instance.name) : NULL;
+    }
+    if (tail == NULL) to->cell = newob;
+    else tail->next = newob;
+    tail = newob;
+    map[i].from = ob;
+    map[i].to = newob;
+  }
+  qsort(map, nobjs, sizeof(struct objmap), objmapcompare);
+
+  /* A closed cell keeps its names;  an open one rebuilds them on use */
+  if (from->nodename_cache != NULL && from->nodename_last == NULL)
+    CacheNodeNames(to);
+
+  CopyObjectHash(&(to->objdict), &(from->objdict), map, nobjs);
+  CopyObjectHash(&(to->instdict), &(from->instdict), map, nobjs);
+  CopyPropertyHash(&(to->propdict), &(from->propdict));
+  FREE(map);
+
+  /* Permutation pin names point to the names of the pin records */
+  to->permutes = permtail = NULL;
+  for (perm = from->permutes; perm != NULL; perm = perm->next) {
+    newperm = (struct Permutation *)CALLOC(1, sizeof(struct Permutation));
+    ob = (struct objlist *)HashLookup(perm->pin1, &(to->objdict));
+    newperm->pin1 = (ob) ? ob->name : perm->pin1;
+    ob = (struct objlist *)HashLookup(perm->pin2, &(to->objdict));
+    newperm->pin2 = (ob) ? ob->name : perm->pin2;
+    if (permtail == NULL) to->permutes = newperm;
+    else permtail->next = newperm;
+    permtail = newperm;
+  }
+}
+
+/* Free the contents of a cell, but not its name or the record itself */
+
+static void FreeCellContents(struct nlist *tp)
+{
+  struct objlist *ob, *obnext;
+  struct Permutation *perm, *permnext;
+
+  HashKill(&(tp->objdict));
+  HashKill(&(tp->instdict));
+  RecurseHashTable(&(tp->propdict), freeprop);
+  HashKill(&(tp->propdict));
+  FreeNodeNames(tp);
+  for (ob = tp->cell; ob != NULL; ob = obnext) {
+    obnext = ob->next;
+    if (IsPort(ob)) ob->model.class = NULL;	/* holds the port number */
+    FreeObject(ob);
+  }
+  tp->cell = NULL;
+  for (perm = tp->permutes; perm != NULL; perm = permnext) {
+    permnext = perm->next;
+    FREE(perm);
+  }
+  tp->permutes = NULL;
+}
+
+/* Discard the current snapshot */
+
+void SnapshotClear(void)
+{
+  int i;
+
+  for (i = 0; i < SnapCount; i++) {
+    FreeCellContents(SnapCells[i]);
+    FREE(SnapCells[i]->name);
+    FREE(SnapCells[i]);
+  }
+  if (SnapCells != NULL) FREE(SnapCells);
+  SnapCells = NULL;
+  SnapCount = 0;
+  SnapFile = -2;
+}
+
+/* Save a snapshot of all cells of file "fnum", or of all files if	*/
+/* fnum is -1.  Returns the number of cells saved.			*/
+
+int SnapshotSave(int fnum)
+{
+  struct nlist *tp, *copy;
+  int n;
+
+  SnapshotClear();
+
+  n = 0;
+  for (tp = FirstCell(); tp != NULL; tp = NextCell())
+    if ((fnum == -1) || (tp->file == fnum)) n++;
+  SnapCells = (struct nlist **)CALLOC(n + 1, sizeof(struct nlist *));
+
+  for (tp = FirstCell(); tp != NULL; tp = NextCell()) {
+    if ((fnum != -1) && (tp->file != fnum)) continue;
+    copy = (struct nlist *)CALLOC(1, sizeof(struct nlist));
+    copy->name = strsave(tp->name);
+    CopyCellContents(copy, tp);
+    SnapCells[SnapCount++] = copy;
+  }
+  qsort(SnapCells, SnapCount, sizeof(struct nlist *), snapcompare);
+  SnapFile = fnum;
+  return SnapCount;
+}
+
+/* Restore all cells from the snapshot.  The snapshot is kept, so it	*/
+/* can be restored again.  Returns the number of cells restored, or -1	*/
+/* if there is no snapshot.						*/
+
+int SnapshotRestore(void)
+{
+  struct nlist *tp, *key, **found, **extra, *restored;
+  unsigned char *seen;
+  int i, nextra;
+
+  if (SnapFile == -2) return -1;
+
+  seen = (unsigned char *)CALLOC(SnapCount + 1, sizeof(unsigned char));
+  nextra = 0;
+  for (tp = FirstCell(); tp != NULL; tp = NextCell())
+    if ((SnapFile == -1) || (tp->file == SnapFile)) nextra++;
+  extra = (struct nlist **)CALLOC(nextra + 1, sizeof(struct nlist *));
+
+  /* Restore cells that still exist, and note cells that are new */
+  nextra = 0;
+  for (tp = FirstCell(); tp != NULL; tp = NextCell()) {
+    if ((SnapFile != -1) && (tp->file != SnapFile)) continue;
+    key = tp;
+    found = (struct nlist **)bsearch(&key, SnapCells, SnapCount,
+		sizeof(struct nlist *), snapcompare);
+    if (found == NULL) {
+      extra[nextra++] = tp;
+      continue;
+    }
+    ClassIndexRemove(tp);
+    FreeCellContents(tp);
+    CopyCellContents(tp, *found);
+    ClassIndexInsert(tp);
+    seen[found - SnapCells] = 1;
+  }
+
+  for (i = 0; i < nextra; i++)
+    CellDelete(extra[i]->name, extra[i]->file);
+  FREE(extra);
+
+  /* Reinstall cells that were deleted */
+  for (i = 0; i < SnapCount; i++) {
+    if (seen[i]) continue;
+    restored = (struct nlist *)CALLOC(1, sizeof(struct nlist));
+    restored->name = strsave(SnapCells[i]->name);
+    CopyCellContents(restored, SnapCells[i]);
+    HashIntPtrInstall(restored->name, restored->file, restored,
+		&cell_dict);
+    ClassIndexInsert(restored);
+  }
+  FREE(seen);
+
+  /* Nothing may continue adding to a restored cell */
+  CurrentCell = NULL;
+  CurrentTail = NULL;
+  LastPlaced = NULL;
+  return SnapCount;
+}
+
+/* Return the number of cells in the snapshot */
+
+int SnapshotCount(void)
+{
+  return SnapCount;
+}
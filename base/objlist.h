@@ -56,6 +56,7 @@
 #define TOK_FUNC_ELSE   19
 #define TOK_SGL_QUOTE	20
 #define TOK_DBL_QUOTE	21
+#define TOK_OPT_STRING	22	/* Operand dropped if it can't be resolved */
 
 /* Part 1b: Stack structure used to hold expressions in tokenized form */
 
@@ -184,6 +185,8 @@ struct Permutation {
                         /* prime numbers are good choices as hash sizes */
                         /* 101 is a good number for IBMPC */
 
+struct pinindex;		/* defined in objlist.c */
+
 /* cell definition for hash table */
 /* NOTE: "file" must come first for the hash matching by name and file */
 
@@ -202,6 +205,11 @@ struct nlist {
   struct hashdict propdict; /* hash table of property keys */
   struct objlist **nodename_cache;
   long nodename_cache_maxnodenum;  /* largest node number in cache */
+  long nodename_cache_size;	/* number of entries allocated in cache */
+  unsigned char *nodename_unsettled;  /* nodes whose cached name is a guess */
+  long nodename_nunsettled;	/* number of entries set in the above */
+  struct objlist **nodename_last;  /* names while the cell is open */
+  struct pinindex *pinindex;	/* node and name index for queries */
   void *embedding;   /* this will be cast to the appropriate data structure */
   struct nlist *next;
 };
@@ -243,6 +251,7 @@ extern struct objlist *LookupObject(char *name, struct nlist *WhichCell);
 extern struct objlist *LookupInstance(char *name, struct nlist *WhichCell);
 extern struct objlist *CopyObjList(struct objlist *oldlist, unsigned char doforall);
 extern void UpdateNodeNumbers(struct objlist *lst, int from, int to);
+extern int RenumberObjList(struct objlist *lst, int lowest, int nextnode);
 
 /* Function pointer to List or ListExact, allowing regular expressions	*/
 /* to be enabled/disabled.						*/
@@ -253,6 +262,8 @@ extern void PrintCellHashTable(int full, int file);
 extern struct nlist *LookupCell(char *s);
 extern struct nlist *LookupCellFile(char *s, int f);
 extern struct nlist *InstallInCellHashTable(char *name, int f);
+extern struct nlist *LookupCellClass(unsigned long classhash, int f);
+extern void SetCellClasshash(struct nlist *tp, unsigned long classhash);
 extern void InitCellHashTable(void);
 extern void ClearDumpedList(void);
 extern int RecurseCellHashTable(int (*foo)(struct hashlist *np));
@@ -262,10 +273,24 @@ extern struct nlist *RecurseCellHashTable2(struct nlist *(*foo)(struct hashlist
 extern struct nlist *FirstCell(void);
 extern struct nlist *NextCell(void);
 
+extern int  SnapshotSave(int fnum);
+extern int  SnapshotRestore(void);
+extern void SnapshotClear(void);
+extern int  SnapshotCount(void);
+
 extern char *NodeName(struct nlist *tp, int node);
 extern char *NodeAlias(struct nlist *tp, struct objlist *ob);
 extern void FreeNodeNames(struct nlist *tp);
 extern void CacheNodeNames(struct nlist *tp);
+extern void OpenNodeNames(struct nlist *tp);
+extern void CloseNodeNames(struct nlist *tp);
+extern void FreeNodePins(struct nlist *tp);
+extern struct objlist **NodePins(struct nlist *tp, int node, int *count);
+extern int PrefixObjects(struct nlist *tp, char *prefix, int noslash,
+		struct objlist ***obs);
+extern void CacheNodeName(struct nlist *tp, struct objlist *ob);
+extern void MergeNodeNames(struct nlist *tp, int from, int to);
+extern void SettleNodeNames(struct nlist *tp);
 
 
 /* enable the following line to debug the core allocator */
@@ -288,9 +313,11 @@ extern char *strsave(char *s);
 #endif /* not DEBUG_GARBAGE */
 
 extern int freeprop(struct hashlist *p);
+extern char *PropKey(char *key);
 
 extern int  match(char *, char *);
 extern int  matchnocase(char *, char *);
+extern int  comparenocase(char *, char *);
 extern int  matchfile(char *, char *, int, int);
 extern int  matchfilenocase(char *, char *, int, int);
 
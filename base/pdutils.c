@@ -48,31 +48,36 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #define IA 1366
 #define IC 150889L
 
-static long idum = -1;  /* needs to be initialized to avoid seg fault if 0 */
+/* idum needs to be initialized to avoid seg fault if 0 */
+static struct randomstate globalstate = {-1};
 
-float ran2(void)
+float RandomStateUniform(struct randomstate *rs)
+/* ran2() on the generator state 'rs', or on the shared one if NULL */
 {
-	static long iy,ir[98];
-	static int iff=0;
 	int j;
-	void nrerror();
 
-	if (idum < 0 || iff == 0) {
-		iff=1;
-		if ((idum=(IC-(idum)) % M) < 0) idum = -idum;
+	if (rs == NULL) rs = &globalstate;
+	if (rs->idum < 0 || rs->iff == 0) {
+		rs->iff=1;
+		if ((rs->idum=(IC-(rs->idum)) % M) < 0) rs->idum = -rs->idum;
 		for (j=1;j<=97;j++) {
-			idum=(IA*idum+IC) % M;
-			ir[j]=idum;
+			rs->idum=(IA*rs->idum+IC) % M;
+			rs->ir[j]=rs->idum;
 		}
-		idum=(IA*idum+IC) % M;
-		iy=idum;
+		rs->idum=(IA*rs->idum+IC) % M;
+		rs->iy=rs->idum;
 	}
-	j=(int)(1 + 97.0*iy/M); /* the cast was added by Glenn for C++ */
+	j=(int)(1 + 97.0*rs->iy/M); /* the cast was added by Glenn for C++ */
 	if (j > 97 || j < 1) perror("RAN2: This cannot happen.");
-	iy=ir[j];
-	idum=(IA*idum+IC) % M;
-	ir[j]=idum;
-	return (float) iy/M;
+	rs->iy=rs->ir[j];
+	rs->idum=(IA*rs->idum+IC) % M;
+	rs->ir[j]=rs->idum;
+	return (float) rs->iy/M;
+}
+
+float ran2(void)
+{
+	return(RandomStateUniform(&globalstate));
 }
 
 #undef M
@@ -96,18 +101,29 @@ int Random(int max)
 }
 #endif
 
-long RandomSeed(long seed)
+int RandomStateInt(struct randomstate *rs, int max)
+{
+  return(RandomStateUniform(rs) * max);
+}
+
+long RandomStateSeed(struct randomstate *rs, long seed)
 /* initialize idum to some negative integer */
 {
 	long oldidum;
 
-	oldidum = idum;
+	if (rs == NULL) rs = &globalstate;
+	oldidum = rs->idum;
 	if (seed == 0) seed = -1;
 	if (seed > 0) seed = -seed;
-	idum = seed;
+	rs->idum = seed;
 	return(oldidum);
 }
 
+long RandomSeed(long seed)
+{
+	return(RandomStateSeed(&globalstate, seed));
+}
+
 float RandomUniform(void)
 {
 	return(ran2());
@@ -1,9 +1,21 @@
 
 /* emulator functions found in pdutils.c */
 
+/* state of one random number generator, for callers that need a	*/
+/* sequence of their own;  NULL selects the shared generator	*/
+struct randomstate {
+  long idum;
+  long iy;
+  long ir[98];
+  int iff;
+};
+
 extern float RandomUniform(void);
 extern long RandomSeed(long seed);
 extern int Random(int max);
+extern float RandomStateUniform(struct randomstate *rs);
+extern long RandomStateSeed(struct randomstate *rs, long seed);
+extern int RandomStateInt(struct randomstate *rs, int max);
 
 #ifdef NEED_STRING
 extern char *strtok(char *s, char *delim);
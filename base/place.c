@@ -40,6 +40,10 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include <signal.h>
 #include <ctype.h>
 
+#ifdef TCL_NETGEN
+#include <tcl.h>
+#endif
+
 #include "netgen.h"
 #include "hash.h"
 #include "objlist.h"
@@ -60,15 +64,25 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 int CountAnyCommonNodes;
 
 
-/* abridged ownership and connectivity matrices */
+/* abridged ownership and connectivity matrices, sized for each cell */
 /* elements, nodes, leaves are indexed from 1 to N, nodes, leaves */
-unsigned short M[MAX_ELEMENTS][7];  
+int (*M)[7];  
 /* height, L, R, SWALLOWED, PINS, LEAVES, USED */
 
-unsigned long MSTAR[MAX_ELEMENTS][(MAX_LEAVES / BITS_PER_LONG)  + 1];
+unsigned long *MStar;
+
+long *CRow;
+int *CNode;
+int *CStar;
+unsigned char *CPin;
+int *NodeUsage;
+unsigned char *PortNode;
+
+long *NodeRow;
+int *NodeLeaf;
 
-unsigned char C[MAX_ELEMENTS][MAX_NODES + 1];
-unsigned char CSTAR[MAX_ELEMENTS][MAX_NODES + 1];
+unsigned long *CBits;
+int (*Span)[4];
 
 /* elements at level i must have TreeFanout[i] or fewer ports */
 int TreeFanout[MAX_TREE_DEPTH + 1];       /* tree fanout at each level */
@@ -83,7 +97,12 @@ int MinUsedLeaves[MAX_TREE_DEPTH + 1];
 int Nodes;   /* number of nodes in the cell */
 int Leaves;  /* number of leaves in the cell */
 int PackedLeaves; /* == Leaves / BITS_PER_LONG, just to save computation */
+int PackedNodes; /* == Nodes / BITS_PER_LONG */
 int Elements; /* number of elements */
+int ElementLimit; /* most elements bottom-up embedding may create */
+int ElementSpace; /* elements allocated in M, CRow, MStar and CBits */
+long PinSpace; /* entries allocated in CNode, CStar and CPin */
+int TreeDepth = TREE_DEPTH; /* depth of the embedding tree for this cell */
 int NewN, NewElements;
 int SumPINS, SumCommonNodes, SumUsedLeaves;
 int NewSwallowed;
@@ -94,6 +113,7 @@ int LogLevel1 = -1; /* automatically log if Level1 == LogLevel1 */
 int LogLevel2 = -1;
 int FatalError = 0; /* internal error */
 int Exhaustive = 0; /* slow, methodical */
+int Agglomerative = 0; /* priority-queue bottom-up merging */
 int PlaceDebug = 0; /* interactive debug */
 
 FILE *outfile;  /* output file */
@@ -130,131 +150,366 @@ void InitializeMinUsedLeaves(void)
 
 int RenumberNodes(char *cellname)
 /* returns number of nodes in 'cellname', numbered from 1 */
+/* returns -1 if there is not enough memory to renumber them */
 {
   struct nlist *tp;
   struct objlist *ob;
   int maxnode, newnode, oldnode;
+  int *newnumber;
 
   tp = LookupCell(cellname);
   if (tp == NULL) return(0);
   if (tp->class != CLASS_SUBCKT) return(0);
-  ob = tp->cell;
   maxnode = -1;
-  while (ob != NULL) {
-    if (ob->node >  maxnode) 
-      maxnode = ob->node;
-    ob = ob->next;
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->node > maxnode) maxnode = ob->node;
+  if (maxnode < 1) return(0);
+
+  /* renumber all the nodes contiguously from 1, keeping their order */
+  newnumber = (int *)CALLOC(maxnode + 1, sizeof(int));
+  if (newnumber == NULL) return(-1);
+  for (ob = tp->cell; ob != NULL; ob = ob->next)
+    if (ob->node > 0) newnumber[ob->node] = 1;
+  newnode = 0;
+  for (oldnode = 1; oldnode <= maxnode; oldnode++)
+    if (newnumber[oldnode]) newnumber[oldnode] = ++newnode;
+
+  if (newnode < maxnode) {
+    for (ob = tp->cell; ob != NULL; ob = ob->next)
+      if (ob->node > 0) ob->node = newnumber[ob->node];
+    CacheNodeNames(tp);	/* the node name cache is indexed by node */
   }
-  /* renumber all the nodes contiguously from 1 */
-  newnode = 1;
-  for (oldnode = 1; oldnode <= maxnode; oldnode++) {
-    int found;
-    found = 0;
-    for (ob = tp->cell; ob != NULL; ob = ob->next) 
-      if (ob->node == oldnode) {
-	found = 1;
-	ob->node = newnode;
-      }
-    if (found) newnode++;
+  FREE(newnumber);
+  return(newnode);
+}
+
+static void FreeOwnership(void)
+{
+  if (MStar != NULL) FREE(MStar);
+  if (CBits != NULL) FREE(CBits);
+  if (Span != NULL) FREE(Span);
+  MStar = NULL;
+  CBits = NULL;
+  Span = NULL;
+}
+
+static void FreeMatrices(void)
+{
+  if (M != NULL) FREE(M);
+  FreeOwnership();
+  if (CRow != NULL) FREE(CRow);
+  if (CNode != NULL) FREE(CNode);
+  if (CStar != NULL) FREE(CStar);
+  if (CPin != NULL) FREE(CPin);
+  if (NodeUsage != NULL) FREE(NodeUsage);
+  if (PortNode != NULL) FREE(PortNode);
+  if (NodeRow != NULL) FREE(NodeRow);
+  if (NodeLeaf != NULL) FREE(NodeLeaf);
+  M = NULL;
+  CRow = NULL;
+  CNode = NULL;
+  CStar = NULL;
+  CPin = NULL;
+  NodeUsage = NULL;
+  PortNode = NULL;
+  NodeRow = NULL;
+  NodeLeaf = NULL;
+  ElementSpace = 0;
+  PinSpace = 0;
+}
+
+static void *GrowArray(void *array, long oldbytes, long newbytes)
+/* return a copy of 'array' enlarged to 'newbytes', zero filled; */
+/* on failure, return NULL and leave 'array' alone */
+{
+  char *newarray;
+
+  newarray = (char *)CALLOC(newbytes, 1);
+  if (newarray == NULL) return(NULL);
+  if (array != NULL) {
+    memcpy(newarray, array, oldbytes);
+    FREE(array);
   }
-  return(newnode - 1);
+  return((void *)newarray);
+}
+
+static int GrowElements(int E)
+/* make room for element E (and the end of its row);  return 1 if OK */
+{
+  int newspace;
+  void *newarray;
+
+  if (E + 1 < ElementSpace) return(1);
+  newspace = (ElementSpace > 0) ? ElementSpace : 64;
+  while (newspace <= E + 1) newspace <<= 1;
+
+  newarray = GrowArray(M, (long)ElementSpace * sizeof(M[0]),
+		(long)newspace * sizeof(M[0]));
+  if (newarray == NULL) return(0);
+  M = newarray;
+  newarray = GrowArray(CRow, (long)ElementSpace * sizeof(long),
+		(long)newspace * sizeof(long));
+  if (newarray == NULL) return(0);
+  CRow = newarray;
+  if (MStar != NULL) {
+    newarray = GrowArray(MStar,
+		(long)ElementSpace * (PackedLeaves + 1) * sizeof(unsigned long),
+		(long)newspace * (PackedLeaves + 1) * sizeof(unsigned long));
+    if (newarray == NULL) return(0);
+    MStar = newarray;
+  }
+  if (CBits != NULL) {
+    newarray = GrowArray(CBits,
+		(long)ElementSpace * (PackedNodes + 1) * sizeof(unsigned long),
+		(long)newspace * (PackedNodes + 1) * sizeof(unsigned long));
+    if (newarray == NULL) return(0);
+    CBits = newarray;
+    newarray = GrowArray(Span, (long)ElementSpace * sizeof(Span[0]),
+		(long)newspace * sizeof(Span[0]));
+    if (newarray == NULL) return(0);
+    Span = newarray;
+  }
+  ElementSpace = newspace;
+  return(1);
+}
+
+static int GrowPins(long entries)
+/* make room for 'entries' sparse connectivity entries;  return 1 if OK */
+{
+  long newspace;
+  void *newarray;
+
+  if (entries <= PinSpace) return(1);
+  newspace = (PinSpace > 0) ? PinSpace : 256;
+  while (newspace < entries) newspace <<= 1;
+
+  newarray = GrowArray(CNode, PinSpace * sizeof(int), newspace * sizeof(int));
+  if (newarray == NULL) return(0);
+  CNode = newarray;
+  newarray = GrowArray(CStar, PinSpace * sizeof(int), newspace * sizeof(int));
+  if (newarray == NULL) return(0);
+  CStar = newarray;
+  newarray = GrowArray(CPin, PinSpace, newspace);
+  if (newarray == NULL) return(0);
+  CPin = newarray;
+  PinSpace = newspace;
+  return(1);
+}
+
+static int CompareNodes(const void *a, const void *b)
+{
+  return(*(const int *)a - *(const int *)b);
 }
 
-void EraseMatrices(void)
+#ifndef __GNUC__
+int PopCount(unsigned long w)
+/* return the number of bits set in w */
 {
-  memzero(C, sizeof(C));
-  memzero(CSTAR, sizeof(CSTAR));
-  memzero(M, sizeof(M));
-  memzero(MSTAR, sizeof(MSTAR));
+  int count;
+
+  for (count = 0; w != 0; count++) w &= w - 1;
+  return(count);
 }
+#endif
 
 int InitializeMatrices(char *cellname)
 /* return 1 if OK; upon exit: 'Leaves', 'Nodes', 'Elements' are initialized */
 {
   struct nlist *tp;
   struct objlist *ob;
-  int i, j;
+  int i, j, pins;
+  long k;
+  int *pinnodes, *filled;
 
   tp = LookupCell(cellname);
   if (tp == NULL) return(0);
   if (tp->class != CLASS_SUBCKT) return(0);
 
-  if ((Nodes = RenumberNodes(cellname)) > MAX_NODES) {
-    Fprintf(stderr,"Too many nodes in cell: %s (%d > MAX_NODES(%d))\n",
-	    cellname, Nodes, MAX_NODES);
+  if ((Nodes = RenumberNodes(cellname)) < 0) {
+    Fprintf(stderr,"Not enough memory to renumber nodes in cell: %s\n",
+	    cellname);
     return(0);
   }
-  EraseMatrices();  /* all elements are set to 0 */
+  FreeMatrices();
 
-  /* create connectivity matrix C */
+  /* count leaves and their pins, to size the matrices */
   Leaves = 0;
+  pins = 0;
   for (ob = tp->cell; ob != NULL; ob = ob->next) {
-    if (ob->type == FIRSTPIN) {
-      struct nlist *tp;
-
-      Leaves++;
-      if (Leaves > MAX_LEAVES) continue; /* keep going within the for loop */
-
-      tp = LookupCell(ob->model.class);
-      if (tp == NULL || (tp->class != CLASS_SUBCKT) || tp->embedding == NULL)
-	LEVEL(Leaves) = 0;
-      else LEVEL(Leaves) = ((struct embed *)(tp->embedding))->level;
-      /* remember, L(Leaves) = R(Leaves) = 0 by EraseMatrices above */
-    }
-    if (ob->type >= FIRSTPIN) C[Leaves][ob->node] = 1;
+    if (ob->type == FIRSTPIN) Leaves++;
+    if (ob->type >= FIRSTPIN && ob->node > 0) pins++;
   }
-  if (Leaves > MAX_LEAVES) {
-    Fprintf(stderr, "Too many leaves in cell: %s (%d > MAX_LEAVES(%d))\n",
-	    cellname, Leaves, MAX_LEAVES);
+  if (Leaves > POW2(MAX_TREE_DEPTH)) {
+    Fprintf(stderr, "Too many leaves in cell: %s (%d > %d)\n",
+	    cellname, Leaves, POW2(MAX_TREE_DEPTH));
     return(0);
   }
   PackedLeaves = Leaves / BITS_PER_LONG;
+  PackedNodes = Nodes / BITS_PER_LONG;
+  ElementLimit = MAX(MAX_ELEMENTS, 4 * Leaves);
+  for (TreeDepth = TREE_DEPTH; POW2(TreeDepth) < Leaves; TreeDepth++) ;
+
+  pinnodes = filled = NULL;
+  if (!GrowElements(2 * Leaves) || !GrowPins(2L * pins + 1)) goto nomemory;
+  NodeUsage = (int *)CALLOC(Nodes + 1, sizeof(int));
+  PortNode = (unsigned char *)CALLOC(Nodes + 1, sizeof(unsigned char));
+  filled = (int *)CALLOC(Nodes + 1, sizeof(int));
+  NodeRow = (long *)CALLOC(Nodes + 2, sizeof(long));
+  NodeLeaf = (int *)CALLOC(pins + 1, sizeof(int));
+  pinnodes = (int *)CALLOC(pins + 1, sizeof(int));
+  if (NodeUsage == NULL || PortNode == NULL || filled == NULL ||
+	NodeRow == NULL || NodeLeaf == NULL || pinnodes == NULL)
+    goto nomemory;
+
+  /* create connectivity matrices C and CSTAR, one sparse row per leaf */
+  i = 0;
+  k = 0;
+  CRow[0] = CRow[1] = 0;
+  ob = tp->cell;
+  while (ob != NULL) {
+    struct nlist *tp2;
+    int m;
+
+    if (ob->type != FIRSTPIN) {
+      ob = ob->next;
+      continue;
+    }
+    i++;
+    tp2 = LookupCell(ob->model.class);
+    if (tp2 == NULL || (tp2->class != CLASS_SUBCKT) || tp2->embedding == NULL)
+      LEVEL(i) = 0;
+    else LEVEL(i) = ((struct embed *)(tp2->embedding))->level;
+    /* remember, L(i) = R(i) = 0 as the matrices start out zeroed */
+
+    /* gather the nodes of the leaf, then count pins on the same node */
+    j = 0;
+    do {
+      if (ob->node > 0) pinnodes[j++] = ob->node;
+      ob = ob->next;
+    } while (ob != NULL && ob->type > FIRSTPIN);
+    qsort(pinnodes, j, sizeof(int), CompareNodes);
+    for (m = 0; m < j; m++) {
+      if (k > CRow[i] && CNode[k - 1] == pinnodes[m]) CStar[k - 1]++;
+      else {
+	CNode[k] = pinnodes[m];
+	CStar[k] = 1;
+	CPin[k] = 1;
+	k++;
+      }
+    }
+    CRow[i + 1] = k;
+
+    /* column PINS of matrix M is special, containing fanout of each element */
+    PINS(i) = k - CRow[i];
+  }
+  FREE(pinnodes);
 
   /* row 0 of C is special, containing the port list of the entire cell */
   for (ob = tp->cell; ob != NULL; ob = ob->next) 
-    if (IsPortInPortlist(ob, tp)) C[0][ob->node] = 1;
-
-  /* matrix M partially init. by EraseMatrices, and by Leaves loop above; */
-  /* column PINS of matrix M is special, containing fanout of each element */
-  for (i = 0; i <= Leaves; i++) 
-    for (j = 1; j <= Nodes; j++) PINS(i) += C[i][j];
+    if (IsPort(ob) && ob->node > 0) PortNode[ob->node] = 1;
+  for (j = 1; j <= Nodes; j++) PINS(0) += PortNode[j];
 
   /* initialize the number of leaves contained by each element */
   LEAVES(0) = Leaves;
   for (i = 1; i <= Leaves; i++) LEAVES(i) = 1;
 
-  /* create transitive closure of M */
-  for (i = 1; i <= Leaves; i++) 
-    SetPackedArrayBit(MSTAR[i],i); /* each leaf owns itself */
-  for (i = 1; i <= Leaves; i++)  /* used to be i = 0 ??? */
-    SetPackedArrayBit(MSTAR[0],i); /* portlist owns all leaves */
-
-  /* create nodal connectivity transitive closure matrix CSTAR */
-  i = 0;
-  for (ob = tp->cell; ob != NULL; ob = ob->next) {
-    if (ob->type == FIRSTPIN) i++;
-    if (ob->type >= FIRSTPIN) CSTAR[i][ob->node]++;
-  }
-  for (j = 1; j <= Nodes; j++){
-    CSTAR[0][j] = 0;
-    for (i = 1; i <= Leaves; i++) CSTAR[0][j] += CSTAR[i][j];
-    if (C[0][j]) CSTAR[0][j]++;  /* increment usage of ports */
-  }
+  /* total node usage, row 0 of CSTAR */
+  for (k = 0; k < CRow[Leaves + 1]; k++) NodeUsage[CNode[k]] += CStar[k];
+  for (j = 1; j <= Nodes; j++)
+    if (PortNode[j]) NodeUsage[j]++;  /* increment usage of ports */
+
+  /* list the leaves on each node */
+  for (k = 0; k < CRow[Leaves + 1]; k++) NodeRow[CNode[k] + 1]++;
+  for (j = 1; j <= Nodes; j++) NodeRow[j + 1] += NodeRow[j];
+  for (i = 1; i <= Leaves; i++)
+    for (k = CRow[i]; k < CRow[i + 1]; k++) {
+      j = CNode[k];
+      NodeLeaf[NodeRow[j] + filled[j]++] = i;
+    }
+  FREE(filled);
 
   /* initially, number of elements == number of leaves */
   Elements = Leaves;
   return(1);
+
+ nomemory:
+  Fprintf(stderr, "Not enough memory to embed cell: %s\n", cellname);
+  if (pinnodes != NULL) FREE(pinnodes);
+  if (filled != NULL) FREE(filled);
+  FreeMatrices();
+  return(0);
+}
+
+static void PackPins(int E)
+/* set row E of CBITS, and its span, from the sparse row of C */
+{
+  long k;
+
+  memzero(CBITS(E), (PackedNodes + 1) * sizeof(unsigned long));
+  CFIRST(E) = PackedNodes + 1;
+  CLAST(E) = -1;
+  for (k = CRow[E]; k < CRow[E + 1]; k++)
+    if (CPin[k]) {
+      SetPackedArrayBit(CBITS(E),CNode[k]);
+      /* nodes are in ascending order */
+      if (CLAST(E) < 0) CFIRST(E) = CNode[k] / BITS_PER_LONG;
+      CLAST(E) = CNode[k] / BITS_PER_LONG;
+    }
+}
+
+int InitializeOwnership(void)
+/* create leaf ownership matrix MSTAR and packed connectivity CBITS
+   for the cell set up by InitializeMatrices();  return 1 if OK */
+{
+  int i, j;
+
+  FreeOwnership();
+  MStar = (unsigned long *)CALLOC((long)ElementSpace * (PackedLeaves + 1),
+		sizeof(unsigned long));
+  CBits = (unsigned long *)CALLOC((long)ElementSpace * (PackedNodes + 1),
+		sizeof(unsigned long));
+  Span = (int (*)[4])CALLOC(ElementSpace, sizeof(Span[0]));
+  if (MStar == NULL || CBits == NULL || Span == NULL) {
+    Fprintf(stderr, "Not enough memory for leaf ownership matrix\n");
+    FreeOwnership();
+    return(0);
+  }
+
+  /* pack the port list of the cell, and the pins of each leaf */
+  for (j = 1; j <= Nodes; j++)
+    if (PortNode[j]) SetPackedArrayBit(CBITS(0),j);
+  CFIRST(0) = 0;
+  CLAST(0) = PackedNodes;
+  for (i = 1; i <= Leaves; i++) PackPins(i);
+  MFIRST(0) = 0;
+  MLAST(0) = PackedLeaves;
+  for (i = 1; i <= Leaves; i++)
+    MFIRST(i) = MLAST(i) = i / BITS_PER_LONG;
+
+  /* create transitive closure of M */
+  for (i = 1; i <= Leaves; i++) 
+    SetPackedArrayBit(MSTAR(i),i); /* each leaf owns itself */
+  for (i = 1; i <= Leaves; i++)  /* used to be i = 0 ??? */
+    SetPackedArrayBit(MSTAR(0),i); /* portlist owns all leaves */
+  return(1);
 }
 
 void PrintC(FILE *outfile)
 {
   int i, j;
+  long k;
 
 	if (outfile == NULL) return;
 	Fprintf(outfile,"C:\n");
 	for (i = 0; i <= Elements; i++) {
 		Fprintf(outfile,"%4d: %3d | ",i,PINS(i));
-		for (j = 1; j <= Nodes; j++) Fprintf(outfile," %d",C[i][j]);
+		k = (i == 0) ? 0 : CRow[i];
+		for (j = 1; j <= Nodes; j++) {
+			if (i == 0) Fprintf(outfile," %d",PortNode[j]);
+			else if (k < CRow[i + 1] && CNode[k] == j)
+				Fprintf(outfile," %d",CPin[k++]);
+			else Fprintf(outfile," 0");
+		}
 		Fprintf(outfile,"\n");
 	}
 	Fprintf(outfile,"\n");
@@ -263,12 +518,19 @@ void PrintC(FILE *outfile)
 void PrintCSTAR(FILE *outfile)
 {
   int i, j;
+  long k;
 
 	if (outfile == NULL) return;
 	Fprintf(outfile,"C*:\n");
 	for (i = 0; i <= Elements; i++) {
 		Fprintf(outfile,"%4d: ",i);
-		for (j=1; j <= Nodes; j++) Fprintf(outfile,"%3d",CSTAR[i][j]);
+		k = (i == 0) ? 0 : CRow[i];
+		for (j = 1; j <= Nodes; j++) {
+			if (i == 0) Fprintf(outfile,"%3d",NodeUsage[j]);
+			else if (k < CRow[i + 1] && CNode[k] == j)
+				Fprintf(outfile,"%3d",CStar[k++]);
+			else Fprintf(outfile,"%3d",0);
+		}
 		Fprintf(outfile,"\n");
 	}
 	Fprintf(outfile,"\n");
@@ -285,15 +547,16 @@ void PrintOwnership(FILE *outfile)
     Fprintf(outfile,"%4d:  %4d %4d %4d %2d %3d %5d %5d: ",i,
 	    LEVEL(i), L(i), R(i), SWALLOWED(i), PINS(i), LEAVES(i), USED(i));
 
-    for (j = 1; j <= Leaves; j++) {
-      if (TestPackedArrayBit(MSTAR[i],j)) Fprintf(outfile,"1");
-      else Fprintf(outfile,"0");
-    }
+    if (MStar != NULL)
+      for (j = 1; j <= Leaves; j++) {
+	if (TestPackedArrayBit(MSTAR(i),j)) Fprintf(outfile,"1");
+	else Fprintf(outfile,"0");
+      }
 #if 0
     /* debugging stuff for packed arrays */
     Fprintf(outfile," : ");
     for(j = 0; j <= PackedLeaves; j++) 
-      Fprintf(outfile," %ld",MSTAR[i][j]);
+      Fprintf(outfile," %ld",MSTAR(i)[j]);
 #endif
     Fprintf(outfile,"\n");
   }
@@ -330,17 +593,20 @@ int CommonNodes(int E1, int E2, int IncludeGlobals)
 /* returns the number of nodes that E1 and E2 share */
 /* if IncludeGlobals == 0, do not count large connectivity nodes */
 {
-  int result, node;
+  unsigned long *c1, *c2, *ports;
+  int i, last, result;
 	
   result = 0;
-  if (IncludeGlobals) {
-    for (node = 1; node <= Nodes; node++) 
-      if (C[E1][node] && C[E2][node]) result++;
-  }
-  else {
-    for (node = 1; node <= Nodes; node++) 
-      if (C[E1][node] && C[E2][node] && !C[0][node]) result++;
-  }
+  c1 = CBITS(E1);
+  c2 = CBITS(E2);
+  ports = CBITS(0);
+  last = MIN(CLAST(E1), CLAST(E2));
+  if (IncludeGlobals)
+    for (i = MAX(CFIRST(E1), CFIRST(E2)); i <= last; i++)
+      result += PopCount(c1[i] & c2[i]);
+  else
+    for (i = MAX(CFIRST(E1), CFIRST(E2)); i <= last; i++)
+      result += PopCount(c1[i] & c2[i] & ~ports[i]);
 #ifdef PLACE_DEBUG
   Printf("CommonNodes(%d,%d) (%s globals) gives %d\n",
 	 E1,E2, IncludeGlobals?"including":"excluding", result);
@@ -352,12 +618,13 @@ int GlobalNodes(int E)
 /* return the number of global nodes that E contacts */
 /* for now, global nodes are just cell ports */
 {
-  int node;
-  int count;
+  unsigned long *c, *ports;
+  int i, count;
 
   count = 0;
-  for (node = 1; node <= Nodes; node++) 
-    if (C[E][node] && C[0][node]) count++;
+  c = CBITS(E);
+  ports = CBITS(0);
+  for (i = CFIRST(E); i <= CLAST(E); i++) count += PopCount(c[i] & ports[i]);
   return(count);
 }
 
@@ -367,24 +634,28 @@ int AnyCommonNodes(int E1, int E2)
 /* if DISCOUNT_GLOBAL_NODES, do not count large connectivity nodes,
    unless these are the only connections */
 {
-  int node;
-  int nodesincommon;
+  unsigned long *c1, *c2, *ports;
+  int i, last, nodesincommon;
 
   CountAnyCommonNodes++;
   nodesincommon = 0;
-  for (node = 1; node <= Nodes; node++) {
+  c1 = CBITS(E1);
+  c2 = CBITS(E2);
+  ports = CBITS(0);
+  last = MIN(CLAST(E1), CLAST(E2));
+  for (i = MAX(CFIRST(E1), CFIRST(E2)); i <= last; i++) {
     /* do not count it if it is a port for the entire cell */
-    if (C[E1][node] && C[E2][node]) {
-      if (!(C[0][node])) return(1);
-      nodesincommon = 1;
-    }
+    if (c1[i] & c2[i] & ~ports[i]) return(1);
+    if (c1[i] & c2[i]) nodesincommon = 1;
   }
 
 #if 1
   if (!nodesincommon) return(0);
   /* if ANY nodes exist that are not ports, return NO_COMMON_NODES */
-  for (node = 1; node <= Nodes; node++) 
-    if ((C[E1][node] || C[E2][node]) && !(C[0][node])) return (0);
+  for (i = CFIRST(E1); i <= CLAST(E1); i++)
+    if (c1[i] & ~ports[i]) return (0);
+  for (i = CFIRST(E2); i <= CLAST(E2); i++)
+    if (c2[i] & ~ports[i]) return (0);
 
   /* all nodes are global, and some are shared,  so return 1 */
   return(1);
@@ -401,12 +672,15 @@ int AnyCommonNodes(int E1, int E2)
 /* returns 1 if E1 and E2 share a node */
 /* any node, including a global node, is OK */
 {
-  int node;
-  int nodesincommon;
+  unsigned long *c1, *c2;
+  int i, last;
 
   CountAnyCommonNodes++;
-  for (node = 1; node <= Nodes; node++) 
-    if (C[E1][node] && C[E2][node]) return(1);
+  c1 = CBITS(E1);
+  c2 = CBITS(E2);
+  last = MIN(CLAST(E1), CLAST(E2));
+  for (i = MAX(CFIRST(E1), CFIRST(E2)); i <= last; i++) 
+    if (c1[i] & c2[i]) return(1);
   return(0);
 }
 #endif /* DISCOUNT_GLOBAL_NODES */
@@ -427,51 +701,82 @@ void IncrementUsedCount(int E)
 
 void AddNewElement(int E1, int E2)
 {
-  int i;
+  int i, pin;
+  long k, k1, k2;
 	
   NewN++;
-  if (NewN >= MAX_ELEMENTS) {
+  if (NewN >= ElementLimit) {
     Fprintf(stderr,"Too many elements (%d)\n",NewN);
     if (outfile != NULL)
       Fprintf(outfile,"Too many elements (%d)\n",NewN);
     return;
   }
+  if (!GrowElements(NewN) || !GrowPins(CRow[NewN] +
+	(CRow[E1 + 1] - CRow[E1]) + (CRow[E2 + 1] - CRow[E2]))) {
+    Fprintf(stderr,"Not enough memory for element %d\n",NewN);
+    FatalError = 1;
+    return;
+  }
   NewElements++;
+  /* the row may be left over from an abandoned partition */
+  memzero(M[NewN], sizeof(M[NewN]));
 	
   /* update ownership matrix */
   LEVEL(NewN) = MAX(LEVEL(E1), LEVEL(E2)) + 1; 
   L(NewN) = E1; R(NewN) = E2;
 	
   /* update leaf ownership matrix */
-  for (i = 0; i <= PackedLeaves; i++)
-    MSTAR[NewN][i] = MSTAR[E1][i] | MSTAR[E2][i];
+  if (MStar != NULL) {
+    for (i = 0; i <= PackedLeaves; i++)
+      MSTAR(NewN)[i] = MSTAR(E1)[i] | MSTAR(E2)[i];
+    MFIRST(NewN) = MIN(MFIRST(E1), MFIRST(E2));
+    MLAST(NewN) = MAX(MLAST(E1), MLAST(E2));
+  }
 	
-  /* update connectivity matrix with actual portlist */
-  for (i = 1; i <= Nodes; i++) 
-    if ((C[E1][i] || C[E2][i]) &&
-	(CSTAR[E1][i] + CSTAR[E2][i] < CSTAR[0][i]))
-      C[NewN][i] = 1;
+  /* merge the rows of E1 and E2 to update node usage matrix, and */
+  /* connectivity matrix with actual portlist */
+  k = CRow[NewN];
+  k1 = CRow[E1];
+  k2 = CRow[E2];
+  while (k1 < CRow[E1 + 1] || k2 < CRow[E2 + 1]) {
+    if (k2 >= CRow[E2 + 1] || (k1 < CRow[E1 + 1] && CNode[k1] < CNode[k2])) {
+      CNode[k] = CNode[k1];
+      CStar[k] = CStar[k1];
+      pin = CPin[k1++];
+    }
+    else if (k1 >= CRow[E1 + 1] || CNode[k2] < CNode[k1]) {
+      CNode[k] = CNode[k2];
+      CStar[k] = CStar[k2];
+      pin = CPin[k2++];
+    }
+    else {
+      CNode[k] = CNode[k1];
+      CStar[k] = CStar[k1] + CStar[k2];
+      pin = CPin[k1++];
+      if (CPin[k2++]) pin = 1;
+    }
+    CPin[k] = (pin && CStar[k] < NodeUsage[CNode[k]]);
+    if (CPin[k]) PINS(NewN)++;
+    k++;
+  }
+  CRow[NewN + 1] = k;
+  if (CBits != NULL) PackPins(NewN);
 
   /* update number of leaves contained by new element */
   /* for (i = 1; i <= Leaves; i++) 
-    if (TestPackedArrayBit(MSTAR[NewN],i)) LEAVES(NewN)++; */
+    if (TestPackedArrayBit(MSTAR(NewN),i)) LEAVES(NewN)++; */
   LEAVES(NewN) = LEAVES(E1) + LEAVES(E2);
 
   /* increment the instance count for tree rooted by NewN */
   IncrementUsedCount(E1);
   IncrementUsedCount(E2); 
 
-  for (i = 1; i <= Nodes; i++) if (C[NewN][i]) PINS(NewN)++;
   SumPINS += PINS(NewN);
   SumCommonNodes += PINS(E1) + PINS(E2) - PINS(NewN);
   SumUsedLeaves += LEAVES(NewN);
 
-  /* update node usage matrix */
-  for (i = 1; i <= Nodes; i++)
-    CSTAR[NewN][i] = CSTAR[E1][i] + CSTAR[E2][i];
-	
   /* add to exist-checking data structure */
-  AddToExistSet(E1, E2);
+  if (MStar != NULL) AddToExistSet(E1, E2);
 
   if (PlaceDebug) {
     if (NewN == Elements + 1) Printf("\n");
@@ -617,9 +922,10 @@ Printf("embedding using strategy %d\n",strategy);
 int CountSubGraphs(char *cellname)
 {
   struct nlist *tp;
-  int i;
-  int groups[MAX_LEAVES+1];
-  int contact[MAX_LEAVES+1];
+  int i, j;
+  int *groups;
+  int *contact;
+  int *seen;
 	
   tp = LookupCell(cellname);
   if (tp == NULL) {
@@ -632,37 +938,50 @@ int CountSubGraphs(char *cellname)
   }
 
   if (!InitializeMatrices(cellname)) return(0);
-  memzero(groups, sizeof(groups));
+  groups = (int *)CALLOC(Leaves + 1, sizeof(int));
+  contact = (int *)CALLOC(Leaves + 1, sizeof(int));
+  seen = (int *)CALLOC(Leaves + 1, sizeof(int));
+  if (groups == NULL || contact == NULL || seen == NULL) {
+    Fprintf(stderr, "Not enough memory to count sub-graphs.\n");
+    goto done;
+  }
 
   for (i = 1; i <= Leaves; i++) groups[i] = i;
 
   for (i = 1; i <= Leaves; i++) {
     int node;
-    int j;
+    int contacts;
     int mingroup;
-
-    memzero(contact, sizeof(contact));
-    contact[i] = 1;
-    for (j = i + 1; j <= Leaves; j++) {
-      /* else, find all elements that contact this node */
-      for (node = 1; node <= Nodes; node++) {
-    	if ((C[i][node] && C[j][node]) && !(C[0][node])) {
-	  contact[j] = 1;
-	  break;
+    long k, m;
+
+    /* find all later leaves that share a node, other than a port, with i */
+    contacts = 0;
+    contact[contacts++] = i;
+    for (k = CRow[i]; k < CRow[i + 1]; k++) {
+      node = CNode[k];
+      if (PortNode[node]) continue;
+      for (m = NodeRow[node]; m < NodeRow[node + 1]; m++) {
+	j = NodeLeaf[m];
+	if (j > i && seen[j] != i) {
+	  seen[j] = i;
+	  contact[contacts++] = j;
 	}
       }
     }
-    mingroup = MAX_LEAVES+2;
-    for (j = 1; j <= Leaves; j++) {
-      if (contact[j] && groups[j] < mingroup) mingroup = groups[j];
-    }
-    for (j = 1; j <= Leaves; j++)
-      if (contact[j]) groups[j] = mingroup;
+    mingroup = Leaves + 2;
+    for (j = 0; j < contacts; j++)
+      if (groups[contact[j]] < mingroup) mingroup = groups[contact[j]];
+    for (j = 0; j < contacts; j++) groups[contact[j]] = mingroup;
   }
 
   Printf("ownership groups: ");
   for (i = 1; i <= Leaves; i++) Printf(" %d",groups[i]);
   Printf("\n");
+
+ done:
+  if (groups != NULL) FREE(groups);
+  if (contact != NULL) FREE(contact);
+  if (seen != NULL) FREE(seen);
   return(0);
 }
 
@@ -786,12 +1105,12 @@ void SetupArray(char *prompt1, char *prompt2, char *prompt3, int *data,
   char name[100];
 
   Printf(prompt1);
-  for (i = 1; i <= MAX_TREE_DEPTH; i++) 
+  for (i = 1; i <= TreeDepth; i++) 
     Printf(" %d", data[i]);
   Printf("\n");
 
   oldfanout = 1;
-  for (i = 1; i <= MAX_TREE_DEPTH; i++) {
+  for (i = 1; i <= TreeDepth; i++) {
     char prompt[100];
     int newfanout;
     sprintf(prompt, prompt2, i);
@@ -812,7 +1131,7 @@ void SetupArray(char *prompt1, char *prompt2, char *prompt3, int *data,
     }
   }
   Printf(prompt3);
-  for (i = 1; i <= MAX_TREE_DEPTH; i++) 
+  for (i = 1; i <= TreeDepth; i++) 
     Printf(" %d", data[i]);
   Printf("\n");
   return;
@@ -828,7 +1147,7 @@ void SetupArrayFromString(char *prompt1, char *prompt3, int *data,
 
   strcpy(string, text);
   Printf(prompt1);
-  for (i = 1; i <= MAX_TREE_DEPTH; i++) 
+  for (i = 1; i <= TreeDepth; i++) 
     Printf(" %d", data[i]);
   Printf("\n");
 
@@ -853,7 +1172,7 @@ void SetupArrayFromString(char *prompt1, char *prompt3, int *data,
     }
   }
   Printf(prompt3);
-  for (i = 1; i <= MAX_TREE_DEPTH; i++) 
+  for (i = 1; i <= TreeDepth; i++) 
     Printf(" %d", data[i]);
   Printf("\n");
   return;
@@ -887,7 +1206,7 @@ void SetupLeafPinout(char *string)
   if (LeafPins == 0) LeafPins = LEAFPINS;
   InitializeFanout();
   Printf("New Fanout:\n");
-  for (i = 1; i <= MAX_TREE_DEPTH; i++) 
+  for (i = 1; i <= TreeDepth; i++) 
     Printf(" %d", TreeFanout[i]);
   Printf("\n");
 }
@@ -899,7 +1218,7 @@ void SetupRentExp(char *string)
   RentExp = atof(string);
   InitializeFanout();
   Printf("New Fanout:\n");
-  for (i = 1; i <= MAX_TREE_DEPTH; i++) 
+  for (i = 1; i <= TreeDepth; i++) 
     Printf(" %d", TreeFanout[i]);
   Printf("\n");
 }
@@ -919,6 +1238,13 @@ void ToggleExhaustive(void)
   else Printf("Accelerating heuristics enabled.\n");
 }
 
+void ToggleAgglomerative(void)
+{
+  Agglomerative = !Agglomerative;
+  if (Agglomerative) Printf("Priority-queue bottom-up merging enabled.\n");
+  else Printf("Level-pair bottom-up passes enabled.\n");
+}
+
 void ToggleDebug(void)
 {
   PlaceDebug = !PlaceDebug;
@@ -940,6 +1266,7 @@ void ProtoEmbed(char *name, char ch)
   strategy = greedy;
   if (toupper(ch) == 'A') strategy = anneal;
   if (toupper(ch) == 'G') strategy = greedy;
+  if (toupper(ch) == 'M') strategy = multilevel;
   if (toupper(ch) == 'O') strategy = bottomup;
   if (toupper(ch) == 'R') strategy = random_embedding;
   if (LookupCell(name) == NULL)
@@ -953,10 +1280,11 @@ void ProtoEmbed(char *name, char ch)
 void ProtoPrintParameters(void)
 {
   Printf("PROTOCHIP embedder compiled with:\n");
-  Printf("MAX_LEAVES = %d; (MAX_TREE_DEPTH = %d)\n",
-	 MAX_LEAVES, MAX_TREE_DEPTH);
-  Printf("MAX_ELEMENTS = %d, MAX_NODES = %d\n",
-	 MAX_ELEMENTS, MAX_NODES);
+  Printf("TREE_DEPTH = %d; (MAX_TREE_DEPTH = %d)\n",
+	 TREE_DEPTH, MAX_TREE_DEPTH);
+  Printf("MAX_ELEMENTS = %d; nodes and leaves are sized for each cell\n",
+	 MAX_ELEMENTS);
+  Printf("Annealing chains = %d\n", AnnealChains);
 }
 
 void PROTOCHIP(void)
@@ -992,6 +1320,13 @@ void PROTOCHIP(void)
     case 'x':
       ToggleExhaustive();
       break;
+    case 'P':
+      ToggleAgglomerative();
+      break;
+    case 'z':
+      promptstring("Embedding cache file (none to clear cache): ",name);
+      SetEmbedCacheFile(name);
+      break;
     case 'V':
       ToggleDebug();
       break;
@@ -1073,6 +1408,8 @@ void PROTOCHIP(void)
     case 'g':
     case 'A':
     case 'a':
+    case 'M':
+    case 'm':
       promptstring("Cell to embed: ", name);
       ProtoEmbed(name, ch);
       break;
@@ -1091,11 +1428,15 @@ void PROTOCHIP(void)
       Printf("New Fanout:\n");
       {
 	int i;
-	for (i = 1; i <= MAX_TREE_DEPTH; i++) 
+	for (i = 1; i <= TreeDepth; i++) 
 	  Printf(" %d", TreeFanout[i]);
       }
       Printf("\n");
       break;
+    case 'K':
+      promptstring("Enter number of annealing chains: ",name);
+      AnnealChains = MAX(1, atoi(name));
+      break;
     case 'X':
       promptstring("Enter Rent's Rule exponent: ",name);
       RentExp = atof(name);
@@ -1103,7 +1444,7 @@ void PROTOCHIP(void)
       Printf("New Fanout:\n");
       {
 	int i;
-	for (i = 1; i <= MAX_TREE_DEPTH; i++) 
+	for (i = 1; i <= TreeDepth; i++) 
 	  Printf(" %d", TreeFanout[i]);
       }
       Printf("\n");
@@ -1236,12 +1577,16 @@ void PROTOCHIP(void)
     case 'Q' : exit(0);
     default:
       Printf("Embed: (e)mbed (E); (o)ld embed (O); e(x)haustive old embed\n");
+      Printf("       (P)riority-queue old embed\n");
       Printf("       (r)andom cut embedding algorithm\n");
       Printf("       (g)reedy embedding algorithm, simulated (a)nnealing\n");
+      Printf("       (m)ultilevel Fiduccia-Mattheyses partitioning\n");
       Printf("Embed parameters: (f)anout, (c)ommon nodes, leaf (C)ontainment.\n");
       Printf("                  Leaf (F)anout, Rent's rule e(X)ponent\n");
+      Printf("                  annealing chains (K)\n");
       Printf("(d)escribe cell; print (h)ash table (H); toggle primiti(v)e bit\n");
       Printf("count (s)ub-graphs, (p)rint embedding constants\n");
+      Printf("embedding cache file (z)\n");
       Printf("toggle (l)ogging (L = single level); toggle (V)erbose output\n");
       Printf("(q)uit; (Q)uit immediately; (!) push shell, (#) set dbug\n");
       break;
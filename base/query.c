@@ -284,8 +284,8 @@ void PrintAllElements(char *cell, int filenum)
 void Fanout(char *cell, char *node, int filter)
 {
   struct nlist *np;
-  struct objlist *ob;
-  int nodenum;
+  struct objlist *ob, **pins;
+  int nodenum, npins, i;
 
   if (*cell == '\0') np = CurrentCell;
   else np = LookupCell(cell);
@@ -295,13 +295,11 @@ void Fanout(char *cell, char *node, int filter)
     return;
   }
 	
-  nodenum = -999;
-  for (ob = np->cell; ob != NULL; ob = ob->next) {
-    if ((*matchfunc)(node, ob->name)) {
-      nodenum = ob->node;
-      break;
-    }
-  }
+  ob = LookupObject(node, np);
+  if (ob == NULL)
+    for (ob = np->cell; ob != NULL; ob = ob->next)
+      if ((*matchfunc)(node, ob->name)) break;
+  nodenum = (ob != NULL) ? ob->node : -999;
 
   /* now print out all elements that connect to that node */
 
@@ -315,36 +313,62 @@ void Fanout(char *cell, char *node, int filter)
     else
        Printf("Object");
     Printf (" '%s' in circuit '%s' connects to:\n", node, cell);
-    ob = np->cell;
-    while (ob != NULL) {
-      char *obname = ob->name;
+    pins = NodePins(np, nodenum, &npins);
+    for (i = 0; i < npins; i++) {
+      char *obname;
+      ob = pins[i];
+      obname = ob->name;
       if (*obname == '/') obname++;
-      if (ob->node == nodenum)
-	 if (filter == ALLOBJECTS) {
-	   Printf("  %s (", obname);
-	   PrintObjectType(ob->type);
-	   Printf(")\n");
-	 }
-	 else if ((filter == ALLELEMENTS) && (ob->type >= FIRSTPIN)) {
-	   Printf("  %s\n", obname);
-	 }
-	 else if (ob->type == filter) {
-	   Printf("  %s\n", obname);
-	 }
-      ob = ob->next;
+      if (filter == ALLOBJECTS) {
+	Printf("  %s (", obname);
+	PrintObjectType(ob->type);
+	Printf(")\n");
+      }
+      else if ((filter == ALLELEMENTS) && (ob->type >= FIRSTPIN)) {
+	Printf("  %s\n", obname);
+      }
+      else if (ob->type == filter) {
+	Printf("  %s\n", obname);
+      }
     }
   }
 }
 	
 #ifdef TCL_NETGEN
 
+/* Return the first net, port or global record on net "node" of cell	*/
+/* "np", or NULL if there is none.					*/
+
+static struct objlist *NetNameObject(struct nlist *np, int node)
+{
+  struct objlist *ob, **pins;
+  int npins, i;
+
+  /* Disconnected pins share negative node numbers, which are not in	*/
+  /* the node index.							*/
+
+  if (node < 0) {
+    for (ob = np->cell; ob != NULL; ob = ob->next)
+      if ((ob->node == node) && (ob->type <= NODE) &&
+		(ob->type >= UNIQUEGLOBAL))
+	return ob;
+    return NULL;
+  }
+
+  pins = NodePins(np, node, &npins);
+  for (i = 0; i < npins; i++)
+    if ((pins[i]->type <= NODE) && (pins[i]->type >= UNIQUEGLOBAL))
+      return pins[i];
+  return NULL;
+}
+
 /* Print the nodes connected to each pin of the specified element */
 
 void ElementNodes(char *cell, char *element, int fnum)
 {
   struct nlist *np;
-  struct objlist *ob, *nob, *nob2;
-  int ckto;
+  struct objlist *ob, *nob, **obs;
+  int ckto, nobs, i;
   char *elementname, *obname;
 
   if ((fnum == -1) && (Circuit1 != NULL) && (Circuit2 != NULL)) {
@@ -367,52 +391,36 @@ void ElementNodes(char *cell, char *element, int fnum)
   if (*elementname == '/') elementname++;
 
   ckto = strlen(elementname);
-  for (ob = np->cell; ob != NULL; ob = ob->next) {
-    obname = ob->name;
-    if (*obname == '/') obname++;
-    if (!strncmp(elementname, obname, ckto))
-       if (*(obname + ckto) == '/' || *(obname + ckto) == '\0')
-	  break;
-  }
-  if (ob == NULL) {
+  nobs = PrefixObjects(np, elementname, 1, &obs);
+  if (nobs == 0) {
     Printf("Device '%s' not found in circuit '%s'.\n", elementname, cell);
     return;
   }
 
   Printf("Device '%s' Pins:\n", elementname);
-  for (; ob != NULL; ob = ob->next) {
+  for (i = 0; i < nobs; i++) {
+    ob = obs[i];
     obname = ob->name;
     if (*obname == '/') obname++;
-    if (!strncmp(elementname, obname, ckto)) {
-       if (*(obname + ckto) != '/' && *(obname + ckto) != '\0')
-	  continue;
 
-       Printf("   ");
-       PrintObjectType(ob->type);
-       Printf(" (%s)", obname + ckto + 1);
-       for (nob = np->cell; nob != NULL; nob = nob->next) {
-	 if (nob->node == ob->node) {
-	    if (nob->type == NODE) {
-	       Printf(" = %s", nob->name);
-	       break;
-	    }
-	    else if (nob->type == PORT) {
-	       Printf(" = %s (port of %s)", nob->name, cell);
-	       break;
-	    }
-	    else if (nob->type == GLOBAL) {
-	       Printf(" = %s (global)", nob->name);
-	       break;
-	    }
-	    else if (nob->type == UNIQUEGLOBAL) {
-	       Printf(" = %s (unique global)", nob->name);
-	       break;
-	    }
- 	 }
-       }
-       Printf("\n");
+    Printf("   ");
+    PrintObjectType(ob->type);
+    Printf(" (%s)", obname + ckto + 1);
+
+    nob = NetNameObject(np, ob->node);
+    if (nob != NULL) {
+      if (nob->type == NODE)
+	Printf(" = %s", nob->name);
+      else if (nob->type == PORT)
+	Printf(" = %s (port of %s)", nob->name, cell);
+      else if (nob->type == GLOBAL)
+	Printf(" = %s (global)", nob->name);
+      else if (nob->type == UNIQUEGLOBAL)
+	Printf(" = %s (unique global)", nob->name);
     }
+    Printf("\n");
   }
+  FREE(obs);
 }
 
 #endif  /* TCL_NETGEN */
@@ -588,7 +596,7 @@ void PrintNodes(char *name, int filenum)
     nodenum = ob->node;
     if (nodenum < 0) continue;
     /* repeat bits of objlist.c here for speed */
-    if (tp->nodename_cache != NULL) {
+    if (tp->nodename_cache != NULL && tp->nodename_last == NULL) {
       nodelist[nodenum].name = tp->nodename_cache[nodenum]->name;
     }
     else {
@@ -706,8 +714,8 @@ void PrintCell(char *name, int fnum)
 void PrintInstances(char *name, int filenum)
 {
   struct nlist *tp;
-  struct objlist *ob;
-  int instancecount;
+  struct objlist *ob, **netobs;
+  int instancecount, nobs, i;
 	
   if ((filenum == -1) && (Circuit1 != NULL) && (Circuit2 != NULL)) {
       PrintInstances(name, Circuit1->file);
@@ -726,7 +734,7 @@ void PrintInstances(char *name, int filenum)
     if (ob->type == FIRSTPIN) {
       struct objlist *ob2;
       int port, node, global, uniqueglobal, pin;
-      int ports, nodes, globals, uniqueglobals, pins;
+      int ports, nodes, globals, uniqueglobals;
 
       port = node = global = uniqueglobal = pin = 0;
       instancecount++;
@@ -735,17 +743,27 @@ void PrintInstances(char *name, int filenum)
       do {
 	struct objlist *ob3;
 
-	ports = nodes = globals = uniqueglobals = pins = 0;
-	for (ob3 = tp->cell; ob3 != NULL; ob3 = ob3->next)
-	  if (ob3->node == ob2->node)
-	    switch (ob3->type) {
+	ports = nodes = globals = uniqueglobals = 0;
+	if (ob2->node >= 0) {
+	  netobs = NodePins(tp, ob2->node, &nobs);
+	  for (i = 0; i < nobs; i++)
+	    switch (netobs[i]->type) {
 	    case UNIQUEGLOBAL: uniqueglobals++; break;
 	    case GLOBAL: globals++; break;
 	    case PORT:   ports++; break;
 	    case NODE:   nodes++; break;
-	    case PROPERTY: break;
-	    default:     pins++; break;
 	    }
+	}
+	else {
+	  for (ob3 = tp->cell; ob3 != NULL; ob3 = ob3->next)
+	    if (ob3->node == ob2->node)
+	      switch (ob3->type) {
+	      case UNIQUEGLOBAL: uniqueglobals++; break;
+	      case GLOBAL: globals++; break;
+	      case PORT:   ports++; break;
+	      case NODE:   nodes++; break;
+	      }
+	}
 	pin++;
 	if (uniqueglobals) uniqueglobal++;
 	else if (globals) global++;
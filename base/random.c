@@ -148,7 +148,7 @@ int RandomPartition(int left, int right, int level)
 #endif    
 
     if (!found || level > TopDownStartLevel - 2) {
-      for (i = MAX_TREE_DEPTH; i > level; i--) Fprintf(stdout, "   ");
+      for (i = TopDownStartLevel; i > level; i--) Fprintf(stdout, "   ");
       Fprintf(stdout,
     "Level: %d; L (%d leaves) fanout %d; R (%d leaves) fanout %d (<= %d) %s\n",
 	      level, (partition - left + 1), leftfanout, 
@@ -176,7 +176,7 @@ int RandomPartition(int left, int right, int level)
       if (leftfanout <= TreeFanout[level] && rightfanout <= TreeFanout[level])
 	      found = 1;
 #endif
-      for (i = MAX_TREE_DEPTH; i > level; i--) Fprintf(stdout, "   ");
+      for (i = TopDownStartLevel; i > level; i--) Fprintf(stdout, "   ");
       Fprintf(stdout,
 	      "       Iteration %2d: L fanout %d; R fanout %d (<= %d) %s\n",
 	      iterations, leftfanout, rightfanout, TreeFanout[level],
@@ -426,14 +426,17 @@ void CleanupSubcell() {
 	       CurrentCell->cell = sobj->next;
 	    FreeObjectAndHash(sobj, CurrentCell);
 	 }
-	 else if (IsPort(sobj) && sobj->model.port == PROXY)
+	 else if (IsPort(sobj) && sobj->model.port == PROXY) {
 	    sobj->node = maxnode++;
+	    CacheNodeName(CurrentCell, sobj);
+	 }
 	 else if (IsPort(sobj)) {
 	    for (pobj = CurrentCell->cell; pobj && (pobj->type == PORT);
 			pobj = pobj->next) {
 	       if (pobj == sobj) continue;
 	       if (matchnocase(pobj->name, sobj->name) && pobj->node >= 0) {
 		  sobj->node = pobj->node;
+		  CacheNodeName(CurrentCell, sobj);
 		  break;
 	       }
 	    }
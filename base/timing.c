@@ -117,3 +117,221 @@ float ElapsedCPUTime(float since)
 }
 
 
+
+/*************************************************************************/
+/*                                                                       */
+/*    Phase statistics:  StatsBegin(name) and StatsEnd() bracket a phase */
+/*    of an LVS run.  Wall time, CPU time, allocation count, and peak    */
+/*    resident set size are accumulated per phase name.  Phases may be   */
+/*    nested;  times are inclusive of any nested phases.                 */
+/*    StatsIteration() records one entry per call to Iterate().          */
+/*                                                                       */
+/*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef IBMPC
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#define MAXSTATSDEPTH 32
+
+long AllocCount = 0;	/* Incremented by the allocation functions */
+
+static struct phasestats *PhaseList = NULL, *PhaseTail = NULL;
+static struct iterstats *IterList = NULL, *IterTail = NULL;
+
+static struct statsframe {
+  char *name;
+  double wall;
+  double cpu;
+  long allocs;
+} StatsStack[MAXSTATSDEPTH];
+static int StatsDepth = 0;
+
+double WallTime(void)
+/* return wall clock time in seconds */
+{
+#ifndef IBMPC
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return((double)tv.tv_sec + (double)tv.tv_usec / 1.0e6);
+#else
+  return((double)CPUTime());
+#endif
+}
+
+static double ProcessTime(void)
+/* return user + system CPU time in seconds */
+{
+#ifndef IBMPC
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return((double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1.0e6
+	+ (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1.0e6);
+#else
+  return((double)CPUTime());
+#endif
+}
+
+static long PeakRSS(void)
+/* return the peak resident set size in kilobytes, or 0 if unknown */
+{
+#ifndef IBMPC
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+  return(ru.ru_maxrss / 1024);
+#else
+  return(ru.ru_maxrss);
+#endif
+#else
+  return(0);
+#endif
+}
+
+void StatsBegin(char *name)
+/* start timing the phase "name" (which must be a static string) */
+{
+  struct statsframe *sf;
+
+  if (StatsDepth < MAXSTATSDEPTH) {
+    sf = &StatsStack[StatsDepth];
+    sf->name = name;
+    sf->wall = WallTime();
+    sf->cpu = ProcessTime();
+    sf->allocs = AllocCount;
+  }
+  StatsDepth++;
+}
+
+void StatsEnd(void)
+/* end the most recently started phase and add it to the totals */
+{
+  struct statsframe *sf;
+  struct phasestats *ps;
+  long rss;
+
+  if (StatsDepth <= 0) return;
+  StatsDepth--;
+  if (StatsDepth >= MAXSTATSDEPTH) return;
+  sf = &StatsStack[StatsDepth];
+
+  for (ps = PhaseList; ps != NULL; ps = ps->next)
+    if (!strcmp(ps->name, sf->name)) break;
+  if (ps == NULL) {
+    ps = (struct phasestats *)calloc(1, sizeof(struct phasestats));
+    if (ps == NULL) return;
+    ps->name = sf->name;
+    if (PhaseTail == NULL) PhaseList = ps;
+    else PhaseTail->next = ps;
+    PhaseTail = ps;
+  }
+  ps->calls++;
+  ps->wall += WallTime() - sf->wall;
+  ps->cpu += ProcessTime() - sf->cpu;
+  ps->allocs += AllocCount - sf->allocs;
+  rss = PeakRSS();
+  if (rss > ps->peakrss) ps->peakrss = rss;
+}
+
+void StatsIteration(char *cell, int iteration, int eclasses, int nclasses)
+/* record the time and class counts for the iteration in progress; */
+/* must be called inside the phase bracketing the iteration.       */
+{
+  struct statsframe *sf;
+  struct iterstats *is;
+
+  if (StatsDepth <= 0 || StatsDepth > MAXSTATSDEPTH) return;
+  sf = &StatsStack[StatsDepth - 1];
+
+  is = (struct iterstats *)calloc(1, sizeof(struct iterstats));
+  if (is == NULL) return;
+  is->cell = (cell == NULL) ? NULL : strdup(cell);
+  is->iteration = iteration;
+  is->wall = WallTime() - sf->wall;
+  is->cpu = ProcessTime() - sf->cpu;
+  is->eclasses = eclasses;
+  is->nclasses = nclasses;
+  if (IterTail == NULL) IterList = is;
+  else IterTail->next = is;
+  IterTail = is;
+}
+
+void StatsReset(void)
+/* discard all accumulated statistics */
+{
+  struct phasestats *ps;
+  struct iterstats *is;
+
+  while (PhaseList != NULL) {
+    ps = PhaseList->next;
+    free(PhaseList);
+    PhaseList = ps;
+  }
+  while (IterList != NULL) {
+    is = IterList->next;
+    if (IterList->cell) free(IterList->cell);
+    free(IterList);
+    IterList = is;
+  }
+  PhaseTail = NULL;
+  IterTail = NULL;
+}
+
+struct phasestats *StatsPhases(void)
+{
+  return(PhaseList);
+}
+
+struct iterstats *StatsIterations(void)
+{
+  return(IterList);
+}
+
+void WriteJSONString(FILE *f, char *s)
+/* write "s" to "f" as a quoted and escaped JSON string */
+{
+  fputc('"', f);
+  if (s != NULL) {
+    for (; *s != '\0'; s++) {
+      if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+      else if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+      else fputc(*s, f);
+    }
+  }
+  fputc('"', f);
+}
+
+void StatsWriteJSON(FILE *f)
+/* write all accumulated statistics to "f" as a JSON object */
+{
+  struct phasestats *ps;
+  struct iterstats *is;
+
+  fprintf(f, "{\n   \"phases\": [");
+  for (ps = PhaseList; ps != NULL; ps = ps->next) {
+    fprintf(f, "\n      {\"name\": ");
+    WriteJSONString(f, ps->name);
+    fprintf(f, ", \"calls\": %d, \"wall\": %.6f, \"cpu\": %.6f, "
+		"\"allocs\": %ld, \"peak_rss_kb\": %ld}%s",
+		ps->calls, ps->wall, ps->cpu, ps->allocs, ps->peakrss,
+		(ps->next == NULL) ? "\n   " : ",");
+  }
+  fprintf(f, "],\n   \"iterations\": [");
+  for (is = IterList; is != NULL; is = is->next) {
+    fprintf(f, "\n      {\"cell\": ");
+    WriteJSONString(f, is->cell);
+    fprintf(f, ", \"iteration\": %d, \"wall\": %.6f, \"cpu\": %.6f, "
+		"\"device_classes\": %d, \"net_classes\": %d}%s",
+		is->iteration, is->wall, is->cpu, is->eclasses, is->nclasses,
+		(is->next == NULL) ? "\n   " : ",");
+  }
+  fprintf(f, "]\n}\n");
+}
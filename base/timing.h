@@ -1,3 +1,40 @@
 /* timing routines */
 extern float CPUTime(void);
 extern float ElapsedCPUTime(float since);
+extern double WallTime(void);
+
+/* per-phase statistics */
+
+struct phasestats {
+  char *name;
+  int calls;
+  double wall;		/* wall clock seconds */
+  double cpu;		/* user + system seconds */
+  long allocs;		/* number of allocations */
+  long peakrss;		/* peak resident set size (kB) at end of phase */
+  struct phasestats *next;
+};
+
+struct iterstats {
+  char *cell;
+  int iteration;
+  double wall;
+  double cpu;
+  int eclasses;		/* number of device classes after iteration */
+  int nclasses;		/* number of net classes after iteration */
+  struct iterstats *next;
+};
+
+extern long AllocCount;
+
+extern void StatsBegin(char *name);
+extern void StatsEnd(void);
+extern void StatsIteration(char *cell, int iteration, int eclasses,
+		int nclasses);
+extern void StatsReset(void);
+extern struct phasestats *StatsPhases(void);
+extern struct iterstats *StatsIterations(void);
+#ifdef EOF
+extern void StatsWriteJSON(FILE *f);
+extern void WriteJSONString(FILE *f, char *s);
+#endif
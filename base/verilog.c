@@ -319,14 +319,17 @@ void CleanupModule() {
       if (sobj->type == FIRSTPIN)
 	 has_submodules = TRUE;
       if (sobj->node < 0) {
-	 if (IsPort(sobj) && sobj->model.port == PROXY)
+	 if (IsPort(sobj) && sobj->model.port == PROXY) {
 	    sobj->node = maxnode++;
+	    CacheNodeName(CurrentCell, sobj);
+	 }
 	 else if (IsPort(sobj)) {
 	    for (pobj = CurrentCell->cell; pobj && (pobj->type == PORT);
 			pobj = pobj->next) {
 	       if (pobj == sobj) continue;
 	       if (match(pobj->name, sobj->name) && pobj->node >= 0) {
 		  sobj->node = pobj->node;
+		  CacheNodeName(CurrentCell, sobj);
 		  break;
 	       }
 	    }
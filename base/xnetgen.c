@@ -472,6 +472,13 @@ void proto_embed_anneal(Widget w, Widget textwidget, caddr_t call_data)
   X_END();
 }
 
+void proto_embed_multilevel(Widget w, Widget textwidget, caddr_t call_data)
+{
+  X_START();
+  ProtoEmbed(get_cell(), 'm');
+  X_END();
+}
+
 void proto_embed_random(Widget w, Widget textwidget, caddr_t call_data)
 {
   X_START();
@@ -490,6 +497,7 @@ void proto_embed_bottup(Widget w, Widget textwidget, caddr_t call_data)
 static menu_struct ProtoEmbedMenu[] = {
   { "Greedy", proto_embed_greedy, NULL, NULL },
   { "Anneal", proto_embed_anneal, NULL, NULL },
+  { "Multilevel", proto_embed_multilevel, NULL, NULL },
   { "Random", proto_embed_random, NULL, NULL },
   { "BottomUp", proto_embed_bottup, NULL, NULL },
   { NULL }
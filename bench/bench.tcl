@@ -0,0 +1,123 @@
+#---------------------------------------------------------------------------
+# bench.tcl --- time the phases of an LVS run on a synthetic netlist.
+#
+# Usage:  tclsh bench.tcl <netgen.tcl> <gennet> <devices> [<gennet options>]
+#
+# Generates a reference netlist and a second netlist with the same options
+# (plus any mismatches given with "-m") using gennet, then reads both, runs
+# a hierarchical comparison in the same way as "netgen::lvs", and finally
+# flattens the first netlist.  Prints the time spent in each step and the
+# per-phase statistics collected by netgen.
+#---------------------------------------------------------------------------
+
+if {$argc < 3} {
+   puts stderr "Usage:  tclsh bench.tcl <netgen.tcl> <gennet> <devices> \[options\]"
+   exit 1
+}
+
+set netgenrc [lindex $argv 0]
+set gennet [lindex $argv 1]
+set devices [lindex $argv 2]
+set genopts [lrange $argv 3 end]
+
+set argv {}
+set argc 0
+source $netgenrc
+
+# Options that only apply to the second netlist
+set mismatch {}
+set idx [lsearch $genopts -m]
+if {$idx >= 0} {
+   set mismatch [lrange $genopts $idx [expr {$idx + 1}]]
+   set genopts [lreplace $genopts $idx [expr {$idx + 1}]]
+}
+set format spice
+set idx [lsearch $genopts -t]
+if {$idx >= 0} {set format [lindex $genopts [expr {$idx + 1}]]}
+set ext [expr {($format == "verilog") ? "v" : "spice"}]
+
+set file1 bench_${devices}_a.$ext
+set file2 bench_${devices}_b.$ext
+exec $gennet -n $devices {*}$genopts -o $file1
+exec $gennet -n $devices {*}$genopts {*}$mismatch -o $file2
+
+#---------------------------------------------------------------------------
+# Run "script" in the caller, adding its run time to step "name".
+#---------------------------------------------------------------------------
+
+set steps {read compare converge resolve properties pins flatten}
+foreach step $steps {set bench_time($step) 0}
+
+proc timed {name script} {
+   global bench_time
+   set start [clock microseconds]
+   set result [uplevel 1 $script]
+   incr bench_time($name) [expr {[clock microseconds] - $start}]
+   return $result
+}
+
+netgen::stats reset
+netgen::log echo off
+
+set start [clock microseconds]
+set fnum1 [timed read {netgen::readnet $format $file1}]
+set fnum2 [timed read {netgen::readnet $format $file2}]
+
+netgen::compare assign "$fnum1 top" "$fnum2 top"
+netgen::permute default
+netgen::property default
+
+set matched 0
+set endval [timed compare {netgen::compare hierarchical "$fnum1 top" "$fnum2 top"}]
+while {$endval != {}} {
+   timed converge {netgen::run converge}
+   set uresult 0
+   if {[netgen::verify equivalent]} {
+      timed resolve {netgen::run resolve}
+      set uresult [timed properties {netgen::verify unique}]
+      if {$uresult == 0} {
+         if {[netgen::print queue] != {}} {
+            netgen::flatten class "[lindex $endval 0] $fnum1"
+            netgen::flatten class "[lindex $endval 1] $fnum2"
+         }
+      } else {
+         set result [timed pins {netgen::equate pins "$fnum1 [lindex $endval 0]" \
+		"$fnum2 [lindex $endval 1]"}]
+         if {$result != 0} {
+            netgen::equate classes "$fnum1 [lindex $endval 0]" \
+		"$fnum2 [lindex $endval 1]"
+         }
+      }
+   } elseif {[netgen::print queue] != {}} {
+      netgen::flatten class "[lindex $endval 0] $fnum1"
+      netgen::flatten class "[lindex $endval 1] $fnum2"
+   }
+   # The last cell compared is the top level
+   set matched $uresult
+   set endval [timed compare {netgen::compare hierarchical}]
+}
+timed flatten {netgen::flatten "top $fnum1"}
+set total [expr {[clock microseconds] - $start}]
+netgen::log echo on
+
+#---------------------------------------------------------------------------
+# Report
+#---------------------------------------------------------------------------
+
+puts stdout [format "\nBenchmark: %s devices (%s) %s" $devices $format \
+	[expr {($matched != 0) ? "match" : "no match"}]]
+foreach step $steps {
+   puts stdout [format "   %-12s %10.3f s" $step [expr {$bench_time($step) / 1.0e6}]]
+}
+puts stdout [format "   %-12s %10.3f s" total [expr {$total / 1.0e6}]]
+
+puts stdout [format "   %-12s %6s %10s %10s %12s %10s" phase calls wall cpu \
+	allocs "peak kB"]
+foreach phase [netgen::stats] {
+   lassign $phase name calls wall cpu allocs peak
+   puts stdout [format "   %-12s %6d %10.3f %10.3f %12d %10d" $name $calls \
+	$wall $cpu $allocs $peak]
+}
+
+file delete $file1 $file2
+exit
@@ -0,0 +1,462 @@
+/* "NETGEN", a netlist-specification tool for VLSI
+   Copyright (C) 1989, 1990   Massimo A. Sivilotti
+   Author's address: mass@csvax.cs.caltech.edu;
+                     Caltech 256-80, Pasadena CA 91125.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation (any version).
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file copying.  If not, write to
+the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* gennet.c -- generate synthetic SPICE or Verilog netlists for	*/
+/* benchmarking LVS.  This is a standalone program and does not	*/
+/* link with the netgen libraries.				*/
+/*								*/
+/* The netlist is built from a NAND2 leaf cell.  Each level of	*/
+/* hierarchy "blk<k>" is a chain of <fanout> stages, each stage	*/
+/* being a bus of <width> bits.  At the first level, bit j of a	*/
+/* stage is a leaf cell driven by bits j and j+1 (mod width) of	*/
+/* the previous stage, so the bus is rotationally symmetric.	*/
+/* The top cell holds an array of instances of the highest	*/
+/* level block, each followed by a row of inverters.  The array	*/
+/* is either chained (each instance driven by the inverters of	*/
+/* the one before) or parallel (all instances driven by the	*/
+/* input bus, which is fully symmetric).			*/
+/*								*/
+/* Each transistor (SPICE) or gate (Verilog) is repeated		*/
+/* <fingers> times in parallel.  Mismatches are injected only	*/
+/* into the top-level inverters, so that netlists generated	*/
+/* with the same options and different mismatch counts differ	*/
+/* only in the injected errors.					*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FORMAT_SPICE	0
+#define FORMAT_VERILOG	1
+
+static int Format = FORMAT_SPICE;
+static long Devices = 10000;	/* target number of devices */
+static int Depth = 3;		/* levels of hierarchy above the leaf */
+static int Fanout = 4;		/* stages per level */
+static int Width = 8;		/* bus width */
+static int Fingers = 1;		/* parallel copies of each device */
+static long Array = 0;		/* top-level instances (0 = from Devices) */
+static int Parallel = 0;	/* parallel instead of chained array */
+static int Mismatches = 0;	/* number of errors to inject */
+static unsigned long Seed = 1;
+
+/*--------------------------------------------------------------*/
+/* Random numbers used only for placing mismatches.		*/
+/*--------------------------------------------------------------*/
+
+static unsigned long RandState;
+
+static unsigned long NextRandom(void)
+{
+   RandState = RandState * 6364136223846793005UL + 1442695040888963407UL;
+   return (RandState >> 33);
+}
+
+/*--------------------------------------------------------------*/
+/* Mismatch bookkeeping:  one entry per top-level inverter	*/
+/* that has an error.  Type 1 connects the gate to the		*/
+/* neighboring bit;  type 2 changes the device width.		*/
+/*--------------------------------------------------------------*/
+
+struct mismatch {
+   long inst;
+   int bit;
+   int type;
+};
+
+static struct mismatch *MismatchList = NULL;
+
+static int FindMismatch(long inst, int bit)
+{
+   int i;
+
+   for (i = 0; i < Mismatches; i++)
+      if (MismatchList[i].inst == inst && MismatchList[i].bit == bit)
+	 return MismatchList[i].type;
+   return 0;
+}
+
+/*--------------------------------------------------------------*/
+/* Print the name of bit "j" of bus "bus" with optional index.	*/
+/*--------------------------------------------------------------*/
+
+static void BusList(FILE *f, char *bus, long idx, char *sep)
+{
+   int j;
+
+   for (j = 0; j < Width; j++) {
+      if (idx < 0)
+	 fprintf(f, "%s%s_%d", (j == 0) ? "" : sep, bus, j);
+      else
+	 fprintf(f, "%s%s%ld_%d", (j == 0) ? "" : sep, bus, idx, j);
+   }
+}
+
+/*--------------------------------------------------------------*/
+/* SPICE output							*/
+/*--------------------------------------------------------------*/
+
+static void SpiceLeaf(FILE *f)
+{
+   int i;
+
+   fprintf(f, ".subckt leaf a b y vdd vss\n");
+   for (i = 0; i < Fingers; i++) {
+      fprintf(f, "MP1_%d y a vdd vdd pch w=2u l=0.15u\n", i);
+      fprintf(f, "MP2_%d y b vdd vdd pch w=2u l=0.15u\n", i);
+      fprintf(f, "MN1_%d y a x vss nch w=1u l=0.15u\n", i);
+      fprintf(f, "MN2_%d x b vss vss nch w=1u l=0.15u\n", i);
+   }
+   fprintf(f, ".ends\n\n");
+}
+
+/* Name the input (out = 0) or output (out = 1) bus of stage s */
+
+static void StageBus(char *buf, int s, int out)
+{
+   int n = s + out;
+
+   if (n == 0)
+      strcpy(buf, "in");
+   else if (n == Fanout)
+      strcpy(buf, "out");
+   else
+      sprintf(buf, "n%d", n);
+}
+
+static void SpiceBlock(FILE *f, int level)
+{
+   char inbus[32], outbus[32];
+   int s, j;
+
+   fprintf(f, ".subckt blk%d ", level);
+   BusList(f, "in", -1, " ");
+   fprintf(f, " ");
+   BusList(f, "out", -1, " ");
+   fprintf(f, " vdd vss\n");
+
+   for (s = 0; s < Fanout; s++) {
+      StageBus(inbus, s, 0);
+      StageBus(outbus, s, 1);
+      if (level == 1) {
+	 for (j = 0; j < Width; j++)
+	    fprintf(f, "X%d_%d %s_%d %s_%d %s_%d vdd vss leaf\n", s, j,
+			inbus, j, inbus, (j + 1) % Width, outbus, j);
+      }
+      else {
+	 fprintf(f, "X%d ", s);
+	 BusList(f, inbus, -1, " ");
+	 fprintf(f, " ");
+	 BusList(f, outbus, -1, " ");
+	 fprintf(f, " vdd vss blk%d\n", level - 1);
+      }
+   }
+   fprintf(f, ".ends\n\n");
+}
+
+static void SpiceTop(FILE *f)
+{
+   long a;
+   int j, i, type;
+   char gate[48], drain[48], inbus[32];
+
+   fprintf(f, ".subckt top ");
+   BusList(f, "in", -1, " ");
+   fprintf(f, " ");
+   BusList(f, "out", -1, " ");
+   fprintf(f, " vdd vss\n");
+
+   for (a = 0; a < Array; a++) {
+      if (Parallel || a == 0)
+	 strcpy(inbus, "in");
+      else
+	 sprintf(inbus, "q%ld", a - 1);
+
+      fprintf(f, "X%ld ", a);
+      for (j = 0; j < Width; j++)
+	 fprintf(f, "%s%s_%d", (j == 0) ? "" : " ", inbus, j);
+      fprintf(f, " ");
+      BusList(f, "o", a, " ");
+      fprintf(f, " vdd vss blk%d\n", Depth);
+
+      for (j = 0; j < Width; j++) {
+	 type = FindMismatch(a, j);
+	 sprintf(gate, "o%ld_%d", a, (type == 1) ? (j + 1) % Width : j);
+	 if (a == Array - 1)
+	    sprintf(drain, "out_%d", j);
+	 else
+	    sprintf(drain, "q%ld_%d", a, j);
+	 for (i = 0; i < Fingers; i++) {
+	    fprintf(f, "MP%ld_%d_%d %s %s vdd vdd pch w=%gu l=0.15u\n",
+			a, j, i, drain, gate, 2.0 + 0.5 * (j % 4));
+	    fprintf(f, "MN%ld_%d_%d %s %s vss vss nch w=%gu l=0.15u\n",
+			a, j, i, drain, gate,
+			(type == 2) ? 3.0 : 1.0 + 0.25 * (j % 4));
+	 }
+      }
+   }
+   fprintf(f, ".ends\n");
+}
+
+/*--------------------------------------------------------------*/
+/* Verilog output.  The leaf cells "nand2" and "inv" are empty	*/
+/* modules, which netgen treats as black-box devices.  Since	*/
+/* black boxes have no properties, only connection errors are	*/
+/* injected.							*/
+/*--------------------------------------------------------------*/
+
+static void VerilogPorts(FILE *f)
+{
+   fprintf(f, "(");
+   BusList(f, "in", -1, ", ");
+   fprintf(f, ", ");
+   BusList(f, "out", -1, ", ");
+   fprintf(f, ", vdd, vss);\n   input ");
+   BusList(f, "in", -1, ", ");
+   fprintf(f, ";\n   output ");
+   BusList(f, "out", -1, ", ");
+   fprintf(f, ";\n   inout vdd, vss;\n");
+}
+
+static void VerilogBusConnect(FILE *f, char *pin, char *bus, long idx)
+{
+   int j;
+
+   for (j = 0; j < Width; j++) {
+      if (idx < 0)
+	 fprintf(f, ".%s_%d(%s_%d), ", pin, j, bus, j);
+      else
+	 fprintf(f, ".%s_%d(%s%ld_%d), ", pin, j, bus, idx, j);
+   }
+}
+
+static void VerilogLeaf(FILE *f)
+{
+   fprintf(f, "module nand2 (a, b, y, vdd, vss);\n"
+		"   input a, b;\n   output y;\n   inout vdd, vss;\n"
+		"endmodule\n\n");
+   fprintf(f, "module inv (a, y, vdd, vss);\n"
+		"   input a;\n   output y;\n   inout vdd, vss;\n"
+		"endmodule\n\n");
+}
+
+static void VerilogBlock(FILE *f, int level)
+{
+   char inbus[32], outbus[32];
+   int s, j, i;
+
+   fprintf(f, "module blk%d ", level);
+   VerilogPorts(f);
+   for (s = 1; s < Fanout; s++) {
+      sprintf(inbus, "n%d", s);
+      fprintf(f, "   wire ");
+      BusList(f, inbus, -1, ", ");
+      fprintf(f, ";\n");
+   }
+
+   for (s = 0; s < Fanout; s++) {
+      StageBus(inbus, s, 0);
+      StageBus(outbus, s, 1);
+      if (level == 1) {
+	 for (j = 0; j < Width; j++)
+	    for (i = 0; i < Fingers; i++)
+	       fprintf(f, "   nand2 X%d_%d_%d (.a(%s_%d), .b(%s_%d), .y(%s_%d), "
+			".vdd(vdd), .vss(vss));\n", s, j, i, inbus, j,
+			inbus, (j + 1) % Width, outbus, j);
+      }
+      else {
+	 fprintf(f, "   blk%d X%d (", level - 1, s);
+	 VerilogBusConnect(f, "in", inbus, -1);
+	 VerilogBusConnect(f, "out", outbus, -1);
+	 fprintf(f, ".vdd(vdd), .vss(vss));\n");
+      }
+   }
+   fprintf(f, "endmodule\n\n");
+}
+
+static void VerilogTop(FILE *f)
+{
+   long a;
+   int j, i, type;
+   char inbus[32];
+
+   fprintf(f, "module top ");
+   VerilogPorts(f);
+   for (a = 0; a < Array; a++) {
+      fprintf(f, "   wire ");
+      BusList(f, "o", a, ", ");
+      if (a < Array - 1) {
+	 fprintf(f, ", ");
+	 BusList(f, "q", a, ", ");
+      }
+      fprintf(f, ";\n");
+   }
+
+   for (a = 0; a < Array; a++) {
+      if (Parallel || a == 0)
+	 strcpy(inbus, "in");
+      else
+	 sprintf(inbus, "q%ld", a - 1);
+
+      fprintf(f, "   blk%d X%ld (", Depth, a);
+      VerilogBusConnect(f, "in", inbus, -1);
+      VerilogBusConnect(f, "out", "o", a);
+      fprintf(f, ".vdd(vdd), .vss(vss));\n");
+
+      for (j = 0; j < Width; j++) {
+	 type = FindMismatch(a, j);
+	 for (i = 0; i < Fingers; i++) {
+	    fprintf(f, "   inv I%ld_%d_%d (.a(o%ld_%d), ", a, j, i, a,
+			(type != 0) ? (j + 1) % Width : j);
+	    if (a == Array - 1)
+	       fprintf(f, ".y(out_%d), ", j);
+	    else
+	       fprintf(f, ".y(q%ld_%d), ", a, j);
+	    fprintf(f, ".vdd(vdd), .vss(vss));\n");
+	 }
+      }
+   }
+   fprintf(f, "endmodule\n");
+}
+
+/*--------------------------------------------------------------*/
+
+static void Usage(void)
+{
+   fprintf(stderr,
+	"usage: gennet [options]\n"
+	"   -t spice|verilog   output format (default spice)\n"
+	"   -n <devices>       target number of devices, rounded to a whole\n"
+	"                      array of blocks (default 10000)\n"
+	"   -d <depth>         levels of hierarchy above the leaf (default 3)\n"
+	"   -f <fanout>        stages per hierarchy level (default 4)\n"
+	"   -w <width>         bus width (default 8)\n"
+	"   -p <fingers>       parallel copies of each device (default 1)\n"
+	"   -a <count>         top-level array size (default: from -n)\n"
+	"   -r                 parallel (symmetric) array instead of chained\n"
+	"   -m <count>         number of mismatches to inject (default 0)\n"
+	"   -s <seed>          seed for placing mismatches (default 1)\n"
+	"   -o <file>          output file (default stdout)\n");
+   exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+   FILE *f = stdout;
+   char *outname = NULL;
+   long perinst, total;
+   int i, k;
+
+   for (i = 1; i < argc; i++) {
+      if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0')
+	 Usage();
+      if (argv[i][1] == 'r') {
+	 Parallel = 1;
+	 continue;
+      }
+      if (i + 1 >= argc) Usage();
+      switch (argv[i][1]) {
+	 case 't':
+	    if (!strcmp(argv[i + 1], "spice")) Format = FORMAT_SPICE;
+	    else if (!strcmp(argv[i + 1], "verilog")) Format = FORMAT_VERILOG;
+	    else Usage();
+	    break;
+	 case 'n': Devices = atol(argv[i + 1]); break;
+	 case 'd': Depth = atoi(argv[i + 1]); break;
+	 case 'f': Fanout = atoi(argv[i + 1]); break;
+	 case 'w': Width = atoi(argv[i + 1]); break;
+	 case 'p': Fingers = atoi(argv[i + 1]); break;
+	 case 'a': Array = atol(argv[i + 1]); break;
+	 case 'm': Mismatches = atoi(argv[i + 1]); break;
+	 case 's': Seed = strtoul(argv[i + 1], NULL, 10); break;
+	 case 'o': outname = argv[i + 1]; break;
+	 default: Usage();
+      }
+      i++;
+   }
+   if (Depth < 1 || Fanout < 1 || Width < 2 || Fingers < 1 ||
+		Mismatches < 0 || Devices < 1 || Array < 0) Usage();
+
+   /* Devices in one top-level array element:  the block plus a	*/
+   /* row of inverters.						*/
+
+   perinst = (long)Width * ((Format == FORMAT_SPICE) ? 4 : 1) * Fingers;
+   for (k = 0; k < Depth; k++) perinst *= Fanout;
+   perinst += (long)Width * ((Format == FORMAT_SPICE) ? 2 : 1) * Fingers;
+
+   /* The size is a whole number of array elements, so it cannot	*/
+   /* be made smaller than one of them.				*/
+
+   if (Array == 0) {
+      if (Devices < perinst) {
+	 fprintf(stderr, "gennet: %ld devices requested, but the minimum "
+		"with these options is %ld.\n"
+		"Use a smaller -d, -f or -w to generate fewer devices.\n",
+		Devices, perinst);
+	 return 1;
+      }
+      Array = (Devices + perinst / 2) / perinst;
+   }
+   total = Array * perinst;
+
+   if (Mismatches > Array * Width) Mismatches = Array * Width;
+   if (Mismatches > 0) {
+      MismatchList = (struct mismatch *)calloc(Mismatches,
+		sizeof(struct mismatch));
+      RandState = Seed;
+      for (i = 0; i < Mismatches; i++) {
+	 do {
+	    MismatchList[i].inst = NextRandom() % Array;
+	    MismatchList[i].bit = NextRandom() % Width;
+	 } while (FindMismatch(MismatchList[i].inst, MismatchList[i].bit));
+	 MismatchList[i].type = (Format == FORMAT_SPICE) ? 1 + (i % 2) : 1;
+      }
+   }
+
+   if (outname != NULL) {
+      f = fopen(outname, "w");
+      if (f == NULL) {
+	 fprintf(stderr, "gennet: cannot open %s for writing.\n", outname);
+	 return 1;
+      }
+   }
+
+   if (Format == FORMAT_SPICE) {
+      fprintf(f, "* gennet: %ld devices, depth %d, fanout %d, width %d, "
+		"fingers %d, array %ld (%s), %d mismatches\n\n", total,
+		Depth, Fanout, Width, Fingers, Array,
+		(Parallel) ? "parallel" : "chained", Mismatches);
+      SpiceLeaf(f);
+      for (k = 1; k <= Depth; k++) SpiceBlock(f, k);
+      SpiceTop(f);
+      fprintf(f, ".end\n");
+   }
+   else {
+      fprintf(f, "// gennet: %ld devices, depth %d, fanout %d, width %d, "
+		"fingers %d, array %ld (%s), %d mismatches\n\n", total,
+		Depth, Fanout, Width, Fingers, Array,
+		(Parallel) ? "parallel" : "chained", Mismatches);
+      VerilogLeaf(f);
+      for (k = 1; k <= Depth; k++) VerilogBlock(f, k);
+      VerilogTop(f);
+   }
+
+   if (f != stdout) fclose(f);
+   if (MismatchList != NULL) free(MismatchList);
+   return 0;
+}
@@ -36,13 +36,220 @@
 /* is ever invoked.  Making "netgenexec" run Tk_Init just causes it to	*/
 /* require graphics accessibility that it does not need.  All calls to	*/
 /* Tk have been replaced with Tcl calls.				*/
+/*									*/
+/* Update:  "netgenexec" also provides the command "netgen::serve",	*/
+/* which turns netgen into a long-running LVS server listening on a	*/
+/* UNIX socket (see netgen_Serve() below).				*/
 /*----------------------------------------------------------------------*/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 // #include <tk.h>
 #include <tcl.h>
 
+#ifndef CONST84
+#define CONST84
+#endif
+
+#define MAX_REQUEST 65536
+
+static volatile int ServeShutdown = 0;
+
+static void
+ServeSignal(sig)
+    int sig;
+{
+    ServeShutdown = 1;
+}
+
+/*----------------------------------------------------------------------*/
+/* Read one request line from a client connection.  Returns a Tcl	*/
+/* object holding the line without its newline, or NULL if the client	*/
+/* closed the connection without sending anything.			*/
+/*----------------------------------------------------------------------*/
+
+static Tcl_Obj *
+ReadRequest(int fd)
+{
+    char buf[1024];
+    Tcl_Obj *robj;
+    char *nl;
+    int n, total = 0;
+
+    robj = Tcl_NewObj();
+    while (total < MAX_REQUEST) {
+	n = read(fd, buf, sizeof(buf));
+	if (n <= 0) break;
+	if ((nl = memchr(buf, '\n', n)) != NULL) {
+	    Tcl_AppendToObj(robj, buf, nl - buf);
+	    total += nl - buf;
+	    break;
+	}
+	Tcl_AppendToObj(robj, buf, n);
+	total += n;
+    }
+    if (total == 0) {
+	Tcl_DecrRefCount(robj);
+	return NULL;
+    }
+    return robj;
+}
+
+/*----------------------------------------------------------------------*/
+/* Handle one client connection in a forked process.  The process has	*/
+/* a private copy of everything the server has read, so each job sees	*/
+/* the preloaded cells and nothing that earlier jobs did.  Never	*/
+/* returns.								*/
+/*----------------------------------------------------------------------*/
+
+static void
+ServeJob(Tcl_Interp *interp, int fd)
+{
+    Tcl_Obj *request, *cmd;
+    char *rstr;
+    int rlen, n, nullfd;
+
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGUSR1, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Comparison output goes to the job's log file, not the server's */
+    nullfd = open("/dev/null", O_WRONLY);
+    if (nullfd >= 0) {
+	dup2(nullfd, 1);
+	dup2(nullfd, 2);
+	close(nullfd);
+    }
+
+    request = ReadRequest(fd);
+    if ((request != NULL) && !strcmp(Tcl_GetString(request), "shutdown")) {
+	kill(getppid(), SIGUSR1);
+	Tcl_SetObjResult(interp, Tcl_NewStringObj("{\"status\": \"shutdown\"}",
+		-1));
+    }
+    else if (request != NULL) {
+	cmd = Tcl_NewListObj(0, NULL);
+	Tcl_IncrRefCount(cmd);
+	Tcl_ListObjAppendElement(interp, cmd,
+		Tcl_NewStringObj("netgen::serve_request", -1));
+	Tcl_ListObjAppendElement(interp, cmd, request);
+	if (Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL) != TCL_OK)
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(
+			"{\"error\": \"Server failed to run request.\"}", -1));
+	Tcl_DecrRefCount(cmd);
+    }
+    if (request != NULL) {
+	rstr = Tcl_GetStringFromObj(Tcl_GetObjResult(interp), &rlen);
+	n = 1;
+	while (rlen > 0) {
+	    n = write(fd, rstr, rlen);
+	    if (n <= 0) break;
+	    rstr += n;
+	    rlen -= n;
+	}
+	if (n > 0) n = write(fd, "\n", 1);
+    }
+    close(fd);
+    _exit(0);
+}
+
+/*----------------------------------------------------------------------*/
+/* netgen::serve <socket>						*/
+/*									*/
+/* Listen on the UNIX socket <socket> and run one LVS job per		*/
+/* connection.  A client sends a single line holding the arguments of	*/
+/* an "lvs" command (a Tcl list), and receives the JSON result (see	*/
+/* netgen::serve_request in netgen.tcl).  Libraries, setup, and any	*/
+/* other netlists read before calling "serve" are kept resident and	*/
+/* shared by all jobs.  Each job runs in its own process, so jobs are	*/
+/* isolated from each other and several can run at once.  A request	*/
+/* of "shutdown" stops the server.  Does not return until then.		*/
+/*----------------------------------------------------------------------*/
+
+static int
+netgen_Serve(clientData, interp, objc, objv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int objc;
+    Tcl_Obj *CONST objv[];
+{
+    struct sockaddr_un addr;
+    struct sigaction sa, oldsa;
+    Tcl_Channel chan;
+    char *path;
+    int lfd, fd;
+    pid_t pid;
+
+    if (objc != 2) {
+	Tcl_WrongNumArgs(interp, 1, objv, "<socket>");
+	return TCL_ERROR;
+    }
+    path = Tcl_GetString(objv[1]);
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+	Tcl_SetResult(interp, "Socket path is too long.", NULL);
+	return TCL_ERROR;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) {
+	Tcl_SetResult(interp, "Cannot create socket.", NULL);
+	return TCL_ERROR;
+    }
+    unlink(path);
+    if ((bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+		(listen(lfd, 16) < 0)) {
+	close(lfd);
+	Tcl_AppendResult(interp, "Cannot listen on socket ", path, NULL);
+	return TCL_ERROR;
+    }
+    chmod(path, 0600);
+
+    /* Pending output must not be repeated by the job processes */
+    if ((chan = Tcl_GetStdChannel(TCL_STDOUT)) != NULL) Tcl_Flush(chan);
+    if ((chan = Tcl_GetStdChannel(TCL_STDERR)) != NULL) Tcl_Flush(chan);
+    fflush(NULL);
+
+    /* Finished jobs are reaped automatically.  A "shutdown" request	*/
+    /* is passed back by its job as SIGUSR1, which interrupts accept().	*/
+    signal(SIGCHLD, SIG_IGN);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = ServeSignal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, &oldsa);
+    ServeShutdown = 0;
+
+    while (!ServeShutdown) {
+	fd = accept(lfd, NULL, NULL);
+	if (fd < 0) continue;
+
+	pid = fork();
+	if (pid == 0) {
+	    close(lfd);
+	    ServeJob(interp, fd);
+	}
+	close(fd);
+    }
+    close(lfd);
+    unlink(path);
+    sigaction(SIGUSR1, &oldsa, NULL);
+    signal(SIGCHLD, SIG_DFL);
+    return TCL_OK;
+}
+
 /*----------------------------------------------------------------------*/
 /* Application initiation.  This is exactly like the AppInit routine	*/
 /* for "wish", minus the cruft, but with "tcl_rcFileName" set to	*/
@@ -62,6 +269,9 @@ netgen_AppInit(interp)
     // Tcl_StaticPackage(interp, "Tk", Tk_Init, Tk_SafeInit);
     Tcl_StaticPackage(interp, "Tcl", Tcl_Init, Tcl_Init);
 
+    Tcl_CreateObjCommand(interp, "netgen::serve", netgen_Serve,
+		(ClientData)NULL, (Tcl_CmdDeleteProc *)NULL);
+
     /* This is where we replace the home ".wishrc" file with	*/
     /* netgen's startup script.					*/
 
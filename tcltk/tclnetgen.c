@@ -32,6 +32,7 @@ the Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 #include "print.h"
 #include "query.h"	/* for ElementNodes() */
 #include "hash.h"
+#include "timing.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -55,6 +56,13 @@ char *LogFileName = NULL;
 
 extern int PropertyErrorDetected;
 
+/* Set when "compare hierarchical" finds a subcell pair whose	*/
+/* signatures cannot match, so that "run" may skip converging	*/
+/* it.  Cleared once the partitions have been refined.		*/
+static int SkipConverge = FALSE;
+
+void tcl_flushbuffer(void);
+
 /* Function prototypes for all Tcl command callbacks */
 
 int _netgen_readnet(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
@@ -76,6 +84,10 @@ int _netgen_leaves(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netgen_quit(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netgen_reinit(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netgen_log(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
+int _netgen_stats(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
+int _netgen_report(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
+int _netgen_job(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
+int _netgen_snapshot(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 #ifdef HAVE_MALLINFO
 int _netgen_printmem(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 #endif
@@ -93,9 +105,11 @@ int _netcmp_ignore(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netcmp_permute(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netcmp_property(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netcmp_exhaustive(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
+int _netcmp_cache(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netcmp_restart(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netcmp_global(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 int _netcmp_convert(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
+int _netgen_dispatch(ClientData, Tcl_Interp *, int, Tcl_Obj *CONST objv[]);
 
 typedef struct _Cmd {
    char 	*name;
@@ -164,9 +178,35 @@ Command netgen_cmds[] = {
 	{"reinitialize",	_netgen_reinit,
 		"\n   "
 		"reintialize netgen data structures"},
+	{"snapshot",		_netgen_snapshot,
+		"[save [<valid_cellname>]|restore|clear]\n   "
+		"save: keep a copy of all cells (or of the cell's file)\n   "
+		"restore: return the saved cells to their saved state\n   "
+		"clear: discard the saved copy"},
 	{"log",			_netgen_log,
 		"[file <name>|start|end|reset|suspend|resume|echo]\n   "
 		"enable or disable output log to file"},
+	{"stats",		_netgen_stats,
+		"[reset|iterations|json <file>|trace [<file>|off]]\n   "
+		"report time, memory, and allocations for each phase\n   "
+		"iterations: report time and class counts per iteration\n   "
+		"json: write all statistics to <file> in JSON format\n   "
+		"trace: write a CSV row per refinement pass to <file>"},
+	{"report",		_netgen_report,
+		"[json <file>|cell|end]\n   "
+		"json: write \"-list\" comparison results to <file> as JSON\n   "
+		"cell: end the results for the current cell pair\n   "
+		"end: finish and close the JSON file"},
+	{"job",			_netgen_job,
+		"start [-progress <cmd>] [-command <cmd>] [-output <file>] "
+		"<script>\n   "
+		"status|cancel|wait|forget <id>\n   "
+		"list\n   "
+		"start: run <script> (e.g., lvs) on a background thread;\n   "
+		"   other netgen commands are refused until it ends\n   "
+		"status: report state and progress of a job\n   "
+		"cancel: stop a job at its next interrupt check\n   "
+		"wait: wait for a job to finish and return its result"},
 #ifdef HAVE_MALLINFO
 	{"memory",		_netgen_printmem,
 		"\n   "
@@ -240,6 +280,11 @@ Command netcmp_cmds[] = {
 	{"exhaustive",		_netcmp_exhaustive,
 		"\n   "
 		"toggle exhaustive subdivision"},
+	{"cache",		_netcmp_cache,
+		"[on|off|clear|load <file>|save <file>]\n   "
+		"on|off: enable or disable reuse of subcircuit results\n   "
+		"clear: remove all cached results\n   "
+		"load|save: read or write cached results from/to <file>"},
 	{"restart",		_netcmp_restart,
 		"\n   "
 		"start over (reset data structures)"},
@@ -784,6 +829,7 @@ _netgen_readnet(ClientData clientData,
    }
    else {
 
+      StatsBegin("read");
       switch(index) {
          case AUTO_IDX:
             retstr = ReadNetlist(savstr, &filenum);
@@ -818,6 +864,7 @@ _netgen_readnet(ClientData clientData,
 	    retstr = formats[index];
 	    break;
       }
+      StatsEnd();
    }
 
    /* Return the file number to the interpreter */
@@ -1118,9 +1165,9 @@ _netgen_nodes(ClientData clientData,
 
    if (estr) {
       if (dolist) {
-	 struct objlist *ob, *nob;
+	 struct objlist *ob, *nob, **obs, **pins;
 	 Tcl_Obj *lobj, *pobj;
-	 int ckto;
+	 int ckto, nobs, npins, i, j;
 
 	 if (np == NULL) np = LookupCellFile(cstr, fnum);
 
@@ -1131,39 +1178,40 @@ _netgen_nodes(ClientData clientData,
 	 }
 
 	 ckto = strlen(estr);
-	 for (ob = np->cell; ob != NULL; ob = ob->next) {
-	    if (!strncmp(estr, ob->name, ckto)) {
-	       if (*(ob->name + ckto) == '/' || *(ob->name + ckto) == '\0')
-		  break;
-	    }
-	 }
-	 if (ob == NULL) {
+	 nobs = PrefixObjects(np, estr, 0, &obs);
+	 if (nobs == 0) {
 	    Tcl_SetResult(interp, "No such element.", NULL);
 	    if (istr) Tcl_Free(istr);
 	    return TCL_ERROR;
 	 }
 	 lobj = Tcl_NewListObj(0, NULL);
-	 for (; ob != NULL; ob = ob->next) {
-	    if (!strncmp(estr, ob->name, ckto)) {
-	       if (*(ob->name + ckto) != '/' && *(ob->name + ckto) != '\0')
-		  continue;
-
-	       pobj = Tcl_NewListObj(0, NULL);
-               Tcl_ListObjAppendElement(interp, pobj,
+	 for (i = 0; i < nobs; i++) {
+	    ob = obs[i];
+	    pobj = Tcl_NewListObj(0, NULL);
+            Tcl_ListObjAppendElement(interp, pobj,
 			Tcl_NewStringObj(ob->name + ckto + 1, -1));
 
-	       for (nob = np->cell; nob != NULL; nob = nob->next) {
-		  if (nob->node == ob->node) {
-		     if (nob->type < FIRSTPIN) {
-                        Tcl_ListObjAppendElement(interp, pobj,
-				Tcl_NewStringObj(nob->name, -1));
-		        break;
-		     }
+	    /* Negative (disconnected) nodes are not in the node index */
+	    nob = NULL;
+	    if (ob->node < 0) {
+	       for (nob = np->cell; nob != NULL; nob = nob->next)
+		  if ((nob->node == ob->node) && (nob->type < FIRSTPIN))
+		     break;
+	    }
+	    else {
+	       pins = NodePins(np, ob->node, &npins);
+	       for (j = 0; j < npins; j++)
+		  if (pins[j]->type < FIRSTPIN) {
+		     nob = pins[j];
+		     break;
 		  }
-	       }
-               Tcl_ListObjAppendElement(interp, lobj, pobj);
 	    }
+	    if (nob != NULL)
+               Tcl_ListObjAppendElement(interp, pobj,
+			Tcl_NewStringObj(nob->name, -1));
+            Tcl_ListObjAppendElement(interp, lobj, pobj);
 	 }
+	 FREE(obs);
 	 Tcl_SetObjResult(interp, lobj);
       }
       else
@@ -1206,7 +1254,7 @@ _netgen_elements(ClientData clientData,
       }
    }
     
-   if (objc < 1 || objc > 2) {
+   if (objc < 1 || objc > 3) {
       Tcl_WrongNumArgs(interp, 1, objv, "?node? valid_cellname");
       return TCL_ERROR;
    }
@@ -1229,9 +1277,9 @@ _netgen_elements(ClientData clientData,
 
    if (nstr) {
       if (dolist) {
-	 struct objlist *ob;
+	 struct objlist *ob, **pins;
 	 Tcl_Obj *lobj;
-	 int nodenum;
+	 int nodenum, npins, i;
 
 	 if (np == NULL) np = LookupCellFile(cstr, fnum);
 
@@ -1240,23 +1288,35 @@ _netgen_elements(ClientData clientData,
 	    return TCL_ERROR;
 	 }
 
-	 for (ob = np->cell; ob != NULL; ob = ob->next) {
-	    if (match(nstr, ob->name)) {
-	       nodenum = ob->node;
-	       break;
-	    }
-	 }
+	 ob = LookupObject(nstr, np);
+	 if ((ob == NULL) || !match(nstr, ob->name))
+	    for (ob = np->cell; ob != NULL; ob = ob->next)
+	       if (match(nstr, ob->name)) break;
 	 if (ob == NULL) {
 	    Tcl_SetResult(interp, "No such node.", NULL);
 	    return TCL_ERROR;
 	 }
+	 nodenum = ob->node;
 	 lobj = Tcl_NewListObj(0, NULL);
-	 for (ob = np->cell; ob != NULL; ob = ob->next) {
-	    if (ob->node == nodenum && ob->type >= FIRSTPIN) {
-	       char *obname = ob->name;
-	       if (*obname == '/') obname++;
-               Tcl_ListObjAppendElement(interp, lobj,
+	 if (nodenum >= 0) {
+	    pins = NodePins(np, nodenum, &npins);
+	    for (i = 0; i < npins; i++) {
+	       if (pins[i]->type >= FIRSTPIN) {
+		  char *obname = pins[i]->name;
+		  if (*obname == '/') obname++;
+		  Tcl_ListObjAppendElement(interp, lobj,
 			Tcl_NewStringObj(obname, -1));
+	       }
+	    }
+	 }
+	 else {
+	    for (ob = np->cell; ob != NULL; ob = ob->next) {
+	       if (ob->node == nodenum && ob->type >= FIRSTPIN) {
+		  char *obname = ob->name;
+		  if (*obname == '/') obname++;
+		  Tcl_ListObjAppendElement(interp, lobj,
+			Tcl_NewStringObj(obname, -1));
+	       }
 	    }
 	 }
 	 Tcl_SetObjResult(interp, lobj);
@@ -1790,6 +1850,7 @@ _netgen_quit(ClientData clientData,
    /* Call tkcon's exit routine, which will make sure	*/
    /* the history file is updated before final exit.	*/
 
+   tcl_flushbuffer();
    if (consoleinterp == interp)
       Tcl_Exit(TCL_OK);
    else
@@ -1818,6 +1879,76 @@ _netgen_reinit(ClientData clientData,
    return TCL_OK;
 }
 
+/*------------------------------------------------------*/
+/* Function name: _netgen_snapshot			*/
+/* Syntax: netgen::snapshot [save [<valid_cellname>]|	*/
+/*		restore|clear]				*/
+/* Formerly: (none)					*/
+/* Results:						*/
+/*	The number of cells in the snapshot.		*/
+/* Side Effects:					*/
+/*	"save" copies all cells, or all cells of the	*/
+/*	file containing <valid_cellname>.  "restore"	*/
+/*	returns those cells to the saved state and	*/
+/*	resets the comparison, so that netlists that	*/
+/*	have been flattened or compared can be compared	*/
+/*	again without reading them again.		*/
+/*------------------------------------------------------*/
+
+int
+_netgen_snapshot(ClientData clientData,
+    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
+{
+   char *options[] = {
+      "save", "restore", "clear", NULL
+   };
+   enum OptionIdx {
+      SAVE_IDX, RESTORE_IDX, CLEAR_IDX
+   };
+   int result, index, filenum = -1;
+   struct nlist *np;
+
+   if (objc == 1) {
+      Tcl_SetObjResult(interp, Tcl_NewIntObj(SnapshotCount()));
+      return TCL_OK;
+   }
+   if (Tcl_GetIndexFromObj(interp, objv[1], (CONST84 char **)options,
+		"option", 0, &index) != TCL_OK)
+      return TCL_ERROR;
+   if ((objc > 3) || ((index != SAVE_IDX) && (objc > 2))) {
+      Tcl_WrongNumArgs(interp, 1, objv, "[save [<valid_cellname>]|restore|clear]");
+      return TCL_ERROR;
+   }
+
+   switch (index) {
+      case SAVE_IDX:
+	 if (objc == 3) {
+	    result = CommonParseCell(interp, objv[2], &np, &filenum);
+	    if (result != TCL_OK) return result;
+	 }
+	 result = SnapshotSave(filenum);
+	 break;
+
+      case RESTORE_IDX:
+	 /* The comparison refers to objects that are about to be replaced */
+	 ResetState();
+	 RemoveCompareQueue();
+	 result = SnapshotRestore();
+	 if (result < 0) {
+	    Tcl_SetResult(interp, "No snapshot has been saved.", NULL);
+	    return TCL_ERROR;
+	 }
+	 break;
+
+      case CLEAR_IDX:
+	 SnapshotClear();
+	 result = 0;
+	 break;
+   }
+   Tcl_SetObjResult(interp, Tcl_NewIntObj(result));
+   return TCL_OK;
+}
+
 /*------------------------------------------------------*/
 /* Function name: _netgen_log				*/
 /* Syntax: netgen::log [option...]			*/
@@ -1949,6 +2080,718 @@ _netgen_log(ClientData clientData,
    return TCL_OK;
 }
 
+/*------------------------------------------------------*/
+/* Function name: _netgen_stats				*/
+/* Syntax: netgen::stats [reset|iterations|json <file>]	*/
+/*	   netgen::stats trace [<file>|off]		*/
+/* Formerly: (none)					*/
+/* Results:						*/
+/*	With no option, a list with one item per phase:	*/
+/*	{name calls wall cpu allocs peakrss}.  With	*/
+/*	"iterations", a list with one item per		*/
+/*	iteration:  {cell iteration wall cpu		*/
+/*	device_classes net_classes}.  "trace" with no	*/
+/*	file returns 1 if a convergence trace is open.	*/
+/* Side Effects:					*/
+/*	"reset" discards all statistics.  "json" writes	*/
+/*	the statistics to a file.  "trace <file>" opens	*/
+/*	a CSV file receiving one row per refinement	*/
+/*	pass, until "trace off".			*/
+/*------------------------------------------------------*/
+
+int
+_netgen_stats(ClientData clientData,
+    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
+{
+   char *options[] = {
+      "reset", "iterations", "json", "trace", NULL
+   };
+   enum OptionIdx {
+      RESET_IDX, ITER_IDX, JSON_IDX, TRACE_IDX, PHASE_IDX
+   };
+   int index;
+   struct phasestats *ps;
+   struct iterstats *is;
+   Tcl_Obj *lobj, *pobj;
+   FILE *f;
+
+   if (objc == 1)
+      index = PHASE_IDX;
+   else if (Tcl_GetIndexFromObj(interp, objv[1], (CONST84 char **)options,
+		"option", 0, &index) != TCL_OK)
+      return TCL_ERROR;
+
+   if (((index == JSON_IDX) && (objc != 3)) || (objc > 3) ||
+		((index != JSON_IDX) && (index != TRACE_IDX) && (objc > 2))) {
+      Tcl_WrongNumArgs(interp, 1, objv,
+		"[reset|iterations|json <file>|trace [<file>|off]]");
+      return TCL_ERROR;
+   }
+
+   switch (index) {
+      case RESET_IDX:
+	 StatsReset();
+	 break;
+
+      case JSON_IDX:
+	 f = fopen(Tcl_GetString(objv[2]), "w");
+	 if (f == NULL) {
+	    Tcl_AppendResult(interp, "Cannot open file ",
+			Tcl_GetString(objv[2]), " for writing.", NULL);
+	    return TCL_ERROR;
+	 }
+	 StatsWriteJSON(f);
+	 fclose(f);
+	 break;
+
+      case TRACE_IDX:
+	 if (objc == 2)
+	    Tcl_SetObjResult(interp, Tcl_NewBooleanObj(TraceActive()));
+	 else if (!strcmp(Tcl_GetString(objv[2]), "off"))
+	    TraceClose();
+	 else if (!TraceOpen(Tcl_GetString(objv[2]))) {
+	    Tcl_AppendResult(interp, "Cannot open file ",
+			Tcl_GetString(objv[2]), " for writing.", NULL);
+	    return TCL_ERROR;
+	 }
+	 break;
+
+      case ITER_IDX:
+	 lobj = Tcl_NewListObj(0, NULL);
+	 for (is = StatsIterations(); is != NULL; is = is->next) {
+	    pobj = Tcl_NewListObj(0, NULL);
+	    Tcl_ListObjAppendElement(interp, pobj,
+			Tcl_NewStringObj((is->cell) ? is->cell : "", -1));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewIntObj(is->iteration));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewDoubleObj(is->wall));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewDoubleObj(is->cpu));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewIntObj(is->eclasses));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewIntObj(is->nclasses));
+	    Tcl_ListObjAppendElement(interp, lobj, pobj);
+	 }
+	 Tcl_SetObjResult(interp, lobj);
+	 break;
+
+      case PHASE_IDX:
+	 lobj = Tcl_NewListObj(0, NULL);
+	 for (ps = StatsPhases(); ps != NULL; ps = ps->next) {
+	    pobj = Tcl_NewListObj(0, NULL);
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewStringObj(ps->name, -1));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewIntObj(ps->calls));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewDoubleObj(ps->wall));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewDoubleObj(ps->cpu));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewLongObj(ps->allocs));
+	    Tcl_ListObjAppendElement(interp, pobj, Tcl_NewLongObj(ps->peakrss));
+	    Tcl_ListObjAppendElement(interp, lobj, pobj);
+	 }
+	 Tcl_SetObjResult(interp, lobj);
+	 break;
+   }
+   return TCL_OK;
+}
+
+/*------------------------------------------------------*/
+/* Function name: _netgen_report			*/
+/* Syntax: netgen::report [json <file>|cell|end]	*/
+/* Formerly: (none)					*/
+/* Results:						*/
+/*	With no option, 1 if a JSON report is open.	*/
+/* Side Effects:					*/
+/*	"json" opens <file>, after which the "-list"	*/
+/*	output of compare, run, verify, and equate	*/
+/*	pins is written to the file as it is produced	*/
+/*	instead of being appended to "lvs_out".  "cell"	*/
+/*	ends the entry for the current cell pair, and	*/
+/*	"end" completes and closes the file.		*/
+/*------------------------------------------------------*/
+
+int
+_netgen_report(ClientData clientData,
+    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
+{
+   char *options[] = {
+      "json", "cell", "end", NULL
+   };
+   enum OptionIdx {
+      JSON_IDX, CELL_IDX, END_IDX
+   };
+   int index;
+
+   if (objc == 1) {
+      Tcl_SetObjResult(interp, Tcl_NewBooleanObj(ReportActive()));
+      return TCL_OK;
+   }
+   if (Tcl_GetIndexFromObj(interp, objv[1], (CONST84 char **)options,
+		"option", 0, &index) != TCL_OK)
+      return TCL_ERROR;
+
+   if (((index == JSON_IDX) && (objc != 3)) ||
+		((index != JSON_IDX) && (objc != 2))) {
+      Tcl_WrongNumArgs(interp, 1, objv, "[json <file>|cell|end]");
+      return TCL_ERROR;
+   }
+
+   switch (index) {
+      case JSON_IDX:
+	 if (!ReportOpen(Tcl_GetString(objv[2]))) {
+	    Tcl_AppendResult(interp, "Cannot open file ",
+			Tcl_GetString(objv[2]), " for writing.", NULL);
+	    return TCL_ERROR;
+	 }
+	 break;
+
+      case CELL_IDX:
+	 ReportNextCell();
+	 break;
+
+      case END_IDX:
+	 ReportClose();
+	 break;
+   }
+   return TCL_OK;
+}
+
+/*------------------------------------------------------*/
+/* Background jobs.  "netgen::job start" evaluates a	*/
+/* script (normally an "lvs" command) on a worker	*/
+/* thread, in an interpreter of its own that has the	*/
+/* netgen commands and the ::netgen procedures.  The	*/
+/* netgen data structures are global and not locked,	*/
+/* so only one job runs at a time, and the netgen	*/
+/* commands of every other interpreter are refused	*/
+/* until it ends.  The worker posts progress and its	*/
+/* completion to the event queue of the thread that	*/
+/* started it.  "job cancel" sets InterruptPending,	*/
+/* the flag that a keyboard interrupt sets, so the	*/
+/* worker stops at its next interrupt check.		*/
+/*------------------------------------------------------*/
+
+#define JOB_RUNNING	0
+#define JOB_DONE	1
+#define JOB_ERROR	2
+#define JOB_CANCELLED	3
+#define JOB_FAILED	4
+
+static char *JobStates[] = {
+   "running", "done", "error", "cancelled", "failed"
+};
+
+typedef struct _lvsjob {
+   int id;
+   Tcl_ThreadId thread;		/* worker thread */
+   Tcl_ThreadId owner;		/* thread that started the job */
+   Tcl_Interp *interp;		/* interpreter that started the job */
+   Tcl_Interp *console;		/* its console interpreter */
+   Tcl_Channel chan;		/* output, handed over to the worker */
+   char *script;		/* script to evaluate */
+   char *procs;			/* script defining the ::netgen procs */
+   char *answer;		/* result string left by the worker */
+   int started;			/* the worker got as far as the script */
+   int state;
+   int cancelled;		/* "job cancel" was requested */
+   int code;			/* Tcl return code of the script */
+   Tcl_Obj *progress;		/* last progress report */
+   Tcl_Obj *result;		/* script result, once finished */
+   Tcl_Obj *progresscmd;	/* callback for progress reports */
+   Tcl_Obj *donecmd;		/* callback when the job finishes */
+   struct _lvsjob *next;
+} LVSJob;
+
+/* Event posted by the worker to the owner thread */
+
+typedef struct _jobevent {
+   Tcl_Event header;
+   int id;
+   int done;			/* FALSE for a progress report */
+   char *cell1;
+   char *cell2;
+   int iteration;
+   int eclasses;
+   int nclasses;
+   int unresolved;
+} JobEvent;
+
+static LVSJob *JobList = NULL;
+static int JobCount = 0;
+static LVSJob *ActiveJob = NULL;	/* the running job, if any */
+static Tcl_Interp *JobInterp = NULL;	/* the worker's interpreter */
+
+int JobActive = FALSE;			/* a job is running */
+volatile int JobCancelled = FALSE;	/* and has been cancelled */
+
+/* Copy the ::netgen procedures of the main interpreter */
+
+static char *JobProcScript =
+   "apply {{} {\n"
+   "   set script {}\n"
+   "   foreach p [info procs ::netgen::*] {\n"
+   "      set arglist {}\n"
+   "      foreach a [info args $p] {\n"
+   "         if {[info default $p $a d]} {lappend arglist [list $a $d]} "
+		"else {lappend arglist $a}\n"
+   "      }\n"
+   "      append script [list proc $p $arglist [info body $p]] \\n\n"
+   "   }\n"
+   "   return $script\n"
+   "}}";
+
+/* Make the netgen commands available without the namespace, as	*/
+/* "pushnamespace netgen" does, but leave existing commands alone	*/
+
+static char *JobImportScript =
+   "apply {{} {\n"
+   "   foreach cmd [info commands ::netgen::*] {\n"
+   "      if {[info commands ::[namespace tail $cmd]] == {}} {\n"
+   "         namespace eval :: [list namespace import $cmd]\n"
+   "      }\n"
+   "   }\n"
+   "}}";
+
+static void NetgenCommands(Tcl_Interp *interp);
+
+static LVSJob *JobLookup(Tcl_Interp *interp, Tcl_Obj *idobj)
+{
+   LVSJob *job;
+   int id;
+
+   if (Tcl_GetIntFromObj(interp, idobj, &id) != TCL_OK) return NULL;
+   for (job = JobList; job != NULL; job = job->next)
+      if (job->id == id) return job;
+   Tcl_SetResult(interp, "No such job.", NULL);
+   return NULL;
+}
+
+static int JobEventProc(Tcl_Event *evPtr, int flags);
+
+/* Queue an event for the thread that started the job (worker side) */
+
+static void JobPost(LVSJob *job, JobEvent *ev)
+{
+   ev->header.proc = JobEventProc;
+   ev->id = job->id;
+   Tcl_ThreadQueueEvent(job->owner, (Tcl_Event *)ev, TCL_QUEUE_TAIL);
+   Tcl_ThreadAlert(job->owner);
+}
+
+/*------------------------------------------------------*/
+/* Called by Iterate() on the worker thread.  Each	*/
+/* report carries its own copy of the data, so the	*/
+/* comparison never waits for the owner thread.		*/
+/*------------------------------------------------------*/
+
+void JobProgress(char *cell1, char *cell2, int iteration, int eclasses,
+	int nclasses, int unresolved)
+{
+   JobEvent *ev;
+
+   if (ActiveJob == NULL) return;
+
+   ev = (JobEvent *)Tcl_Alloc(sizeof(JobEvent));
+   ev->done = FALSE;
+   ev->cell1 = strsave(cell1);
+   ev->cell2 = strsave(cell2);
+   ev->iteration = iteration;
+   ev->eclasses = eclasses;
+   ev->nclasses = nclasses;
+   ev->unresolved = unresolved;
+   JobPost(ActiveJob, ev);
+}
+
+/*------------------------------------------------------*/
+/* Worker thread body.  Everything the worker needs is	*/
+/* in the job record, which the owner does not change	*/
+/* or free while the job is running.			*/
+/*------------------------------------------------------*/
+
+static Tcl_ThreadCreateType JobThread(ClientData clientData)
+{
+   LVSJob *job = (LVSJob *)clientData;
+   Tcl_Interp *interp;
+   JobEvent *ev;
+   int code;
+
+   /* All output of the job goes to its output channel */
+
+   Tcl_SpliceChannel(job->chan);
+   Tcl_RegisterChannel(NULL, job->chan);
+   Tcl_SetStdChannel(NULL, TCL_STDIN);
+   Tcl_SetStdChannel(job->chan, TCL_STDOUT);
+   Tcl_SetStdChannel(job->chan, TCL_STDERR);
+
+   interp = Tcl_CreateInterp();
+   code = Tcl_Init(interp);
+   if (code == TCL_OK) {
+      NetgenCommands(interp);
+      code = Tcl_Eval(interp, job->procs);
+   }
+   if (code == TCL_OK) code = Tcl_Eval(interp, JobImportScript);
+
+   if (code == TCL_OK) {
+      job->started = TRUE;
+      JobInterp = interp;
+      netgeninterp = interp;
+      consoleinterp = interp;
+      code = Tcl_EvalEx(interp, job->script, -1, TCL_EVAL_GLOBAL);
+      tcl_flushbuffer();
+      if (JobCancelled) code = TCL_BREAK;
+   }
+   job->code = code;
+   job->answer = strsave((char *)Tcl_GetStringResult(interp));
+
+   Tcl_DeleteInterp(interp);
+   Tcl_SetStdChannel(NULL, TCL_STDOUT);
+   Tcl_SetStdChannel(NULL, TCL_STDERR);
+   Tcl_UnregisterChannel(NULL, job->chan);	/* flushes and closes */
+
+   ev = (JobEvent *)Tcl_Alloc(sizeof(JobEvent));
+   ev->done = TRUE;
+   ev->cell1 = ev->cell2 = NULL;
+   JobPost(job, ev);
+
+   Tcl_FinalizeThread();
+   TCL_THREAD_CREATE_RETURN;
+}
+
+/*------------------------------------------------------*/
+/* Evaluate a job callback with the job ID and "args"	*/
+/* appended.						*/
+/*------------------------------------------------------*/
+
+static void JobCallback(Tcl_Interp *interp, LVSJob *job, Tcl_Obj *cmd,
+	Tcl_Obj *arg1, Tcl_Obj *arg2)
+{
+   Tcl_Obj *cobj;
+
+   cobj = Tcl_DuplicateObj(cmd);
+   Tcl_IncrRefCount(cobj);
+   Tcl_ListObjAppendElement(interp, cobj, Tcl_NewIntObj(job->id));
+   Tcl_ListObjAppendElement(interp, cobj, arg1);
+   if (arg2 != NULL) Tcl_ListObjAppendElement(interp, cobj, arg2);
+   Tcl_Preserve((ClientData)interp);
+   if (Tcl_EvalObjEx(interp, cobj, TCL_EVAL_GLOBAL) != TCL_OK)
+      Tcl_BackgroundError(interp);
+   Tcl_Release((ClientData)interp);
+   Tcl_DecrRefCount(cobj);
+}
+
+/*------------------------------------------------------*/
+/* Wait for the worker thread to exit, give the netgen	*/
+/* data back to the owner, and record the outcome.	*/
+/* Does nothing if the job has already finished.	*/
+/*------------------------------------------------------*/
+
+static void JobFinish(LVSJob *job)
+{
+   int status;
+
+   if (job->state != JOB_RUNNING) return;
+
+   Tcl_JoinThread(job->thread, &status);
+   netgeninterp = job->interp;
+   consoleinterp = job->console;
+   JobInterp = NULL;
+   ActiveJob = NULL;
+   JobActive = FALSE;
+   JobCancelled = FALSE;
+   InterruptPending = 0;
+
+   /* A job that ended before noticing "cancel" keeps its outcome */
+   if (job->cancelled && job->code == TCL_BREAK)
+      job->state = JOB_CANCELLED;
+   else if (!job->started)
+      job->state = JOB_FAILED;
+   else
+      job->state = (job->code == TCL_OK) ? JOB_DONE : JOB_ERROR;
+
+   if (job->state == JOB_CANCELLED)
+      job->result = Tcl_NewStringObj("Job cancelled.", -1);
+   else
+      job->result = Tcl_NewStringObj(job->answer, -1);
+   Tcl_IncrRefCount(job->result);
+   FREE(job->answer);
+   FREE(job->script);
+   FREE(job->procs);
+   job->answer = job->script = job->procs = NULL;
+
+   if (job->donecmd != NULL) {
+      Tcl_Preserve((ClientData)job);
+      JobCallback(job->interp, job, job->donecmd,
+		Tcl_NewStringObj(JobStates[job->state], -1), job->result);
+      Tcl_Release((ClientData)job);
+   }
+}
+
+/* Event handler:  a report from the worker (owner side) */
+
+static int JobEventProc(Tcl_Event *evPtr, int flags)
+{
+   JobEvent *ev = (JobEvent *)evPtr;
+   LVSJob *job;
+
+   for (job = JobList; job != NULL; job = job->next)
+      if (job->id == ev->id) break;
+
+   if (ev->done) {
+      if (job != NULL) JobFinish(job);
+      return 1;
+   }
+
+   /* Reports that arrive after "job wait" are stale */
+   if (job != NULL && job->state == JOB_RUNNING) {
+      if (job->progress != NULL) Tcl_DecrRefCount(job->progress);
+      job->progress = Tcl_NewListObj(0, NULL);
+      Tcl_IncrRefCount(job->progress);
+      Tcl_ListObjAppendElement(NULL, job->progress,
+		Tcl_NewStringObj(ev->cell1, -1));
+      Tcl_ListObjAppendElement(NULL, job->progress,
+		Tcl_NewStringObj(ev->cell2, -1));
+      Tcl_ListObjAppendElement(NULL, job->progress,
+		Tcl_NewIntObj(ev->iteration));
+      Tcl_ListObjAppendElement(NULL, job->progress,
+		Tcl_NewIntObj(ev->eclasses));
+      Tcl_ListObjAppendElement(NULL, job->progress,
+		Tcl_NewIntObj(ev->nclasses));
+      Tcl_ListObjAppendElement(NULL, job->progress,
+		Tcl_NewIntObj(ev->unresolved));
+      if (job->progresscmd != NULL)
+	 JobCallback(job->interp, job, job->progresscmd, job->progress, NULL);
+   }
+   FREE(ev->cell1);
+   FREE(ev->cell2);
+   return 1;
+}
+
+/* Free a job record once it is no longer in use */
+
+static void JobFree(char *clientData)
+{
+   LVSJob *job = (LVSJob *)clientData;
+
+   if (job->progress != NULL) Tcl_DecrRefCount(job->progress);
+   if (job->result != NULL) Tcl_DecrRefCount(job->result);
+   if (job->progresscmd != NULL) Tcl_DecrRefCount(job->progresscmd);
+   if (job->donecmd != NULL) Tcl_DecrRefCount(job->donecmd);
+   FREE(job);
+}
+
+/*------------------------------------------------------*/
+/* Function name: _netgen_job				*/
+/* Syntax: netgen::job start [-progress <cmd>]		*/
+/*		[-command <cmd>] [-output <file>] <script>	*/
+/*	   netgen::job status|cancel|wait|forget <id>	*/
+/*	   netgen::job list				*/
+/* Formerly: (none)					*/
+/* Results:						*/
+/*	"start" returns the job ID.  "status" returns	*/
+/*	{state progress}, where state is one of		*/
+/*	running, done, error, cancelled, or failed, and	*/
+/*	progress is the last report {cell1 cell2	*/
+/*	iteration device_classes net_classes		*/
+/*	unresolved_classes}.  "wait" returns the result	*/
+/*	of the script.  "list" returns all job IDs.	*/
+/* Side Effects:					*/
+/*	"start" runs <script> on a worker thread, in a	*/
+/*	new interpreter that has the netgen commands	*/
+/*	and ::netgen procedures, but no other procs or	*/
+/*	variables.  Only one job may run at a time, and	*/
+/*	other netgen commands are refused until it	*/
+/*	ends.  The -progress command is called with the	*/
+/*	job ID and each progress report;  the -command	*/
+/*	command is called with the job ID, final state,	*/
+/*	and result.  Output of the job goes to the	*/
+/*	-output file (default none).  "cancel" stops	*/
+/*	the job at its next interrupt check.  "wait"	*/
+/*	blocks until the job ends.  "forget" discards a	*/
+/*	finished job.					*/
+/*------------------------------------------------------*/
+
+int
+_netgen_job(ClientData clientData,
+    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
+{
+   char *options[] = {
+      "start", "status", "cancel", "wait", "forget", "list", NULL
+   };
+   enum OptionIdx {
+      START_IDX, STATUS_IDX, CANCEL_IDX, WAIT_IDX, FORGET_IDX, LIST_IDX
+   };
+   char *startopts[] = {
+      "-progress", "-command", "-output", NULL
+   };
+   enum StartIdx {
+      PROGRESS_IDX, COMMAND_IDX, OUTPUT_IDX
+   };
+   int index, sidx, i;
+   char *outfile = NULL;
+   Tcl_Obj *progresscmd = NULL, *donecmd = NULL, *lobj;
+   LVSJob *job, **jptr;
+   Tcl_Channel chan;
+
+   if (objc < 2) {
+      Tcl_WrongNumArgs(interp, 1, objv, "start|status|cancel|wait|forget|list "
+		"[<args>]");
+      return TCL_ERROR;
+   }
+   if (Tcl_GetIndexFromObj(interp, objv[1], (CONST84 char **)options,
+		"option", 0, &index) != TCL_OK)
+      return TCL_ERROR;
+
+   /* The job list belongs to the thread that runs the jobs */
+   if (interp == JobInterp) {
+      Tcl_SetResult(interp, "Jobs cannot be controlled from within a job.",
+		NULL);
+      return TCL_ERROR;
+   }
+
+   switch (index) {
+      case START_IDX:
+	 for (i = 2; i < objc - 1; i += 2) {
+	    if (Tcl_GetIndexFromObj(interp, objv[i], (CONST84 char **)startopts,
+			"option", 0, &sidx) != TCL_OK)
+	       return TCL_ERROR;
+	    if (i + 1 >= objc - 1) {
+	       Tcl_AppendResult(interp, "No value given for option ",
+			startopts[sidx], ".", NULL);
+	       return TCL_ERROR;
+	    }
+	    switch (sidx) {
+	       case PROGRESS_IDX:
+		  progresscmd = objv[i + 1];
+		  break;
+	       case COMMAND_IDX:
+		  donecmd = objv[i + 1];
+		  break;
+	       case OUTPUT_IDX:
+		  outfile = Tcl_GetString(objv[i + 1]);
+		  break;
+	    }
+	 }
+	 /* An option name in place of the script is missing its value */
+	 if ((i == objc - 1) && (Tcl_GetIndexFromObj(NULL, objv[i],
+			(CONST84 char **)startopts, "option", TCL_EXACT,
+			&sidx) == TCL_OK)) {
+	    Tcl_AppendResult(interp, "No value given for option ",
+			startopts[sidx], ".", NULL);
+	    return TCL_ERROR;
+	 }
+	 if (i != objc - 1) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "[-progress <cmd>] [-command <cmd>] "
+			"[-output <file>] <script>");
+	    return TCL_ERROR;
+	 }
+	 if (JobActive) {
+	    Tcl_SetResult(interp, "Another job is still running.", NULL);
+	    return TCL_ERROR;
+	 }
+
+	 chan = Tcl_OpenFileChannel(interp, (outfile) ? outfile : "/dev/null",
+		"w", 0666);
+	 if (chan == NULL) return TCL_ERROR;
+	 if (Tcl_Eval(interp, JobProcScript) != TCL_OK) {
+	    Tcl_Close(NULL, chan);
+	    return TCL_ERROR;
+	 }
+
+	 job = (LVSJob *)CALLOC(1, sizeof(LVSJob));
+	 job->id = ++JobCount;
+	 job->owner = Tcl_GetCurrentThread();
+	 job->interp = interp;
+	 job->console = consoleinterp;
+	 job->chan = chan;
+	 job->script = strsave(Tcl_GetString(objv[objc - 1]));
+	 job->procs = strsave((char *)Tcl_GetStringResult(interp));
+	 job->state = JOB_RUNNING;
+	 Tcl_ResetResult(interp);
+
+	 /* Pending output belongs to the owner, not the job */
+	 tcl_flushbuffer();
+
+	 Tcl_CutChannel(chan);
+	 ActiveJob = job;
+	 JobActive = TRUE;
+	 JobCancelled = FALSE;
+	 if (Tcl_CreateThread(&job->thread, JobThread, (ClientData)job,
+		TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE) != TCL_OK) {
+	    ActiveJob = NULL;
+	    JobActive = FALSE;
+	    Tcl_SpliceChannel(chan);
+	    Tcl_Close(NULL, chan);
+	    FREE(job->script);
+	    FREE(job->procs);
+	    FREE(job);
+	    JobCount--;
+	    Tcl_SetResult(interp, "Cannot start job thread "
+			"(Tcl may be built without threads).", NULL);
+	    return TCL_ERROR;
+	 }
+
+	 if (progresscmd != NULL) {
+	    job->progresscmd = progresscmd;
+	    Tcl_IncrRefCount(progresscmd);
+	 }
+	 if (donecmd != NULL) {
+	    job->donecmd = donecmd;
+	    Tcl_IncrRefCount(donecmd);
+	 }
+	 job->next = JobList;
+	 JobList = job;
+	 Tcl_SetObjResult(interp, Tcl_NewIntObj(job->id));
+	 return TCL_OK;
+
+      case LIST_IDX:
+	 lobj = Tcl_NewListObj(0, NULL);
+	 for (job = JobList; job != NULL; job = job->next)
+	    Tcl_ListObjAppendElement(interp, lobj, Tcl_NewIntObj(job->id));
+	 Tcl_SetObjResult(interp, lobj);
+	 return TCL_OK;
+   }
+
+   if (objc != 3) {
+      Tcl_WrongNumArgs(interp, 2, objv, "<id>");
+      return TCL_ERROR;
+   }
+   if ((job = JobLookup(interp, objv[2])) == NULL) return TCL_ERROR;
+
+   switch (index) {
+      case STATUS_IDX:
+	 lobj = Tcl_NewListObj(0, NULL);
+	 Tcl_ListObjAppendElement(interp, lobj,
+		Tcl_NewStringObj(JobStates[job->state], -1));
+	 Tcl_ListObjAppendElement(interp, lobj, (job->progress) ?
+		job->progress : Tcl_NewListObj(0, NULL));
+	 Tcl_SetObjResult(interp, lobj);
+	 break;
+
+      case CANCEL_IDX:
+	 if (job->state == JOB_RUNNING) {
+	    job->cancelled = TRUE;
+	    JobCancelled = TRUE;
+	    InterruptPending = 1;
+	 }
+	 break;
+
+      case WAIT_IDX:
+	 Tcl_Preserve((ClientData)job);
+	 JobFinish(job);
+	 Tcl_SetObjResult(interp, job->result);
+	 i = job->state;
+	 Tcl_Release((ClientData)job);
+	 if (i != JOB_DONE) return TCL_ERROR;
+	 break;
+
+      case FORGET_IDX:
+	 if (job->state == JOB_RUNNING) {
+	    Tcl_SetResult(interp, "Job is still running.", NULL);
+	    return TCL_ERROR;
+	 }
+	 for (jptr = &JobList; *jptr != job; jptr = &((*jptr)->next));
+	 *jptr = job->next;
+	 Tcl_EventuallyFree((ClientData)job, JobFree);
+	 break;
+   }
+   return TCL_OK;
+}
+
 #ifdef HAVE_MALLINFO
 /*------------------------------------------------------*/
 /* Function name: _netgen_printmem			*/
@@ -2085,19 +2928,71 @@ _netcmp_compare(ClientData clientData,
       return TCL_ERROR;
    }
 
-   UniquePins(name1, fnum1);		// Check for and remove duplicate pins
-   UniquePins(name2, fnum2);		// Check for and remove duplicate pins
+   while (1) {
+      char *qname1, *qname2, *key;
+      int qfile1, qfile2;
+      struct nlist *tc1, *tc2;
 
-   // Resolve global nodes into local nodes and ports
-   if (dohierarchy) {
-      ConvertGlobals(name1, fnum1);
-      ConvertGlobals(name2, fnum2);
+      UniquePins(name1, fnum1);		// Check for and remove duplicate pins
+      UniquePins(name2, fnum2);		// Check for and remove duplicate pins
+
+      // Resolve global nodes into local nodes and ports
+      if (dohierarchy) {
+         ConvertGlobals(name1, fnum1);
+         ConvertGlobals(name2, fnum2);
+      }
+
+      // Subcircuits that were already proven equivalent with the same
+      // contents and settings are taken from the compare cache.  The
+      // top-level cells are always compared.
+
+      if (!dohierarchy || !CompareCacheActive) break;
+      if (PeekCompareQueueTop(&qname1, &qfile1, &qname2, &qfile2) < 0) break;
+      tc1 = LookupCellFile(name1, fnum1);
+      tc2 = LookupCellFile(name2, fnum2);
+      if ((tc1 == NULL) || (tc2 == NULL)) break;
+
+      key = CompareCacheKey(tc1, tc2);
+      if (CompareCacheApply(key, tc1, tc2) == 0) break;
+
+      Fprintf(stdout, "Subcircuits %s and %s match (cached result).\n",
+		name1, name2);
+      if (EquivalenceClasses(name1, fnum1, name2, fnum2))
+	 Fprintf(stdout, "Device classes %s and %s are equivalent.\n",
+		name1, name2);
+      GetCompareQueueTop(&name1, &fnum1, &name2, &fnum2);
    }
 
+   StatsBegin("createlists");
    CreateTwoLists(name1, fnum1, name2, fnum2, dolist);
-   while (PrematchLists(name1, fnum1, name2, fnum2) > 0) {
+   StatsEnd();
+   while (1) {
+      StatsBegin("prematch");
+      result = PrematchLists(name1, fnum1, name2, fnum2);
+      StatsEnd();
+      if (result <= 0) break;
       Fprintf(stdout, "Making another compare attempt.\n");
+      StatsBegin("createlists");
       CreateTwoLists(name1, fnum1, name2, fnum2, dolist);
+      StatsEnd();
+   }
+
+   // A subcircuit whose signature proves a mismatch is going to be
+   // flattened into its parent, so don't pay for convergence on it
+   // unless its mismatch report is printed (see Converge()).  The
+   // top-level cells are always iterated for full diagnostics.
+
+   SkipConverge = FALSE;
+   if (dohierarchy && (SignatureMismatch > 0)) {
+      char *qname1, *qname2;
+      int qfile1, qfile2;
+
+      if (PeekCompareQueueTop(&qname1, &qfile1, &qname2, &qfile2) >= 0) {
+	 Fprintf(stdout, "Subcircuits %s and %s cannot match; flagging "
+			"for flattening.\n", name1, name2);
+	 MatchFail(name1, name2);
+	 SkipConverge = TRUE;
+      }
    }
 
    // Return the names of the two cells being compared, if doing "compare
@@ -2280,6 +3175,24 @@ _netcmp_print(ClientData clientData,
    return TCL_OK;
 }
 
+/*------------------------------------------------------*/
+/* Refine the partitions of the current cell pair.  For	*/
+/* a pair that the signature prefilter has proven not	*/
+/* to match, this is skipped only if nothing will be	*/
+/* reported:  a report printed from unrefined		*/
+/* partitions would list nets and devices that do	*/
+/* match.  Called with interrupts enabled.		*/
+/*------------------------------------------------------*/
+
+static void Converge(int dolist)
+{
+   if (SkipConverge && !dolist && !ReportActive() &&
+		(LoggingFile == NULL) && NoOutput)
+      return;
+   SkipConverge = FALSE;
+   while (!Iterate() && !InterruptPending);
+}
+
 /*------------------------------------------------------*/
 /* Function name: _netcmp_run				*/
 /* Syntax: netgen::run [converge|resolve]		*/
@@ -2330,7 +3243,7 @@ _netcmp_run(ClientData clientData,
 	 }
 	 else {
 	    enable_interrupt();
-	    while (!Iterate() && !InterruptPending);
+	    Converge(dolist);
 	    if (dolist) {
 	       result = _netcmp_verify(clientData, interp, 2, objv - 1);
 	    }
@@ -2348,7 +3261,8 @@ _netcmp_run(ClientData clientData,
 	 }
 	 else {
 	    enable_interrupt();
-	    while (!Iterate() && !InterruptPending);
+	    Converge(dolist);
+	    StatsBegin("resolve");
 	    automorphisms = VerifyMatching();
 	    if (automorphisms == -1)
 	       Fprintf(stdout, "Netlists do not match.\n");
@@ -2378,9 +3292,12 @@ _netcmp_run(ClientData clientData,
 	       if (automorphisms == -1) Fprintf(stdout, "Netlists do not match.\n");
 		  else Fprintf(stdout, "Circuits match correctly.\n");
 	    }
+	    StatsEnd();
 	    if (PropertyErrorDetected) {
 	       Fprintf(stdout, "There were property errors.\n");
+	       StatsBegin("properties");
 	       PrintPropertyResults(dolist);
+	       StatsEnd();
 	    }
 	    disable_interrupt();
          }
@@ -2404,7 +3321,8 @@ _netcmp_run(ClientData clientData,
 /*	For options elements, nodes, and all without	*/
 /*	option -list:  Write output to log file.	*/
 /*	For -list options, append list to global	*/
-/*	variable "lvs_out", if it exists.		*/
+/*	variable "lvs_out", if it exists, or write it	*/
+/*	to the JSON report if one is open.		*/
 /*------------------------------------------------------*/
 
 int
@@ -2421,6 +3339,7 @@ _netcmp_verify(ClientData clientData,
    int result, index = -1;
    int automorphisms;
    int dolist = 0;
+   int nreport = -1, ereport = -1;
    Tcl_Obj *egood, *ebad, *ngood, *nbad;
 
    if (objc > 1) {
@@ -2458,6 +3377,14 @@ _netcmp_verify(ClientData clientData,
       return TCL_OK;
    }
    else {
+      /* Partitions left unrefined for a mismatched pair must be	*/
+      /* refined before their classes are reported.		*/
+      if (SkipConverge && (index != EQUIV_IDX) && (index != UNIQUE_IDX)
+		&& (index != ONLY_IDX)) {
+	 enable_interrupt();
+	 Converge(dolist);
+	 disable_interrupt();
+      }
       automorphisms = VerifyMatching();
       if (automorphisms == -1) {
 	 enable_interrupt();
@@ -2466,7 +3393,9 @@ _netcmp_verify(ClientData clientData,
 	        PrintIllegalNodeClasses();	// Old style
 	     else {
 	        FormatIllegalNodeClasses(); // Side-by-side, to log file
-	        if (dolist) {
+	        if (dolist && ReportActive())
+		   nreport = FALSE;			// Written below
+	        else if (dolist) {
 	           nbad = ListNodeClasses(FALSE);	// As Tcl nested list
 #if 0
 	           ngood = ListNodeClasses(TRUE);	// As Tcl nested list
@@ -2479,7 +3408,9 @@ _netcmp_verify(ClientData clientData,
 	        PrintIllegalElementClasses();	// Old style
 	     else {
 	        FormatIllegalElementClasses();	// Side-by-side, to log file
-	        if (dolist) {
+	        if (dolist && ReportActive())
+		   ereport = FALSE;			// Written below
+	        else if (dolist) {
 	           ebad = ListElementClasses(FALSE); // As Tcl nested list
 #if 0
 	           egood = ListElementClasses(TRUE); // As Tcl nested list
@@ -2523,7 +3454,9 @@ _netcmp_verify(ClientData clientData,
 	 }
 #endif
          if ((index == PROP_IDX) && (PropertyErrorDetected != 0)) {
+	    StatsBegin("properties");
 	    PrintPropertyResults(dolist);
+	    StatsEnd();
 	 }
       }
    }
@@ -2534,7 +3467,18 @@ _netcmp_verify(ClientData clientData,
    /* For "verify" or "verify all", return a nested	*/
    /* list of {node list, element list}.		*/
 
-   if (dolist)
+   /* With a JSON report open, the classes go to the report	*/
+   /* file instead.  A class list that was not generated is	*/
+   /* written as an empty list (legal value -1).		*/
+
+   if (dolist && ReportActive())
+   {
+      if (objc == 1 || index == NODE_IDX || index == ALL_IDX)
+	 ReportNodeClasses(nreport);
+      if (objc == 1 || index == ELEM_IDX || index == ALL_IDX)
+	 ReportElementClasses(ereport);
+   }
+   else if (dolist)
    {
       if (objc == 1 || index == NODE_IDX || index == ALL_IDX) {
 	 if (nbad == NULL) nbad = Tcl_NewListObj(0, NULL);
@@ -2926,7 +3870,10 @@ _netcmp_equate(ClientData clientData,
 	 UniquePins(tp1->name, tp1->file);
 	 UniquePins(tp2->name, tp2->file);
 
+	 StatsBegin("pins");
 	 result = MatchPins(tp1, tp2, dolist);
+	 StatsEnd();
+	 CompareCacheRecord(tp1, tp2, result);
 	 if (result == 2) {
 	    Fprintf(stdout, "Cells have no pins;  pin matching not needed.\n");
 	 }
@@ -3781,6 +4728,77 @@ _netcmp_exhaustive(ClientData clientData,
    return TCL_OK;
 }
 
+/*------------------------------------------------------*/
+/* Function name: _netcmp_cache				*/
+/* Syntax: netgen::cache [on|off|clear|load <file>|	*/
+/*		save <file>]				*/
+/* Formerly: (none)					*/
+/* Results: number of entries in the cache		*/
+/* Side Effects: enables or disables reuse of results	*/
+/*	of subcircuit comparisons in "compare		*/
+/*	hierarchical", or modifies the cache contents.	*/
+/*------------------------------------------------------*/
+
+int
+_netcmp_cache(ClientData clientData,
+    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
+{
+   char *options[] = {
+      "on", "off", "clear", "load", "save", NULL
+   };
+   enum OptionIdx {
+      ON_IDX, OFF_IDX, CLEAR_IDX, LOAD_IDX, SAVE_IDX
+   };
+   int result, index;
+
+   if (objc > 1) {
+      if (Tcl_GetIndexFromObj(interp, objv[1], (CONST84 char **)options,
+		"option", 0, &index) != TCL_OK)
+         return TCL_ERROR;
+
+      if (((index == LOAD_IDX) || (index == SAVE_IDX)) && (objc != 3)) {
+	 Tcl_WrongNumArgs(interp, 2, objv, "<file>");
+	 return TCL_ERROR;
+      }
+      else if ((index != LOAD_IDX) && (index != SAVE_IDX) && (objc != 2)) {
+	 Tcl_WrongNumArgs(interp, 1, objv, "[on|off|clear|load <file>|"
+			"save <file>]");
+	 return TCL_ERROR;
+      }
+
+      switch(index) {
+	 case ON_IDX:
+	    CompareCacheActive = TRUE;
+	    break;
+	 case OFF_IDX:
+	    CompareCacheActive = FALSE;
+	    break;
+	 case CLEAR_IDX:
+	    CompareCacheClear();
+	    break;
+	 case LOAD_IDX:
+	    result = CompareCacheLoad(Tcl_GetString(objv[2]));
+	    if (result < 0) {
+	       Tcl_AppendResult(interp, "Unable to read compare cache file ",
+			Tcl_GetString(objv[2]), NULL);
+	       return TCL_ERROR;
+	    }
+	    CompareCacheActive = TRUE;
+	    break;
+	 case SAVE_IDX:
+	    result = CompareCacheSave(Tcl_GetString(objv[2]));
+	    if (result < 0) {
+	       Tcl_AppendResult(interp, "Unable to write compare cache file ",
+			Tcl_GetString(objv[2]), NULL);
+	       return TCL_ERROR;
+	    }
+	    break;
+      }
+   }
+   Tcl_SetObjResult(interp, Tcl_NewIntObj(CompareCacheCount()));
+   return TCL_OK;
+}
+
 /*------------------------------------------------------*/
 /* Function name: _netcmp_restart			*/
 /* Syntax: netgen::restart				*/
@@ -3907,83 +4925,138 @@ _netcmp_matching(ClientData clientData,
 
 
 /*------------------------------------------------------*/
-/* Define a calloc() function for Tcl			*/
+/* Define malloc() and calloc() functions for Tcl.	*/
+/* Allocations are counted for "netgen::stats".		*/
 /*------------------------------------------------------*/
 
+char *tcl_malloc(unsigned int nbytes)
+{
+   AllocCount++;
+   return Tcl_Alloc(nbytes);
+}
+
 char *tcl_calloc(size_t asize, size_t nbytes)
 {
    size_t tsize = asize * nbytes;
    char *cp = Tcl_Alloc((int)tsize);
+   AllocCount++;
    bzero((void *)cp, tsize);
    return cp;
 }
 
 /*------------------------------------------------------*/
 /* Redefine the printf() functions for use with tkcon	*/
+/*							*/
+/* Output is collected in a buffer and passed to Tcl	*/
+/* in large blocks:  directly to the standard channel	*/
+/* when running in a terminal, or with one "puts" per	*/
+/* block to the console interpreter under tkcon.  The	*/
+/* buffer is flushed when it fills, when the output	*/
+/* switches between stdout and stderr, on Fflush(), and	*/
+/* at the end of every netgen command, so output stays	*/
+/* in order with any output from Tcl scripts.		*/
 /*------------------------------------------------------*/
 
+#define OUTBUFSIZE 65536
+
+static char OutBuffer[OUTBUFSIZE];
+static int OutLength = 0;
+static FILE *OutStream = NULL;	/* stdout or stderr */
+
+/* Send "len" bytes of "text" to the standard channel for "f" */
+
+static void tcl_writeout(FILE *f, char *text, int len)
+{
+    Tcl_Channel chan;
+    Tcl_Obj *objv[4];
+    int i;
+
+    if (len <= 0) return;
+
+    if (consoleinterp == netgeninterp) {
+	chan = Tcl_GetStdChannel((f == stderr) ? TCL_STDERR : TCL_STDOUT);
+	if (chan != NULL) {
+	    Tcl_WriteChars(chan, text, len);
+	    return;
+	}
+    }
+
+    objv[0] = Tcl_NewStringObj("puts", 4);
+    objv[1] = Tcl_NewStringObj("-nonewline", 10);
+    objv[2] = Tcl_NewStringObj((f == stderr) ? "stderr" : "stdout", 6);
+    objv[3] = Tcl_NewStringObj(text, len);
+    for (i = 0; i < 4; i++) Tcl_IncrRefCount(objv[i]);
+    Tcl_EvalObjv(consoleinterp, 4, objv, TCL_EVAL_GLOBAL);
+    for (i = 0; i < 4; i++) Tcl_DecrRefCount(objv[i]);
+}
+
+/* Pass any buffered output to Tcl */
+
+void tcl_flushbuffer(void)
+{
+    int len = OutLength;
+
+    if (len > 0) {
+	OutLength = 0;		/* Reset first in case of reentry */
+	tcl_writeout(OutStream, OutBuffer, len);
+    }
+}
+
 void tcl_vprintf(FILE *f, const char *fmt, va_list args_in)
 {
     va_list args;
-    static char outstr[128] = "puts -nonewline std";
-    char *outptr, *bigstr = NULL, *finalstr = NULL;
-    int i, nchars, result, escapes = 0, limit;
+    FILE *stream = (f == stderr) ? stderr : stdout;
+    char *outptr, *bigstr = NULL;
+    int nchars;
 
-    strcpy (outstr + 19, (f == stderr) ? "err \"" : "out \"");
-    outptr = outstr;
+    if (stream != OutStream) {
+	tcl_flushbuffer();
+	OutStream = stream;
+    }
 
     va_copy(args, args_in);
-    nchars = vsnprintf(outptr + 24, 102, fmt, args);
+    nchars = vsnprintf(OutBuffer + OutLength, OUTBUFSIZE - OutLength, fmt, args);
     va_end(args);
+    if (nchars < 0) {
+	OutBuffer[OutLength] = '\0';
+	return;
+    }
 
-    if (nchars >= 102)
-    {
-	va_copy(args, args_in);
-	bigstr = Tcl_Alloc(nchars + 26);
-	strncpy(bigstr, outptr, 24);
-	outptr = bigstr;
-	vsnprintf(outptr + 24, nchars + 2, fmt, args);
-	va_end(args);
+    if (OutLength + nchars >= OUTBUFSIZE) {
+	/* Didn't fit:  flush what was there before and try again */
+	OutBuffer[OutLength] = '\0';
+	tcl_flushbuffer();
+
+	if (nchars < OUTBUFSIZE) {
+	    va_copy(args, args_in);
+	    vsnprintf(OutBuffer, OUTBUFSIZE, fmt, args);
+	    va_end(args);
+	    outptr = OutBuffer;
+	}
+	else {
+	    bigstr = Tcl_Alloc(nchars + 1);
+	    va_copy(args, args_in);
+	    vsnprintf(bigstr, nchars + 1, fmt, args);
+	    va_end(args);
+	    outptr = bigstr;
+	}
     }
-    else if (nchars == -1) nchars = 126;
-
-    for (i = 24; *(outptr + i) != '\0'; i++) {
-	if (*(outptr + i) == '\"' || *(outptr + i) == '[' ||
-	    	*(outptr + i) == ']' || *(outptr + i) == '\\' ||
-		*(outptr + i) == '$')
-	    escapes++;
-	if (*(outptr + i) == '\n')
+    else
+	outptr = OutBuffer + OutLength;
+
+    for (; *outptr != '\0'; outptr++) {
+	if (*outptr == '\n')
 	    ColumnBase = 0;
 	else
 	    ColumnBase++;
     }
 
-    if (escapes > 0)
-    {
-	finalstr = Tcl_Alloc(nchars + escapes + 26);
-	strncpy(finalstr, outptr, 24);
-	escapes = 0;
-	for (i = 24; *(outptr + i) != '\0'; i++)
-	{
-	    if (*(outptr + i) == '\"' || *(outptr + i) == '[' ||
-	    		*(outptr + i) == ']' || *(outptr + i) == '\\' ||
-			*(outptr + i) == '$')
-	    {
-	        *(finalstr + i + escapes) = '\\';
-		escapes++;
-	    }
-	    *(finalstr + i + escapes) = *(outptr + i);
-	}
-        outptr = finalstr;
+    if (bigstr != NULL) {
+	tcl_writeout(stream, bigstr, nchars);
+	Tcl_Free(bigstr);
     }
-
-    *(outptr + 24 + nchars + escapes) = '\"';
-    *(outptr + 25 + nchars + escapes) = '\0';
-
-    result = Tcl_Eval(consoleinterp, outptr);
-
-    if (bigstr != NULL) Tcl_Free(bigstr);
-    if (finalstr != NULL) Tcl_Free(finalstr);
+    else
+	OutLength = outptr - OutBuffer;
 }
     
 /*------------------------------------------------------*/
@@ -3994,8 +5067,19 @@ void tcl_vprintf(FILE *f, const char *fmt, va_list args_in)
 void tcl_stdflush(FILE *f)
 {   
    Tcl_SavedResult state;
+   Tcl_Channel chan;
    static char stdstr[] = "::flush stdxxx";
    char *stdptr = stdstr + 11;
+
+   tcl_flushbuffer();
+
+   if (consoleinterp == netgeninterp) {
+      chan = Tcl_GetStdChannel((f == stderr) ? TCL_STDERR : TCL_STDOUT);
+      if (chan != NULL) {
+	 Tcl_Flush(chan);
+	 return;
+      }
+   }
     
    Tcl_SaveResult(netgeninterp, &state);
    strcpy(stdptr, (f == stderr) ? "err" : "out");
@@ -4045,7 +5129,10 @@ int _tkcon_interrupt(ClientData clientData,
 /*--------------------------------------------------------------*/
 
 int check_interrupt() {
-   Tcl_DoOneEvent(TCL_WINDOW_EVENTS | TCL_DONT_WAIT);
+   tcl_flushbuffer();
+   /* A background job must not service the owner's events */
+   if (!JobActive)
+      Tcl_DoOneEvent(TCL_WINDOW_EVENTS | TCL_DONT_WAIT);
    if (InterruptPending) {
       Fprintf(stderr, "Interrupt!\n");
       return 1;
@@ -4053,13 +5140,67 @@ int check_interrupt() {
    return 0;
 }
 
+/*------------------------------------------------------*/
+/* Common entry point for all netgen commands.  Calls	*/
+/* the command handler, then passes any output that the	*/
+/* command left in the output buffer to Tcl.		*/
+/*------------------------------------------------------*/
+
+int _netgen_dispatch(ClientData clientData,
+    Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
+{
+   Command *cmd = (Command *)clientData;
+   int result;
+
+   /* While a job runs, it owns the netgen data and the	*/
+   /* output buffer;  other interpreters may only use "job"	*/
+   if (JobActive && interp != JobInterp) {
+      if (cmd->handler != _netgen_job) {
+	 Tcl_SetResult(interp, "A background job is running;  wait for it "
+		"or cancel it first.", NULL);
+	 return TCL_ERROR;
+      }
+      return (*cmd->handler)((ClientData)NULL, interp, objc, objv);
+   }
+   if (JobCancelled) {
+      Tcl_SetResult(interp, "Job cancelled.", NULL);
+      return TCL_ERROR;
+   }
+   result = (*cmd->handler)((ClientData)NULL, interp, objc, objv);
+   tcl_flushbuffer();
+   return result;
+}
+
+/*------------------------------------------------------*/
+/* Create the netgen commands in an interpreter (the	*/
+/* main one, or the interpreter of a background job).	*/
+/*------------------------------------------------------*/
+
+static void NetgenCommands(Tcl_Interp *interp)
+{
+   int n;
+   char keyword[128];
+
+   for (n = 0; netgen_cmds[n].name != NULL; n++) {
+      sprintf(keyword, "netgen::%s", netgen_cmds[n].name);
+      Tcl_CreateObjCommand(interp, keyword, _netgen_dispatch,
+		(ClientData)(&netgen_cmds[n]), (Tcl_CmdDeleteProc *)NULL);
+   }
+   for (n = 0; netcmp_cmds[n].name != NULL; n++) {
+      sprintf(keyword, "netgen::%s", netcmp_cmds[n].name);
+      Tcl_CreateObjCommand(interp, keyword, _netgen_dispatch,
+		(ClientData)(&netcmp_cmds[n]), (Tcl_CmdDeleteProc *)NULL);
+   }
+
+   Tcl_Eval(interp, "namespace eval netgen namespace export *");
+}
+
 /*------------------------------------------------------*/
 /* Tcl package initialization function			*/
 /*------------------------------------------------------*/
 
 int Tclnetgen_Init(Tcl_Interp *interp)
 {
-   int n;
    char keyword[128];
    char *cadroot;
 
@@ -4070,19 +5211,8 @@ int Tclnetgen_Init(Tcl_Interp *interp)
    netgeninterp = interp;
 
    if (Tcl_InitStubs(interp, "8.5", 0) == NULL) return TCL_ERROR;
-  
-   for (n = 0; netgen_cmds[n].name != NULL; n++) {
-      sprintf(keyword, "netgen::%s", netgen_cmds[n].name);
-      Tcl_CreateObjCommand(interp, keyword, netgen_cmds[n].handler,
-		(ClientData)NULL, (Tcl_CmdDeleteProc *)NULL);
-   }
-   for (n = 0; netcmp_cmds[n].name != NULL; n++) {
-      sprintf(keyword, "netgen::%s", netcmp_cmds[n].name);
-      Tcl_CreateObjCommand(interp, keyword, netcmp_cmds[n].handler,
-		(ClientData)NULL, (Tcl_CmdDeleteProc *)NULL);
-   }
 
-   Tcl_Eval(interp, "namespace eval netgen namespace export *");
+   NetgenCommands(interp);
 
    /* Set $CAD_ROOT as a Tcl variable */
 
@@ -4102,6 +5232,7 @@ int Tclnetgen_Init(Tcl_Interp *interp)
    sprintf(keyword, "Netgen %s.%s compiled on %s\n", NETGEN_VERSION,
 		NETGEN_REVISION, NETGEN_DATE);
    Printf(keyword);
+   tcl_flushbuffer();
 
    return TCL_OK;	/* Drop back to interpreter for input */
 }
@@ -0,0 +1,28 @@
+# Run "lvs" as a background job, then cancel a second job before it
+# can do anything.  Records the outcome of each, and the errors for a
+# missing option value and for netgen commands used while a job runs.
+set out [open background_job.out w]
+set reports 0
+proc progress {id report} {incr ::reports}
+proc finished {id state result} {set ::finished [list $state $result]}
+
+puts $out [list [catch {job start -output} msg] $msg]
+set id [job start -progress progress -command finished \
+	-output background_job1.log {
+   lvs "mismatch_report1.spice top" "mismatch_report2.spice top" \
+	nosetup background_job.lvs
+   format ok
+}]
+puts $out [list [catch {readnet mismatch_report1.spice} msg] $msg]
+puts $out [list [catch {job start {format again}} msg] $msg]
+vwait finished
+puts $out $finished
+puts $out [expr {$reports > 0}]
+job forget $id
+
+set id [job start {lvs "mismatch_report1.spice top" \
+	"mismatch_report2.spice top" nosetup background_job.lvs}]
+job cancel $id
+puts $out [list [catch {job wait $id} msg] $msg [lindex [job status $id] 0]]
+puts $out [list [catch {readnet mismatch_report1.spice} msg]]
+close $out
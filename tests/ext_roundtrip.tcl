@@ -0,0 +1,7 @@
+# Read an extracted .ext file, whose cell is left open, and write it out
+# as SPICE.  Many nets carry several node names merged together, so the
+# names written show which of them is taken:  the last one in the cell,
+# as for any cell not yet ended.
+readnet ext ext_roundtrip.ext
+writenet spice ext_roundtrip 0
+file rename -force ext_roundtrip.spice ext_roundtrip.out
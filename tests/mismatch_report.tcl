@@ -0,0 +1,7 @@
+# Cell "buf" has an extra transistor in the first netlist, so it cannot
+# match and is flattened.  Its mismatch report must come from fully
+# refined partitions:  nets "vdd" and "y" of "buf" match and must not be
+# listed with the mismatched nets.  The JSON report is the output checked.
+lvs "mismatch_report1.spice top" "mismatch_report2.spice top" nosetup \
+	mismatch_report.lvs -json
+file rename -force mismatch_report.json mismatch_report.out
@@ -0,0 +1,46 @@
+#---------------------------------------------------------------------------
+# runtest.tcl --- run one regression test and check its output.
+#
+# Usage:  tclsh runtest.tcl <netgen.tcl> <test>
+#
+# Sources <test>.tcl with the netgen Tcl library loaded.  The test writes
+# <test>.out, which is compared with the expected output <test>.ref.
+# Exits with status 0 if they are the same, and 1 otherwise.
+#---------------------------------------------------------------------------
+
+if {$argc != 2} {
+   puts stderr "Usage:  tclsh runtest.tcl <netgen.tcl> <test>"
+   exit 1
+}
+
+set netgenrc [lindex $argv 0]
+set test [lindex $argv 1]
+
+set argv {}
+set argc 0
+source $netgenrc
+
+file delete -force $test.out
+if {[catch {source $test.tcl} msg]} {
+   puts "Test $test failed: $msg"
+   exit 1
+}
+
+proc readfile {name} {
+   set f [open $name r]
+   set text [read $f]
+   close $f
+   return $text
+}
+
+if {![file exists $test.out]} {
+   puts "Test $test wrote no output."
+   exit 1
+}
+if {[readfile $test.out] != [readfile $test.ref]} {
+   puts "Output of test $test differs from $test.ref:"
+   catch {exec diff $test.ref $test.out} diffs
+   puts $diffs
+   exit 1
+}
+exit 0
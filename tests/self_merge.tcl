@@ -0,0 +1,3 @@
+# Three parallel resistors that cannot be merged.  Each must be kept,
+# so the changed value of R2 must be reported.
+lvs "self_merge1.spice cell" "self_merge2.spice cell" nosetup self_merge.out
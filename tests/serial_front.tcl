@@ -0,0 +1,5 @@
+# A parallel run of resistors is sorted with a series chain in the middle
+# of it.  R0 comes before the sorted run and differs between the two
+# netlists, so the comparison must report its value.
+lvs "serial_front1.spice cell" "serial_front2.spice cell" setup_default.tcl \
+	serial_front.out